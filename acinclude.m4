@@ -1620,6 +1620,7 @@ AC_CHECK_FUNCS([ \
 	sigaction \
 	strcasestr \
 	strerror \
+	syncfs \
 	sysconf \
 	sysctl \
 	tdestroy \
@@ -231,6 +231,62 @@ static struct ctl_table afs_sysctl_table[] = {
 	.mode		= 0644,
      	.proc_handler	= &proc_dointvec
     },
+    {
+#if defined(STRUCT_CTL_TABLE_HAS_CTL_NAME)
+#if defined(CTL_UNNUMBERED)
+	.ctl_name 	= CTL_UNNUMBERED, 
+#else
+	.ctl_name	= 15,
+#endif
+#endif
+	.procname	= "readahead_max",
+	.data		= &afs_readAheadMax,
+	.maxlen		= sizeof(afs_int32),
+	.mode		= 0644,
+	.proc_handler	= &proc_dointvec
+    },
+    {
+#if defined(STRUCT_CTL_TABLE_HAS_CTL_NAME)
+#if defined(CTL_UNNUMBERED)
+	.ctl_name 	= CTL_UNNUMBERED, 
+#else
+	.ctl_name	= 16,
+#endif
+#endif
+	.procname	= "fetch_stripe_width",
+	.data		= &afs_fetchStripeWidth,
+	.maxlen		= sizeof(afs_int32),
+	.mode		= 0644,
+	.proc_handler	= &proc_dointvec
+    },
+    {
+#if defined(STRUCT_CTL_TABLE_HAS_CTL_NAME)
+#if defined(CTL_UNNUMBERED)
+	.ctl_name 	= CTL_UNNUMBERED, 
+#else
+	.ctl_name	= 17,
+#endif
+#endif
+	.procname	= "write_behind_max",
+	.data		= &afs_writeBehindMax,
+	.maxlen		= sizeof(afs_int32),
+	.mode		= 0644,
+	.proc_handler	= &proc_dointvec
+    },
+    {
+#if defined(STRUCT_CTL_TABLE_HAS_CTL_NAME)
+#if defined(CTL_UNNUMBERED)
+	.ctl_name 	= CTL_UNNUMBERED, 
+#else
+	.ctl_name	= 18,
+#endif
+#endif
+	.procname	= "bulkstat_ahead",
+	.data		= &afs_bulkStatAhead,
+	.maxlen		= sizeof(afs_int32),
+	.mode		= 0644,
+	.proc_handler	= &proc_dointvec
+    },
     {0}
 };
 
@@ -657,15 +657,24 @@ afs_nfsrdwr(struct vcache *avc, struct uio *auio, enum uio_rw arw,
      * cache size, we we wait for a cache drain for any write.
      */
     afs_MaybeWakeupTruncateDaemon();
-    while ((arw == UIO_WRITE)
-	   && (afs_blocksUsed > PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks))) {
-	if (afs_blocksUsed - afs_blocksDiscarded >
-	    PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks)) {
-	    afs_WaitForCacheDrain = 1;
-	    afs_osi_Sleep(&afs_WaitForCacheDrain);
+    if ((arw == UIO_WRITE)
+	&& (afs_blocksUsed > PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks))) {
+	osi_timeval_t drainStart;
+	int slept = 0;
+
+	osi_GetuTime(&drainStart);
+	while (afs_blocksUsed > PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks)) {
+	    if (afs_blocksUsed - afs_blocksDiscarded >
+		PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks)) {
+		afs_WaitForCacheDrain = 1;
+		afs_osi_Sleep(&afs_WaitForCacheDrain);
+		slept = 1;
+	    }
+	    afs_MaybeFreeDiscardedDCache();
+	    afs_MaybeWakeupTruncateDaemon();
 	}
-	afs_MaybeFreeDiscardedDCache();
-	afs_MaybeWakeupTruncateDaemon();
+	if (slept)
+	    afs_CacheDrainWaited(&drainStart);
     }
     code = afs_VerifyVCache(avc, &treq);
     if (code)
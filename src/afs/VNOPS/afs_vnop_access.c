@@ -61,7 +61,7 @@ afs_GetAccessBits(struct vcache *avc, afs_int32 arights,
     }
 
     /* look in per-pag cache */
-    if (avc->Access) {		/* not beautiful, but Sun's cc will tolerate it */
+    {
 	struct axscache *ac;
 
 	ac = afs_FindAxs(avc->Access, areq->uid);
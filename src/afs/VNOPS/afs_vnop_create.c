@@ -447,7 +447,7 @@ afs_create(OSI_VC_DECL(adp), char *aname, struct vattr *attrs,
 		tvc->f.states &= ~CBulkFetching;
 		if (!AFS_IS_DISCON_RW) {
 		    tvc->cbExpires = CallBack.ExpirationTime;
-		    afs_QueueCallback(tvc, CBHash(CallBack.ExpirationTime), volp);
+		    afs_QueueCallback(tvc, volp);
 		}
 	    } else {
 		afs_DequeueCallback(tvc);
@@ -30,6 +30,9 @@ extern struct vcache *afs_globalVp;
 
 afs_int32 afs_bkvolpref = 0;
 afs_int32 afs_bulkStatsDone;
+afs_int32 afs_bulkStatAhead = 2;	/* background bulk stats to keep going */
+afs_int32 afs_bulkStatsQueued;	/* background bulk stats queued or running */
+afs_int32 afs_warmCache;	/* revalidate the disk cache at startup */
 static int bulkStatCounter = 0;	/* counter for bulk stat seq. numbers */
 int afs_fakestat_enable = 0;	/* 1: fakestat-all, 2: fakestat-crosscell */
 
@@ -650,6 +653,459 @@ afs_CheckBulkStatus(struct afs_conn *tc, int nFids, AFSBulkStats *statParm,
 
 extern int BlobScan(struct dcache * afile, afs_int32 ablob, afs_int32 *ablobOut);
 
+static struct vcache *BStvc = NULL;
+
+/*
+ * Turn off the CBulkFetching flag on fids [from, nfids) of a bulk stat
+ * request, unless someone else has started fetching them since.
+ */
+static void
+afs_BulkStatClearFlags(struct VenusFid *avfid, AFSFid *fidsp, int from,
+		       int nfids, afs_size_t statSeqNo)
+{
+    struct VenusFid afid;
+    struct vcache *tvcp;
+    afs_int32 retry;
+    int i;
+
+    for (i = from; i < nfids; i++) {
+	afid.Cell = avfid->Cell;
+	afid.Fid.Volume = avfid->Fid.Volume;
+	afid.Fid.Vnode = fidsp[i].Vnode;
+	afid.Fid.Unique = fidsp[i].Unique;
+	do {
+	    retry = 0;
+	    ObtainReadLock(&afs_xvcache);
+	    tvcp = afs_FindVCache(&afid, &retry, 0 /* !stats&!lru */);
+	    ReleaseReadLock(&afs_xvcache);
+	} while (tvcp && retry);
+	if (tvcp != NULL) {
+	    if ((tvcp->f.states & CBulkFetching)
+		&& (tvcp->f.m.Length == statSeqNo)) {
+		tvcp->f.states &= ~CBulkFetching;
+	    }
+	    afs_PutVCache(tvcp);
+	}
+    }
+}
+
+/*
+ * Fetch the status of nfids files in the volume of avfid with a single
+ * InlineBulkStatus (or BulkStatus) call, and merge the results into the
+ * vcaches the caller marked CBulkFetching with statSeqNo.  The
+ * CBulkFetching flags are cleared again before returning.
+ */
+static int
+afs_BulkStatFids(struct VenusFid *avfid, AFSFid *fidsp, int nfids,
+		 afs_size_t statSeqNo, struct vrequest *areqp)
+{
+    int nskip;			/* # of slots in the LRU queue to skip */
+#ifdef AFS_DARWIN80_ENV
+    int npasses = 0;
+    struct vnode *lruvp;
+#endif
+    struct vcache *lruvcp;	/* vcache ptr of our goal pos in LRU queue */
+    struct AFSCallBack *cbsp;	/* call back pointers */
+    struct AFSCallBack *tcbp;	/* temp callback ptr */
+    struct AFSFetchStatus *statsp;	/* file status info */
+    struct AFSVolSync volSync;	/* vol sync return info */
+    struct vcache *tvcp;	/* temp vcp */
+    struct afs_q *tq;		/* temp queue variable */
+    AFSCBFids fidParm;		/* file ID parm for bulk stat */
+    AFSBulkStats statParm;	/* stat info parm for bulk stat */
+    struct afs_conn *tcp = 0;	/* conn for call */
+    AFSCBs cbParm;		/* callback parm for bulk stat */
+    struct server *hostp = 0;	/* host we got callback from */
+    long startTime;		/* time we started the call,
+				 * for callback expiration base
+				 */
+    int ftype[4] = {VNON, VREG, VDIR, VLNK}; /* verify type is as expected */
+    int code;			/* error code */
+    int i;
+    struct VenusFid afid;	/* file ID we are using now */
+    afs_int32 retry;		/* handle low-level SGI MP race conditions */
+    long volStates;		/* flags from vol structure */
+    struct volume *volp = 0;	/* volume ptr */
+    struct VenusFid dotdot = {0, {0, 0, 0}};
+    int flagIndex = 0;		/* First file with bulk fetch flag set */
+    struct rx_connection *rxconn;
+    XSTATS_DECLS;
+    dotdot.Cell = 0;
+    dotdot.Fid.Unique = 0;
+    dotdot.Fid.Vnode = 0;
+
+    /* to reduce the stack size, allocate the stat info and callbacks */
+    statsp = osi_Alloc(AFSCBMAX * sizeof(AFSFetchStatus));
+    cbsp = osi_Alloc(AFSCBMAX * sizeof(AFSCallBack));
+
+    do {
+	/* setup the RPC parm structures */
+	fidParm.AFSCBFids_len = nfids;
+	fidParm.AFSCBFids_val = fidsp;
+	statParm.AFSBulkStats_len = nfids;
+	statParm.AFSBulkStats_val = statsp;
+	cbParm.AFSCBs_len = nfids;
+	cbParm.AFSCBs_val = cbsp;
+
+	/* start the timer; callback expirations are relative to this */
+	startTime = osi_Time();
+
+	tcp = afs_Conn(avfid, areqp, SHARED_LOCK, &rxconn);
+	if (tcp) {
+	    hostp = tcp->parent->srvr->server;
+
+	    for (i = 0; i < nfids; i++) {
+		/* we must set tvcp->callback before the BulkStatus call, so
+		 * we can detect concurrent InitCallBackState's */
+
+		afid.Cell = avfid->Cell;
+		afid.Fid.Volume = avfid->Fid.Volume;
+		afid.Fid.Vnode = fidsp[i].Vnode;
+		afid.Fid.Unique = fidsp[i].Unique;
+
+		do {
+		    retry = 0;
+		    ObtainReadLock(&afs_xvcache);
+		    tvcp = afs_FindVCache(&afid, &retry, 0 /* !stats&!lru */);
+		    ReleaseReadLock(&afs_xvcache);
+		} while (tvcp && retry);
+
+		if (!tvcp) {
+		    continue;
+		}
+
+		if ((tvcp->f.states & CBulkFetching) &&
+		     (tvcp->f.m.Length == statSeqNo)) {
+		    tvcp->callback = hostp;
+		}
+
+		afs_PutVCache(tvcp);
+		tvcp = NULL;
+	    }
+
+	    XSTATS_START_TIME(AFS_STATS_FS_RPCIDX_BULKSTATUS);
+
+	    if (!(tcp->parent->srvr->server->flags & SNO_INLINEBULK)) {
+		RX_AFS_GUNLOCK();
+		code =
+		    RXAFS_InlineBulkStatus(rxconn, &fidParm, &statParm,
+					   &cbParm, &volSync);
+		RX_AFS_GLOCK();
+		if (code == RXGEN_OPCODE) {
+		    tcp->parent->srvr->server->flags |= SNO_INLINEBULK;
+		    RX_AFS_GUNLOCK();
+		    code =
+			RXAFS_BulkStatus(rxconn, &fidParm, &statParm,
+					 &cbParm, &volSync);
+		    RX_AFS_GLOCK();
+		}
+	    } else {
+		RX_AFS_GUNLOCK();
+		code =
+		    RXAFS_BulkStatus(rxconn, &fidParm, &statParm, &cbParm,
+				     &volSync);
+		RX_AFS_GLOCK();
+	    }
+	    XSTATS_END_TIME;
+
+	    if (code == 0) {
+		code = afs_CheckBulkStatus(tcp, nfids, &statParm, &cbParm);
+	    }
+	} else
+	    code = -1;
+	/* make sure we give afs_Analyze a chance to retry,
+	 * but if the RPC succeeded we may have entries to merge.
+	 * if we wipe code with one entry's status we get bogus failures.
+	 */
+    } while (afs_Analyze
+	     (tcp, rxconn, code ? code : (&statsp[0])->errorCode,
+	      avfid, areqp, AFS_STATS_FS_RPCIDX_BULKSTATUS,
+	      SHARED_LOCK, NULL));
+
+    /* now, if we didnt get the info, bail out. */
+    if (code)
+	goto done;
+
+    /* we need vol flags to create the entries properly */
+    dotdot.Fid.Volume = 0;
+    volp = afs_GetVolume(avfid, areqp, READ_LOCK);
+    if (volp) {
+	volStates = volp->states;
+	if (volp->dotdot.Fid.Volume != 0)
+	    dotdot = volp->dotdot;
+    } else
+	volStates = 0;
+
+    /* find the place to merge the info into  We do this by skipping
+     * nskip entries in the LRU queue.  The more we skip, the more
+     * we preserve, since the head of the VLRU queue is the most recently
+     * referenced file.
+     */
+  reskip:
+    nskip = afs_cacheStats / 2;	/* preserved fraction of the cache */
+    ObtainReadLock(&afs_xvcache);
+#ifdef AFS_DARWIN80_ENV
+ reskip2:
+#endif
+    if (QEmpty(&VLRU)) {
+	/* actually a serious error, probably should panic. Probably will 
+	 * panic soon, oh well. */
+	ReleaseReadLock(&afs_xvcache);
+	afs_warnuser("afs_DoBulkStat: VLRU empty!");
+	goto done;
+    }
+    if ((VLRU.next->prev != &VLRU) || (VLRU.prev->next != &VLRU)) {
+	refpanic("Bulkstat VLRU inconsistent");
+    }
+    for (tq = VLRU.next; tq != &VLRU; tq = QNext(tq)) {
+	if (--nskip <= 0) {
+#ifdef AFS_DARWIN80_ENV
+	    if ((!(QTOV(tq)->f.states & CDeadVnode)&&!(QTOV(tq)->f.states & CVInit)))
+#endif
+		break;
+	}
+	if (QNext(QPrev(tq)) != tq) {
+	    BStvc = QTOV(tq);
+	    refpanic("BulkStat VLRU inconsistent");
+	}
+    }
+    if (tq != &VLRU)
+	lruvcp = QTOV(tq);
+    else
+	lruvcp = QTOV(VLRU.next);
+
+    /* now we have to hold this entry, so that it does not get moved
+     * into the free list while we're running.  It could still get
+     * moved within the lru queue, but hopefully that will be rare; it
+     * doesn't hurt nearly as much.
+     */
+    retry = 0;
+#ifdef AFS_DARWIN80_ENV
+    if (((lruvcp->f.states & CDeadVnode)||(lruvcp->f.states & CVInit))) {
+	if (npasses == 0) {
+	    nskip = 1;
+	    npasses++;
+	    goto reskip2;
+	} else
+	    panic("Can't find non-dead vnode in VLRU\n");
+    }
+    lruvp = AFSTOV(lruvcp);
+    if (vnode_get(lruvp))       /* this bumps ref count */
+	retry = 1;
+    else if (vnode_ref(lruvp)) {
+	AFS_GUNLOCK();
+	/* AFSTOV(lruvcp) may be NULL */
+	vnode_put(lruvp);
+	AFS_GLOCK();
+	retry = 1;
+    }
+#else
+    osi_vnhold(lruvcp, &retry);
+#endif
+    ReleaseReadLock(&afs_xvcache);	/* could be read lock */
+    if (retry)
+	goto reskip;
+
+    /* otherwise, merge in the info.  We have to be quite careful here,
+     * since we need to ensure that we don't merge old info over newer
+     * stuff in a stat cache entry.  We're very conservative here: we don't
+     * do the merge at all unless we ourselves create the stat cache
+     * entry.  That's pretty safe, and should work pretty well, since we
+     * typically expect to do the stat cache creation ourselves.
+     *
+     * We also have to take into account racing token revocations.
+     */
+    for (i = 0; i < nfids; i++) {
+	if ((&statsp[i])->errorCode)
+	    continue;
+	afid.Cell = avfid->Cell;
+	afid.Fid.Volume = avfid->Fid.Volume;
+	afid.Fid.Vnode = fidsp[i].Vnode;
+	afid.Fid.Unique = fidsp[i].Unique;
+	do {
+	    retry = 0;
+	    ObtainReadLock(&afs_xvcache);
+	    tvcp = afs_FindVCache(&afid, &retry, 0/* !stats&!lru */);
+	    ReleaseReadLock(&afs_xvcache);
+	} while (tvcp && retry);
+
+	/* The entry may no longer exist */
+	if (tvcp == NULL) {
+	    continue;
+	}
+
+	/* now we have the entry held, but we need to fill it in */
+	ObtainWriteLock(&tvcp->lock, 131);
+
+	/* if CBulkFetching is not set, or if the file size no longer
+	 * matches the value we placed there when we set the CBulkFetching
+	 * flag, then someone else has done something with this node,
+	 * and we may not have the latest status information for this
+	 * file.  Leave the entry alone. There's also a file type
+	 * change here, for OSX bulkstat support.
+	 */
+	if (!(tvcp->f.states & CBulkFetching)
+	    || (tvcp->f.m.Length != statSeqNo)
+	    || (ftype[(&statsp[i])->FileType] != vType(tvcp))) {
+	    flagIndex++;
+	    ReleaseWriteLock(&tvcp->lock);
+	    afs_PutVCache(tvcp);
+	    continue;
+	}
+
+	/* now copy ".." entry back out of volume structure, if necessary */
+	if (tvcp->mvstat == AFS_MVSTAT_ROOT && (dotdot.Fid.Volume != 0)) {
+	    if (!tvcp->mvid.parent)
+		tvcp->mvid.parent = osi_AllocSmallSpace(sizeof(struct VenusFid));
+	    *tvcp->mvid.parent = dotdot;
+	}
+
+#ifdef AFS_DARWIN80_ENV
+	if (((lruvcp->f.states & CDeadVnode)||(lruvcp->f.states & CVInit)))
+	    panic("vlru control point went dead\n");
+#endif
+
+	ObtainWriteLock(&afs_xvcache, 132);
+	if ((VLRU.next->prev != &VLRU) || (VLRU.prev->next != &VLRU)) {
+	    refpanic("Bulkstat VLRU inconsistent2");
+	}
+	if ((QNext(QPrev(&tvcp->vlruq)) != &tvcp->vlruq)
+	    || (QPrev(QNext(&tvcp->vlruq)) != &tvcp->vlruq)) {
+	    refpanic("Bulkstat VLRU inconsistent4");
+	}
+	if ((QNext(QPrev(&lruvcp->vlruq)) != &lruvcp->vlruq)
+	    || (QPrev(QNext(&lruvcp->vlruq)) != &lruvcp->vlruq)) {
+	    refpanic("Bulkstat VLRU inconsistent5");
+	}
+
+	if (tvcp != lruvcp) {	/* if they are == don't move it, don't corrupt vlru */
+	    QRemove(&tvcp->vlruq);
+	    QAdd(&lruvcp->vlruq, &tvcp->vlruq);
+	}
+
+	if ((VLRU.next->prev != &VLRU) || (VLRU.prev->next != &VLRU)) {
+	    refpanic("Bulkstat VLRU inconsistent3");
+	}
+	if ((QNext(QPrev(&tvcp->vlruq)) != &tvcp->vlruq)
+	    || (QPrev(QNext(&tvcp->vlruq)) != &tvcp->vlruq)) {
+	    refpanic("Bulkstat VLRU inconsistent5");
+	}
+	if ((QNext(QPrev(&lruvcp->vlruq)) != &lruvcp->vlruq)
+	    || (QPrev(QNext(&lruvcp->vlruq)) != &lruvcp->vlruq)) {
+	    refpanic("Bulkstat VLRU inconsistent6");
+	}
+	ReleaseWriteLock(&afs_xvcache);
+
+	ObtainWriteLock(&afs_xcbhash, 494);
+
+	/* We need to check the flags again. We may have missed
+	 * something while we were waiting for a lock.
+	 */
+	if (!(tvcp->f.states & CBulkFetching) || (tvcp->f.m.Length != statSeqNo)) {
+	    flagIndex++;
+	    ReleaseWriteLock(&tvcp->lock);
+	    ReleaseWriteLock(&afs_xcbhash);
+	    afs_PutVCache(tvcp);
+	    continue;
+	}
+
+	/* now merge in the resulting status back into the vnode.
+	 * We only do this if the entry looks clear.
+	 */
+	afs_ProcessFS(tvcp, &statsp[i], areqp);
+#if defined(AFS_LINUX22_ENV)
+	afs_fill_inode(AFSTOV(tvcp), NULL);	/* reset inode operations */
+#endif
+
+	/* do some accounting for bulk stats: mark this entry as
+	 * loaded, so we can tell if we use it before it gets
+	 * recycled.
+	 */
+	tvcp->f.states |= CBulkStat;
+	tvcp->f.states &= ~CBulkFetching;
+	flagIndex++;
+	afs_bulkStatsDone++;
+
+	/* merge in vol info */
+	if (volStates & VRO)
+	    tvcp->f.states |= CRO;
+	if (volStates & VBackup)
+	    tvcp->f.states |= CBackup;
+	if (volStates & VForeign)
+	    tvcp->f.states |= CForeign;
+
+	/* merge in the callback info */
+	tvcp->f.states |= CTruth;
+
+	/* get ptr to the callback we are interested in */
+	tcbp = cbsp + i;
+
+	if (tcbp->ExpirationTime != 0) {
+	    tvcp->cbExpires = tcbp->ExpirationTime + startTime;
+	    tvcp->callback = hostp;
+	    tvcp->f.states |= CStatd;
+	    afs_QueueCallback(tvcp, volp);
+	} else if (tvcp->f.states & CRO) {
+	    /* ordinary callback on a read-only volume -- AFS 3.2 style */
+	    tvcp->cbExpires = 3600 + startTime;
+	    tvcp->callback = hostp;
+	    tvcp->f.states |= CStatd;
+	    afs_QueueCallback(tvcp, volp);
+	} else {
+	    tvcp->callback = 0;
+	    tvcp->f.states &= ~(CStatd | CUnique);
+	    afs_DequeueCallback(tvcp);
+	    if ((tvcp->f.states & CForeign) || (vType(tvcp) == VDIR))
+		osi_dnlc_purgedp(tvcp);	/* if it (could be) a directory */
+	}
+#ifdef AFS_DARWIN80_ENV
+	/* reclaim->FlushVCache will need xcbhash */
+	if (((tvcp->f.states & CDeadVnode)||(tvcp->f.states & CVInit))) {
+	    ReleaseWriteLock(&afs_xcbhash);
+	    /* passing in a parent hangs getting the vnode lock */
+	    code = afs_darwin_finalizevnode(tvcp, NULL, NULL, 0, 1);
+	    if (code) {
+		/* It's gonna get recycled - shouldn't happen */
+		tvcp->callback = 0;
+		tvcp->f.states &= ~(CStatd | CUnique);
+		afs_DequeueCallback(tvcp);
+		if ((tvcp->f.states & CForeign) || (vType(tvcp) == VDIR))
+		    osi_dnlc_purgedp(tvcp); /* if it (could be) a directory */
+	    } else
+		/* re-acquire the usecount that finalizevnode disposed of */
+		vnode_ref(AFSTOV(tvcp));
+	} else
+#endif
+	ReleaseWriteLock(&afs_xcbhash);
+
+	ReleaseWriteLock(&tvcp->lock);
+	/* finally, we're done with the entry */
+	afs_PutVCache(tvcp);
+    }				/* for all files we got back */
+
+    /* finally return the pointer into the LRU queue */
+#ifdef AFS_DARWIN80_ENV
+    if (((lruvcp->f.states & CDeadVnode)||(lruvcp->f.states & CVInit)))
+	panic("vlru control point went dead before put\n");
+    AFS_GUNLOCK();
+    vnode_put(lruvp);
+    vnode_rele(lruvp);
+    AFS_GLOCK();
+#else
+    afs_PutVCache(lruvcp);
+#endif
+
+  done:
+    /* Be sure to turn off the CBulkFetching flags */
+    afs_BulkStatClearFlags(avfid, fidsp, flagIndex, nfids, statSeqNo);
+    if (volp)
+	afs_PutVolume(volp, READ_LOCK);
+
+    osi_Free((char *)statsp, AFSCBMAX * sizeof(AFSFetchStatus));
+    osi_Free((char *)cbsp, AFSCBMAX * sizeof(AFSCallBack));
+    return code;
+}
+
 /* called with an unlocked directory and directory cookie.  Areqp
  * describes who is making the call.
  * Scans the next N (about 30, typically) directory entries, and does
@@ -666,55 +1122,22 @@ extern int BlobScan(struct dcache * afile, afs_int32 ablob, afs_int32 *ablobOut)
  * ensure that vcaches created for failed RPC's to older servers have the
  * CForeign bit set.
  */
-static struct vcache *BStvc = NULL;
-
 int
 afs_DoBulkStat(struct vcache *adp, long dirCookie, struct vrequest *areqp)
 {
     int nentries;		/* # of entries to prefetch */
-    int nskip;			/* # of slots in the LRU queue to skip */
-#ifdef AFS_DARWIN80_ENV
-    int npasses = 0;
-    struct vnode *lruvp;
-#endif
-    struct vcache *lruvcp;	/* vcache ptr of our goal pos in LRU queue */
     struct dcache *dcp;		/* chunk containing the dir block */
     afs_size_t temp;		/* temp for holding chunk length, &c. */
     struct AFSFid *fidsp;	/* file IDs were collecting */
-    struct AFSCallBack *cbsp;	/* call back pointers */
-    struct AFSCallBack *tcbp;	/* temp callback ptr */
-    struct AFSFetchStatus *statsp;	/* file status info */
-    struct AFSVolSync volSync;	/* vol sync return info */
     struct vcache *tvcp;	/* temp vcp */
-    struct afs_q *tq;		/* temp queue variable */
-    AFSCBFids fidParm;		/* file ID parm for bulk stat */
-    AFSBulkStats statParm;	/* stat info parm for bulk stat */
     int fidIndex = 0;		/* which file were stating */
-    struct afs_conn *tcp = 0;	/* conn for call */
-    AFSCBs cbParm;		/* callback parm for bulk stat */
-    struct server *hostp = 0;	/* host we got callback from */
-    long startTime;		/* time we started the call,
-				 * for callback expiration base
-				 */
-    int ftype[4] = {VNON, VREG, VDIR, VLNK}; /* verify type is as expected */
     afs_size_t statSeqNo = 0;	/* Valued of file size to detect races */
     int code;			/* error code */
     afs_int32 newIndex;		/* new index in the dir */
     struct DirBuffer entry;	/* Buffer for dir manipulation */
     struct DirEntry *dirEntryp;	/* dir entry we are examining */
-    int i;
-    struct VenusFid afid;	/* file ID we are using now */
     struct VenusFid tfid;	/* another temp. file ID */
     afs_int32 retry;		/* handle low-level SGI MP race conditions */
-    long volStates;		/* flags from vol structure */
-    struct volume *volp = 0;	/* volume ptr */
-    struct VenusFid dotdot = {0, {0, 0, 0}};
-    int flagIndex = 0;		/* First file with bulk fetch flag set */
-    struct rx_connection *rxconn;
-    XSTATS_DECLS;
-    dotdot.Cell = 0;
-    dotdot.Fid.Unique = 0;
-    dotdot.Fid.Vnode = 0;
 
     /* first compute some basic parameters.  We dont want to prefetch more
      * than a fraction of the cache in any given call, and we want to preserve
@@ -735,13 +1158,7 @@ afs_DoBulkStat(struct vcache *adp, long dirCookie, struct vrequest *areqp)
     if (nentries > 30)
 	nentries = 30;
 
-    /* now, to reduce the stack size, well allocate two 4K blocks,
-     * one for fids and callbacks, and one for stat info.  Well set
-     * up our pointers to the memory from there, too.
-     */
-    statsp = osi_Alloc(AFSCBMAX * sizeof(AFSFetchStatus));
     fidsp = osi_AllocLargeSpace(nentries * sizeof(AFSFid));
-    cbsp = osi_Alloc(AFSCBMAX * sizeof(AFSCallBack));
 
     /* next, we must iterate over the directory, starting from the specified
      * cookie offset (dirCookie), and counting out nentries file entries.
@@ -803,7 +1220,6 @@ afs_DoBulkStat(struct vcache *adp, long dirCookie, struct vrequest *areqp)
 
     /* now we have dir data in the cache, so scan the dir page */
     fidIndex = 0;
-    flagIndex = 0;
     while (1) {			/* Should probably have some constant bound */
 	/* look for first safe entry to examine in the directory.  BlobScan
 	 * looks for a the 1st allocated dir after the dirCookie slot.
@@ -849,7 +1265,7 @@ afs_DoBulkStat(struct vcache *adp, long dirCookie, struct vrequest *areqp)
 		}
 	    } while (tvcp && retry);
 	    if (!tvcp) {	/* otherwise, create manually */
-		tvcp = afs_NewBulkVCache(&tfid, hostp, statSeqNo);
+		tvcp = afs_NewBulkVCache(&tfid, NULL, statSeqNo);
 		if (tvcp)
 		{
 		    ObtainWriteLock(&tvcp->lock, 505);
@@ -915,429 +1331,273 @@ afs_DoBulkStat(struct vcache *adp, long dirCookie, struct vrequest *areqp)
 		 * not change. NewBulkVCache sets us up for the new ones.
 		 * Set up the rest here.
 		 *
-		 * Don't fetch status for dirty files. We need to
-		 * preserve the value of the file size. We could
-		 * flush the pages, but it wouldn't be worthwhile.
-		 */
-		if (!(tvcp->f.states & CBulkFetching)) {
-		    tvcp->f.states |= CBulkFetching;
-		    tvcp->f.m.Length = statSeqNo;
-		}
-		memcpy((char *)(fidsp + fidIndex), (char *)&tfid.Fid,
-		       sizeof(*fidsp));
-		fidIndex++;
-	    }
-	    afs_PutVCache(tvcp);
-	}
-
-	/* if dir vnode has non-zero entry */
-	/* move to the next dir entry by adding in the # of entries
-	 * used by this dir entry.
-	 */
-	temp = afs_dir_NameBlobs(dirEntryp->name) << 5;
-	DRelease(&entry, 0);
-	if (temp <= 0)
-	    break;
-	dirCookie += temp;
-    }				/* while loop over all dir entries */
-
-    /* now release the dir lock and prepare to make the bulk RPC */
-    ReleaseReadLock(&dcp->lock);
-    ReleaseReadLock(&adp->lock);
-
-    /* release the chunk */
-    afs_PutDCache(dcp);
-
-    /* dont make a null call */
-    if (fidIndex == 0)
-	goto done;
-
-    do {
-	/* setup the RPC parm structures */
-	fidParm.AFSCBFids_len = fidIndex;
-	fidParm.AFSCBFids_val = fidsp;
-	statParm.AFSBulkStats_len = fidIndex;
-	statParm.AFSBulkStats_val = statsp;
-	cbParm.AFSCBs_len = fidIndex;
-	cbParm.AFSCBs_val = cbsp;
-
-	/* start the timer; callback expirations are relative to this */
-	startTime = osi_Time();
-
-	tcp = afs_Conn(&adp->f.fid, areqp, SHARED_LOCK, &rxconn);
-	if (tcp) {
-	    hostp = tcp->parent->srvr->server;
-
-	    for (i = 0; i < fidIndex; i++) {
-		/* we must set tvcp->callback before the BulkStatus call, so
-		 * we can detect concurrent InitCallBackState's */
-
-		afid.Cell = adp->f.fid.Cell;
-		afid.Fid.Volume = adp->f.fid.Fid.Volume;
-		afid.Fid.Vnode = fidsp[i].Vnode;
-		afid.Fid.Unique = fidsp[i].Unique;
-
-		do {
-		    retry = 0;
-		    ObtainReadLock(&afs_xvcache);
-		    tvcp = afs_FindVCache(&afid, &retry, 0 /* !stats&!lru */);
-		    ReleaseReadLock(&afs_xvcache);
-		} while (tvcp && retry);
-
-		if (!tvcp) {
-		    continue;
-		}
-
-		if ((tvcp->f.states & CBulkFetching) &&
-		     (tvcp->f.m.Length == statSeqNo)) {
-		    tvcp->callback = hostp;
-		}
-
-		afs_PutVCache(tvcp);
-		tvcp = NULL;
-	    }
-
-	    XSTATS_START_TIME(AFS_STATS_FS_RPCIDX_BULKSTATUS);
-
-	    if (!(tcp->parent->srvr->server->flags & SNO_INLINEBULK)) {
-		RX_AFS_GUNLOCK();
-		code =
-		    RXAFS_InlineBulkStatus(rxconn, &fidParm, &statParm,
-					   &cbParm, &volSync);
-		RX_AFS_GLOCK();
-		if (code == RXGEN_OPCODE) {
-		    tcp->parent->srvr->server->flags |= SNO_INLINEBULK;
-		    RX_AFS_GUNLOCK();
-		    code =
-			RXAFS_BulkStatus(rxconn, &fidParm, &statParm,
-					 &cbParm, &volSync);
-		    RX_AFS_GLOCK();
-		}
-	    } else {
-		RX_AFS_GUNLOCK();
-		code =
-		    RXAFS_BulkStatus(rxconn, &fidParm, &statParm, &cbParm,
-				     &volSync);
-		RX_AFS_GLOCK();
-	    }
-	    XSTATS_END_TIME;
-
-	    if (code == 0) {
-		code = afs_CheckBulkStatus(tcp, fidIndex, &statParm, &cbParm);
-	    }
-	} else
-	    code = -1;
-	/* make sure we give afs_Analyze a chance to retry,
-	 * but if the RPC succeeded we may have entries to merge.
-	 * if we wipe code with one entry's status we get bogus failures.
-	 */
-    } while (afs_Analyze
-	     (tcp, rxconn, code ? code : (&statsp[0])->errorCode,
-	      &adp->f.fid, areqp, AFS_STATS_FS_RPCIDX_BULKSTATUS,
-	      SHARED_LOCK, NULL));
-
-    /* now, if we didnt get the info, bail out. */
-    if (code)
-	goto done;
-
-    /* we need vol flags to create the entries properly */
-    dotdot.Fid.Volume = 0;
-    volp = afs_GetVolume(&adp->f.fid, areqp, READ_LOCK);
-    if (volp) {
-	volStates = volp->states;
-	if (volp->dotdot.Fid.Volume != 0)
-	    dotdot = volp->dotdot;
-    } else
-	volStates = 0;
-
-    /* find the place to merge the info into  We do this by skipping
-     * nskip entries in the LRU queue.  The more we skip, the more
-     * we preserve, since the head of the VLRU queue is the most recently
-     * referenced file.
-     */
-  reskip:
-    nskip = afs_cacheStats / 2;	/* preserved fraction of the cache */
-    ObtainReadLock(&afs_xvcache);
-#ifdef AFS_DARWIN80_ENV
- reskip2:
-#endif
-    if (QEmpty(&VLRU)) {
-	/* actually a serious error, probably should panic. Probably will 
-	 * panic soon, oh well. */
-	ReleaseReadLock(&afs_xvcache);
-	afs_warnuser("afs_DoBulkStat: VLRU empty!");
-	goto done;
-    }
-    if ((VLRU.next->prev != &VLRU) || (VLRU.prev->next != &VLRU)) {
-	refpanic("Bulkstat VLRU inconsistent");
-    }
-    for (tq = VLRU.next; tq != &VLRU; tq = QNext(tq)) {
-	if (--nskip <= 0) {
-#ifdef AFS_DARWIN80_ENV
-	    if ((!(QTOV(tq)->f.states & CDeadVnode)&&!(QTOV(tq)->f.states & CVInit)))
-#endif
-		break;
-	}
-	if (QNext(QPrev(tq)) != tq) {
-	    BStvc = QTOV(tq);
-	    refpanic("BulkStat VLRU inconsistent");
-	}
-    }
-    if (tq != &VLRU)
-	lruvcp = QTOV(tq);
-    else
-	lruvcp = QTOV(VLRU.next);
-
-    /* now we have to hold this entry, so that it does not get moved
-     * into the free list while we're running.  It could still get
-     * moved within the lru queue, but hopefully that will be rare; it
-     * doesn't hurt nearly as much.
-     */
-    retry = 0;
-#ifdef AFS_DARWIN80_ENV
-    if (((lruvcp->f.states & CDeadVnode)||(lruvcp->f.states & CVInit))) {
-	if (npasses == 0) {
-	    nskip = 1;
-	    npasses++;
-	    goto reskip2;
-	} else
-	    panic("Can't find non-dead vnode in VLRU\n");
-    }
-    lruvp = AFSTOV(lruvcp);
-    if (vnode_get(lruvp))       /* this bumps ref count */
-	retry = 1;
-    else if (vnode_ref(lruvp)) {
-	AFS_GUNLOCK();
-	/* AFSTOV(lruvcp) may be NULL */
-	vnode_put(lruvp);
-	AFS_GLOCK();
-	retry = 1;
-    }
-#else
-    osi_vnhold(lruvcp, &retry);
-#endif
-    ReleaseReadLock(&afs_xvcache);	/* could be read lock */
-    if (retry)
-	goto reskip;
-
-    /* otherwise, merge in the info.  We have to be quite careful here,
-     * since we need to ensure that we don't merge old info over newer
-     * stuff in a stat cache entry.  We're very conservative here: we don't
-     * do the merge at all unless we ourselves create the stat cache
-     * entry.  That's pretty safe, and should work pretty well, since we
-     * typically expect to do the stat cache creation ourselves.
-     *
-     * We also have to take into account racing token revocations.
-     */
-    for (i = 0; i < fidIndex; i++) {
-	if ((&statsp[i])->errorCode)
-	    continue;
-	afid.Cell = adp->f.fid.Cell;
-	afid.Fid.Volume = adp->f.fid.Fid.Volume;
-	afid.Fid.Vnode = fidsp[i].Vnode;
-	afid.Fid.Unique = fidsp[i].Unique;
-	do {
-	    retry = 0;
-	    ObtainReadLock(&afs_xvcache);
-	    tvcp = afs_FindVCache(&afid, &retry, 0/* !stats&!lru */);
-	    ReleaseReadLock(&afs_xvcache);
-	} while (tvcp && retry);
-
-	/* The entry may no longer exist */
-	if (tvcp == NULL) {
-	    continue;
+		 * Don't fetch status for dirty files. We need to
+		 * preserve the value of the file size. We could
+		 * flush the pages, but it wouldn't be worthwhile.
+		 */
+		if (!(tvcp->f.states & CBulkFetching)) {
+		    tvcp->f.states |= CBulkFetching;
+		    tvcp->f.m.Length = statSeqNo;
+		}
+		memcpy((char *)(fidsp + fidIndex), (char *)&tfid.Fid,
+		       sizeof(*fidsp));
+		fidIndex++;
+	    }
+	    afs_PutVCache(tvcp);
 	}
 
-	/* now we have the entry held, but we need to fill it in */
-	ObtainWriteLock(&tvcp->lock, 131);
-
-	/* if CBulkFetching is not set, or if the file size no longer
-	 * matches the value we placed there when we set the CBulkFetching
-	 * flag, then someone else has done something with this node,
-	 * and we may not have the latest status information for this
-	 * file.  Leave the entry alone. There's also a file type
-	 * change here, for OSX bulkstat support.
+	/* if dir vnode has non-zero entry */
+	/* move to the next dir entry by adding in the # of entries
+	 * used by this dir entry.
 	 */
-	if (!(tvcp->f.states & CBulkFetching)
-	    || (tvcp->f.m.Length != statSeqNo)
-	    || (ftype[(&statsp[i])->FileType] != vType(tvcp))) {
-	    flagIndex++;
-	    ReleaseWriteLock(&tvcp->lock);
-	    afs_PutVCache(tvcp);
-	    continue;
-	}
+	temp = afs_dir_NameBlobs(dirEntryp->name) << 5;
+	DRelease(&entry, 0);
+	if (temp <= 0)
+	    break;
+	dirCookie += temp;
+    }				/* while loop over all dir entries */
 
-	/* now copy ".." entry back out of volume structure, if necessary */
-	if (tvcp->mvstat == AFS_MVSTAT_ROOT && (dotdot.Fid.Volume != 0)) {
-	    if (!tvcp->mvid.parent)
-		tvcp->mvid.parent = osi_AllocSmallSpace(sizeof(struct VenusFid));
-	    *tvcp->mvid.parent = dotdot;
-	}
+    /* now release the dir lock and prepare to make the bulk RPC */
+    ReleaseReadLock(&dcp->lock);
+    ReleaseReadLock(&adp->lock);
 
-#ifdef AFS_DARWIN80_ENV
-	if (((lruvcp->f.states & CDeadVnode)||(lruvcp->f.states & CVInit)))
-	    panic("vlru control point went dead\n");
-#endif
+    /* release the chunk */
+    afs_PutDCache(dcp);
 
-	ObtainWriteLock(&afs_xvcache, 132);
-	if ((VLRU.next->prev != &VLRU) || (VLRU.prev->next != &VLRU)) {
-	    refpanic("Bulkstat VLRU inconsistent2");
-	}
-	if ((QNext(QPrev(&tvcp->vlruq)) != &tvcp->vlruq)
-	    || (QPrev(QNext(&tvcp->vlruq)) != &tvcp->vlruq)) {
-	    refpanic("Bulkstat VLRU inconsistent4");
-	}
-	if ((QNext(QPrev(&lruvcp->vlruq)) != &lruvcp->vlruq)
-	    || (QPrev(QNext(&lruvcp->vlruq)) != &lruvcp->vlruq)) {
-	    refpanic("Bulkstat VLRU inconsistent5");
-	}
+    /* dont make a null call */
+    if (fidIndex > 0)
+	code = afs_BulkStatFids(&adp->f.fid, fidsp, fidIndex, statSeqNo,
+				areqp);
+    goto done2;
 
-	if (tvcp != lruvcp) {	/* if they are == don't move it, don't corrupt vlru */
-	    QRemove(&tvcp->vlruq);
-	    QAdd(&lruvcp->vlruq, &tvcp->vlruq);
-	}
+  done:
+    /* Be sure to turn off the CBulkFetching flags */
+    afs_BulkStatClearFlags(&adp->f.fid, fidsp, 0, fidIndex, statSeqNo);
+  done2:
+    osi_FreeLargeSpace((char *)fidsp);
+    return code;
+}
 
-	if ((VLRU.next->prev != &VLRU) || (VLRU.prev->next != &VLRU)) {
-	    refpanic("Bulkstat VLRU inconsistent3");
-	}
-	if ((QNext(QPrev(&tvcp->vlruq)) != &tvcp->vlruq)
-	    || (QPrev(QNext(&tvcp->vlruq)) != &tvcp->vlruq)) {
-	    refpanic("Bulkstat VLRU inconsistent5");
-	}
-	if ((QNext(QPrev(&lruvcp->vlruq)) != &lruvcp->vlruq)
-	    || (QPrev(QNext(&lruvcp->vlruq)) != &lruvcp->vlruq)) {
-	    refpanic("Bulkstat VLRU inconsistent6");
-	}
-	ReleaseWriteLock(&afs_xvcache);
+#ifndef AFS_DARWIN80_ENV
+/* files of one volume waiting to be bulk stat'ed by afs_WarmCache */
+#define WARM_NBATCH	8	/* volumes being collected at once */
+#define WARM_BATCHSIZE	30	/* files per bulk stat, as in afs_DoBulkStat */
+struct warm_batch {
+    struct VenusFid vfid;	/* cell and volume of the files */
+    int nfids;
+    AFSFid fids[WARM_BATCHSIZE];
+};
 
-	ObtainWriteLock(&afs_xcbhash, 494);
+/*
+ * Find, or make room for, the batch collecting files of afid's volume.
+ * Makes room by bulk stat'ing the fullest batch.
+ */
+static struct warm_batch *
+afs_WarmBatch(struct warm_batch *batches, struct VenusFid *afid,
+	      afs_size_t statSeqNo, struct vrequest *areqp)
+{
+    struct warm_batch *tb, *empty = NULL, *full = NULL;
+    int i;
 
-	/* We need to check the flags again. We may have missed
-	 * something while we were waiting for a lock.
-	 */
-	if (!(tvcp->f.states & CBulkFetching) || (tvcp->f.m.Length != statSeqNo)) {
-	    flagIndex++;
-	    ReleaseWriteLock(&tvcp->lock);
-	    ReleaseWriteLock(&afs_xcbhash);
-	    afs_PutVCache(tvcp);
-	    continue;
+    for (i = 0; i < WARM_NBATCH; i++) {
+	tb = &batches[i];
+	if (tb->nfids == 0) {
+	    if (!empty)
+		empty = tb;
+	} else if (tb->vfid.Cell == afid->Cell
+		   && tb->vfid.Fid.Volume == afid->Fid.Volume) {
+	    return tb;
+	} else if (!full || tb->nfids > full->nfids) {
+	    full = tb;
 	}
-
-	/* now merge in the resulting status back into the vnode.
-	 * We only do this if the entry looks clear.
-	 */
-	afs_ProcessFS(tvcp, &statsp[i], areqp);
-#if defined(AFS_LINUX22_ENV)
-	afs_fill_inode(AFSTOV(tvcp), NULL);	/* reset inode operations */
+    }
+    if (!empty) {
+	afs_BulkStatFids(&full->vfid, full->fids, full->nfids, statSeqNo,
+			 areqp);
+	full->nfids = 0;
+	empty = full;
+    }
+    empty->vfid = *afid;
+    return empty;
+}
 #endif
 
-	/* do some accounting for bulk stats: mark this entry as
-	 * loaded, so we can tell if we use it before it gets
-	 * recycled.
-	 */
-	tvcp->f.states |= CBulkStat;
-	tvcp->f.states &= ~CBulkFetching;
-	flagIndex++;
-	afs_bulkStatsDone++;
+/*!
+ * Revalidate the chunks a previous run of the cache manager left in the
+ * disk cache.  The chunks and their data versions survive a restart in
+ * CacheItems, but the vcaches and callbacks do not, so without this the
+ * first use of every cached file costs a FetchStatus.  Bulk stat the
+ * files the cache holds, a volume at a time, before anybody asks for
+ * them; afs_GetDCache then reuses every chunk whose version still
+ * matches without going back to the file server.
+ *
+ * We stop short of filling the stat cache: vcaches that push afs_vcount
+ * past -stat only make afs_ShakeLooseVCaches throw away entries somebody
+ * is using, and are likely thrown away themselves before use.
+ *
+ * \param areqp  request to bulk stat with
+ */
+void
+afs_WarmCache(struct vrequest *areqp)
+{
+#ifndef AFS_DARWIN80_ENV
+    struct warm_batch *batches, *tb;
+    struct dcache *tdc;
+    struct vcache *tvcp;
+    struct VenusFid tfid;
+    afs_hyper_t versionNo;
+    afs_size_t statSeqNo;
+    afs_int32 retry, reused = 0, stale = 0;
+    int i;
 
-	/* merge in vol info */
-	if (volStates & VRO)
-	    tvcp->f.states |= CRO;
-	if (volStates & VBackup)
-	    tvcp->f.states |= CBackup;
-	if (volStates & VForeign)
-	    tvcp->f.states |= CForeign;
+    batches = osi_Alloc(WARM_NBATCH * sizeof(*batches));
+    memset(batches, 0, WARM_NBATCH * sizeof(*batches));
 
-	/* merge in the callback info */
-	tvcp->f.states |= CTruth;
+    /* one sequence number does for the whole pass; see afs_DoBulkStat */
+    statSeqNo = bulkStatCounter++;
+    if (statSeqNo == 0)
+	statSeqNo = bulkStatCounter++;
 
-	/* get ptr to the callback we are interested in */
-	tcbp = cbsp + i;
+    for (i = 0; i < afs_cacheFiles && !afs_shuttingdown; i++) {
+	if (afs_vcount + WARM_BATCHSIZE > afs_cacheStats)
+	    break;
+	ObtainWriteLock(&afs_xdcache, 1211);
+	if (afs_indexFlags[i] & (IFFree | IFDiscarded)) {
+	    ReleaseWriteLock(&afs_xdcache);
+	    continue;
+	}
+	tdc = afs_GetValidDSlot(i);
+	if (!tdc) {
+	    ReleaseWriteLock(&afs_xdcache);
+	    continue;
+	}
+	tfid = tdc->f.fid;
+	ReleaseReadLock(&tdc->tlock);
+	afs_PutDCache(tdc);
+	ReleaseWriteLock(&afs_xdcache);
 
-	if (tcbp->ExpirationTime != 0) {
-	    tvcp->cbExpires = tcbp->ExpirationTime + startTime;
-	    tvcp->callback = hostp;
-	    tvcp->f.states |= CStatd;
-	    afs_QueueCallback(tvcp, CBHash(tcbp->ExpirationTime), volp);
-	} else if (tvcp->f.states & CRO) {
-	    /* ordinary callback on a read-only volume -- AFS 3.2 style */
-	    tvcp->cbExpires = 3600 + startTime;
-	    tvcp->callback = hostp;
-	    tvcp->f.states |= CStatd;
-	    afs_QueueCallback(tvcp, CBHash(3600), volp);
+	if (tfid.Fid.Volume == 0 || afs_IsDynrootAnyFid(&tfid))
+	    continue;
+
+	do {
+	    retry = 0;
+	    ObtainWriteLock(&afs_xvcache, 1212);
+	    tvcp = afs_FindVCache(&tfid, &retry, IS_WLOCK /* no stats | LRU */ );
+	    if (tvcp && retry) {
+		ReleaseWriteLock(&afs_xvcache);
+		afs_PutVCache(tvcp);
+	    }
+	} while (tvcp && retry);
+	if (!tvcp) {
+	    tvcp = afs_NewBulkVCache(&tfid, NULL, statSeqNo);
+	    if (tvcp) {
+		ObtainWriteLock(&tvcp->lock, 1213);
+		ReleaseWriteLock(&afs_xvcache);
+		afs_RemoveVCB(&tfid);
+		ReleaseWriteLock(&tvcp->lock);
+	    } else {
+		ReleaseWriteLock(&afs_xvcache);
+		break;
+	    }
 	} else {
-	    tvcp->callback = 0;
-	    tvcp->f.states &= ~(CStatd | CUnique);
-	    afs_DequeueCallback(tvcp);
-	    if ((tvcp->f.states & CForeign) || (vType(tvcp) == VDIR))
-		osi_dnlc_purgedp(tvcp);	/* if it (could be) a directory */
+	    ReleaseWriteLock(&afs_xvcache);
+	    /* already known, or another chunk of a file we are fetching */
+	    if ((tvcp->f.states & (CStatd | CBulkFetching))
+		|| tvcp->execsOrWriters > 0 || afs_DirtyPages(tvcp)) {
+		afs_PutVCache(tvcp);
+		continue;
+	    }
+	    tvcp->f.states |= CBulkFetching;
+	    tvcp->f.m.Length = statSeqNo;
 	}
-#ifdef AFS_DARWIN80_ENV
-	/* reclaim->FlushVCache will need xcbhash */
-	if (((tvcp->f.states & CDeadVnode)||(tvcp->f.states & CVInit))) {
-	    ReleaseWriteLock(&afs_xcbhash);
-	    /* passing in a parent hangs getting the vnode lock */
-	    code = afs_darwin_finalizevnode(tvcp, NULL, NULL, 0, 1);
-	    if (code) {
-		/* It's gonna get recycled - shouldn't happen */
-		tvcp->callback = 0;
-		tvcp->f.states &= ~(CStatd | CUnique);
-		afs_DequeueCallback(tvcp);
-		if ((tvcp->f.states & CForeign) || (vType(tvcp) == VDIR))
-		    osi_dnlc_purgedp(tvcp); /* if it (could be) a directory */
-	    } else
-		/* re-acquire the usecount that finalizevnode disposed of */
-		vnode_ref(AFSTOV(tvcp));
-	} else
-#endif
-	ReleaseWriteLock(&afs_xcbhash);
-
-	ReleaseWriteLock(&tvcp->lock);
-	/* finally, we're done with the entry */
 	afs_PutVCache(tvcp);
-    }				/* for all files we got back */
 
-    /* finally return the pointer into the LRU queue */
-#ifdef AFS_DARWIN80_ENV
-    if (((lruvcp->f.states & CDeadVnode)||(lruvcp->f.states & CVInit)))
-	panic("vlru control point went dead before put\n");
-    AFS_GUNLOCK();
-    vnode_put(lruvp);
-    vnode_rele(lruvp);
-    AFS_GLOCK();
-#else
-    afs_PutVCache(lruvcp);
-#endif
+	tb = afs_WarmBatch(batches, &tfid, statSeqNo, areqp);
+	tb->fids[tb->nfids++] = tfid.Fid;
+	if (tb->nfids == WARM_BATCHSIZE) {
+	    afs_BulkStatFids(&tb->vfid, tb->fids, tb->nfids, statSeqNo,
+			     areqp);
+	    tb->nfids = 0;
+	}
+    }
+    for (i = 0; i < WARM_NBATCH; i++) {
+	tb = &batches[i];
+	if (tb->nfids > 0)
+	    afs_BulkStatFids(&tb->vfid, tb->fids, tb->nfids, statSeqNo,
+			     areqp);
+    }
+    osi_Free(batches, WARM_NBATCH * sizeof(*batches));
 
-  done:
-    /* Be sure to turn off the CBulkFetching flags */
-    for (i = flagIndex; i < fidIndex; i++) {
-	afid.Cell = adp->f.fid.Cell;
-	afid.Fid.Volume = adp->f.fid.Fid.Volume;
-	afid.Fid.Vnode = fidsp[i].Vnode;
-	afid.Fid.Unique = fidsp[i].Unique;
+    /* see how much of the cache turned out to be still good */
+    for (i = 0; i < afs_cacheFiles && !afs_shuttingdown; i++) {
+	ObtainWriteLock(&afs_xdcache, 1214);
+	if (afs_indexFlags[i] & (IFFree | IFDiscarded)) {
+	    ReleaseWriteLock(&afs_xdcache);
+	    continue;
+	}
+	tdc = afs_GetValidDSlot(i);
+	if (!tdc) {
+	    ReleaseWriteLock(&afs_xdcache);
+	    continue;
+	}
+	tfid = tdc->f.fid;
+	hset(versionNo, tdc->f.versionNo);
+	ReleaseReadLock(&tdc->tlock);
+	afs_PutDCache(tdc);
+	ReleaseWriteLock(&afs_xdcache);
+
+	if (tfid.Fid.Volume == 0 || afs_IsDynrootAnyFid(&tfid))
+	    continue;
 	do {
 	    retry = 0;
 	    ObtainReadLock(&afs_xvcache);
-	    tvcp = afs_FindVCache(&afid, &retry, 0 /* !stats&!lru */);
+	    tvcp = afs_FindVCache(&tfid, &retry, 0 /* !stats&!lru */);
 	    ReleaseReadLock(&afs_xvcache);
 	} while (tvcp && retry);
-	if (tvcp != NULL) {
-	    if ((tvcp->f.states & CBulkFetching)
-		&& (tvcp->f.m.Length == statSeqNo)) {
-		tvcp->f.states &= ~CBulkFetching;
-	    }
+	if (tvcp && (tvcp->f.states & CStatd)
+	    && hsame(tvcp->f.m.DataVersion, versionNo))
+	    reused++;
+	else
+	    stale++;
+	if (tvcp)
 	    afs_PutVCache(tvcp);
-	}
     }
-    if (volp)
-	afs_PutVolume(volp, READ_LOCK);
+    afs_stats_cmperf.warmChunksReused += reused;
+    afs_stats_cmperf.warmChunksStale += stale;
+    afs_warn("afs: warm restart: %d of %d cached chunks still valid\n",
+	     reused, reused + stale);
+#endif
+}
 
-  done2:
-    osi_FreeLargeSpace((char *)fidsp);
-    osi_Free((char *)statsp, AFSCBMAX * sizeof(AFSFetchStatus));
-    osi_Free((char *)cbsp, AFSCBMAX * sizeof(AFSCallBack));
-    return code;
+/*!
+ * Queue background bulk stats of adp from dirCookie, so that by the time a
+ * lookup stream reaches the entries beyond the ones just stat'ed, their
+ * status is already here.  Each request takes the next entries that are
+ * neither stat'ed nor being fetched, so several may be in flight at once;
+ * at most afs_bulkStatAhead are.  A stream that looks the same entry up
+ * again (stat, then getxattr, say) has not moved, so queue nothing new for
+ * it; each request would only rescan what the last one already covered.
+ *
+ * afs_DoBulkStat merges what it fetches in behind the most recently used
+ * half of VLRU, so this cannot push out entries that are in use, and a
+ * full stat cache is no reason to stop.
+ *
+ * \param adp       directory being read
+ * \param dirCookie where the lookup stream is in adp
+ * \param acred     credentials to bulk stat with
+ */
+static void
+afs_BulkStatAhead(struct vcache *adp, long dirCookie, afs_ucred_t *acred)
+{
+    if (adp->bulkStatCookie == dirCookie)
+	return;
+    while (afs_bulkStatsQueued < afs_bulkStatAhead) {
+	if (!afs_BQueue(BOP_BULKSTAT, adp, B_DONTWAIT, 0, acred,
+			(afs_size_t) dirCookie, 0, NULL, NULL, NULL))
+	    break;
+	afs_bulkStatsQueued++;
+	adp->bulkStatCookie = dirCookie;
+    }
 }
 
 /* was: (AFS_DEC_ENV) || defined(AFS_OSF30_ENV) || defined(AFS_NCR_ENV) */
@@ -1605,6 +1865,11 @@ afs_lookup(OSI_VC_DECL(adp), char *aname, struct vcache **avcp, afs_ucred_t *acr
 	hit = 1;
 	goto done;
 #endif /* linux22 */
+    } else if (!AFS_IS_DISCONNECTED && !sysState.allocked
+	       && osi_dnlc_negative(adp, tname)) {
+	/* we looked here already, and the directory hasn't changed since */
+	code = ENOENT;
+	goto done;
     }
 
     {				/* sub-block just to reduce stack usage */
@@ -1728,6 +1993,11 @@ afs_lookup(OSI_VC_DECL(adp), char *aname, struct vcache **avcp, afs_ucred_t *acr
 	if (code) {
 	    if (code != ENOENT) {
 		/*printf("LOOKUP dirLookupOff -> %d\n", code);*/
+	    } else if (!AFS_IS_DISCONNECTED && !sysState.allocked
+		       && !afs_IsDynroot(adp)) {
+		/* so that searches along a path don't read the directory
+		 * again for every name that isn't there */
+		osi_dnlc_enter(adp, tname, NULL, &versionNo);
 	    }
 	    goto done;
 	}
@@ -1749,10 +2019,16 @@ afs_lookup(OSI_VC_DECL(adp), char *aname, struct vcache **avcp, afs_ucred_t *acr
 		ReleaseReadLock(&afs_xvcache);
 	    } while (tvc && retry);
 
-	    if (!tvc || !(tvc->f.states & CStatd))
+	    if (!tvc || !(tvc->f.states & CStatd)) {
 		bulkcode = afs_DoBulkStat(adp, dirCookie, treq);
-	    else
+		if (!bulkcode)
+		    afs_BulkStatAhead(adp, dirCookie, acred);
+	    } else {
 		bulkcode = 0;
+		/* Using an entry we bulk stat'ed: keep ahead of the reader. */
+		if (tvc->f.states & CBulkStat)
+		    afs_BulkStatAhead(adp, dirCookie, acred);
+	    }
 
 	    /* if the vcache isn't usable, release it */
 	    if (tvc && !(tvc->f.states & CStatd)) {
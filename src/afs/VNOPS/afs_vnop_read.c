@@ -41,6 +41,12 @@ extern afs_hyper_t afs_indexCounter;	/* Fake time for marking index */
 void afs_PrefetchChunk(struct vcache *avc, struct dcache *adc,
 		       afs_ucred_t *acred, struct vrequest *areq);
 
+/* Is chunk ahead of the one that last started a read-ahead of avc, and
+ * within the window read ahead from it? */
+#define AFS_READAHEAD_SEQ(avc, chunk) \
+    ((avc)->readAheadChunk >= 0 && (chunk) > (avc)->readAheadChunk \
+     && (chunk) <= (avc)->readAheadChunk + ((avc)->readAhead > 0 ? (avc)->readAhead : 1))
+
 int
 afs_read(struct vcache *avc, struct uio *auio, afs_ucred_t *acred,
 	 int noLock)
@@ -185,6 +191,22 @@ afs_read(struct vcache *avc, struct uio *auio, afs_ucred_t *acred,
 	    }
 
 	    ObtainReadLock(&tdc->lock);
+	    /* On the first read of a chunk that was read ahead for a
+	     * sequential reader, see whether the read-ahead kept up.  Only
+	     * count each chunk once; readAheadChunk does not move when the
+	     * prefetch is skipped, so it cannot tell us that. */
+	    if (avc->readAhead > 1 && AFS_READAHEAD_SEQ(avc, tdc->f.chunk)
+		&& avc->readAheadCounted != tdc->f.chunk) {
+		avc->readAheadCounted = tdc->f.chunk;
+		if ((tdc->dflags & DFFetching) || (tdc->mflags & DFFetchReq)
+		    || hsame(avc->f.m.DataVersion, tdc->f.versionNo)) {
+		    afs_cmstats.readAheadInfo.hits++;
+		    afs_stats_cmperf.readAheadHits++;
+		} else {
+		    afs_cmstats.readAheadInfo.misses++;
+		    afs_stats_cmperf.readAheadMisses++;
+		}
+	    }
 	    /* now, first try to start transfer, if we'll need the data.  If
 	     * data already coming, we don't need to do this, obviously.  Type
 	     * 2 requests never return a null dcache entry, btw.
@@ -398,11 +420,110 @@ out:
     return code;
 }
 
+/* Largest read-ahead window, in chunks. */
+afs_int32 afs_readAheadMax = 8;
+
+/* Most chunks of one file that read-ahead keeps being fetched at once, each
+ * by its own background daemon and FetchData call.  It is further limited to
+ * a third of the background request table, so that one sequential reader
+ * leaves room for the prefetches and stores of others. */
+afs_int32 afs_fetchStripeWidth = 4;
+
+/* results of afs_PrefetchOne */
+#define AFS_PREFETCH_CACHED	0	/* chunk is already cached */
+#define AFS_PREFETCH_INFLIGHT	1	/* chunk is being or will be fetched */
+#define AFS_PREFETCH_FULL	2	/* background request table is full */
+
+/* Adjust the read-ahead window of avc now that the reader has reached
+ * chunk, and return it.  The window doubles each time the reader moves
+ * forward into the chunks read ahead last time, and is halved when it goes
+ * anywhere else, but is always at least one chunk.  The fields are only
+ * hints, so they are updated without a write lock. */
+static afs_int32
+afs_AdjustReadAhead(struct vcache *avc, afs_int32 chunk)
+{
+    afs_int32 window = avc->readAhead;
+
+    if (AFS_READAHEAD_SEQ(avc, chunk)) {
+	window = (window > 0) ? window * 2 : 2;
+	if (window > afs_readAheadMax)
+	    window = afs_readAheadMax;
+    } else {
+	window /= 2;
+    }
+    if (window < 1)
+	window = 1;
+    avc->readAhead = window;
+    avc->readAheadChunk = chunk;
+    return window;
+}
+
+/* Ask a background daemon to fetch the chunk starting at offset, unless it
+ * is already present or on its way.  Returns one of the AFS_PREFETCH_*
+ * values. */
+static int
+afs_PrefetchOne(struct vcache *avc, afs_size_t offset, afs_ucred_t *acred,
+		struct vrequest *areq)
+{
+    struct dcache *tdc;
+    afs_size_t j1, j2;		/* junk vbls for GetDCache to trash */
+    struct brequest *bp;
+
+    tdc = afs_FindDCache(avc, offset);
+    if (tdc) {
+	int code = -1;
+
+	ObtainReadLock(&tdc->lock);
+	if ((tdc->dflags & DFFetching) || (tdc->mflags & DFFetchReq))
+	    code = AFS_PREFETCH_INFLIGHT;
+	else if (hsame(avc->f.m.DataVersion, tdc->f.versionNo))
+	    code = AFS_PREFETCH_CACHED;
+	ReleaseReadLock(&tdc->lock);
+	afs_PutDCache(tdc);
+	if (code >= 0)
+	    return code;
+    }
+
+    tdc = afs_GetDCache(avc, offset, areq, &j1, &j2, 2);	/* type 2 never returns 0 */
+    /*
+     * In disconnected mode, type 2 can return 0 because it doesn't
+     * make any sense to allocate a dcache we can never fill
+     */
+    if (tdc == NULL)
+	return AFS_PREFETCH_CACHED;
+
+    ObtainSharedLock(&tdc->mflock, 651);
+    if (!(tdc->mflags & DFFetchReq)) {
+	/* ask the daemon to do the work */
+	UpgradeSToWLock(&tdc->mflock, 652);
+	tdc->mflags |= DFFetchReq;	/* guaranteed to be cleared by BKG or GetDCache */
+	/* last parm (1) tells bkg daemon to do an afs_PutDCache when it is done,
+	 * since we don't want to wait for it to finish before doing so ourselves.
+	 */
+	bp = afs_BQueue(BOP_FETCH, avc, B_DONTWAIT, 0, acred,
+			(afs_size_t) offset, (afs_size_t) 1, tdc,
+			(void *)0, (void *)0);
+	if (!bp) {
+	    /* Bkg table full; just abort non-important prefetching to avoid deadlocks */
+	    tdc->mflags &= ~DFFetchReq;
+	    ReleaseWriteLock(&tdc->mflock);
+	    afs_PutDCache(tdc);
+	    return AFS_PREFETCH_FULL;
+	}
+	ReleaseWriteLock(&tdc->mflock);
+    } else {
+	ReleaseSharedLock(&tdc->mflock);
+	afs_PutDCache(tdc);
+    }
+    return AFS_PREFETCH_INFLIGHT;
+}
+
 /* called with the dcache entry triggering the fetch, the vcache entry involved,
  * and a vrequest for the read call.  Marks the dcache entry as having already
- * triggered a prefetch, starts the prefetch going and sets the DFFetchReq
- * flag in the prefetched block, so that the next call to read knows to wait
- * for the daemon to start doing things.
+ * triggered a prefetch, starts prefetches of the chunks in the file's
+ * read-ahead window and sets the DFFetchReq flag in the prefetched blocks,
+ * so that the next call to read knows to wait for the daemon to start
+ * doing things.
  *
  * This function must be called with the vnode at least read-locked, and
  * no locks on the dcache, because it plays around with dcache entries.
@@ -411,66 +532,57 @@ void
 afs_PrefetchChunk(struct vcache *avc, struct dcache *adc,
 		  afs_ucred_t *acred, struct vrequest *areq)
 {
-    struct dcache *tdc;
     afs_size_t offset;
-    afs_size_t j1, j2;		/* junk vbls for GetDCache to trash */
+    afs_int32 chunk, window, width, inflight, i;
+    int code;
 
-    offset = adc->f.chunk + 1;	/* next chunk we'll need */
-    offset = AFS_CHUNKTOBASE(offset);	/* base of next chunk */
+    chunk = adc->f.chunk;
+    offset = AFS_CHUNKTOBASE(chunk + 1);	/* base of next chunk */
     ObtainReadLock(&adc->lock);
     ObtainSharedLock(&adc->mflock, 662);
     if (offset < avc->f.m.Length && !(adc->mflags & DFNextStarted)
 	&& !afs_BBusy()) {
-	struct brequest *bp;
-
 	UpgradeSToWLock(&adc->mflock, 663);
 	adc->mflags |= DFNextStarted;	/* we've tried to prefetch for this guy */
 	ReleaseWriteLock(&adc->mflock);
 	ReleaseReadLock(&adc->lock);
 
-	tdc = afs_GetDCache(avc, offset, areq, &j1, &j2, 2);	/* type 2 never returns 0 */
-        /*
-         * In disconnected mode, type 2 can return 0 because it doesn't
-         * make any sense to allocate a dcache we can never fill
-         */
-         if (tdc == NULL)
-             return;
-
-	ObtainSharedLock(&tdc->mflock, 651);
-	if (!(tdc->mflags & DFFetchReq)) {
-	    /* ask the daemon to do the work */
-	    UpgradeSToWLock(&tdc->mflock, 652);
-	    tdc->mflags |= DFFetchReq;	/* guaranteed to be cleared by BKG or GetDCache */
-	    /* last parm (1) tells bkg daemon to do an afs_PutDCache when it is done,
-	     * since we don't want to wait for it to finish before doing so ourselves.
-	     */
-	    bp = afs_BQueue(BOP_FETCH, avc, B_DONTWAIT, 0, acred,
-			    (afs_size_t) offset, (afs_size_t) 1, tdc,
-			    (void *)0, (void *)0);
-	    if (!bp) {
-		/* Bkg table full; just abort non-important prefetching to avoid deadlocks */
-		tdc->mflags &= ~DFFetchReq;
-		ReleaseWriteLock(&tdc->mflock);
-		afs_PutDCache(tdc);
-
-		/*
-		 * DCLOCKXXX: This is a little sketchy, since someone else
-		 * could have already started a prefetch..  In practice,
-		 * this probably doesn't matter; at most it would cause an
-		 * extra slot in the BKG table to be used up when someone
-		 * prefetches this for the second time.
-		 */
-		ObtainReadLock(&adc->lock);
-		ObtainWriteLock(&adc->mflock, 664);
-		adc->mflags &= ~DFNextStarted;
-		ReleaseWriteLock(&adc->mflock);
-		ReleaseReadLock(&adc->lock);
-	    } else {
-		ReleaseWriteLock(&tdc->mflock);
+	/* Fetch the chunks of the read-ahead window that are not cached yet,
+	 * with at most a stripe's worth of them in flight at once, and only
+	 * while there are idle background daemons. */
+	window = afs_AdjustReadAhead(avc, chunk);
+	width = afs_fetchStripeWidth;
+	if (width > NBRS / 3)
+	    width = NBRS / 3;
+	if (width < 1)
+	    width = 1;
+	inflight = 0;
+	for (i = 1; i <= window && inflight < width; i++) {
+	    offset = AFS_CHUNKTOBASE(chunk + i);
+	    if (offset >= avc->f.m.Length)
+		break;
+	    if (i > 1 && afs_BBusy())
+		break;
+	    code = afs_PrefetchOne(avc, offset, acred, areq);
+	    if (code == AFS_PREFETCH_INFLIGHT)
+		inflight++;
+	    if (code == AFS_PREFETCH_FULL) {
+		if (i == 1) {
+		    /*
+		     * DCLOCKXXX: This is a little sketchy, since someone else
+		     * could have already started a prefetch..  In practice,
+		     * this probably doesn't matter; at most it would cause an
+		     * extra slot in the BKG table to be used up when someone
+		     * prefetches this for the second time.
+		     */
+		    ObtainReadLock(&adc->lock);
+		    ObtainWriteLock(&adc->mflock, 664);
+		    adc->mflags &= ~DFNextStarted;
+		    ReleaseWriteLock(&adc->mflock);
+		    ReleaseReadLock(&adc->lock);
+		}
+		break;
 	    }
-	} else {
-	    ReleaseSharedLock(&tdc->mflock);
-	    afs_PutDCache(tdc);
 	}
     } else {
 	ReleaseSharedLock(&adc->mflock);
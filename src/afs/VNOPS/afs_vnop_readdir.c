@@ -88,10 +88,7 @@ BlobScan(struct dcache * afile, afs_int32 ablob, int *ablobOut)
 		relativeBlob = 1;
 	}
 	/* make sure blob is allocated */
-	for (i = relativeBlob; i < EPP; i++) {
-	    if (tpe->freebitmap[i >> 3] & (1 << (i & 7)))
-		break;
-	}
+	i = afs_dir_NextAllocBlob(tpe, relativeBlob);
 	/* now relativeBlob is the page-relative first allocated blob,
 	 * or EPP (if there are none in this page). */
 	DRelease(&headerbuf, 0);
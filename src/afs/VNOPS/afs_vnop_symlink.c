@@ -255,7 +255,7 @@ afs_symlink(OSI_VC_DECL(adp), char *aname, struct vattr *attrs,
 	 * under the afs_xvcache lock actually, afs_NewVCache may drop the 
 	 * afs_xvcache lock, if it calls afs_FlushVCache */
 	tvc->cbExpires = CallBack.ExpirationTime + now;
-	afs_QueueCallback(tvc, CBHash(CallBack.ExpirationTime), volp);
+	afs_QueueCallback(tvc, volp);
     } else {
 	tvc->cbExpires = 0x7fffffff;	/* never expires, they can't change */
 	/* since it never expires, we don't have to queue the callback */
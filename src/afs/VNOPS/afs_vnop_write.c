@@ -199,6 +199,38 @@ afs_UFSWriteUIO(struct vcache *avc, afs_dcache_id_t *inode, struct uio *tuiop)
     return code;
 }
 
+/* Most chunks a writer may fill before it has to wait for them to be stored.
+ * Each chunk filled is handed to a background daemon straight away, so
+ * close and fsync only have to store what is left.  0 turns write-behind
+ * off. */
+afs_int32 afs_writeBehindMax = 8;
+
+/* Called with avc write-locked when a write has filled a chunk of avc. */
+static int
+afs_WriteBehind(struct vcache *avc, afs_ucred_t *acred, struct vrequest *areq,
+		int noLock)
+{
+    if (afs_writeBehindMax <= 0 || AFS_IS_DISCONNECTED)
+	return 0;
+
+    avc->writeBehindChunks++;
+    if (!avc->writeBehindQueued) {
+	/* One request per file is enough: it keeps storing until no
+	 * more chunks have been filled. */
+	if (afs_BQueue(BOP_WRITE_BEHIND, avc, B_DONTWAIT, 0, acred,
+		       0, 0, NULL, NULL, NULL))
+	    avc->writeBehindQueued = 1;
+    }
+    if (avc->writeBehindChunks <= afs_writeBehindMax || noLock)
+	return 0;
+
+    /* The daemons are behind; store from here rather than let the
+     * writer dirty the whole cache. */
+    afs_Trace2(afs_iclSetp, CM_TRACE_PARTIALWRITE, ICL_TYPE_POINTER, avc,
+	       ICL_TYPE_OFFSET, ICL_HANDLE_OFFSET(avc->f.m.Length));
+    return afs_StoreAllSegments(avc, areq, AFS_ASYNC);
+}
+
 /* called on writes */
 int
 afs_write(struct vcache *avc, struct uio *auio, int aio,
@@ -378,6 +410,13 @@ afs_write(struct vcache *avc, struct uio *auio, int aio,
 #endif
 	ReleaseWriteLock(&tdc->lock);
 	afs_PutDCache(tdc);
+	if (offset + len == max) {
+	    code = afs_WriteBehind(avc, acred, treq, noLock);
+	    if (code) {
+		error = code;
+		break;
+	    }
+	}
 #if !defined(AFS_VM_RDWR_ENV)
 	/*
 	 * If write is implemented via VM, afs_DoPartialWrite() is called from
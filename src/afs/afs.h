@@ -144,6 +144,11 @@ struct sysname_info {
 #define	BOP_MOVE	5	 /* ptr1 afs_uspc_param ptr2 sname ptr3 dname */
 #endif
 #define BOP_PARTIAL_STORE 6     /* parm1 is chunk to store */
+#define BOP_WRITE_BEHIND 7	/* store full dirty chunks of vnode */
+#define BOP_BULKSTAT	8	/* parm1 is dir cookie to bulk stat from */
+#define BOP_WARMCACHE	9	/* revalidate the cache left from last boot */
+#define BOP_VOLREFRESH	10	/* parm1 is volume id, parm2 cell to refresh */
+#define BOP_RENEWCB	11	/* ptr1 is batch of callbacks to renew */
 
 #define	B_DONTWAIT	1	/* On failure return; don't wait */
 
@@ -580,6 +585,7 @@ struct chservinfo {
 #define VForeign		8	/* this is a non-afs volume */
 #define VPartVisible		16	/* Volume's partition is visible on the client */
 #define VHardMount		32	/* we are hard-mount waiting for the vol */
+#define VRefreshing		64	/* a background refresh is queued */
 
 enum repstate { not_busy, end_not_busy = 6, rd_busy, rdwr_busy, offline };
 
@@ -902,7 +908,7 @@ struct vcache {
     struct server *callback;	/* The callback host, if any */
     afs_uint32 cbExpires;	/* time the callback expires */
     struct afs_q callsort;	/* queue in expiry order, sort of */
-    struct axscache *Access;	/* a list of cached access bits */
+    struct axstable *Access;	/* cached access bits, by PAG or uid */
     afs_int32 last_looker;	/* pag/uid from last lookup here */
 #if	defined(AFS_SUN5_ENV)
     afs_int32 activeV;
@@ -917,6 +923,16 @@ struct vcache {
     char cachingStates;			/* Caching policies for this file */
     afs_uint32 cachingTransitions;		/* # of times file has flopped between caching and not */
 
+    afs_int32 readAhead;	/* read-ahead window, in chunks */
+    afs_int32 readAheadChunk;	/* chunk that last started read-ahead */
+    afs_int32 readAheadCounted;	/* chunk last counted in the read-ahead stats */
+
+    afs_int32 writeBehindChunks;	/* chunks filled since the last store */
+    char writeBehindQueued;	/* a BOP_WRITE_BEHIND request is pending */
+    char writeBehindActive;	/* write-behind is storing without avc->lock */
+
+    long bulkStatCookie;	/* dir cookie the last bulk stat ahead was queued at */
+
 #if defined(AFS_LINUX24_ENV)
     off_t next_seq_offset;	/* Next sequential offset (used by prefetch/readahead) */
 #elif defined(AFS_SUN5_ENV) || defined(AFS_SGI65_ENV)
@@ -1111,6 +1127,7 @@ struct cm_initparams {
 #define	IFDirtyPages	16      /* Solaris-only. contains dirty pages */
 #define	IFAnyPages	32
 #define	IFDiscarded	64	/* index entry in discardDCList */
+#define	IFProtected	128	/* 2Q: reloaded soon after eviction */
 
 #ifdef AFS_DARWIN100_ENV
 typedef user_addr_t iparmtype; /* 64 bit */
@@ -1215,6 +1232,7 @@ struct buffer {
   char dirty;
   char hashIndex;
   afs_rwlock_t lock;          /* the lock for this structure */
+  struct DirIndex *dirIndex;  /* lookup index, if this is page 0 of a dir */
 };
 
 /* kept on disk and in dcache entries */
@@ -1280,9 +1298,10 @@ struct dcache {
 /* afs_memcache.c */
 struct memCacheEntry {
   int size;                   /* # of valid bytes in this entry */
-  int dataSize;               /* size of allocated data area */
+  int dataSize;               /* bytes in the pages attached to this entry */
   afs_lock_t afs_memLock;
-  char *data;                 /* bytes */
+  char **pages;               /* pages holding the bytes, in order */
+  int maxPages;               /* # of slots in pages */
 };
 
 struct afs_FetchOutput {
@@ -1414,15 +1433,21 @@ extern struct brequest afs_brs[NBRS];	/* request structures */
  * daemon will also try to free space until the cache is at most 90% full by
  * chunks (CM_DCACHECOUNTFREEPCT - CM_DCACHEEXTRAPCT), but the 85% space limit
  * is the only limit that we must hit.
+ * If writers have had to wait for the cache to drain since the daemon last
+ * looked, it frees another CM_DCACHEAHEADPCT, to stay ahead of them.
  * afs_UFSWrite and afs_GetDCache (when it needs to fetch data) will wait on
  * afs_WaitForCacheDrain if the cache is 98% (CM_WAITFORDRAINPCT) full.
  * afs_GetDownD wakes those processes once the cache is 95% full
  * (CM_CACHESIZEDRAINEDPCT).
+ * Discarded chunks are truncated CM_DISCARDBATCH at a time, by as many
+ * truncation daemons as afsd started; only one of them evicts at a time.
  */
 #define CM_MAXDISCARDEDCHUNKS	16	/* # of chunks */
 #define CM_DCACHECOUNTFREEPCT	95	/* max pct of chunks in use */
 #define CM_DCACHESPACEFREEPCT	90	/* max pct of space in use */
 #define CM_DCACHEEXTRAPCT    	 5	/* extra to get when freeing */
+#define CM_DCACHEAHEADPCT	 5	/* more to get when writers have waited */
+#define CM_DISCARDBATCH		 8	/* discarded chunks truncated at once */
 #define CM_CACHESIZEDRAINEDPCT	95	/* wakeup processes when down to here. */
 #define CM_WAITFORDRAINPCT	98	/* sleep if cache is this full. */
 
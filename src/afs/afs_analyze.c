@@ -416,6 +416,7 @@ afs_Analyze(struct afs_conn *aconn, struct rx_connection *rxconn,
     struct volume *tvp = NULL;
     afs_int32 shouldRetry = 0;
     afs_int32 serversleft = 1;
+    int async;
     struct afs_stats_RPCErrors *aerrP;
     afs_uint32 address;
 
@@ -499,8 +500,10 @@ afs_Analyze(struct afs_conn *aconn, struct rx_connection *rxconn,
 			afs_warnuser
 		            ("afs: hard-mount waiting for a vlserver to return to service\n");
 		    }
+		    async = afs_CheckServersAsync();	/* probe while we wait */
 		    VSleep(hm_retry_int);
-		    afs_CheckServers(1, cellp);
+		    if (!async)
+			afs_CheckServers(1, cellp);
 		    shouldRetry = 1;
 
 		    if (warn) {
@@ -545,8 +548,10 @@ afs_Analyze(struct afs_conn *aconn, struct rx_connection *rxconn,
 			    afs_PrintServerErrors(areq, afid);
 			}
 
+			async = afs_CheckServersAsync();
 			VSleep(hm_retry_int);
-			afs_CheckServers(1, cellp);
+			if (!async)
+			    afs_CheckServers(1, cellp);
 			/* clear the black listed servers on this request. */
 			memset(areq->skipserver, 0, sizeof(areq->skipserver));
 
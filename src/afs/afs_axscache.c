@@ -15,172 +15,240 @@
 #include "afsincludes.h"	/* Afs-based standard headers */
 #include "afs/afs_stats.h"	/* statistics */
 #include "afs/stds.h"
-static struct axscache *afs_axsfreelist = NULL;
-
-#define NAXSs (1000 / sizeof(struct axscache))
-static struct xfreelist {
-    struct xfreelist *next;
-    struct axscache data[NAXSs];
-} *xfreemallocs = 0;
-static int afs_xaxscnt = 0;
+/*
+ * Tables of up to AXS_MINSIZE << (AXS_NCLASSES - 1) slots are carved out of
+ * slabs, with a free list for each size; the bigger ones that a file used by
+ * very many PAGs needs are allocated on their own.  Slabs are only freed at
+ * shutdown.  Free tables are chained through their first word.
+ */
+#define AXS_MINSIZE	4	/* slots in a new table */
+#define AXS_NCLASSES	5	/* sizes kept in slabs: 4, 8, 16, 32, 64 */
+
+/* bytes in a table of size slots, with its state bytes */
+#define AXS_BYTES(size) \
+    ((sizeof(struct axstable) - sizeof(struct axscache) + \
+      (size) * (sizeof(struct axscache) + 1) + 7) & ~7)
+
+#define axs_Hash(tp, id) \
+    ((afs_int32)(((afs_uint32)(id) * 0x9e3779b1) >> (tp)->shift))
+
+struct axsslab {
+    struct axsslab *next;
+};
+
+static struct axstable *axsFreeTables[AXS_NCLASSES];
+static struct axsslab *axsSlabs;
+static int afs_xaxscnt = 0;	/* slabs allocated */
 afs_rwlock_t afs_xaxs;
 
-/* takes an address of an access cache & uid, returns ptr */
-/* PRECONDITION: first field has been checked and doesn't match!
- * INVARIANT:  isparent(i,j) ^ isparent(j,i)  (ie, they switch around)
- */
-struct axscache *
-afs_SlowFindAxs(struct axscache **cachep, afs_int32 id)
+/* The slab class of a table of size slots, or -1 if it is too big. */
+static int
+axs_Class(int size)
 {
-    struct axscache *i, *j;
-
-    j = (*cachep);
-    i = j->next;
-    while (i) {
-	if (i->uid == id) {
-	    axs_Front(cachep, j, i);	/* maintain LRU queue */
-	    return (i);
-	}
+    int c;
 
-	if ((j = i->next)) {	/* ASSIGNMENT HERE! */
-	    if (j->uid == id) {
-		axs_Front(cachep, i, j);
-		return (j);
-	    }
-	} else
-	    return (NULL);
-	i = j->next;
+    for (c = 0; c < AXS_NCLASSES; c++) {
+	if (size == (AXS_MINSIZE << c))
+	    return c;
     }
-    return (NULL);
+    return -1;
 }
 
-
-struct axscache *
-axs_Alloc(void)
+/* Allocate an empty table of size slots.  Returns NULL if there is no
+ * memory; the caller just doesn't cache anything then. */
+static struct axstable *
+axs_Alloc(int size)
 {
-    struct axscache *i, *j;
-    struct xfreelist *h, *xsp;
-    int k;
-
-    ObtainWriteLock(&afs_xaxs, 174);
-    if ((i = afs_axsfreelist)) {
-	afs_axsfreelist = i->next;
-	ReleaseWriteLock(&afs_xaxs);
-	return i;
+    struct axstable *tp;
+    struct axsslab *slab;
+    int c, i, bytes;
+
+    bytes = AXS_BYTES(size);
+    c = axs_Class(size);
+    if (c < 0) {
+	tp = afs_osi_Alloc(bytes);
     } else {
-	h = afs_osi_Alloc(sizeof(struct xfreelist));
-	osi_Assert(h != NULL);
-	afs_xaxscnt++;
-	xsp = xfreemallocs;
-	xfreemallocs = h;
-	xfreemallocs->next = xsp;
-	i = j = h->data;
-	for (k = 0; k < NAXSs - 1; k++, i++) {
-	    i->uid = -2;
-	    i->axess = 0;
-	    i->next = ++j;	/* need j because order of evaluation not defined */
+	ObtainWriteLock(&afs_xaxs, 174);
+	if (axsFreeTables[c] == NULL) {
+	    slab = afs_osi_Alloc(AXS_SLABSIZE);
+	    if (slab != NULL) {
+		slab->next = axsSlabs;
+		axsSlabs = slab;
+		afs_xaxscnt++;
+		for (i = (AXS_SLABSIZE - sizeof(struct axsslab)) / bytes - 1;
+		     i >= 0; i--) {
+		    tp = (struct axstable *)((char *)(slab + 1) + i * bytes);
+		    *(struct axstable **)tp = axsFreeTables[c];
+		    axsFreeTables[c] = tp;
+		}
+	    }
 	}
-	i->uid = -2;
-	i->axess = 0;
-	i->next = NULL;
-	afs_axsfreelist = (h->data)->next;
+	tp = axsFreeTables[c];
+	if (tp != NULL)
+	    axsFreeTables[c] = *(struct axstable **)tp;
+	ReleaseWriteLock(&afs_xaxs);
     }
-    ReleaseWriteLock(&afs_xaxs);
-    return (h->data);
+    if (tp == NULL)
+	return NULL;
+
+    memset(tp, 0, bytes);
+    tp->size = size;
+    for (tp->shift = 32; size > 1; size >>= 1)
+	tp->shift--;
+    return tp;
 }
 
+static void
+axs_Free(struct axstable *tp)
+{
+    int c;
 
-#define axs_Free(axsp) { \
- ObtainWriteLock(&afs_xaxs,175);             \
- axsp->next = afs_axsfreelist;           \
- afs_axsfreelist = axsp;                 \
- ReleaseWriteLock(&afs_xaxs);            \
+    c = axs_Class(tp->size);
+    if (c < 0) {
+	afs_osi_Free(tp, AXS_BYTES(tp->size));
+	return;
+    }
+    ObtainWriteLock(&afs_xaxs, 175);
+    *(struct axstable **)tp = axsFreeTables[c];
+    axsFreeTables[c] = tp;
+    ReleaseWriteLock(&afs_xaxs);
 }
 
+/* The slot holding the entry for id, or -1. */
+static int
+axs_Slot(struct axstable *tp, afs_int32 id)
+{
+    int i, state;
+
+    /* There is always a free slot, so this ends. */
+    for (i = axs_Hash(tp, id);; i = (i + 1) & (tp->size - 1)) {
+	state = axs_State(tp, i);
+	if (state == AXS_FREE)
+	    return -1;
+	if (state == AXS_USED && tp->slot[i].uid == id)
+	    return i;
+    }
+}
 
-/* I optimize for speed on lookup, and don't give a RIP about delete.
- */
-void
-afs_RemoveAxs(struct axscache **headp, struct axscache *axsp)
+/* Put an entry for id, which must not be there already, into the first
+ * slot free for it. */
+static void
+axs_Put(struct axstable *tp, afs_int32 id, afs_int32 bits)
 {
-    struct axscache *i, *j;
+    int i;
+
+    for (i = axs_Hash(tp, id); axs_State(tp, i) == AXS_USED;
+	 i = (i + 1) & (tp->size - 1))
+	;
+    if (axs_State(tp, i) == AXS_FREE)
+	tp->used++;
+    axs_State(tp, i) = AXS_USED;
+    tp->slot[i].uid = id;
+    tp->slot[i].axess = bits;
+    tp->count++;
+}
 
-    if (*headp && axsp) {	/* is bullet-proofing really neccessary? */
-	if (*headp == axsp) {	/* most common case, I think */
-	    *headp = axsp->next;
-	    axs_Free(axsp);
-	    return;
-	}
+/* Look up the access bits cached for id in a table, which may be NULL. */
+struct axscache *
+afs_FindAxs(struct axstable *tp, afs_int32 id)
+{
+    int i;
 
-	i = *headp;
-	j = i->next;
+    AFS_STATCNT(afs_FindAxs);
+    if (tp != NULL && (i = axs_Slot(tp, id)) >= 0)
+	return &tp->slot[i];
+    afs_stats_cmperf.accessCacheMisses++;
+    return NULL;
+}
 
-	while (j) {
-	    if (j == axsp) {
-		i->next = j->next;
-		axs_Free(axsp);
-		return;
-	    }
-	    if ((i = j->next)) {	/* ASSIGNMENT HERE! */
-		j->next = i->next;
-		axs_Free(axsp);
-		return;
+/* Cache bits as the access of id, adding an entry if it has none. */
+void
+afs_InsertAxs(struct axstable **tpp, afs_int32 id, afs_int32 bits)
+{
+    struct axstable *tp, *ntp = NULL;
+    int i, size;
+
+    for (;;) {
+	tp = *tpp;
+	if (tp != NULL && (i = axs_Slot(tp, id)) >= 0) {
+	    tp->slot[i].axess = bits;
+	    goto out;
+	}
+	/* keep at least a quarter of the slots free */
+	if (tp != NULL && (tp->used + 1) * 4 <= tp->size * 3)
+	    break;
+
+	/* Rebuild the table, dropping its tombstones, at a size that leaves
+	 * it at most half full. */
+	size = AXS_MINSIZE;
+	while (size < ((tp ? tp->count : 0) + 1) * 2)
+	    size <<= 1;
+	if (ntp != NULL && ntp->size >= size) {
+	    if (tp != NULL) {
+		for (i = 0; i < tp->size; i++) {
+		    if (axs_State(tp, i) == AXS_USED)
+			axs_Put(ntp, tp->slot[i].uid, tp->slot[i].axess);
+		}
 	    }
+	    /* publish the new table before freeing the old one, as freeing
+	     * may sleep; then look again, as someone may have got in */
+	    *tpp = ntp;
+	    ntp = NULL;
+	    if (tp != NULL)
+		axs_Free(tp);
+	    continue;
 	}
+	if (ntp != NULL)
+	    axs_Free(ntp);
+	/* allocating may drop the global lock, so look again afterwards */
+	ntp = axs_Alloc(size);
+	if (ntp == NULL)
+	    return;
     }
-    /* end of "if neither pointer is NULL" */
-    return;			/* !#@  FAILED to find it! */
+    axs_Put(tp, id, bits);
+  out:
+    if (ntp != NULL)
+	axs_Free(ntp);
 }
 
-
-/*
- * Takes an entire list of access cache structs and prepends them, lock, stock,
- * and barrel, to the front of the freelist.
- */
+/* Remove an entry found with afs_FindAxs. */
 void
-afs_FreeAllAxs(struct axscache **headp)
+afs_RemoveAxs(struct axstable **tpp, struct axscache *axsp)
 {
-    struct axscache *i, *j;
-
-    i = *headp;
-    j = NULL;
-
-    while (i) {			/* chase down the list 'til we reach the end */
-	j = i->next;
-	if (!j) {
-	    ObtainWriteLock(&afs_xaxs, 176);
-	    i->next = afs_axsfreelist;	/* tack on the freelist to the end */
-	    afs_axsfreelist = *headp;
-	    ReleaseWriteLock(&afs_xaxs);
-	    *headp = NULL;
-	    return;
-	}
-	i = j->next;
+    struct axstable *tp = *tpp;
+
+    if (tp == NULL || axsp == NULL)
+	return;
+    axs_State(tp, axsp - tp->slot) = AXS_DEAD;
+    if (--tp->count == 0) {
+	*tpp = NULL;
+	axs_Free(tp);
     }
+}
 
-    if (j) {			/* we ran off the end of the list... */
-	ObtainWriteLock(&afs_xaxs, 177);
-	j->next = afs_axsfreelist;	/* tack on the freelist to the end */
-	afs_axsfreelist = *headp;
-	ReleaseWriteLock(&afs_xaxs);
+/* Throw away a whole table. */
+void
+afs_FreeAllAxs(struct axstable **tpp)
+{
+    struct axstable *tp = *tpp;
+
+    if (tp != NULL) {
+	*tpp = NULL;
+	axs_Free(tp);
     }
-    *headp = NULL;
-    return;
 }
 
 
 void
 shutdown_xscache(void)
 {
-    struct xfreelist *xp, *nxp;
+    struct axsslab *slab;
 
     AFS_RWLOCK_INIT(&afs_xaxs, "afs_xaxs");
-    xp = xfreemallocs;
-    while (xp) {
-	nxp = xp->next;
-	afs_osi_Free(xp, sizeof(struct xfreelist));
-	xp = nxp;
+    while ((slab = axsSlabs) != NULL) {
+	axsSlabs = slab->next;
+	afs_osi_Free(slab, AXS_SLABSIZE);
     }
-    afs_axsfreelist = NULL;
-    xfreemallocs = NULL;
+    afs_xaxscnt = 0;
+    memset(axsFreeTables, 0, sizeof(axsFreeTables));
 }
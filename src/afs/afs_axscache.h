@@ -11,39 +11,42 @@
 #define AFSAXCACHEH
 
 /*  Access cache -
- *  The way to use this package is:
- *  If the cache pointer is not NULL, call afs_findAxs, and if it's not
- *                                    NULL, use its access field
- *  Otherwise,
- *       axs_Alloc a new one,
- *       fill it in,
- *       insert it at the head of the list.
+ *  Each vcache keeps the access rights it has been told each user (PAG or
+ *  uid) has in a small open-addressed hash table.  The way to use it is:
+ *  call afs_FindAxs, and if it's not NULL, use (or update) its access field.
+ *  Otherwise call afs_AddAxs to add an entry.
  *
- *  Of course, don't forget to axs_Free them occasionally,
- *
- *  Alloc and Free need a lock on the freelist, the other guys are safe if the
- *  parent structure is locked, but probably REQUIRE the parent to be locked...
+ *  Unlike the list this replaces, lookups do not reorder anything, so they
+ *  write nothing but the statistics and take no lock.  Adding and removing
+ *  entries rely, as before, on the global lock (and the vcache lock, where
+ *  the caller has it) to keep them apart.  The tables come from per-size
+ *  free lists carved out of slabs, which afs_xaxs protects.
  */
 
 struct axscache {
-    afs_int32 uid;		/* most frequently used field, I think */
+    afs_int32 uid;
     afs_int32 axess;
-    struct axscache *next;
 };
 
-/* DON'T use this with a NULL pointer!
- * the quick check should cover 99.9% of the cases
- */
-#define afs_FindAxs(cachep,id) (((cachep)->uid == id) ? (cachep) : afs_SlowFindAxs(&(cachep),(id)))
+struct axstable {
+    afs_int32 size;		/* number of slots; a power of two */
+    afs_int32 shift;		/* 32 - log2(size), for hashing */
+    afs_int32 count;		/* slots holding an entry */
+    afs_int32 used;		/* slots holding an entry or a tombstone */
+    struct axscache slot[1];	/* really size of them, followed by a state
+				 * byte for each */
+};
+
+#define AXS_SLABSIZE	4096	/* bytes of tables allocated at once */
+
+/* states of a slot */
+#define AXS_FREE	0
+#define AXS_USED	1
+#define AXS_DEAD	2	/* entry was removed; keep probing past it */
 
-#define axs_Front(head,pp,p) {(pp)->next = (p)->next; (p)->next= *(head);*(head)=(p);}
+#define axs_State(tp, i) (((unsigned char *)&(tp)->slot[(tp)->size])[i])
 
-#define afs_AddAxs(cachep,id,bits) {   \
- struct axscache *ac;                  \
- if ((ac = axs_Alloc())) {               \
- ac->uid = (id);                         \
- ac->axess = (afs_int32)(bits);               \
- ac->next = (cachep);                    \
- cachep = ac; }}
+#define afs_AddAxs(cachep,id,bits) \
+    afs_InsertAxs(&(cachep), (id), (afs_int32)(bits))
 
 #endif
@@ -142,6 +142,7 @@ DInit(int abuffers)
 	tb->data = &BufferData[AFS_BUFFER_PAGESIZE * (i & (NPB - 1))];
 	tb->hashIndex = 0;
 	tb->dirty = 0;
+	tb->dirIndex = NULL;
 	AFS_RWLOCK_INIT(&tb->lock, "buffer lock");
     }
     return;
@@ -363,6 +364,7 @@ afs_newslot(struct dcache *adc, afs_int32 apage, struct buffer *lp)
 	    tp->data = &BufferData[AFS_BUFFER_PAGESIZE * i];
 	    tp->hashIndex = 0;
 	    tp->dirty = 0;
+	    tp->dirIndex = NULL;
 	    AFS_RWLOCK_INIT(&tp->lock, "buffer lock");
 	}
 	lp = &Buffers[nbuffers];
@@ -379,6 +381,12 @@ afs_newslot(struct dcache *adc, afs_int32 apage, struct buffer *lp)
 	AFS_STATS(afs_stats_cmperf.bufFlushDirty++);
     }
 
+    /* nobody has the old page held, so nobody is using its lookup index */
+    if (lp->dirIndex) {
+	afs_dir_FreeIndex(lp->dirIndex);
+	lp->dirIndex = NULL;
+    }
+
     /* Now fill in the header. */
     lp->fid = adc->index;
     afs_copy_inode(&lp->inode, &adc->f.inode);
@@ -408,6 +416,66 @@ DRelease(struct DirBuffer *entry, int flag)
     ReleaseWriteLock(&tp->lock);
 }
 
+/*!
+ * Return the lookup index kept with a directory's header page, if any.
+ * See dir.c.
+ *
+ * \param entry The held buffer of the directory's page 0.
+ */
+struct DirIndex *
+DGetIndex(struct DirBuffer *entry)
+{
+    struct buffer *tb = entry->buffer;
+    struct DirIndex *index;
+
+    ObtainReadLock(&tb->lock);
+    index = tb->dirIndex;
+    ReleaseReadLock(&tb->lock);
+    return index;
+}
+
+/*!
+ * Keep a lookup index with a directory's header page, unless someone
+ * already has.
+ *
+ * \param entry The held buffer of the directory's page 0.
+ * \param index The index to keep.
+ *
+ * \return The index now kept.
+ */
+struct DirIndex *
+DSetIndex(struct DirBuffer *entry, struct DirIndex *index)
+{
+    struct buffer *tb = entry->buffer;
+
+    ObtainWriteLock(&tb->lock, 702);
+    if (!tb->dirIndex)
+	tb->dirIndex = index;
+    index = tb->dirIndex;
+    ReleaseWriteLock(&tb->lock);
+    return index;
+}
+
+/*!
+ * Take back the lookup index kept with a directory's header page.
+ *
+ * \param entry The held buffer of the directory's page 0.
+ *
+ * \return The index, or NULL if there was none.
+ */
+struct DirIndex *
+DDropIndex(struct DirBuffer *entry)
+{
+    struct buffer *tb = entry->buffer;
+    struct DirIndex *index;
+
+    ObtainWriteLock(&tb->lock, 703);
+    index = tb->dirIndex;
+    tb->dirIndex = NULL;
+    ReleaseWriteLock(&tb->lock);
+    return index;
+}
+
 int
 DVOffset(struct DirBuffer *entry)
 {
@@ -448,6 +516,11 @@ DZap(struct dcache *adc)
 		tb->fid = NULLIDX;
 		afs_reset_inode(&tb->inode);
 		tb->dirty = 0;
+		/* a held buffer's index may be in use; afs_newslot frees it */
+		if (tb->dirIndex && tb->lockers == 0) {
+		    afs_dir_FreeIndex(tb->dirIndex);
+		    tb->dirIndex = NULL;
+		}
 		ReleaseWriteLock(&tb->lock);
 	    }
     ReleaseReadLock(&afs_bufferLock);
@@ -572,6 +645,8 @@ shutdown_bufferpackage(void)
     DFlush();
     if (afs_cold_shutdown) {
 	dinit_flag = 0;
+	for (i = 0; i < nbuffers; i++)
+	    afs_dir_FreeIndex(Buffers[i].dirIndex);
 	tp = Buffers;
 	for (i = 0; i < nbuffers; i += NPB, tp += NPB) {
 	    afs_osi_Free(tp->data, NPB * AFS_BUFFER_PAGESIZE);
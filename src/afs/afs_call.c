@@ -1106,6 +1106,9 @@ afs_syscall_call(long parm, long parm2, long parm3,
 	       (100 * afs_stats_cmperf.cacheFilesReused) /
 	       (afs_stats_cmperf.cacheNumEntries ? afs_stats_cmperf.
 		cacheNumEntries : 1));
+	if (afs_warmCache && afs_stats_cmperf.cacheFilesReused > 0)
+	    afs_BQueue(BOP_WARMCACHE, NULL, B_DONTWAIT, 0, afs_osi_credp,
+		       0, 0, NULL, NULL, NULL);
     } else if (parm == AFSOP_ADVISEADDR) {
 	/* pass in the host address to the rx package */
 	int rxbind = 0;
@@ -1313,6 +1316,22 @@ afs_syscall_call(long parm, long parm2, long parm3,
     } else if (parm == AFSOP_SET_RMTSYS_FLAG) {
 	afs_rmtsys_enable = parm2;
 	code = 0;
+    } else if (parm == AFSOP_SET_WARMCACHE) {
+	afs_warmCache = parm2;
+	code = 0;
+    } else if (parm == AFSOP_SET_CBRENEW) {
+	afs_cbRenew = parm2;
+	code = 0;
+    } else if (parm == AFSOP_SET_DCPOLICY) {
+	/* must come before AFSOP_CACHEINIT, which sizes the ghost list */
+	if (afs_cacheFiles)
+	    code = EBUSY;
+	else if (parm2 != AFS_DCPOLICY_LRU && parm2 != AFS_DCPOLICY_2Q)
+	    code = EINVAL;
+	else {
+	    afs_dcPolicy = parm2;
+	    code = 0;
+	}
 #ifndef UKERNEL
     } else if (parm == AFSOP_SEED_ENTROPY) {
 	unsigned char *seedbuf;
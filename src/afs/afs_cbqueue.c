@@ -13,20 +13,32 @@
  * whether a callback has expired or not, but can tell with one simple
  * check, that is, whether the CStatd bit is on or off.
  *
- * The base of the hash table moves periodically (every 128 seconds)
- * QueueCallback rarely touches the first 3 slots in the hash table
- * (only when called from CheckCallbacks) since MinTimeOut in
- * viced/callback.c is currently 7 minutes.
- * Therefore, CheckCallbacks should be able to run concurrently with
- * QueueCallback, given the proper locking, of course.
+ * Callbacks are kept in a two level timer wheel.  cbHashT is a table of
+ * CBHTSIZE slots, each covering CBHTSLOTLEN seconds, that moves on one slot
+ * every CBHTSLOTLEN seconds.  The slot at its base, which covers the next
+ * CBHTSLOTLEN seconds, is split up when it becomes due into cbFineT, a table
+ * of CBFINESIZE slots of CBFINESLOTLEN seconds each.  CheckCallbacks only
+ * looks at the fine slots that are due, so each callback is looked at about
+ * twice between being queued and expiring: once when its slot of cbHashT is
+ * split up, and once when its fine slot comes due.  The number of callbacks
+ * held makes no difference to how much work is done for each one.
+ *
+ * A callback is treated as running out up to CBJITTER seconds before it
+ * really does, by an amount that depends only on its fid, so that the many
+ * callbacks granted at once by a bulk stat, or by a whole-volume callback on
+ * a read-only volume, don't all run out, and get refetched, at once.
+ *
+ * If afs_cbRenew is set, the callbacks of open files on read-write volumes
+ * are looked at CBRENEWAHEAD seconds before they run out instead, and
+ * renewed by a bulk status fetch in the background (BOP_RENEWCB), so that
+ * files in constant use needn't ever wait on a FetchStatus.
  *
  * Note:
- * 1. CheckCallbacks and BumpBase never run simultaneously.  This is because
- * they are only called from afs_Daemon.  Therefore, base and basetime will
- * always be consistent during CheckCallbacks.
- * 2. cbHashT [base] rarely (if ever) gets stuff queued in it.  The only way
- * that could happen is CheckCallbacks might fencepost and move something in
- * place, or BumpBase might push some stuff up.
+ * 1. CheckCallbacks moves base on itself; it is only called from afs_Daemon,
+ * so only one instance of it runs at a time.
+ * 2. Callbacks that have run out on read-only volumes whose servers are all
+ * down aren't dropped, since we might as well keep using them; they are kept
+ * in cbLate, which is looked at every time CheckCallbacks runs.
  * 3. Hash chains aren't particularly sorted.
  * 4. The file server keeps its callback state around for 3 minutes
  * longer than it promises the cache manager in order to account for
@@ -38,14 +50,6 @@
  * but probably more than one.  In measurements on MP-safe implementations,
  * I have never seen any contention over the xcbhash lock.
  *
- * Incompatible operations:
- * Enqueue and "dequeue of first vcache" in same slot
- * dequeue and "dequeue of preceding vcache" in same slot
- * dequeue and "dequeue of successive vcache" in same slot
- * BumpBase pushing a list and enqueue in the new base slot
- * Two enqueues in same slot
- * more...
- *
  * Certain invariants exist:
  *    1  Callback expiration times granted by a file server will never
  *       decrease for a particular vnode UNLESS a CallBack RPC is invoked
@@ -56,8 +60,8 @@
  *       result, it may expire later than the slot in which it is enqueued.
  *       Not to worry, the CheckCallbacks code will move it if neccessary.
  *       This approach means that busy vnodes won't be continually moved
- *       around within the expiry queue: they are only moved when they
- *       finally advance to the lead bucket.
+ *       around within the expiry queue: they are only moved when their
+ *       slot finally comes due.
  *    3  Anything which has a callback on it must be in the expiry
  *       queue.  In AFS 3.3, that means everything but symlinks (which
  *       are immutable), including contents of Read-Only volumes
@@ -82,22 +86,96 @@
 #include "afs/lock.h"
 #include "afs/afs_stats.h"
 
-static unsigned int base = 0;
-static unsigned int basetime = 0;
+static unsigned int base = 0;	/* slot of cbHashT split up in cbFineT */
+static unsigned int basetime = 0;	/* when that slot's interval starts */
+static unsigned int fine = 0;	/* first slot of cbFineT not yet expired */
 static struct vcache *debugvc;	/* used only for post-mortem debugging */
 struct bucket {
     struct afs_q head;
     /*  struct afs_lock lock;  only if you want lots of locks... */
 };
 static struct bucket cbHashT[CBHTSIZE];
+static struct bucket cbFineT[CBFINESIZE];
+static struct bucket cbLate;	/* run out, but their servers are down */
 struct afs_lock afs_xcbhash;
 
+afs_int32 afs_cbRenew = 0;	/* renew the callbacks of open files early */
+
+/* Callbacks on one volume to be renewed together by afs_RenewCallbacks,
+ * with the tokens of one user.  Protected by afs_xcbhash. */
+#define CBRENEWBATCHES	4
+struct cbrenew {
+    int queued;			/* handed to a background daemon */
+    afs_int32 uid;		/* user whose tokens to use */
+    struct VenusFid fid;	/* cell and volume of the files */
+    int nfids;
+    AFSFid fids[AFSCBMAX];
+};
+static struct cbrenew cbRenewT[CBRENEWBATCHES];
+
+/* Sanity check on the callback queue. Allow for slop in the computation. */
+#if defined(AFS_LINUX22_ENV)
+#define CBQ_LIMIT (afs_maxvcount + 10)
+#else
+#define CBQ_LIMIT (afs_cacheStats + afs_stats_cmperf.vcacheXAllocs + 10)
+#endif
+
+/* when we stop believing avc's callback; a little before it runs out */
+static afs_uint32
+CBDue(struct vcache *avc)
+{
+    afs_uint32 jitter;
+
+    jitter = (((avc->f.fid.Fid.Vnode ^ avc->f.fid.Fid.Unique)
+	       * 2654435761U) >> 16) % CBJITTER;
+    return (avc->cbExpires > jitter) ? avc->cbExpires - jitter : 0;
+}
+
+/* is avc an open file whose callback we should try to renew early? */
+static int
+CBHot(struct vcache *avc)
+{
+    return afs_cbRenew && avc->opens > 0 && avc->Access
+	&& !(avc->f.states & (CRO | CForeign)) && avc->callback
+	&& !(avc->callback->flags & SRVR_ISDOWN);
+}
+
+/* when CheckCallbacks next has to look at avc */
+static afs_uint32
+CBWhen(struct vcache *avc)
+{
+    if (CBHot(avc) && avc->cbExpires > CBRENEWAHEAD)
+	return avc->cbExpires - CBRENEWAHEAD;
+    return CBDue(avc);
+}
+
+/* the bucket for something CheckCallbacks has to look at at time awhen */
+static struct bucket *
+CBBucket(afs_uint32 awhen)
+{
+    unsigned int slot;
+
+    if (awhen < basetime + CBHTSLOTLEN) {
+	slot = (awhen < basetime) ? 0 : (awhen - basetime) / CBFINESLOTLEN;
+	if (slot < fine)
+	    slot = fine;	/* overdue; don't leave it behind */
+	if (slot < CBFINESIZE)
+	    return &cbFineT[slot];
+	slot = 1;		/* CheckCallbacks is about to move base on */
+    } else {
+	slot = (awhen - basetime) / CBHTSLOTLEN;
+	if (slot >= CBHTSIZE)
+	    slot = CBHTSIZE - 1;	/* rehashed when its slot comes due */
+    }
+    return &cbHashT[(base + slot) % CBHTSIZE];
+}
+
 /* afs_QueueCallback
- * Takes a write-locked vcache pointer and a callback expiration time
- * as returned by the file server (ie, in units of 128 seconds from "now").
+ * Takes a write-locked vcache pointer, whose callback expiration time
+ * (cbExpires) has just been set from what the file server granted.
  *
- * Uses the time as an index into a hash table, and inserts the vcache
- * structure into the overflow chain.
+ * Uses the time to pick a slot in the timer wheel, and inserts the vcache
+ * structure into its chain.
  *
  * If the vcache is already on some hash chain, leave it there.
  * CheckCallbacks will get to it eventually.  In the meantime, it
@@ -108,13 +186,12 @@ struct afs_lock afs_xcbhash;
  */
 
 void
-afs_QueueCallback(struct vcache *avc, unsigned int atime, struct volume *avp)
+afs_QueueCallback(struct vcache *avc, struct volume *avp)
 {
     if (avp && (avp->expireTime < avc->cbExpires))
 	avp->expireTime = avc->cbExpires;
     if (!(avc->callsort.next)) {
-	atime = (atime + base) % CBHTSIZE;
-	QAdd(&(cbHashT[atime].head), &(avc->callsort));
+	QAdd(&(CBBucket(CBWhen(avc))->head), &(avc->callsort));
     }
 
     return;
@@ -127,8 +204,7 @@ afs_QueueCallback(struct vcache *avc, unsigned int atime, struct volume *avp)
  * for now, just get a lock on everything when doing the dequeue, don't
  * worry about getting a lock on the individual slot.
  *
- * the only other places that do anything like dequeues are CheckCallbacks
- * and BumpBase.
+ * the only other place that does anything like dequeues is CheckCallbacks.
  *
  * NOTE: The caller must hold a write lock on afs_xcbhash
  */
@@ -144,29 +220,182 @@ afs_DequeueCallback(struct vcache *avc)
     return;
 }				/* afs_DequeueCallback */
 
+/* Add an open file whose callback is about to run out to a batch to be
+ * renewed.  If there's no room, it will just run out. */
+static void
+CBRenewAdd(struct vcache *avc)
+{
+    struct axstable *tp = avc->Access;
+    struct cbrenew *tb, *empty = NULL;
+    afs_int32 uid;
+    int i;
+
+    /* use the tokens of someone who has been using it */
+    for (i = 0; i < tp->size; i++)
+	if (axs_State(tp, i) == AXS_USED)
+	    break;
+    if (i == tp->size)
+	return;
+    uid = tp->slot[i].uid;
+
+    for (tb = cbRenewT; tb < &cbRenewT[CBRENEWBATCHES]; tb++) {
+	if (tb->queued)
+	    continue;
+	if (tb->nfids == 0) {
+	    if (!empty)
+		empty = tb;
+	    continue;
+	}
+	if (tb->uid == uid && tb->fid.Cell == avc->f.fid.Cell
+	    && tb->fid.Fid.Volume == avc->f.fid.Fid.Volume)
+	    break;
+    }
+    if (tb == &cbRenewT[CBRENEWBATCHES]) {
+	if (!(tb = empty))
+	    return;
+	tb->uid = uid;
+	tb->fid = avc->f.fid;
+    }
+    if (tb->nfids == AFSCBMAX)
+	return;
+    for (i = 0; i < tb->nfids; i++)
+	if (tb->fids[i].Vnode == avc->f.fid.Fid.Vnode
+	    && tb->fids[i].Unique == avc->f.fid.Fid.Unique)
+	    return;		/* already asked for */
+    tb->fids[tb->nfids++] = avc->f.fid.Fid;
+}
+
+/* Take away the status of a vcache whose callback has run out. */
+static void
+CBUnstat(struct vcache *tvc)
+{
+    /* Do I need to worry about things like execsorwriters?
+     * What about locking xvcache or vrefcount++ or write locking tvc?
+     */
+    QRemove(&(tvc->callsort));
+    tvc->f.states &= ~(CStatd | CMValid | CUnique);
+    if (!(tvc->f.states & (CVInit|CVFlushed)) &&
+	(tvc->f.fid.Fid.Vnode & 1 || (vType(tvc) == VDIR)))
+	osi_dnlc_purgedp(tvc);
+}
+
+/*
+ * tvc's callback is about to run out.  Unstat it, unless it's on a
+ * read-only volume whose callback has been renewed (in which case take the
+ * volume's expiration time), or whose servers are all down (NB #1).
+ */
+static void
+CBExpire(struct vcache *tvc, afs_uint32 alimit)
+{
+    struct volume *tvp;
+    int i;
+
+    if ((tvc->f.states & CRO)
+	&& (tvp = afs_FindVolume(&(tvc->f.fid), READ_LOCK))) {
+	if (tvp->expireTime > tvc->cbExpires)
+	    tvc->cbExpires = tvp->expireTime;	/* XXX race here */
+	if (CBDue(tvc) < alimit) {
+	    for (i = 0; i < AFS_MAXHOSTS && tvp->serverHost[i]; i++) {
+		if (!(tvp->serverHost[i]->flags & SRVR_ISDOWN)) {
+		    CBUnstat(tvc);
+		    tvc->dchint = NULL;	/*invalidate em */
+		    afs_ExpireVolumeInfo(tvp);
+		    break;
+		}
+	    }
+	}
+	afs_PutVolume(tvp, READ_LOCK);
+    } else
+	CBUnstat(tvc);
+}
+
+/*
+ * Deal with everything in bucket ab that CheckCallbacks has to look at
+ * before alimit, and move anything whose callback has been renewed to where
+ * it now belongs.  Returns nonzero if the bucket looks corrupt.
+ */
+static int
+CBCheckBucket(struct bucket *ab, afs_uint32 alimit)
+{
+    struct vcache *tvc;
+    struct afs_q *tq;
+    struct afs_q *uq;
+    struct bucket *tb;
+    int safety;
+
+    for (safety = 0, tq = ab->head.prev;
+	 (safety <= CBQ_LIMIT) && (tq != &(ab->head));
+	 tq = uq, safety++) {
+
+	uq = QPrev(tq);
+	tvc = CBQTOV(tq);
+	if (CBWhen(tvc) >= alimit) {
+	    /* not due yet; it's been renewed on us, or it's overdue stuff
+	     * in the first fine slot */
+	    tb = CBBucket(CBWhen(tvc));
+	} else if (CBDue(tvc) >= alimit) {
+	    /* only its renewal is due */
+	    CBRenewAdd(tvc);
+	    tb = CBBucket(CBDue(tvc));
+	} else {
+	    CBExpire(tvc, alimit);	/* race #1 here */
+	    if (!QPrev(tq))
+		continue;
+	    tb = (CBDue(tvc) >= alimit) ? CBBucket(CBDue(tvc)) : &cbLate;
+	}
+	/* Have to be careful not to put it back into this bucket, or we may
+	 * never get out of here. */
+	if (tb != ab) {
+	    QRemove(tq);
+	    QAdd(&(tb->head), tq);
+	}
+    }
+    return (safety > CBQ_LIMIT);
+}
+
+/*
+ * Everything in base's interval has been dealt with; move base on to the
+ * next slot of cbHashT, and split that up into cbFineT.  Returns nonzero
+ * if the slot looks corrupt.
+ */
+static int
+CBAdvance(void)
+{
+    struct bucket *tb;
+    struct afs_q *tq;
+    struct afs_q *uq;
+    int safety;
+
+    basetime += CBHTSLOTLEN;
+    base = (base + 1) % CBHTSIZE;
+    fine = 0;
+    tb = &cbHashT[base];
+    for (safety = 0, tq = tb->head.prev;
+	 (safety <= CBQ_LIMIT) && (tq != &(tb->head));
+	 tq = uq, safety++) {
+	uq = QPrev(tq);
+	QRemove(tq);
+	QAdd(&(CBBucket(CBWhen(CBQTOV(tq)))->head), tq);
+    }
+    return (safety > CBQ_LIMIT);
+}
+
 /* afs_CheckCallbacks
  * called periodically to determine which callbacks are likely to
  * expire in the next n second interval.  Preemptively marks them as
- * expired.  Rehashes items which are now in the wrong hash bucket.
- * Preemptively renew recently-accessed items.  Only removes things
- * from the first and second bucket (as long as secs < 128), and
- * inserts things into other, later buckets.  either need to advance
- * to the second bucket if secs spans two intervals, or else be
- * certain to call afs_CheckCallbacks immediately after calling
- * BumpBase (allows a little more slop but it's ok because file server
- * keeps 3 minutes of slop time)
+ * expired.  Rehashes items which are now in the wrong bucket, and
+ * hands the callbacks of open files that are about to run out to a
+ * background daemon to renew.  Moves base on when its interval is
+ * done with.
  *
  * There is a little race between CheckCallbacks and any code which
  * updates cbExpires, always just prior to calling QueueCallback. We
  * don't lock the vcache struct here (can't, or we'd risk deadlock),
  * so GetVCache (for example) may update cbExpires before or after #1
- * below.  If before, CheckCallbacks moves this entry to its proper
- * slot.  If after, GetVCache blocks in the call to QueueCallbacks,
+ * in CBCheckBucket.  If before, CheckCallbacks moves this entry to its
+ * proper slot.  If after, GetVCache blocks in the call to QueueCallbacks,
  * this code dequeues the vcache, and then QueueCallbacks re-enqueues it.
  *
- * XXX to avoid the race, make QueueCallback take the "real" time
- * and update cbExpires under the xcbhash lock.
- *
  * NB #1: There's a little optimization here: if I go to invalidate a
  * RO vcache or volume, first check to see if the server is down.  If
  * it _is_, don't invalidate it, cuz we might just as well keep using
@@ -176,88 +405,31 @@ afs_DequeueCallback(struct vcache *avc)
  * Don't really need to invalidate the hints, we could just wait to see if
  * the dv has changed after a subsequent FetchStatus, but this is safer.
  */
-
-/* Sanity check on the callback queue. Allow for slop in the computation. */
-#if defined(AFS_LINUX22_ENV)
-#define CBQ_LIMIT (afs_maxvcount + 10)
-#else
-#define CBQ_LIMIT (afs_cacheStats + afs_stats_cmperf.vcacheXAllocs + 10)
-#endif
-
 void
 afs_CheckCallbacks(unsigned int secs)
 {
-    struct vcache *tvc;
-    struct afs_q *tq;
-    struct afs_q *uq;
-    afs_uint32 now;
-    struct volume *tvp;
-    int safety;
+    afs_uint32 limit;
+    struct cbrenew *tb;
+    int bad, i;
+    int mine[CBRENEWBATCHES];	/* batches this pass is handing off */
 
     ObtainWriteLock(&afs_xcbhash, 85);	/* pretty likely I'm going to remove something */
-    now = osi_Time();
-    for (safety = 0, tq = cbHashT[base].head.prev;
-	 (safety <= CBQ_LIMIT) && (tq != &(cbHashT[base].head));
-	 tq = uq, safety++) {
-
-	uq = QPrev(tq);
-	tvc = CBQTOV(tq);
-	if (tvc->cbExpires < now + secs) {	/* race #1 here */
-	    /* Get the volume, and if its callback expiration time is more than secs
-	     * seconds into the future, update this vcache entry and requeue it below
-	     */
-	    if ((tvc->f.states & CRO)
-		&& (tvp = afs_FindVolume(&(tvc->f.fid), READ_LOCK))) {
-		if (tvp->expireTime > now + secs) {
-		    tvc->cbExpires = tvp->expireTime;	/* XXX race here */
-		} else {
-		    int i;
-		    for (i = 0; i < AFS_MAXHOSTS && tvp->serverHost[i]; i++) {
-			if (!(tvp->serverHost[i]->flags & SRVR_ISDOWN)) {
-			    /* What about locking xvcache or vrefcount++ or
-			     * write locking tvc? */
-			    QRemove(tq);
-			    tvc->f.states &= ~(CStatd | CMValid | CUnique);
-                            if (!(tvc->f.states & (CVInit|CVFlushed)) &&
-                                (tvc->f.fid.Fid.Vnode & 1 ||
-                                 (vType(tvc) == VDIR)))
-				osi_dnlc_purgedp(tvc);
-			    tvc->dchint = NULL;	/*invalidate em */
-			    afs_ResetVolumeInfo(tvp);
-			    break;
-			}
-		    }
-		}
-		afs_PutVolume(tvp, READ_LOCK);
-	    } else {
-		/* Do I need to worry about things like execsorwriters?
-		 * What about locking xvcache or vrefcount++ or write locking tvc?
-		 */
-		QRemove(tq);
-		tvc->f.states &= ~(CStatd | CMValid | CUnique);
-                if (!(tvc->f.states & (CVInit|CVFlushed)) &&
-                    (tvc->f.fid.Fid.Vnode & 1 || (vType(tvc) == VDIR)))
-		    osi_dnlc_purgedp(tvc);
-	    }
-	}
-
-	if ((tvc->cbExpires > basetime) && CBHash(tvc->cbExpires - basetime)) {
-	    /* it's been renewed on us.  Have to be careful not to put it back
-	     * into this slot, or we may never get out of here.
-	     */
-	    int slot;
-	    slot = (CBHash(tvc->cbExpires - basetime) + base) % CBHTSIZE;
-	    if (slot != base) {
-		if (QPrev(tq))
-		    QRemove(&(tvc->callsort));
-		QAdd(&(cbHashT[slot].head), &(tvc->callsort));
-		/* XXX remember to update volume expiration time */
-		/* -- not needed for correctness, though */
-	    }
+    limit = osi_Time() + secs;
+    bad = CBCheckBucket(&cbLate, limit);
+    while (!bad) {
+	/* a fine slot is done with once its whole interval is before limit */
+	while (fine < CBFINESIZE && basetime + fine * CBFINESLOTLEN < limit) {
+	    bad = CBCheckBucket(&cbFineT[fine], limit);
+	    if (bad || basetime + (fine + 1) * CBFINESLOTLEN > limit)
+		break;
+	    fine++;
 	}
+	if (bad || fine < CBFINESIZE)
+	    break;
+	bad = CBAdvance();
     }
 
-    if (safety > CBQ_LIMIT) {
+    if (bad) {
 	afs_stats_cmperf.cbloops++;
 	if (afs_paniconwarn)
 	    osi_Panic("CheckCallbacks");
@@ -267,27 +439,145 @@ afs_CheckCallbacks(unsigned int secs)
 	ReleaseWriteLock(&afs_xcbhash);
 	afs_FlushCBs();
 	return;
-    } else
-	ReleaseWriteLock(&afs_xcbhash);
-
+    }
 
-/* XXX future optimization:
-   if this item has been recently accessed, queue up a stat for it.
-   {
-   struct dcache * adc;
+    /* batches queued by an earlier pass are still a daemon's; only
+     * hand off the ones filled since */
+    for (i = 0; i < CBRENEWBATCHES; i++) {
+	tb = &cbRenewT[i];
+	mine[i] = (tb->nfids > 0 && !tb->queued);
+	if (mine[i])
+	    tb->queued = 1;
+    }
+    ReleaseWriteLock(&afs_xcbhash);
 
-   ObtainReadLock(&afs_xdcache);
-   if ((adc = tvc->quick.dc) && (adc->stamp == tvc->quick.stamp)
-   && (afs_indexTimes[adc->index] > afs_indexCounter - 20)) {
-   queue up the stat request
-   }
-   ReleaseReadLock(&afs_xdcache);
-   }
-   */
+    for (i = 0; i < CBRENEWBATCHES; i++) {
+	tb = &cbRenewT[i];
+	if (mine[i]
+	    && !afs_BQueue(BOP_RENEWCB, NULL, B_DONTWAIT, 0, afs_osi_credp,
+			   0, 0, tb, NULL, NULL)) {
+	    /* no daemon to spare; let them run out */
+	    ObtainWriteLock(&afs_xcbhash, 1215);
+	    tb->nfids = 0;
+	    tb->queued = 0;
+	    ReleaseWriteLock(&afs_xcbhash);
+	}
+    }
 
     return;
 }				/* afs_CheckCallback */
 
+/* afs_RenewCallbacks
+ * Renew the callbacks on a batch of open files collected by
+ * afs_CheckCallbacks, with one bulk status fetch.  The new callback is only
+ * taken if nothing about the file can have changed: we still hold the old
+ * one, no callbacks at all were broken while the call was made, and the
+ * data version is the one we have.  Anything not renewed just runs out.
+ */
+void
+afs_RenewCallbacks(struct cbrenew *ab, afs_ucred_t *acred)
+{
+    AFSCBFids fidParm;
+    AFSBulkStats statParm;
+    AFSCBs cbParm;
+    AFSVolSync volSync;
+    AFSFetchStatus *statsp;
+    AFSCallBack *cbsp;
+    struct vrequest *treq = NULL;
+    struct afs_conn *tc;
+    struct rx_connection *rxconn;
+    struct server *hostp = NULL;
+    struct vcache *tvc;
+    struct VenusFid tfid;
+    afs_hyper_t dv;
+    afs_uint32 start = 0;
+    afs_int32 origCBs, retry;
+    int i, code;
+    XSTATS_DECLS;
+
+    AFS_STATCNT(afs_RenewCallbacks);
+    if (afs_CreateReq(&treq, acred))
+	goto done;
+    treq->uid = ab->uid;
+    statsp = osi_Alloc(AFSCBMAX * sizeof(AFSFetchStatus));
+    cbsp = osi_Alloc(AFSCBMAX * sizeof(AFSCallBack));
+
+    origCBs = afs_allCBs;
+    do {
+	fidParm.AFSCBFids_len = ab->nfids;
+	fidParm.AFSCBFids_val = ab->fids;
+	statParm.AFSBulkStats_len = ab->nfids;
+	statParm.AFSBulkStats_val = statsp;
+	cbParm.AFSCBs_len = ab->nfids;
+	cbParm.AFSCBs_val = cbsp;
+
+	/* callback expirations are relative to when we asked */
+	start = osi_Time();
+	tc = afs_Conn(&ab->fid, treq, SHARED_LOCK, &rxconn);
+	if (tc) {
+	    hostp = tc->parent->srvr->server;
+	    XSTATS_START_TIME(AFS_STATS_FS_RPCIDX_BULKSTATUS);
+	    code = RXGEN_OPCODE;
+	    if (!(hostp->flags & SNO_INLINEBULK)) {
+		RX_AFS_GUNLOCK();
+		code = RXAFS_InlineBulkStatus(rxconn, &fidParm, &statParm,
+					      &cbParm, &volSync);
+		RX_AFS_GLOCK();
+		if (code == RXGEN_OPCODE)
+		    hostp->flags |= SNO_INLINEBULK;
+	    }
+	    if (code == RXGEN_OPCODE) {
+		RX_AFS_GUNLOCK();
+		code = RXAFS_BulkStatus(rxconn, &fidParm, &statParm,
+					&cbParm, &volSync);
+		RX_AFS_GLOCK();
+	    }
+	    XSTATS_END_TIME;
+	    if (code == 0 && (statParm.AFSBulkStats_len != ab->nfids
+			      || cbParm.AFSCBs_len != ab->nfids))
+		code = -1;
+	} else
+	    code = -1;
+    } while (afs_Analyze(tc, rxconn, code, &ab->fid, treq,
+			 AFS_STATS_FS_RPCIDX_BULKSTATUS, SHARED_LOCK, NULL));
+
+    for (i = 0; code == 0 && i < ab->nfids; i++) {
+	if (statsp[i].errorCode || cbsp[i].ExpirationTime == 0)
+	    continue;
+	tfid.Cell = ab->fid.Cell;
+	tfid.Fid.Volume = ab->fid.Fid.Volume;
+	tfid.Fid.Vnode = ab->fids[i].Vnode;
+	tfid.Fid.Unique = ab->fids[i].Unique;
+	do {
+	    retry = 0;
+	    ObtainReadLock(&afs_xvcache);
+	    tvc = afs_FindVCache(&tfid, &retry, 0 /* !stats&!lru */);
+	    ReleaseReadLock(&afs_xvcache);
+	} while (tvc && retry);
+	if (!tvc)
+	    continue;
+	hset64(dv, statsp[i].dataVersionHigh, statsp[i].DataVersion);
+	ObtainWriteLock(&tvc->lock, 1216);
+	ObtainWriteLock(&afs_xcbhash, 1217);
+	if ((tvc->f.states & CStatd) && tvc->callback == hostp
+	    && origCBs == afs_allCBs && hsame(tvc->f.m.DataVersion, dv)
+	    && start + cbsp[i].ExpirationTime > tvc->cbExpires)
+	    tvc->cbExpires = start + cbsp[i].ExpirationTime;
+	ReleaseWriteLock(&afs_xcbhash);
+	ReleaseWriteLock(&tvc->lock);
+	afs_PutVCache(tvc);
+    }
+
+    osi_Free(statsp, AFSCBMAX * sizeof(AFSFetchStatus));
+    osi_Free(cbsp, AFSCBMAX * sizeof(AFSCallBack));
+    afs_DestroyReq(treq);
+  done:
+    ObtainWriteLock(&afs_xcbhash, 1218);
+    ab->nfids = 0;
+    ab->queued = 0;
+    ReleaseWriteLock(&afs_xcbhash);
+}
+
 /* afs_FlushCBs
  * to be used only in dire circumstances, this drops all callbacks on
  * the floor, without giving them back to the server.  It's ok, the server can
@@ -364,53 +654,12 @@ afs_InitCBQueue(int doLockInit)
 	/* Lock_Init(&(cbHashT[i].lock)); only if you want lots of locks, which
 	 * don't seem too useful at present.  */
     }
+    for (i = 0; i < CBFINESIZE; i++)
+	QInit(&(cbFineT[i].head));
+    QInit(&(cbLate.head));
     base = 0;
+    fine = 0;
     basetime = osi_Time();
     if (doLockInit)
 	Lock_Init(&afs_xcbhash);
 }
-
-/* Because there are no real-time guarantees, and especially because a
- * thread may wait on a lock indefinitely, this routine has to be
- * careful that it doesn't get permanently out-of-date.  Important
- * assumption: this routine is only called from afs_Daemon, so there
- * can't be more than one instance of this running at any one time.
- * Presumes that basetime is never 0, and is always sane.
- *
- * Before calling this routine, be sure that the first slot is pretty
- * empty.  This -20 is because the granularity of the checks in
- * afs_Daemon is pretty large, so I'd rather err on the side of safety
- * sometimes.  The fact that I only bump basetime by CBHTSLOTLEN-1
- * instead of the whole CBHTSLOTLEN is also for "safety".
- * Conceptually, it makes this clock run just a little faster than the
- * clock governing which slot a callback gets hashed into.  Both of these
- * things make CheckCallbacks work a little harder than it would have to
- * if I wanted to cut things finer.
- * Everything from the old first slot is carried over into the new first
- * slot.  Thus, if there were some things that ought to have been invalidated,
- * but weren't (say, if the server was down), they will be examined at every
- * opportunity thereafter.
- */
-int
-afs_BumpBase(void)
-{
-    afs_uint32 now;
-    int didbump;
-    u_int oldbase;
-
-    ObtainWriteLock(&afs_xcbhash, 87);
-    didbump = 0;
-    now = osi_Time();
-    while (basetime + (CBHTSLOTLEN - 20) <= now) {
-	oldbase = base;
-	basetime += CBHTSLOTLEN - 1;
-	base = (base + 1) % CBHTSIZE;
-	didbump++;
-	if (!QEmpty(&(cbHashT[oldbase].head))) {
-	    QCat(&(cbHashT[oldbase].head), &(cbHashT[base].head));
-	}
-    }
-    ReleaseWriteLock(&afs_xcbhash);
-
-    return didbump;
-}
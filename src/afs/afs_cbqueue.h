@@ -18,7 +18,14 @@
 #define CBHTSLOTLEN 128
 /* how many slots in the table */
 #define CBHTSIZE    128
-/* 7 is LOG2(slotlen) */
-#define CBHash(t) ((t)>>7)
+/* how many seconds in a slot of the fine table, which splits up the
+ * interval of the slot of the table that is due next */
+#define CBFINESLOTLEN 8
+#define CBFINESIZE  (CBHTSLOTLEN / CBFINESLOTLEN)
+/* a callback is treated as running out up to this many seconds early,
+ * depending on the file, so that those granted together are spread out */
+#define CBJITTER    32
+/* how long before an open file's callback runs out to try to renew it */
+#define CBRENEWAHEAD 120
 
 #define	CBQTOV(e)	    ((struct vcache *)(((char *) (e)) - (((char *)(&(((struct vcache *)(e))->callsort))) - ((char *)(e)))))
@@ -82,7 +82,21 @@ find_preferred_connection(struct sa_conn_vector *xcv, int create)
     afs_int32 cix, bix;
     struct afs_conn *tc = NULL;
 
+    /* Prefer the least busy of the connections we already have, so that
+     * concurrent calls (such as the chunk fetches of read-ahead) are spread
+     * over them rather than all queued on the first one. */
     bix = -1;
+    for(cix = 0; cix < CVEC_LEN; ++cix) {
+        tc = &(xcv->cvec[cix]);
+        if (tc->id && tc->refCount < (RX_MAXCALLS-1)
+            && (bix < 0 || tc->refCount < xcv->cvec[bix].refCount))
+            bix = cix;
+    }
+    if (bix >= 0) {
+        tc = &(xcv->cvec[bix]);
+        goto f_conn;
+    }
+
     for(cix = 0; cix < CVEC_LEN; ++cix) {
         tc = &(xcv->cvec[cix]);
         if (!tc->id) {
@@ -72,6 +72,25 @@ afs_SetCheckServerNATmode(int isnat)
     wasnat = isnat;
 }
 
+/* set to have the server check daemon probe the down servers right away */
+static int afs_CheckDownServersNow = 0;
+
+/*
+ * Have the down servers probed in the background now, rather than waiting
+ * for the next regular probe, so that a user process waiting for a server
+ * to come back need not do the probing itself.  Returns 0 if there is no
+ * server check daemon to do it.
+ */
+int
+afs_CheckServersAsync(void)
+{
+    if (!afs_CheckServerDaemonStarted)
+	return 0;
+    afs_CheckDownServersNow = 1;
+    afs_osi_CancelWait(&AFS_CSWaitHandler);
+    return 1;
+}
+
 void
 afs_CheckServerDaemon(void)
 {
@@ -92,7 +111,8 @@ afs_CheckServerDaemon(void)
 	}
 
 	now = osi_Time();
-	if (afs_probe_interval + lastCheck <= now) {
+	if (afs_CheckDownServersNow || afs_probe_interval + lastCheck <= now) {
+	    afs_CheckDownServersNow = 0;
 	    afs_CheckServers(1, NULL);	/* check down servers */
 	    lastCheck = now = osi_Time();
 	}
@@ -116,6 +136,8 @@ afs_CheckServerDaemon(void)
 	delay -= now;
 	if (delay < 1)
 	    delay = 1;
+	if (afs_CheckDownServersNow)
+	    continue;		/* asked for while we were probing */
 	afs_osi_Wait(delay * 1000, &AFS_CSWaitHandler, 0);
     }
     afs_CheckServerDaemonStarted = 0;
@@ -135,7 +157,6 @@ afs_Daemon(void)
     afs_int32 now;
     afs_int32 last3MinCheck, last10MinCheck, last60MinCheck, lastNMinCheck;
     afs_int32 last1MinCheck, last5MinCheck;
-    afs_uint32 lastCBSlotBump;
 
     AFS_STATCNT(afs_Daemon);
 
@@ -154,7 +175,6 @@ afs_Daemon(void)
     afs_osi_ctxtp_initialized = 1;
 #endif
     now = osi_Time();
-    lastCBSlotBump = now;
 
     /* when a lot of clients are booted simultaneously, they develop
      * annoying synchronous VL server bashing behaviors.  So we stagger them.
@@ -179,12 +199,6 @@ afs_Daemon(void)
 	rx_CheckPackets();	/* Does RX need more packets? */
 
 	now = osi_Time();
-	if (lastCBSlotBump + CBHTSLOTLEN < now) {	/* pretty time-dependant */
-	    lastCBSlotBump = now;
-	    if (afs_BumpBase()) {
-		afs_CheckCallbacks(20);	/* unstat anything which will expire soon */
-	    }
-	}
 
 	if (last1MinCheck + 60 < now) {
 	    /* things to do every minute */
@@ -282,9 +296,8 @@ afs_Daemon(void)
 	    afs_osi_Wakeup(&afs_initState);
 	}
 
-	/* 18285 is because we're trying to divide evenly into 128, that is,
-	 * CBSlotLen, while staying just under 20 seconds.  If CBSlotLen
-	 * changes, should probably change this interval, too.
+	/* 18285 is because we're trying to stay just under 20 seconds, the
+	 * time ahead that afs_CheckCallbacks unstats things.
 	 * Some of the preceding actions may take quite some time, so we
 	 * might not want to wait the entire interval */
 	now = 18285 - (osi_Time() - now);
@@ -598,6 +611,87 @@ BPartialStore(struct brequest *ab)
     afs_DestroyReq(treq);
 }
 
+/* Store the chunks a writer has filled so far, without waiting for close.
+ * The vnode lock is only held between stores, so the writer keeps going;
+ * chunks it fills meanwhile are picked up by the next pass.  Nobody waits
+ * for this request, so a failure is left in vc_error for the next close or
+ * fsync to return. */
+static void
+BWriteBehind(struct brequest *ab)
+{
+    struct vcache *tvc;
+    afs_int32 code;
+    struct vrequest *treq = NULL;
+
+    AFS_STATCNT(BStore);
+    tvc = ab->vc;
+    if ((code = afs_CreateReq(&treq, ab->cred))) {
+	tvc->writeBehindQueued = 0;
+	return;
+    }
+    ObtainWriteLock(&tvc->lock, 1210);
+    while (tvc->writeBehindChunks > 0 && (tvc->f.states & CDirty)) {
+	code = afs_StoreFilledSegments(tvc, treq);
+	if (code) {
+	    if (!tvc->vc_error)
+		tvc->vc_error = afs_CheckCode(code, treq, 431);
+	    break;
+	}
+    }
+    tvc->writeBehindQueued = 0;
+    ReleaseWriteLock(&tvc->lock);
+    afs_DestroyReq(treq);
+}
+
+/* Bulk stat a directory ahead of a lookup stream; queued by afs_lookup. */
+static void
+BBulkStat(struct brequest *ab)
+{
+    struct vcache *adp = ab->vc;
+    struct vrequest *treq = NULL;
+
+    /* nobody is reading the directory any more, so don't bother */
+    if (adp->opens > 0 && !afs_CreateReq(&treq, ab->cred)) {
+	afs_DoBulkStat(adp, (long)ab->size_parm[0], treq);
+	afs_DestroyReq(treq);
+    }
+    afs_bulkStatsQueued--;
+}
+
+/* Revalidate the cache left by the last boot; queued at AFSOP_GO. */
+static void
+BWarmCache(struct brequest *ab)
+{
+    struct vrequest *treq = NULL;
+
+    if (!afs_CreateReq(&treq, ab->cred)) {
+	afs_WarmCache(treq);
+	afs_DestroyReq(treq);
+    }
+}
+
+/* Refresh a volume's location before anyone needs it; queued by
+ * afs_ExpireVolumeInfo. */
+static void
+BRefreshVolume(struct brequest *ab)
+{
+    struct vrequest *treq = NULL;
+
+    if (!afs_CreateReq(&treq, ab->cred)) {
+	afs_RefreshVolume((afs_int32)ab->size_parm[0],
+			  (afs_int32)ab->size_parm[1], treq);
+	afs_DestroyReq(treq);
+    }
+}
+
+/* Renew the callbacks of open files before they run out; queued by
+ * afs_CheckCallbacks. */
+static void
+BRenewCallbacks(struct brequest *ab)
+{
+    afs_RenewCallbacks(ab->ptr_parm[0], ab->cred);
+}
+
 /* release a held request buffer */
 void
 afs_BRelease(struct brequest *ab)
@@ -1095,6 +1189,16 @@ afs_BackgroundDaemon(void)
 #endif
 	    else if (tb->opcode == BOP_PARTIAL_STORE)
 		BPartialStore(tb);
+	    else if (tb->opcode == BOP_WRITE_BEHIND)
+		BWriteBehind(tb);
+	    else if (tb->opcode == BOP_BULKSTAT)
+		BBulkStat(tb);
+	    else if (tb->opcode == BOP_WARMCACHE)
+		BWarmCache(tb);
+	    else if (tb->opcode == BOP_VOLREFRESH)
+		BRefreshVolume(tb);
+	    else if (tb->opcode == BOP_RENEWCB)
+		BRenewCallbacks(tb);
 	    else
 		panic("background bop");
 	    brequest_release(tb);
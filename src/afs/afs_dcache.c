@@ -24,7 +24,7 @@
 
 /* Forward declarations. */
 static void afs_GetDownD(int anumber, int *aneedSpace, afs_int32 buckethint);
-static int afs_FreeDiscardedDCache(void);
+static int afs_FreeDiscardedDCache(int abatch);
 static void afs_DiscardDCache(struct dcache *);
 static void afs_FreeDCache(struct dcache *);
 /* For split cache */
@@ -93,11 +93,20 @@ afs_size_t afs_vmMappingEnd;	/* !< For large files (>= 2GB) the VM
  * the cache is nearly full.
  */
 int afs_WaitForCacheDrain = 0;
-int afs_TruncateDaemonRunning = 0;
+int afs_TruncateDaemons = 0;		/* truncate daemons started */
+int afs_TruncateDaemonRunning = 0;	/* how many of them are awake */
+static int afs_TruncateDaemonEvicting = 0;	/* one of them is in GetDownD */
 int afs_CacheTooFull = 0;
 
 afs_int32 afs_dcentries;	/*!< In-memory dcache entries */
 
+afs_int32 afs_dcPolicy = AFS_DCPOLICY_LRU;	/*!< How GetDownD picks victims */
+static afs_uint32 *afs_dcGhosts;	/*!< 2Q: tags of chunks recently evicted
+					 * before being reused */
+static afs_int32 afs_dcGhostSize;	/*!< Slots in afs_dcGhosts */
+static afs_int32 afs_dcProbation;	/*!< 2Q: chunks cached on probation */
+static afs_int32 afs_dcProtected;	/*!< 2Q: chunks cached protected */
+
 
 int dcacheDisabled = 0;
 
@@ -396,23 +405,44 @@ afs_MaybeWakeupTruncateDaemon(void)
 {
     if (!afs_CacheTooFull && afs_CacheIsTooFull()) {
 	afs_CacheTooFull = 1;
-	if (!afs_TruncateDaemonRunning)
+	if (afs_TruncateDaemonRunning < afs_TruncateDaemons)
 	    afs_osi_Wakeup((int *)afs_CacheTruncateDaemon);
-    } else if (!afs_TruncateDaemonRunning
+    } else if (afs_TruncateDaemonRunning < afs_TruncateDaemons
 	       && afs_blocksDiscarded > CM_MAXDISCARDEDCHUNKS) {
 	afs_osi_Wakeup((int *)afs_CacheTruncateDaemon);
     }
 }
 
+/*!
+ * Account for the time a writer was held up waiting for the cache to
+ * drain, in the mean statistics of the call info xstat collection.  Only
+ * call this if the writer actually slept.
+ *
+ * \param astart When it started waiting.
+ */
+void
+afs_CacheDrainWaited(osi_timeval_t *astart)
+{
+    static afs_uint64 totalMs;	/* sum of the waits counted in elements */
+    struct afs_MeanStats *msp = &afs_cmstats.meanInfo.cacheDrainWait;
+    osi_timeval_t now, elapsed;
+
+    osi_GetuTime(&now);
+    afs_stats_GetDiff(elapsed, (*astart), now);
+    if (msp->elements == 0)
+	totalMs = 0;		/* the stats have been reset */
+    totalMs += (afs_uint64)elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000;
+    msp->elements++;
+    msp->average = (afs_int32)(totalMs / msp->elements);
+}
+
 /*!
  * /struct CTD_stats
  *
- * Keep statistics on run time for afs_CacheTruncateDaemon. This is a
- * struct so we need only export one symbol for AIX.
+ * Keep statistics on run time for afs_CacheTruncateDaemon, summed over all
+ * the daemons. This is a struct so we need only export one symbol for AIX.
  */
 static struct CTD_stats {
-    osi_timeval_t CTD_beforeSleep;
-    osi_timeval_t CTD_afterSleep;
     osi_timeval_t CTD_sleepTime;
     osi_timeval_t CTD_runTime;
     int CTD_nSleeps;
@@ -443,27 +473,45 @@ afs_WakeCacheWaitersIfDrained(void)
 
 /*!
  * Keeps the cache clean and free by truncating uneeded files, when used.
+ * afsd may start several of these; one at a time picks victims with
+ * afs_GetDownD, and all of them truncate discarded chunks in batches.
  * \param
  * \return
  */
 void
 afs_CacheTruncateDaemon(void)
 {
+    osi_timeval_t CTD_beforeSleep;
+    osi_timeval_t CTD_afterSleep;
     osi_timeval_t CTD_tmpTime;
     u_int counter;
     u_int cb_lowat;
+    u_int ahead = 0;
+    afs_int32 drainWaits = 0;
+    int stuck = 0;
     u_int dc_hiwat =
 	PERCENT((100 - CM_DCACHECOUNTFREEPCT + CM_DCACHEEXTRAPCT), afs_cacheFiles);
     afs_min_cache =
 	(((10 * AFS_CHUNKSIZE(0)) + afs_fsfragsize) & ~afs_fsfragsize) >> 10;
 
-    osi_GetuTime(&CTD_stats.CTD_afterSleep);
-    afs_TruncateDaemonRunning = 1;
+    osi_GetuTime(&CTD_afterSleep);
+    afs_TruncateDaemons++;
+    afs_TruncateDaemonRunning++;
     while (1) {
-	cb_lowat = PERCENT((CM_DCACHESPACEFREEPCT - CM_DCACHEEXTRAPCT), afs_cacheBlocks);
+	/* If writers have had to wait since we last looked, we are not
+	 * keeping up with them; free further ahead until they stop. */
+	if (afs_cmstats.meanInfo.cacheDrainWait.elements != drainWaits) {
+	    drainWaits = afs_cmstats.meanInfo.cacheDrainWait.elements;
+	    ahead = CM_DCACHEAHEADPCT;
+	} else if (!afs_CacheTooFull)
+	    ahead = 0;
+	cb_lowat = PERCENT((CM_DCACHESPACEFREEPCT - CM_DCACHEEXTRAPCT - ahead),
+			   afs_cacheBlocks);
 	ObtainWriteLock(&afs_xdcache, 266);
-	if (afs_CacheTooFull || afs_WaitForCacheDrain) {
+	if ((afs_CacheTooFull || afs_WaitForCacheDrain)
+	    && !afs_TruncateDaemonEvicting) {
 	    int space_needed, slots_needed;
+	    afs_TruncateDaemonEvicting = 1;
 	    /* if we get woken up, we should try to clean something out */
 	    for (counter = 0; counter < 10; counter++) {
 		space_needed =
@@ -486,6 +534,7 @@ afs_CacheTruncateDaemon(void)
 		afs_CacheTooFull = 0;
 		afs_WakeCacheWaitersIfDrained();
 	    }
+	    afs_TruncateDaemonEvicting = 0;
 	}	/* end of cache cleanup */
 	ReleaseWriteLock(&afs_xdcache);
 
@@ -497,16 +546,21 @@ afs_CacheTruncateDaemon(void)
 	 * threads get a chance to run.
 	 */
 	if ((afs_termState != AFSOP_STOP_TRUNCDAEMON) && afs_CacheTooFull
-	    && (!afs_blocksDiscarded || afs_WaitForCacheDrain)) {
+	    && (!afs_blocksDiscarded || stuck
+		|| (afs_WaitForCacheDrain && !afs_TruncateDaemonEvicting))) {
 	    afs_osi_Wait(100, 0, 0);	/* 100 milliseconds */
 	}
 
 	/*
-	 * This is where we free the discarded cache elements.
+	 * This is where we free the discarded cache elements.  If writers
+	 * are waiting, stop and go back to evicting, unless another daemon
+	 * is already doing that.
 	 */
-	while (afs_blocksDiscarded && !afs_WaitForCacheDrain
+	stuck = 0;
+	while (afs_blocksDiscarded
+	       && (!afs_WaitForCacheDrain || afs_TruncateDaemonEvicting)
 	       && (afs_termState != AFSOP_STOP_TRUNCDAEMON)) {
-	    int code = afs_FreeDiscardedDCache();
+	    int code = afs_FreeDiscardedDCache(CM_DISCARDBATCH);
 	    if (code) {
 		/* If we can't free any discarded dcache entries, that's okay.
 		 * We're just doing this in the background; if someone needs
@@ -514,6 +568,7 @@ afs_CacheTruncateDaemon(void)
 		 * signal us that the cache is too full. In any case, we'll
 		 * try doing this again the next time we run through the loop.
 		 */
+		stuck = 1;
 		break;
 	    }
 	}
@@ -525,23 +580,25 @@ afs_CacheTruncateDaemon(void)
 	    && (afs_termState != AFSOP_STOP_TRUNCDAEMON)) {
 	    /* Collect statistics on truncate daemon. */
 	    CTD_stats.CTD_nSleeps++;
-	    osi_GetuTime(&CTD_stats.CTD_beforeSleep);
-	    afs_stats_GetDiff(CTD_tmpTime, CTD_stats.CTD_afterSleep,
-			      CTD_stats.CTD_beforeSleep);
+	    osi_GetuTime(&CTD_beforeSleep);
+	    afs_stats_GetDiff(CTD_tmpTime, CTD_afterSleep, CTD_beforeSleep);
 	    afs_stats_AddTo(CTD_stats.CTD_runTime, CTD_tmpTime);
 
-	    afs_TruncateDaemonRunning = 0;
+	    afs_TruncateDaemonRunning--;
 	    afs_osi_Sleep((int *)afs_CacheTruncateDaemon);
-	    afs_TruncateDaemonRunning = 1;
+	    afs_TruncateDaemonRunning++;
 
-	    osi_GetuTime(&CTD_stats.CTD_afterSleep);
-	    afs_stats_GetDiff(CTD_tmpTime, CTD_stats.CTD_beforeSleep,
-			      CTD_stats.CTD_afterSleep);
+	    osi_GetuTime(&CTD_afterSleep);
+	    afs_stats_GetDiff(CTD_tmpTime, CTD_beforeSleep, CTD_afterSleep);
 	    afs_stats_AddTo(CTD_stats.CTD_sleepTime, CTD_tmpTime);
 	}
 	if (afs_termState == AFSOP_STOP_TRUNCDAEMON) {
-	    afs_termState = AFSOP_STOP_AFSDB;
-	    afs_osi_Wakeup(&afs_termState);
+	    /* the last one out moves shutdown on */
+	    afs_TruncateDaemonRunning--;
+	    if (--afs_TruncateDaemons == 0) {
+		afs_termState = AFSOP_STOP_AFSDB;
+		afs_osi_Wakeup(&afs_termState);
+	    }
 	    break;
 	}
     }
@@ -585,6 +642,105 @@ afs_AdjustSize(struct dcache *adc, afs_int32 newSize)
 }
 
 
+/*
+ * The 2Q replacement policy.
+ *
+ * Plain LRU lets a single pass over a large file or tree push everything
+ * else out of the cache, however often it was being used.  Under 2Q a new
+ * chunk starts out on probation, and GetDownD takes its victims from the
+ * probationary chunks as long as they are more than a quarter of the
+ * chunks cached.  When a probationary chunk is evicted its [fid, chunk] is
+ * remembered in the ghost list; if it is read back in while still
+ * remembered, it was evicted too early, and it comes back protected
+ * (IFProtected), to be evicted only when probation has shrunk to its
+ * quarter.  Chunks that a scan reads once never get protected.
+ *
+ * The ghost list is a direct-mapped table of tags with twice as many
+ * slots as there are cache files; a chunk is forgotten when a later
+ * eviction's tag lands on its slot, which on average takes about that
+ * many evictions.  Both lists are kept in LRU order by afs_indexTimes,
+ * like the whole cache is under plain LRU, and afs_dcProbation and
+ * afs_dcProtected count how many chunks are on each.
+ *
+ * All of this is under afs_xdcache(W).
+ *
+ * src/venus/dcsim.c replays traces against a model of the code from
+ * afs_DCGhostTag to the end of afs_GetDownD, and will not build once that
+ * code changes until the model has been updated to match.
+ */
+
+/* nonzero tag for the ghost list; 0 marks an empty slot */
+static afs_uint32
+afs_DCGhostTag(struct VenusFid *afid, afs_int32 chunk)
+{
+    afs_uint32 tag;
+
+    tag = afid->Fid.Volume * 0x9e3779b1;
+    tag ^= afid->Fid.Vnode * 0x85ebca6b;
+    tag ^= afid->Fid.Unique * 0xc2b2ae35;
+    tag ^= (afs_uint32)chunk * 0x27d4eb2f;
+    return tag | 1;
+}
+
+/* remember that the probationary chunk adc is being evicted */
+static void
+afs_DCGhostAdd(struct dcache *adc)
+{
+    afs_uint32 tag;
+
+    if (!afs_dcGhosts)
+	return;
+    tag = afs_DCGhostTag(&adc->f.fid, adc->f.chunk);
+    afs_dcGhosts[tag % afs_dcGhostSize] = tag;
+}
+
+/* set up the policy state of a newly allocated dcache entry */
+static void
+afs_DCAdmit(struct dcache *adc)
+{
+    afs_uint32 tag;
+    afs_int32 slot;
+
+    afs_indexFlags[adc->index] &= ~IFProtected;
+    if (afs_dcGhosts) {
+	tag = afs_DCGhostTag(&adc->f.fid, adc->f.chunk);
+	slot = tag % afs_dcGhostSize;
+	if (afs_dcGhosts[slot] == tag) {
+	    afs_dcGhosts[slot] = 0;
+	    afs_indexFlags[adc->index] |= IFProtected;
+	    afs_stats_cmperf.dcacheGhostHits++;
+	}
+    }
+    if (afs_indexFlags[adc->index] & IFProtected)
+	afs_dcProtected++;
+    else
+	afs_dcProbation++;
+}
+
+/* take a chunk that is leaving the cache off its 2Q list's count */
+static void
+afs_DCForget(struct dcache *adc)
+{
+    if (afs_indexFlags[adc->index] & (IFFree | IFDiscarded))
+	return;			/* not cached, so not counted */
+    if (afs_indexFlags[adc->index] & IFProtected)
+	afs_dcProtected--;
+    else
+	afs_dcProbation--;
+}
+
+/*
+ * Decide which 2Q list GetDownD should take victims from: the protected
+ * one only once probation is down to a quarter of the chunks cached.  Count
+ * chunks rather than compare with afs_cacheFiles, as a cache usually runs
+ * out of blocks long before it runs out of files.
+ */
+static int
+afs_DCWantProtected(void)
+{
+    return afs_dcProbation <= (afs_dcProbation + afs_dcProtected) / 4;
+}
+
 /*!
  * This routine is responsible for moving at least one entry (but up
  * to some number of them) from the LRU queue to the free queue.
@@ -626,6 +782,7 @@ afs_GetDownD(int anumber, int *aneedSpace, afs_int32 buckethint)
     afs_uint32 maxVictimPtr;	/* where it is */
     int discard;
     int curbucket;
+    int twoq, wantProtected = 0;
 
     AFS_STATCNT(afs_GetDownD);
 
@@ -665,17 +822,28 @@ afs_GetDownD(int anumber, int *aneedSpace, afs_int32 buckethint)
 	/* turn off all flags */
 	afs_indexFlags[i] &= ~IFFlag;
 
+    /* Under 2Q, start out taking victims from one list only; if that
+     * finds nothing we can use, fall back to LRU over the whole cache
+     * before going on to the later phases. */
+    twoq = (afs_dcPolicy == AFS_DCPOLICY_2Q);
+
     while (anumber > 0 || (aneedSpace && *aneedSpace > 0)) {
 	/* find oldest entries for reclamation */
 	maxVictimPtr = victimPtr = 0;
 	hzero(maxVictimTime);
 	curbucket = afs_DCWhichBucket(phase, buckethint);
+	if (twoq)
+	    wantProtected = afs_DCWantProtected();
 	/* select victims from access time array */
 	for (i = 0; i < afs_cacheFiles; i++) {
 	    if (afs_indexFlags[i] & (IFDataMod | IFFree | IFDiscarded)) {
 		/* skip if dirty or already free */
 		continue;
 	    }
+	    if (twoq && !(afs_indexFlags[i] & IFProtected) != !wantProtected) {
+		/* not on the 2Q list we are taking from */
+		continue;
+	    }
 	    tdc = afs_indexTable[i];
 	    if (tdc && (curbucket != tdc->bucket) && (phase < 4))
 	    {
@@ -883,6 +1051,14 @@ afs_GetDownD(int anumber, int *aneedSpace, afs_int32 buckethint)
 			       ICL_TYPE_INT32, tdc->index, ICL_TYPE_OFFSET,
 			       ICL_HANDLE_OFFSET(tchunkoffset));
 		    AFS_STATCNT(afs_gget);
+		    afs_stats_cmperf.dcacheEvictions++;
+		    afs_Trace4(afs_iclSetp, CM_TRACE_DCACHEEVICT, ICL_TYPE_FID,
+			       &tdc->f.fid, ICL_TYPE_INT32, tdc->f.chunk,
+			       ICL_TYPE_INT32, tdc->f.chunkBytes,
+			       ICL_TYPE_INT32,
+			       (afs_indexFlags[tdc->index] & IFProtected) != 0);
+		    if (!(afs_indexFlags[tdc->index] & IFProtected))
+			afs_DCGhostAdd(tdc);
 		    afs_HashOutDCache(tdc, 1);
 		    if (tdc->f.chunkBytes != 0) {
 			discard = 1;
@@ -905,6 +1081,13 @@ afs_GetDownD(int anumber, int *aneedSpace, afs_int32 buckethint)
 		afs_PutDCache(tdc);
 	} 			/* end of for victims loop */
 
+	if (twoq && j == 0) {
+	    /* nothing usable on the 2Q list; retry with plain LRU */
+	    twoq = 0;
+	    for (i = 0; i < afs_cacheFiles; i++)
+		afs_indexFlags[i] &= ~IFFlag;
+	    continue;
+	}
 	if (phase < 5) {
 	    /* Phase is 0 and no one was found, so try phase 1 (ignore
 	     * osi_Active flag) */
@@ -1052,6 +1235,7 @@ afs_FreeDCache(struct dcache *adc)
      * written out (set DFEntryMod).
      */
 
+    afs_DCForget(adc);
     afs_dvnextTbl[adc->index] = afs_freeDCList;
     afs_freeDCList = adc->index;
     afs_freeDCCount++;
@@ -1090,6 +1274,7 @@ afs_DiscardDCache(struct dcache *adc)
     afs_blocksDiscarded += size;
     afs_stats_cmperf.cacheBlocksDiscarded = afs_blocksDiscarded;
 
+    afs_DCForget(adc);
     afs_dvnextTbl[adc->index] = afs_discardDCList;
     afs_discardDCList = adc->index;
     afs_discardDCCount++;
@@ -1130,17 +1315,20 @@ afs_GetDSlotFromList(afs_int32 *indexp)
 }
 
 /*!
- * Free the next element on the list of discarded cache elements.
+ * Free up to abatch elements from the list of discarded cache elements,
+ * truncating them without holding afs_xdcache.  When several truncate
+ * daemons are running, each takes no more than its share of the list.
  *
  * Returns -1 if we encountered an error preventing us from freeing a
  * discarded dcache, or 0 on success.
  */
 static int
-afs_FreeDiscardedDCache(void)
+afs_FreeDiscardedDCache(int abatch)
 {
-    struct dcache *tdc;
+    struct dcache *tdc[CM_DISCARDBATCH];
     struct osi_file *tfile;
     afs_int32 size;
+    int i, n;
 
     AFS_STATCNT(afs_FreeDiscardedDCache);
 
@@ -1150,41 +1338,52 @@ afs_FreeDiscardedDCache(void)
 	return 0;
     }
 
+    if (afs_TruncateDaemons > 1
+	&& abatch > afs_discardDCCount / afs_TruncateDaemons + 1)
+	abatch = afs_discardDCCount / afs_TruncateDaemons + 1;
+    if (abatch > CM_DISCARDBATCH)
+	abatch = CM_DISCARDBATCH;
+
     /*
-     * Get an entry from the list of discarded cache elements
+     * Get entries from the list of discarded cache elements
      */
-    tdc = afs_GetDSlotFromList(&afs_discardDCList);
-    if (!tdc) {
-	ReleaseWriteLock(&afs_xdcache);
-	return -1;
+    for (n = 0; n < abatch; n++) {
+	tdc[n] = afs_GetDSlotFromList(&afs_discardDCList);
+	if (!tdc[n])
+	    break;
+	afs_discardDCCount--;
+	size = ((tdc[n]->f.chunkBytes + afs_fsfragsize) ^ afs_fsfragsize) >> 10;	/* round up */
+	afs_blocksDiscarded -= size;
+	/* We can lock because we just took it off the free list */
+	ObtainWriteLock(&tdc[n]->lock, 626);
     }
-
-    afs_discardDCCount--;
-    size = ((tdc->f.chunkBytes + afs_fsfragsize) ^ afs_fsfragsize) >> 10;	/* round up */
-    afs_blocksDiscarded -= size;
     afs_stats_cmperf.cacheBlocksDiscarded = afs_blocksDiscarded;
-    /* We can lock because we just took it off the free list */
-    ObtainWriteLock(&tdc->lock, 626);
     ReleaseWriteLock(&afs_xdcache);
+    if (n == 0)
+	return -1;
 
     /*
-     * Truncate the element to reclaim its space
+     * Truncate the elements to reclaim their space
      */
-    tfile = afs_CFileOpen(&tdc->f.inode);
-    afs_CFileTruncate(tfile, 0);
-    afs_CFileClose(tfile);
-    afs_AdjustSize(tdc, 0);
-    afs_DCMoveBucket(tdc, 0, 0);
+    for (i = 0; i < n; i++) {
+	tfile = afs_CFileOpen(&tdc[i]->f.inode);
+	afs_CFileTruncate(tfile, 0);
+	afs_CFileClose(tfile);
+	afs_AdjustSize(tdc[i], 0);
+	afs_DCMoveBucket(tdc[i], 0, 0);
+    }
 
     /*
-     * Free the element we just truncated
+     * Free the elements we just truncated
      */
     ObtainWriteLock(&afs_xdcache, 511);
-    afs_indexFlags[tdc->index] &= ~IFDiscarded;
-    afs_FreeDCache(tdc);
-    tdc->f.states &= ~(DRO|DBackup|DRW);
-    ReleaseWriteLock(&tdc->lock);
-    afs_PutDCache(tdc);
+    for (i = 0; i < n; i++) {
+	afs_FreeDCache(tdc[i]);
+	afs_indexFlags[tdc[i]->index] &= ~IFDiscarded;
+	tdc[i]->f.states &= ~(DRO|DBackup|DRW);
+	ReleaseWriteLock(&tdc[i]->lock);
+	afs_PutDCache(tdc[i]);
+    }
     ReleaseWriteLock(&afs_xdcache);
 
     return 0;
@@ -1205,7 +1404,7 @@ afs_MaybeFreeDiscardedDCache(void)
     while (afs_blocksDiscarded
 	   && (afs_blocksUsed >
 	       PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks))) {
-	int code = afs_FreeDiscardedDCache();
+	int code = afs_FreeDiscardedDCache(1);
 	if (code) {
 	    /* Callers depend on us to get the afs_blocksDiscarded count down.
 	     * If we cannot do that, the callers can spin by calling us over
@@ -1500,6 +1699,27 @@ afs_DCacheMissingChunks(struct vcache *avc)
     return (totalChunks);
 }
 
+/*
+ * afs_TraceDCacheRef
+ *
+ * Description:
+ *	Log a reference by afs_GetDCache to the chunk of avc holding abyte,
+ *	for fstrace.  Together with the CM_TRACE_DCACHEFIND and
+ *	CM_TRACE_DCACHEEVICT records, this is what dcsim replays.
+ *
+ * Parameters:
+ *	avc   : Pointer to the vcache entry.
+ *	abyte : Which byte was wanted.
+ *	hit   : Set if the chunk was in the cache and current.
+ */
+static_inline void
+afs_TraceDCacheRef(struct vcache *avc, afs_size_t abyte, int hit)
+{
+    afs_Trace4(afs_iclSetp, CM_TRACE_DCACHEREF, ICL_TYPE_FID, &avc->f.fid,
+	       ICL_TYPE_OFFSET, ICL_HANDLE_OFFSET(abyte), ICL_TYPE_OFFSET,
+	       ICL_HANDLE_OFFSET(avc->f.m.Length), ICL_TYPE_INT32, hit);
+}
+
 /*
  * afs_FindDCache
  *
@@ -1556,10 +1776,14 @@ afs_FindDCache(struct vcache *avc, afs_size_t abyte)
 	hset(afs_indexTimes[tdc->index], afs_indexCounter);
 	hadd32(afs_indexCounter, 1);
 	ReleaseWriteLock(&afs_xdcache);
-	return tdc;
+    } else {
+	ReleaseWriteLock(&afs_xdcache);
+	tdc = NULL;
     }
-    ReleaseWriteLock(&afs_xdcache);
-    return NULL;
+    afs_Trace3(afs_iclSetp, CM_TRACE_DCACHEFIND, ICL_TYPE_FID, &avc->f.fid,
+	       ICL_TYPE_OFFSET, ICL_HANDLE_OFFSET(abyte), ICL_TYPE_INT32,
+	       tdc != NULL);
+    return tdc;
 }				/*afs_FindDCache */
 
 /* only call these from afs_AllocDCache() */
@@ -1679,6 +1903,7 @@ afs_AllocDCache(struct vcache *avc, afs_int32 chunk, afs_int32 lock,
     	hones(tdc->f.versionNo);	/* invalid value */
     tdc->f.chunk = chunk;
     tdc->validPos = AFS_CHUNKTOBASE(chunk);
+    afs_DCAdmit(tdc);
     /* XXX */
     if (tdc->lruq.prev == &tdc->lruq)
 	osi_Panic("lruq 1");
@@ -1838,6 +2063,7 @@ afs_GetDCache(struct vcache *avc, afs_size_t abyte,
 		&& !(tdc->dflags & DFFetching)) {
 
 		afs_stats_cmperf.dcacheHits++;
+		afs_TraceDCacheRef(avc, abyte, 1);
 		ObtainWriteLock(&afs_xdcache, 559);
 		QRemove(&tdc->lruq);
 		QAdd(&afs_DLRU, &tdc->lruq);
@@ -2188,6 +2414,7 @@ afs_GetDCache(struct vcache *avc, afs_size_t abyte,
 	if (hsame(avc->f.m.DataVersion, tdc->f.versionNo)) {
 	    updateV2DC(setLocks, avc, tdc, 569);	/* set hint */
 	    afs_stats_cmperf.dcacheHits++;
+	    afs_TraceDCacheRef(avc, abyte, 1);
 	    ConvertWToSLock(&tdc->lock);
 	    goto done;
 	}
@@ -2196,6 +2423,10 @@ afs_GetDCache(struct vcache *avc, afs_size_t abyte,
 	if (setLocks && !slowPass
 	    && (afs_blocksUsed >
 		PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks))) {
+	    osi_timeval_t drainStart;
+	    int slept = 0;
+
+	    osi_GetuTime(&drainStart);
 	    /* Make sure truncate daemon is running */
 	    afs_MaybeWakeupTruncateDaemon();
 	    ObtainWriteLock(&tdc->tlock, 614);
@@ -2207,8 +2438,11 @@ afs_GetDCache(struct vcache *avc, afs_size_t abyte,
 		   PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks)) {
 		afs_WaitForCacheDrain = 1;
 		afs_osi_Sleep(&afs_WaitForCacheDrain);
+		slept = 1;
 	    }
 	    afs_MaybeFreeDiscardedDCache();
+	    if (slept)
+		afs_CacheDrainWaited(&drainStart);
 	    /* need to check if someone else got the chunk first. */
 	    goto RetryGetDCache;
 	}
@@ -2307,8 +2541,10 @@ afs_GetDCache(struct vcache *avc, afs_size_t abyte,
 		   ICL_TYPE_FID, &(avc->f.fid), ICL_TYPE_OFFSET,
 		   ICL_HANDLE_OFFSET(Position), ICL_TYPE_INT32, size);
 
-	if (size)
+	if (size) {
 	    afs_stats_cmperf.dcacheMisses++;
+	    afs_TraceDCacheRef(avc, abyte, 0);
+	}
 	code = 0;
 	/*
 	 * Dynamic root support:  fetch data from local memory.
@@ -2523,6 +2759,7 @@ afs_GetDCache(struct vcache *avc, afs_size_t abyte,
 	 * Data version numbers match.
 	 */
 	afs_stats_cmperf.dcacheHits++;
+	afs_TraceDCacheRef(avc, abyte, 1);
     }				/*Data version numbers match */
 
     updateV2DC(setLocks, avc, tdc, 335);	/* set hint */
@@ -3212,6 +3449,7 @@ afs_InitCacheFile(char *afile, ino_t ainode)
 	    hset32(afs_indexCounter, tstat.atime);
 	}
 	afs_indexUnique[index] = tdc->f.fid.Fid.Unique;
+	afs_dcProbation++;
     }				/*File is not bad */
 
     if (tfile)
@@ -3316,6 +3554,13 @@ afs_dcacheInit(int afiles, int ablocks, int aDentries, int achunk, int aflags)
     afs_indexFlags = afs_osi_Alloc(afiles * sizeof(u_char));
     osi_Assert(afs_indexFlags != NULL);
     memset(afs_indexFlags, 0, afiles * sizeof(char));
+    if (afs_dcPolicy == AFS_DCPOLICY_2Q) {
+	afs_dcGhostSize = 2 * afiles;
+	afs_dcGhosts = afs_osi_Alloc(afs_dcGhostSize * sizeof(afs_uint32));
+	osi_Assert(afs_dcGhosts != NULL);
+	memset(afs_dcGhosts, 0, afs_dcGhostSize * sizeof(afs_uint32));
+    }
+    afs_dcProbation = afs_dcProtected = 0;
 
     /* Allocate and thread the struct dcache entries themselves */
     tdp = afs_Initial_freeDSList =
@@ -3408,6 +3653,11 @@ shutdown_dcache(void)
     afs_osi_Free(afs_indexTimes, afs_cacheFiles * sizeof(afs_hyper_t));
     afs_osi_Free(afs_indexUnique, afs_cacheFiles * sizeof(afs_uint32));
     afs_osi_Free(afs_indexFlags, afs_cacheFiles * sizeof(u_char));
+    if (afs_dcGhosts) {
+	afs_osi_Free(afs_dcGhosts, afs_dcGhostSize * sizeof(afs_uint32));
+	afs_dcGhosts = NULL;
+	afs_dcGhostSize = 0;
+    }
     afs_osi_Free(afs_Initial_freeDSList,
 		 afs_dcentries * sizeof(struct dcache));
 #ifdef	KERNEL_HAVE_PIN
@@ -3493,6 +3743,10 @@ afs_ObtainDCacheForWriting(struct vcache *avc, afs_size_t filePos,
 	    }
 	}
 	if (!tdc) {
+	    osi_timeval_t drainStart;
+	    int slept = 0;
+
+	    osi_GetuTime(&drainStart);
 	    afs_MaybeWakeupTruncateDaemon();
 	    while (afs_blocksUsed >
 		   PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks)) {
@@ -3501,11 +3755,14 @@ afs_ObtainDCacheForWriting(struct vcache *avc, afs_size_t filePos,
 		    PERCENT(CM_WAITFORDRAINPCT, afs_cacheBlocks)) {
 		    afs_WaitForCacheDrain = 1;
 		    afs_osi_Sleep(&afs_WaitForCacheDrain);
+		    slept = 1;
 		}
 		afs_MaybeFreeDiscardedDCache();
 		afs_MaybeWakeupTruncateDaemon();
 		ObtainWriteLock(&avc->lock, 509);
 	    }
+	    if (slept)
+		afs_CacheDrainWaited(&drainStart);
 	    avc->f.states |= CDirty;
 	    tdc = afs_GetDCache(avc, filePos, areq, &offset, &len, 4);
 	    if (tdc)
@@ -1505,6 +1505,8 @@ afs_GenDisconStatus(struct vcache *adp, struct vcache *avc,
 		    struct VenusFid *afid, struct vattr *attrs,
 		    struct vrequest *areq, int file_type)
 {
+    struct axscache *ac;
+
     memcpy(&avc->f.fid, afid, sizeof(struct VenusFid));
     avc->f.m.Mode = attrs->va_mode;
     /* Used to do this:
@@ -1543,7 +1545,8 @@ afs_GenDisconStatus(struct vcache *adp, struct vcache *avc,
 	break;
     }
     avc->f.anyAccess = adp->f.anyAccess;
-    afs_AddAxs(avc->Access, areq->uid, adp->Access->axess);
+    if ((ac = afs_FindAxs(adp->Access, areq->uid)))
+	afs_AddAxs(avc->Access, areq->uid, ac->axess);
 
     avc->callback = NULL;
     avc->f.states |= CStatd;
@@ -558,6 +558,66 @@ afs_CacheStoreDCaches(struct vcache *avc, struct dcache **dclist,
     return code;
 }
 
+/*!
+ *	Store a contiguous run of chunks in a single StoreData call.
+ *
+ * \param avc Ptr to the vcache entry.
+ * \param areq Ptr to the request structure
+ * \param dclist pointer to the list of dcaches, in order
+ * \param nchunks number of dcaches in dclist
+ * \param base offset of the first chunk
+ * \param bytes number of bytes to store, including any padding
+ * \param length file length to give the fileserver
+ * \param sync sync flag
+ * \param nomore copy of the "no more data" flag
+ * \param anewDV Ptr to the dataversion after store
+ * \param doProcessFS pointer to the "do process FetchStatus" flag
+ * \param OutStatus pointer to the FetchStatus as returned by the fileserver
+ *
+ * \note Environment: the dcaches are share-locked.  avc->lock is not
+ *	 needed here, so write-behind calls this without it.
+ */
+int
+afs_CacheStoreRun(struct vcache *avc, struct vrequest *areq,
+		  struct dcache **dclist, afs_uint32 nchunks,
+		  afs_size_t base, afs_size_t bytes, afs_size_t length,
+		  int sync, int nomore, afs_hyper_t *anewDV,
+		  int *doProcessFS, struct AFSFetchStatus *OutStatus)
+{
+    afs_int32 code;
+    struct storeOps *ops;
+    void * rock = NULL;
+    struct afs_conn *tc;
+    struct rx_connection *rxconn;
+
+    do {
+	tc = afs_Conn(&avc->f.fid, areq, 0, &rxconn);
+
+#ifdef AFS_64BIT_CLIENT
+      restart:
+#endif
+	code = rxfs_storeInit(avc, tc, rxconn, base, bytes, length,
+			      sync, &ops, &rock);
+	if ( !code ) {
+	    code = afs_CacheStoreDCaches(avc, dclist, bytes, anewDV,
+					 doProcessFS, OutStatus,
+					 nchunks, nomore, ops, rock);
+	}
+
+#ifdef AFS_64BIT_CLIENT
+	if (code == RXGEN_OPCODE && !afs_serverHasNo64Bit(tc)) {
+	    afs_serverSetNo64Bit(tc);
+	    goto restart;
+	}
+#endif /* AFS_64BIT_CLIENT */
+    } while (afs_Analyze
+	     (tc, rxconn, code, &avc->f.fid, areq,
+	      AFS_STATS_FS_RPCIDX_STOREDATA, SHARED_LOCK,
+	      NULL));
+
+    return code;
+}
+
 #define lmin(a,b) (((a) < (b)) ? (a) : (b))
 /*!
  *	Called upon store.
@@ -581,8 +641,6 @@ afs_CacheStoreVCache(struct dcache **dcList, struct vcache *avc,
 		     afs_hyper_t *anewDV, afs_size_t *amaxStoredLength)
 {
     afs_int32 code = 0;
-    struct storeOps *ops;
-    void * rock = NULL;
     unsigned int i, j;
 
     struct AFSFetchStatus OutStatus;
@@ -590,8 +648,6 @@ afs_CacheStoreVCache(struct dcache **dcList, struct vcache *avc,
     afs_size_t base, bytes, length;
     int nomore;
     unsigned int first = 0;
-    struct afs_conn *tc;
-    struct rx_connection *rxconn;
 
     for (bytes = 0, j = 0; !code && j <= high; j++) {
 	if (dcList[j]) {
@@ -635,30 +691,9 @@ afs_CacheStoreVCache(struct dcache **dcList, struct vcache *avc,
 		       ICL_HANDLE_OFFSET(bytes), ICL_TYPE_OFFSET,
 		       ICL_HANDLE_OFFSET(length));
 
-	    do {
-	        tc = afs_Conn(&avc->f.fid, areq, 0, &rxconn);
-
-#ifdef AFS_64BIT_CLIENT
-	      restart:
-#endif
-		code = rxfs_storeInit(avc, tc, rxconn, base, bytes, length,
-				      sync, &ops, &rock);
-		if ( !code ) {
-		    code = afs_CacheStoreDCaches(avc, dclist, bytes, anewDV,
-			                         &doProcessFS, &OutStatus,
-						 nchunks, nomore, ops, rock);
-		}
-
-#ifdef AFS_64BIT_CLIENT
-		if (code == RXGEN_OPCODE && !afs_serverHasNo64Bit(tc)) {
-		    afs_serverSetNo64Bit(tc);
-		    goto restart;
-		}
-#endif /* AFS_64BIT_CLIENT */
-	    } while (afs_Analyze
-		     (tc, rxconn, code, &avc->f.fid, areq,
-		      AFS_STATS_FS_RPCIDX_STOREDATA, SHARED_LOCK,
-		      NULL));
+	    code = afs_CacheStoreRun(avc, areq, dclist, nchunks, base, bytes,
+				     length, sync, nomore, anewDV,
+				     &doProcessFS, &OutStatus);
 
 	    /* put back all remaining locked dcache entries */
 	    for (i = 0; i < nchunks; i++) {
@@ -131,7 +131,7 @@ afs_CacheInit(afs_int32 astatSize, afs_int32 afiles, afs_int32 ablocks,
     AFS_RWLOCK_INIT(&afs_disconDirtyLock, "afs_disconDirtyLock");
     QInit(&afs_disconDirty);
     QInit(&afs_disconShadow);
-    osi_dnlc_init();
+    osi_dnlc_init(astatSize);
 
     /*
      * create volume list structure
@@ -19,36 +19,168 @@
 #include "afs/afs_stats.h"	/* statistics */
 
 /* memory cache routines */
+
+/*
+ * The data of each memory cache entry is kept in fixed-size pages rather
+ * than one contiguous buffer, so that an entry that outgrows its chunk (a
+ * big directory, usually) just has pages added to it instead of being
+ * reallocated and copied, and so that memory given back by one entry is
+ * reused as is by the next.  Pages are carved out of slabs, which are only
+ * freed at shutdown; free pages are chained through their first word.
+ */
+#define AFS_MEMPAGESIZE	4096	/* largest page size */
+#define AFS_MEMSLABSIZE	65536	/* bytes of pages allocated at once */
+
+struct memCacheSlab {
+    struct memCacheSlab *next;
+    char *base;
+};
+
 static struct memCacheEntry *memCache;
 static int memCacheBlkSize = 8192;
 static int memMaxBlkNumber = 0;
+static int memPageSize;		/* bytes in each page */
+static int memBlkPages;		/* pages in a chunk sized entry */
+static char **memPageTable;	/* page slots of chunk sized entries */
+static char *memFreePages;	/* free pages */
+static struct memCacheSlab *memSlabs;	/* every slab allocated */
 
 extern int cacheDiskType;
 
+/* Put a page on the free list. */
+static void
+afs_MemPutPage(char *page)
+{
+    *(char **)page = memFreePages;
+    memFreePages = page;
+}
+
+/* Allocate another slab and put its pages on the free list. */
+static int
+afs_MemAllocSlab(void)
+{
+    struct memCacheSlab *slab;
+    int i;
+
+    slab = afs_osi_Alloc(sizeof(struct memCacheSlab));
+    if (slab == NULL)
+	return ENOMEM;
+    slab->base = afs_osi_Alloc(AFS_MEMSLABSIZE);
+    if (slab->base == NULL) {
+	afs_osi_Free(slab, sizeof(struct memCacheSlab));
+	return ENOMEM;
+    }
+    slab->next = memSlabs;
+    memSlabs = slab;
+    for (i = AFS_MEMSLABSIZE - memPageSize; i >= 0; i -= memPageSize)
+	afs_MemPutPage(slab->base + i);
+    return 0;
+}
+
+/* Take a page off the free list, allocating a slab if it is empty.
+ * Returns NULL if there is no memory. */
+static char *
+afs_MemGetPage(void)
+{
+    char *page;
+
+    if (memFreePages == NULL && afs_MemAllocSlab() != 0)
+	return NULL;
+    page = memFreePages;
+    memFreePages = *(char **)page;
+    return page;
+}
+
+/* The page slots a chunk sized entry starts out with. */
+#define MEM_BLKPAGES(mceP) (memPageTable + ((mceP) - memCache) * memBlkPages)
+
+/* Copy len bytes of the data of mceP at offset out to buf, or in from buf
+ * if write is set, going a page at a time.  A NULL buf when writing zeros
+ * the range.  The range must already be covered by pages. */
+static void
+afs_MemCopy(struct memCacheEntry *mceP, int offset, char *buf, int len,
+	    int write)
+{
+    int page, poff, n;
+
+    while (len > 0) {
+	page = offset / memPageSize;
+	poff = offset % memPageSize;
+	n = memPageSize - poff;
+	if (n > len)
+	    n = len;
+	if (!write)
+	    memcpy(buf, mceP->pages[page] + poff, n);
+	else if (buf)
+	    memcpy(mceP->pages[page] + poff, buf, n);
+	else
+	    memset(mceP->pages[page] + poff, 0, n);
+	if (buf)
+	    buf += n;
+	offset += n;
+	len -= n;
+    }
+}
+
+/* Free the first count entries of the memory cache and all its pages. */
+static void
+afs_MemFreeCache(int count)
+{
+    struct memCacheSlab *slab;
+    int index;
+
+    for (index = 0; index < count; index++) {
+	if (memCache[index].maxPages > memBlkPages)
+	    afs_osi_Free(memCache[index].pages,
+			 memCache[index].maxPages * sizeof(char *));
+    }
+    while ((slab = memSlabs) != NULL) {
+	memSlabs = slab->next;
+	afs_osi_Free(slab->base, AFS_MEMSLABSIZE);
+	afs_osi_Free(slab, sizeof(struct memCacheSlab));
+    }
+    memFreePages = NULL;
+    afs_osi_Free(memPageTable, memMaxBlkNumber * memBlkPages * sizeof(char *));
+    memPageTable = NULL;
+    afs_osi_Free(memCache, memMaxBlkNumber * sizeof(struct memCacheEntry));
+    memCache = NULL;
+    memMaxBlkNumber = 0;
+}
+
 int
 afs_InitMemCache(int blkCount, int blkSize, int flags)
 {
-    int index;
+    struct memCacheEntry *mceP;
+    int index, i;
 
     AFS_STATCNT(afs_InitMemCache);
     if (blkSize)
 	memCacheBlkSize = blkSize;
+    memPageSize = (memCacheBlkSize < AFS_MEMPAGESIZE)
+	? memCacheBlkSize : AFS_MEMPAGESIZE;
+    memBlkPages = (memCacheBlkSize + memPageSize - 1) / memPageSize;
 
     memMaxBlkNumber = blkCount;
     memCache =
 	afs_osi_Alloc(memMaxBlkNumber * sizeof(struct memCacheEntry));
     osi_Assert(memCache != NULL);
+    memPageTable =
+	afs_osi_Alloc(memMaxBlkNumber * memBlkPages * sizeof(char *));
+    osi_Assert(memPageTable != NULL);
 
     for (index = 0; index < memMaxBlkNumber; index++) {
-	char *blk;
-	(memCache + index)->size = 0;
-	(memCache + index)->dataSize = memCacheBlkSize;
-	LOCK_INIT(&((memCache + index)->afs_memLock), "afs_memLock");
-	blk = afs_osi_Alloc(memCacheBlkSize);
-	if (blk == NULL)
-	    goto nomem;
-	(memCache + index)->data = blk;
-	memset((memCache + index)->data, 0, memCacheBlkSize);
+	mceP = memCache + index;
+	mceP->size = 0;
+	mceP->dataSize = memBlkPages * memPageSize;
+	mceP->pages = MEM_BLKPAGES(mceP);
+	mceP->maxPages = memBlkPages;
+	LOCK_INIT(&mceP->afs_memLock, "afs_memLock");
+	for (i = 0; i < memBlkPages; i++) {
+	    mceP->pages[i] = afs_MemGetPage();
+	    if (mceP->pages[i] == NULL)
+		goto nomem;
+	    memset(mceP->pages[i], 0, memPageSize);
+	}
     }
 #if defined(AFS_HAVE_VXFS)
     afs_InitDualFSCacheOps((struct vnode *)0);
@@ -60,10 +192,7 @@ afs_InitMemCache(int blkCount, int blkSize, int flags)
   nomem:
     afs_warn("afsd:  memCache allocation failure at %d KB.\n",
 	     (index * memCacheBlkSize) / 1024);
-    while (--index >= 0) {
-	afs_osi_Free((memCache + index)->data, memCacheBlkSize);
-	(memCache + index)->data = NULL;
-    }
+    afs_MemFreeCache(index + 1);
     return ENOMEM;
 
 }
@@ -84,7 +213,7 @@ afs_MemCacheOpen(afs_dcache_id_t *ainode)
     }
     mep = (memCache + ainode->mem);
     afs_Trace3(afs_iclSetp, CM_TRACE_MEMOPEN, ICL_TYPE_INT32, ainode->mem,
-	       ICL_TYPE_POINTER, mep, ICL_TYPE_POINTER, mep ? mep->data : 0);
+	       ICL_TYPE_POINTER, mep, ICL_TYPE_POINTER, mep ? mep->pages : 0);
     return (void *)mep;
 }
 
@@ -109,7 +238,7 @@ afs_MemReadBlk(struct osi_file *fP, int offset, void *dest,
 
     if (bytesRead > 0) {
 	AFS_GUNLOCK();
-	memcpy(dest, mceP->data + offset, bytesRead);
+	afs_MemCopy(mceP, offset, dest, bytesRead, 0);
 	AFS_GLOCK();
     } else
 	bytesRead = 0;
@@ -139,14 +268,14 @@ afs_MemReadvBlk(struct memCacheEntry *mceP, int offset,
     bytesRead = (size < mceP->size - offset) ? size : mceP->size - offset;
 
     if (bytesRead > 0) {
+	AFS_GUNLOCK();
 	for (i = 0, size = bytesRead; i < nio && size > 0; i++) {
 	    bytesToRead = (size < iov[i].iov_len) ? size : iov[i].iov_len;
-	    AFS_GUNLOCK();
-	    memcpy(iov[i].iov_base, mceP->data + offset, bytesToRead);
-	    AFS_GLOCK();
+	    afs_MemCopy(mceP, offset, iov[i].iov_base, bytesToRead, 0);
 	    offset += bytesToRead;
 	    size -= bytesToRead;
 	}
+	AFS_GLOCK();
 	bytesRead -= size;
     } else
 	bytesRead = 0;
@@ -161,35 +290,59 @@ afs_MemReadUIO(afs_dcache_id_t *ainode, struct uio *uioP)
     struct memCacheEntry *mceP =
 	(struct memCacheEntry *)afs_MemCacheOpen(ainode);
     int length = mceP->size - AFS_UIO_OFFSET(uioP);
-    afs_int32 code;
+    int offset, poff, tlen;
+    afs_int32 code = 0;
 
     AFS_STATCNT(afs_MemReadUIO);
     ObtainReadLock(&mceP->afs_memLock);
     length = (length < AFS_UIO_RESID(uioP)) ? length : AFS_UIO_RESID(uioP);
-    AFS_UIOMOVE(mceP->data + AFS_UIO_OFFSET(uioP), length, UIO_READ, uioP, code);
+    offset = AFS_UIO_OFFSET(uioP);
+    while (length > 0 && code == 0) {
+	poff = offset % memPageSize;
+	tlen = memPageSize - poff;
+	if (tlen > length)
+	    tlen = length;
+	AFS_UIOMOVE(mceP->pages[offset / memPageSize] + poff, tlen, UIO_READ,
+		    uioP, code);
+	offset += tlen;
+	length -= tlen;
+    }
     ReleaseReadLock(&mceP->afs_memLock);
     return code;
 }
 
+/* Attach pages to mceP until they hold at least size bytes.  Only the
+ * array of page pointers is ever copied, never the data. */
 static int
 _afs_MemExtendEntry(struct memCacheEntry *mceP, afs_uint32 size)
 {
-    if (size > mceP->dataSize) {
-	char *oldData = mceP->data;
+    int npages = (size + memPageSize - 1) / memPageSize;
+    int have = mceP->dataSize / memPageSize;
+    char **pages;
+
+    if (npages > mceP->maxPages) {
+	int maxPages = mceP->maxPages;
 
-	mceP->data = afs_osi_Alloc(size);
-	if (mceP->data == NULL) {       /* no available memory */
-	    mceP->data = oldData;       /* revert back change that was made */
+	while (maxPages < npages)
+	    maxPages *= 2;
+	pages = afs_osi_Alloc(maxPages * sizeof(char *));
+	if (pages == NULL) {
 	    afs_warn("afs: afs_MemWriteBlk mem alloc failure (%d bytes)\n", size);
 	    return -ENOMEM;
 	}
-
-	/* may overlap, but this is OK */
-	AFS_GUNLOCK();
-	memcpy(mceP->data, oldData, mceP->size);
-	AFS_GLOCK();
-	afs_osi_Free(oldData, mceP->dataSize);
-	mceP->dataSize = size;
+	memcpy(pages, mceP->pages, have * sizeof(char *));
+	if (mceP->maxPages > memBlkPages)
+	    afs_osi_Free(mceP->pages, mceP->maxPages * sizeof(char *));
+	mceP->pages = pages;
+	mceP->maxPages = maxPages;
+    }
+    for (; have < npages; have++) {
+	mceP->pages[have] = afs_MemGetPage();
+	if (mceP->pages[have] == NULL) {	/* no available memory */
+	    afs_warn("afs: afs_MemWriteBlk mem alloc failure (%d bytes)\n", size);
+	    return -ENOMEM;
+	}
+	mceP->dataSize += memPageSize;
     }
     return 0;
 }
@@ -221,10 +374,10 @@ afs_MemWritevBlk(struct memCacheEntry *mceP, int offset,
       goto out;
     AFS_GUNLOCK();
     if (mceP->size < offset)
-	memset(mceP->data + mceP->size, 0, offset - mceP->size);
+	afs_MemCopy(mceP, mceP->size, NULL, offset - mceP->size, 1);
     for (bytesWritten = 0, i = 0; i < nio && size > 0; i++) {
 	bytesToWrite = (size < iov[i].iov_len) ? size : iov[i].iov_len;
-	memcpy(mceP->data + offset, iov[i].iov_base, bytesToWrite);
+	afs_MemCopy(mceP, offset, iov[i].iov_base, bytesToWrite, 1);
 	offset += bytesToWrite;
 	bytesWritten += bytesToWrite;
 	size -= bytesToWrite;
@@ -241,34 +394,29 @@ afs_MemWriteUIO(struct vcache *avc, afs_dcache_id_t *ainode, struct uio *uioP)
 {
     struct memCacheEntry *mceP =
 	(struct memCacheEntry *)afs_MemCacheOpen(ainode);
-    afs_int32 code;
+    int offset, poff, tlen, length;
+    afs_int32 code = 0;
 
     AFS_STATCNT(afs_MemWriteUIO);
     ObtainWriteLock(&mceP->afs_memLock, 312);
-    if (AFS_UIO_RESID(uioP) + AFS_UIO_OFFSET(uioP) > mceP->dataSize) {
-	char *oldData = mceP->data;
-
-	mceP->data = afs_osi_Alloc(AFS_UIO_RESID(uioP) + AFS_UIO_OFFSET(uioP));
-	if (mceP->data == NULL) {	/* no available memory */
-	    mceP->data = oldData;	/* revert back change that was made */
-	    ReleaseWriteLock(&mceP->afs_memLock);
-	    afs_warn("afs: afs_MemWriteBlk mem alloc failure (%ld bytes)\n",
-		     (long)(AFS_UIO_RESID(uioP) + AFS_UIO_OFFSET(uioP)));
-	    return -ENOMEM;
-	}
-
-	AFS_GUNLOCK();
-	memcpy(mceP->data, oldData, mceP->size);
-	AFS_GLOCK();
-
-	afs_osi_Free(oldData, mceP->dataSize);
-	mceP->dataSize = AFS_UIO_RESID(uioP) + AFS_UIO_OFFSET(uioP);
+    offset = AFS_UIO_OFFSET(uioP);
+    length = AFS_UIO_RESID(uioP);
+    if (_afs_MemExtendEntry(mceP, offset + length) != 0) {
+	ReleaseWriteLock(&mceP->afs_memLock);
+	return -ENOMEM;
+    }
+    if (mceP->size < offset)
+	afs_MemCopy(mceP, mceP->size, NULL, offset - mceP->size, 1);
+    while (length > 0 && code == 0) {
+	poff = offset % memPageSize;
+	tlen = memPageSize - poff;
+	if (tlen > length)
+	    tlen = length;
+	AFS_UIOMOVE(mceP->pages[offset / memPageSize] + poff, tlen, UIO_WRITE,
+		    uioP, code);
+	offset += tlen;
+	length -= tlen;
     }
-    if (mceP->size < AFS_UIO_OFFSET(uioP))
-	memset(mceP->data + mceP->size, 0,
-	       (int)(AFS_UIO_OFFSET(uioP) - mceP->size));
-    AFS_UIOMOVE(mceP->data + AFS_UIO_OFFSET(uioP), AFS_UIO_RESID(uioP), UIO_WRITE,
-		uioP, code);
     if (AFS_UIO_OFFSET(uioP) > mceP->size)
 	mceP->size = AFS_UIO_OFFSET(uioP);
 
@@ -280,22 +428,19 @@ int
 afs_MemCacheTruncate(struct osi_file *fP, int size)
 {
     struct memCacheEntry *mceP = (struct memCacheEntry *)fP;
+    int i;
     AFS_STATCNT(afs_MemCacheTruncate);
 
     ObtainWriteLock(&mceP->afs_memLock, 313);
-    /* old directory entry; g.c. */
-    if (size == 0 && mceP->dataSize > memCacheBlkSize) {
-	char *oldData = mceP->data;
-	mceP->data = afs_osi_Alloc(memCacheBlkSize);
-	if (mceP->data == NULL) {	/* no available memory */
-	    mceP->data = oldData;
-	    ReleaseWriteLock(&mceP->afs_memLock);
-	    afs_warn("afs: afs_MemWriteBlk mem alloc failure (%d bytes)\n",
-		     memCacheBlkSize);
-	} else {
-	    afs_osi_Free(oldData, mceP->dataSize);
-	    mceP->dataSize = memCacheBlkSize;
-	}
+    /* old directory entry; give the pages past its chunk back */
+    if (size == 0 && mceP->maxPages > memBlkPages) {
+	for (i = mceP->dataSize / memPageSize - 1; i >= memBlkPages; i--)
+	    afs_MemPutPage(mceP->pages[i]);
+	memcpy(MEM_BLKPAGES(mceP), mceP->pages, memBlkPages * sizeof(char *));
+	afs_osi_Free(mceP->pages, mceP->maxPages * sizeof(char *));
+	mceP->pages = MEM_BLKPAGES(mceP);
+	mceP->maxPages = memBlkPages;
+	mceP->dataSize = memBlkPages * memPageSize;
     }
 
     if (size < mceP->size)
@@ -323,11 +468,7 @@ shutdown_memcache(void)
     if (cacheDiskType != AFS_FCACHE_TYPE_MEM)
 	return;
     memCacheBlkSize = 8192;
-    for (index = 0; index < memMaxBlkNumber; index++) {
+    for (index = 0; index < memMaxBlkNumber; index++)
 	LOCK_INIT(&((memCache + index)->afs_memLock), "afs_memLock");
-	afs_osi_Free((memCache + index)->data, (memCache + index)->dataSize);
-    }
-    afs_osi_Free((char *)memCache,
-		 memMaxBlkNumber * sizeof(struct memCacheEntry));
-    memMaxBlkNumber = 0;
+    afs_MemFreeCache(memMaxBlkNumber);
 }
@@ -19,7 +19,6 @@
 #include "afs/afs_osidnlc.h"
 
 /* Things to do:
- *    also cache failed lookups.
  *    look into interactions of dnlc and readdir.
  *    cache larger names, perhaps by using a better,longer key (SHA) and discarding
  *    the actual name itself.
@@ -32,16 +31,33 @@ extern struct afs_lock afs_xvcache;
 
 dnlcstats_t dnlcstats;
 
-#define NCSIZE 300
-#define NHSIZE 256		/* must be power of 2. == NHASHENT in dir package */
+#define NCSIZE 300		/* fewest entries */
+#define NCMAXSIZE 32768		/* most entries */
+#define NHSIZE 256		/* fewest hash buckets */
+
+/* The cache has one entry per stat cache entry, within the limits above,
+ * and about two entries per hash bucket. */
+int afs_dnlcSize;
+static int dnlcHashSize;	/* must be power of 2 */
 struct nc *ncfreelist = NULL;
-static struct nc nameCache[NCSIZE];
-struct nc *nameHash[NHSIZE];
+static struct nc *nameCache;
+static struct nc **nameHash;
 /* Hash table invariants:
  *     1.  If nameHash[i] is NULL, list is empty
  *     2.  A single element in a hash bucket has itself as prev and next.
  */
 
+/* Every entry in nameHash is also chained off ncDirHash by its directory,
+ * and off ncVpHash by its vnode if it has one, so that purging a vcache
+ * only has to look at the entries hashed with it rather than the whole
+ * table.  Entries invalidated without the write lock stay on these chains
+ * until RemoveEntry or GetMeAnEntry takes them off. */
+static struct afs_q *ncDirHash;
+static struct afs_q *ncVpHash;
+#define ncVcHash(avc)	(((uintptrsz)(avc) / sizeof(struct vcache)) & (dnlcHashSize - 1))
+#define QTONCD(e)	QEntry(e, struct nc, dirq)
+#define QTONCV(e)	QEntry(e, struct nc, vpq)
+
 typedef enum { osi_dnlc_enterT, InsertEntryT, osi_dnlc_lookupT,
     ScavengeEntryT, osi_dnlc_removeT, RemoveEntryT, osi_dnlc_purgedpT,
     osi_dnlc_purgevpT, osi_dnlc_purgeT
@@ -61,6 +77,23 @@ int dnlct;
 
 #define dnlcHash(ts, hval) for (hval=0; *ts; ts++) { hval *= 173;  hval  += *ts;   }
 
+static void
+LinkEntry(struct nc *tnc)
+{
+    QAdd(&ncDirHash[ncVcHash(tnc->dirp)], &tnc->dirq);
+    if (tnc->vp)
+	QAdd(&ncVpHash[ncVcHash(tnc->vp)], &tnc->vpq);
+}
+
+static void
+UnlinkEntry(struct nc *tnc)
+{
+    if (tnc->dirq.prev)
+	QRemove(&tnc->dirq);
+    if (tnc->vpq.prev)
+	QRemove(&tnc->vpq);
+}
+
 static struct nc *
 GetMeAnEntry(void)
 {
@@ -74,14 +107,14 @@ GetMeAnEntry(void)
 	return tnc;
     }
 
-    for (j = 0; j < NHSIZE + 2; j++, nameptr++) {
-	if (nameptr >= NHSIZE)
+    for (j = 0; j < dnlcHashSize + 2; j++, nameptr++) {
+	if (nameptr >= dnlcHashSize)
 	    nameptr = 0;
 	if (nameHash[nameptr])
 	    break;
     }
 
-    if (nameptr >= NHSIZE)
+    if (nameptr >= dnlcHashSize)
 	nameptr = 0;
 
     TRACE(ScavengeEntryT, nameptr);
@@ -91,6 +124,7 @@ GetMeAnEntry(void)
 
     if (tnc->prev == tnc) {	/* only thing in list, don't screw around */
 	nameHash[nameptr] = NULL;
+	UnlinkEntry(tnc);
 	return (tnc);
     }
 
@@ -98,6 +132,7 @@ GetMeAnEntry(void)
     /* remove it from list */
     tnc->next->prev = tnc->prev;
     tnc->prev->next = tnc->next;
+    UnlinkEntry(tnc);
 
     return (tnc);
 }
@@ -106,7 +141,7 @@ static void
 InsertEntry(struct nc *tnc)
 {
     unsigned int key;
-    key = tnc->key & (NHSIZE - 1);
+    key = tnc->key & (dnlcHashSize - 1);
 
     TRACE(InsertEntryT, key);
     if (!nameHash[key]) {
@@ -122,6 +157,17 @@ InsertEntry(struct nc *tnc)
 }
 
 
+/*!
+ * Remember that aname in directory adp is avc.  If avc is NULL, remember
+ * instead that there is no such name; that negative entry only holds while
+ * the directory's DataVersion is still *avno.
+ *
+ * \param adp vcache entry for the directory.
+ * \param aname name looked up.
+ * \param avc vcache entry aname refers to, or NULL.
+ * \param avno version of the directory the lookup was done in.
+ * \return 0
+ */
 int
 osi_dnlc_enter(struct vcache *adp, char *aname, struct vcache *avc,
 	       afs_hyper_t * avno)
@@ -139,8 +185,10 @@ osi_dnlc_enter(struct vcache *adp, char *aname, struct vcache *avc,
     if (ts - aname >= AFSNCNAMESIZE) {
 	return 0;
     }
-    skey = key & (NHSIZE - 1);
+    skey = key & (dnlcHashSize - 1);
     dnlcstats.enters++;
+    if (!avc)
+	dnlcstats.negenters++;
 
   retry:
     ObtainWriteLock(&afs_xdnlc, 222);
@@ -161,7 +209,7 @@ osi_dnlc_enter(struct vcache *adp, char *aname, struct vcache *avc,
 	} else if (tnc->next == nameHash[skey]) {	/* end of list */
 	    tnc = NULL;
 	    break;
-	} else if (safety > NCSIZE) {
+	} else if (safety > afs_dnlcSize) {
 	    afs_warn("DNLC cycle");
 	    dnlcstats.cycles++;
 	    ReleaseWriteLock(&afs_xdnlc);
@@ -179,10 +227,16 @@ osi_dnlc_enter(struct vcache *adp, char *aname, struct vcache *avc,
 	memcpy((char *)tnc->name, aname, ts - aname + 1);	/* include the NULL */
 
 	InsertEntry(tnc);
+	LinkEntry(tnc);
     } else {
 	/* duplicate */
+	if (tnc->vpq.prev)
+	    QRemove(&tnc->vpq);
 	tnc->vp = avc;
+	if (avc)
+	    QAdd(&ncVpHash[ncVcHash(avc)], &tnc->vpq);
     }
+    hset(tnc->dv, *avno);
     ReleaseWriteLock(&afs_xdnlc);
 
     return 0;
@@ -207,7 +261,7 @@ osi_dnlc_lookup(struct vcache *adp, char *aname, int locktype)
     dnlcHash(ts, key);		/* leaves ts pointing at the NULL */
     if (ts - aname >= AFSNCNAMESIZE)
       return 0;
-    skey = key & (NHSIZE - 1);
+    skey = key & (dnlcHashSize - 1);
 
     TRACE(osi_dnlc_lookupT, skey);
     dnlcstats.lookups++;
@@ -223,7 +277,7 @@ osi_dnlc_lookup(struct vcache *adp, char *aname, int locktype)
 	    break;
 	} else if (tnc->next == nameHash[skey]) {	/* end of list */
 	    break;
-	} else if (safety > NCSIZE) {
+	} else if (safety > afs_dnlcSize) {
 	    afs_warn("DNLC cycle");
 	    dnlcstats.cycles++;
 	    ReleaseReadLock(&afs_xdnlc);
@@ -238,6 +292,7 @@ osi_dnlc_lookup(struct vcache *adp, char *aname, int locktype)
     if (!tvc) {
 	ReleaseReadLock(&afs_xvcache);
 	dnlcstats.misses++;
+	afs_stats_cmperf.dnlcMisses++;
     } else {
 	if ((tvc->f.states & CVInit)
 #ifdef  AFS_DARWIN80_ENV
@@ -271,12 +326,55 @@ osi_dnlc_lookup(struct vcache *adp, char *aname, int locktype)
 	osi_vnhold(tvc, 0);
 #endif
 	ReleaseReadLock(&afs_xvcache);
-
+	afs_stats_cmperf.dnlcHits++;
     }
 
     return tvc;
 }
 
+/*!
+ * Check for a negative entry, after osi_dnlc_lookup has missed.
+ *
+ * \param adp vcache entry for the directory.
+ * \param aname name looked up.
+ * \return 1 if aname is known not to be in the current version of adp.
+ */
+int
+osi_dnlc_negative(struct vcache *adp, char *aname)
+{
+    unsigned int key, skey;
+    char *ts = aname;
+    struct nc *tnc;
+    int safety, found = 0;
+
+    if (!afs_usednlc)
+	return 0;
+
+    dnlcHash(ts, key);		/* leaves ts pointing at the NULL */
+    if (ts - aname >= AFSNCNAMESIZE)
+	return 0;
+    skey = key & (dnlcHashSize - 1);
+
+    ObtainReadLock(&afs_xdnlc);
+    for (tnc = nameHash[skey], safety = 0; tnc; tnc = tnc->next, safety++) {
+	if ((tnc->dirp == adp) && (tnc->key == key)
+	    && (!strcmp((char *)tnc->name, aname))) {
+	    found = (tnc->vp == NULL && (adp->f.states & CStatd)
+		     && hsame(tnc->dv, adp->f.m.DataVersion));
+	    break;
+	} else if (tnc->next == nameHash[skey] || safety > afs_dnlcSize) {
+	    break;
+	}
+    }
+    ReleaseReadLock(&afs_xdnlc);
+
+    if (found) {
+	dnlcstats.neghits++;
+	afs_stats_cmperf.dnlcNegativeHits++;
+    }
+    return found;
+}
+
 
 static void
 RemoveEntry(struct nc *tnc, unsigned int key)
@@ -293,6 +391,7 @@ RemoveEntry(struct nc *tnc, unsigned int key)
 	tnc->prev->next = tnc->next;
 	tnc->next->prev = tnc->prev;
     }
+    UnlinkEntry(tnc);
 
     tnc->prev = NULL;		/* everything not in hash table has 0 prev */
     tnc->key = 0;		/* just for safety's sake */
@@ -314,7 +413,7 @@ osi_dnlc_remove(struct vcache *adp, char *aname, struct vcache *avc)
     if (ts - aname >= AFSNCNAMESIZE) {
 	return 0;
     }
-    skey = key & (NHSIZE - 1);
+    skey = key & (dnlcHashSize - 1);
     TRACE(osi_dnlc_removeT, skey);
     dnlcstats.removes++;
     ObtainReadLock(&afs_xdnlc);
@@ -349,10 +448,10 @@ osi_dnlc_remove(struct vcache *adp, char *aname, struct vcache *avc)
 }
 
 /*!
- * Remove anything pertaining to this directory.  I can invalidate
- * things without the lock, since I am just looking through the array,
- * but to move things off the lists or into the freelist, I need the
- * write lock
+ * Remove anything pertaining to this directory.  With the write lock I
+ * only need to walk the chains adp hashes to, and can free what I find.
+ * Without it I can still invalidate things, since I am just looking
+ * through the array, but I can't move anything off the lists.
  *
  * \param adp vcache entry for the directory to be purged.
  * \return 0
@@ -362,6 +461,8 @@ osi_dnlc_purgedp(struct vcache *adp)
 {
     int i;
     int writelocked;
+    struct afs_q *head, *tq, *nq;
+    struct nc *tnc;
 
 #ifdef AFS_DARWIN_ENV
     if (!(adp->f.states & (CVInit | CVFlushed
@@ -379,18 +480,37 @@ osi_dnlc_purgedp(struct vcache *adp)
     TRACE(osi_dnlc_purgedpT, 0);
     writelocked = (0 == NBObtainWriteLock(&afs_xdnlc, 2));
 
-    for (i = 0; i < NCSIZE; i++) {
-	if ((nameCache[i].dirp == adp) || (nameCache[i].vp == adp)) {
-	    nameCache[i].dirp = nameCache[i].vp = NULL;
-	    if (writelocked && nameCache[i].prev) {
-		RemoveEntry(&nameCache[i], nameCache[i].key & (NHSIZE - 1));
-		nameCache[i].next = ncfreelist;
-		ncfreelist = &nameCache[i];
-	    }
+    if (!writelocked) {
+	for (i = 0; i < afs_dnlcSize; i++) {
+	    if ((nameCache[i].dirp == adp) || (nameCache[i].vp == adp))
+		nameCache[i].dirp = nameCache[i].vp = NULL;
 	}
+	return 0;
     }
-    if (writelocked)
-	ReleaseWriteLock(&afs_xdnlc);
+
+    head = &ncDirHash[ncVcHash(adp)];
+    for (tq = QNext(head); tq != head; tq = nq) {
+	nq = QNext(tq);
+	tnc = QTONCD(tq);
+	if (tnc->dirp == adp) {
+	    tnc->dirp = tnc->vp = NULL;
+	    RemoveEntry(tnc, tnc->key & (dnlcHashSize - 1));
+	    tnc->next = ncfreelist;
+	    ncfreelist = tnc;
+	}
+    }
+    head = &ncVpHash[ncVcHash(adp)];
+    for (tq = QNext(head); tq != head; tq = nq) {
+	nq = QNext(tq);
+	tnc = QTONCV(tq);
+	if (tnc->vp == adp) {
+	    tnc->dirp = tnc->vp = NULL;
+	    RemoveEntry(tnc, tnc->key & (dnlcHashSize - 1));
+	    tnc->next = ncfreelist;
+	    ncfreelist = tnc;
+	}
+    }
+    ReleaseWriteLock(&afs_xdnlc);
 
     return 0;
 }
@@ -406,6 +526,8 @@ osi_dnlc_purgevp(struct vcache *avc)
 {
     int i;
     int writelocked;
+    struct afs_q *head, *tq, *nq;
+    struct nc *tnc;
 
 #ifdef AFS_DARWIN_ENV
     if (!(avc->f.states & (CVInit | CVFlushed
@@ -423,20 +545,28 @@ osi_dnlc_purgevp(struct vcache *avc)
     TRACE(osi_dnlc_purgevpT, 0);
     writelocked = (0 == NBObtainWriteLock(&afs_xdnlc, 3));
 
-    for (i = 0; i < NCSIZE; i++) {
-	if (nameCache[i].vp == avc) {
-	    nameCache[i].dirp = nameCache[i].vp = NULL;
-	    /* can't simply break; because of hard links -- might be two */
-	    /* different entries with same vnode */
-	    if (writelocked && nameCache[i].prev) {
-		RemoveEntry(&nameCache[i], nameCache[i].key & (NHSIZE - 1));
-		nameCache[i].next = ncfreelist;
-		ncfreelist = &nameCache[i];
-	    }
+    if (!writelocked) {
+	for (i = 0; i < afs_dnlcSize; i++) {
+	    if (nameCache[i].vp == avc)
+		nameCache[i].dirp = nameCache[i].vp = NULL;
 	}
+	return 0;
     }
-    if (writelocked)
-	ReleaseWriteLock(&afs_xdnlc);
+
+    /* can't simply stop at the first match because of hard links --
+     * might be two different entries with same vnode */
+    head = &ncVpHash[ncVcHash(avc)];
+    for (tq = QNext(head); tq != head; tq = nq) {
+	nq = QNext(tq);
+	tnc = QTONCV(tq);
+	if (tnc->vp == avc) {
+	    tnc->dirp = tnc->vp = NULL;
+	    RemoveEntry(tnc, tnc->key & (dnlcHashSize - 1));
+	    tnc->next = ncfreelist;
+	    ncfreelist = tnc;
+	}
+    }
+    ReleaseWriteLock(&afs_xdnlc);
 
     return 0;
 }
@@ -450,13 +580,17 @@ osi_dnlc_purge(void)
     dnlcstats.purges++;
     TRACE(osi_dnlc_purgeT, 0);
     if (EWOULDBLOCK == NBObtainWriteLock(&afs_xdnlc, 4)) {	/* couldn't get lock */
-	for (i = 0; i < NCSIZE; i++)
+	for (i = 0; i < afs_dnlcSize; i++)
 	    nameCache[i].dirp = nameCache[i].vp = NULL;
     } else {			/* did get the lock */
 	ncfreelist = NULL;
-	memset(nameCache, 0, sizeof(struct nc) * NCSIZE);
-	memset(nameHash, 0, sizeof(struct nc *) * NHSIZE);
-	for (i = 0; i < NCSIZE; i++) {
+	memset(nameCache, 0, sizeof(struct nc) * afs_dnlcSize);
+	memset(nameHash, 0, sizeof(struct nc *) * dnlcHashSize);
+	for (i = 0; i < dnlcHashSize; i++) {
+	    QInit(&ncDirHash[i]);
+	    QInit(&ncVpHash[i]);
+	}
+	for (i = 0; i < afs_dnlcSize; i++) {
 	    nameCache[i].next = ncfreelist;
 	    ncfreelist = &nameCache[i];
 	}
@@ -477,20 +611,47 @@ osi_dnlc_purgevol(struct VenusFid *fidp)
     return 0;
 }
 
+/*!
+ * Set up the name cache.
+ *
+ * \param astatSize number of stat cache entries; the name cache gets one
+ *	entry for each, between NCSIZE and NCMAXSIZE.
+ * \return 0
+ */
 int
-osi_dnlc_init(void)
+osi_dnlc_init(afs_int32 astatSize)
 {
     int i;
 
+    afs_dnlcSize = astatSize;
+    if (afs_dnlcSize < NCSIZE)
+	afs_dnlcSize = NCSIZE;
+    if (afs_dnlcSize > NCMAXSIZE)
+	afs_dnlcSize = NCMAXSIZE;
+    for (dnlcHashSize = NHSIZE; dnlcHashSize * 2 < afs_dnlcSize;)
+	dnlcHashSize *= 2;
+    nameCache = afs_osi_Alloc(afs_dnlcSize * sizeof(struct nc));
+    osi_Assert(nameCache != NULL);
+    nameHash = afs_osi_Alloc(dnlcHashSize * sizeof(struct nc *));
+    osi_Assert(nameHash != NULL);
+    ncDirHash = afs_osi_Alloc(dnlcHashSize * sizeof(struct afs_q));
+    osi_Assert(ncDirHash != NULL);
+    ncVpHash = afs_osi_Alloc(dnlcHashSize * sizeof(struct afs_q));
+    osi_Assert(ncVpHash != NULL);
+
     Lock_Init(&afs_xdnlc);
     memset(&dnlcstats, 0, sizeof(dnlcstats));
     memset(dnlctracetable, 0, sizeof(dnlctracetable));
     dnlct = 0;
     ObtainWriteLock(&afs_xdnlc, 223);
     ncfreelist = NULL;
-    memset(nameCache, 0, sizeof(struct nc) * NCSIZE);
-    memset(nameHash, 0, sizeof(struct nc *) * NHSIZE);
-    for (i = 0; i < NCSIZE; i++) {
+    memset(nameCache, 0, sizeof(struct nc) * afs_dnlcSize);
+    memset(nameHash, 0, sizeof(struct nc *) * dnlcHashSize);
+    for (i = 0; i < dnlcHashSize; i++) {
+	QInit(&ncDirHash[i]);
+	QInit(&ncVpHash[i]);
+    }
+    for (i = 0; i < afs_dnlcSize; i++) {
 	nameCache[i].next = ncfreelist;
 	ncfreelist = &nameCache[i];
     }
@@ -502,5 +663,18 @@ osi_dnlc_init(void)
 int
 osi_dnlc_shutdown(void)
 {
+    if (!nameCache)
+	return 0;
+    ObtainWriteLock(&afs_xdnlc, 224);
+    afs_osi_Free(nameCache, afs_dnlcSize * sizeof(struct nc));
+    afs_osi_Free(nameHash, dnlcHashSize * sizeof(struct nc *));
+    afs_osi_Free(ncDirHash, dnlcHashSize * sizeof(struct afs_q));
+    afs_osi_Free(ncVpHash, dnlcHashSize * sizeof(struct afs_q));
+    nameCache = NULL;
+    nameHash = NULL;
+    ncDirHash = ncVpHash = NULL;
+    ncfreelist = NULL;
+    afs_dnlcSize = dnlcHashSize = 0;
+    ReleaseWriteLock(&afs_xdnlc);
     return 0;
 }
@@ -11,7 +11,10 @@
 struct nc {
     unsigned int key;
     struct nc *next, *prev;
-    struct vcache *dirp, *vp;
+    struct afs_q dirq;		/* on ncDirHash chain for dirp */
+    struct afs_q vpq;		/* on ncVpHash chain for vp, if vp is set */
+    struct vcache *dirp, *vp;	/* vp is NULL for a negative entry */
+    afs_hyper_t dv;		/* DataVersion of dirp a negative entry is for */
     unsigned char name[AFSNCNAMESIZE];
     /* I think that we can avoid wasting a byte for NULL, with a
      * a little bit of thought.
@@ -22,4 +25,5 @@ typedef struct {
     unsigned int enters, lookups, misses, removes;
     unsigned int purgeds, purgevs, purgevols, purges;
     unsigned int cycles, lookuprace;
+    unsigned int negenters, neghits;
 } dnlcstats_t;
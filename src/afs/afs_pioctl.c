@@ -3685,12 +3685,16 @@ DECL_PIOCTL(PGetVnodeXStatus)
     hset(stat.flushDV, avc->flushDV);
     hset(stat.mapDV, avc->mapDV);
     stat.truncPos = avc->f.truncPos;
-    {			/* just grab the first two - won't break anything... */
-	struct axscache *ac;
+    if (avc->Access) {	/* just grab the first two - won't break anything... */
+	struct axstable *tp = avc->Access;
+	int j;
 
-	for (i = 0, ac = avc->Access; ac && i < CPSIZE; i++, ac = ac->next) {
-	    stat.randomUid[i] = ac->uid;
-	    stat.randomAccess[i] = ac->axess;
+	for (i = 0, j = 0; j < tp->size && i < CPSIZE; j++) {
+	    if (axs_State(tp, j) != AXS_USED)
+		continue;
+	    stat.randomUid[i] = tp->slot[j].uid;
+	    stat.randomAccess[i] = tp->slot[j].axess;
+	    i++;
 	}
     }
     stat.callback = afs_data_pointer_to_int32(avc->callback);
@@ -18,11 +18,11 @@ extern int afs_Analyze(struct afs_conn *aconn, struct rx_connection *rxconn,
 
 /* afs_axscache.c */
 extern afs_rwlock_t afs_xaxs;
-extern struct axscache *afs_SlowFindAxs(struct axscache **cachep,
-					afs_int32 id);
-extern struct axscache *axs_Alloc(void);
-extern void afs_RemoveAxs(struct axscache **headp, struct axscache *axsp);
-extern void afs_FreeAllAxs(struct axscache **headp);
+extern struct axscache *afs_FindAxs(struct axstable *tp, afs_int32 id);
+extern void afs_InsertAxs(struct axstable **tpp, afs_int32 id,
+			  afs_int32 bits);
+extern void afs_RemoveAxs(struct axstable **tpp, struct axscache *axsp);
+extern void afs_FreeAllAxs(struct axstable **tpp);
 extern void shutdown_xscache(void);
 
 /* afs_buffer.c */
@@ -107,12 +107,13 @@ extern int SRXAFSCB_StoreData(struct rx_call *rxcall, struct AFSFid *Fid,
 
 /* afs_cbqueue.c */
 extern afs_rwlock_t afs_xcbhash;
-extern void afs_QueueCallback(struct vcache *avc, unsigned int atime,
-			      struct volume *avp);
+struct cbrenew;
+extern afs_int32 afs_cbRenew;
+extern void afs_QueueCallback(struct vcache *avc, struct volume *avp);
 extern void afs_CheckCallbacks(unsigned int secs);
+extern void afs_RenewCallbacks(struct cbrenew *ab, afs_ucred_t *acred);
 extern void afs_FlushCBs(void);
 extern void afs_FlushServerCBs(struct server *srvp);
-extern int afs_BumpBase(void);
 extern void afs_InitCBQueue(int doLockInit);
 extern void afs_DequeueCallback(struct vcache *avc);
 
@@ -217,6 +218,7 @@ extern struct brequest *afs_BQueue(short aopcode,
 				   void *apparm2);
 extern void afs_SetCheckServerNATmode(int isnat);
 extern void afs_CheckServerDaemon(void);
+extern int afs_CheckServersAsync(void);
 extern int afs_CheckRootVolume(void);
 extern void afs_BRelease(struct brequest *ab);
 extern int afs_BBusy(void);
@@ -241,6 +243,7 @@ extern afs_int32 afs_blocksDiscarded;
 extern int afs_WaitForCacheDrain;
 extern int cacheDiskType;
 extern afs_uint32 afs_tpct1, afs_tpct2, splitdcache;
+extern afs_int32 afs_dcPolicy;
 extern unsigned char *afs_indexFlags;
 extern struct afs_cacheOps *afs_cacheType;
 extern afs_dcache_id_t cacheInode;
@@ -270,6 +273,7 @@ extern void afs_AdjustSize(struct dcache *adc,
 			   afs_int32 newSize);
 extern int afs_HashOutDCache(struct dcache *adc, int zap);
 extern int afs_MaybeFreeDiscardedDCache(void);
+extern void afs_CacheDrainWaited(osi_timeval_t *astart);
 extern int afs_RefDCache(struct dcache *adc);
 extern void afs_TryToSmush(struct vcache *avc,
 			   afs_ucred_t *acred, int sync);
@@ -491,6 +495,12 @@ extern void afs_MarinerLog(char *astring,
 extern void shutdown_mariner(void);
 
 /* afs_fetchstore.c */
+extern int afs_CacheStoreRun(struct vcache *avc, struct vrequest *areq,
+			     struct dcache **dclist, afs_uint32 nchunks,
+			     afs_size_t base, afs_size_t bytes,
+			     afs_size_t length, int sync, int nomore,
+			     afs_hyper_t *anewDV, int *doProcessFS,
+			     struct AFSFetchStatus *OutStatus);
 extern int afs_CacheStoreVCache(struct dcache **dcList, struct vcache *avc,
 				struct vrequest *areq,
 				int sync, unsigned int minj,
@@ -842,6 +852,8 @@ extern int HandleIoctl(struct vcache *avc, afs_int32 acom,
 /* afs_segments.c */
 extern int afs_StoreAllSegments(struct vcache *avc,
 				struct vrequest *areq, int sync);
+extern int afs_StoreFilledSegments(struct vcache *avc,
+				   struct vrequest *areq);
 extern int afs_InvalidateAllSegments(struct vcache *avc);
 extern int afs_ExtendSegments(struct vcache *avc,
 			      afs_size_t alen, struct vrequest *areq);
@@ -898,13 +910,14 @@ extern int osi_dnlc_enter(struct vcache *adp, char *aname, struct vcache *avc,
 			  afs_hyper_t * avno);
 extern struct vcache *osi_dnlc_lookup(struct vcache *adp, char *aname,
 				      int locktype);
+extern int osi_dnlc_negative(struct vcache *adp, char *aname);
 extern int osi_dnlc_remove(struct vcache *adp, char *aname,
 			   struct vcache *avc);
 extern int osi_dnlc_purgedp(struct vcache *adp);
 extern int osi_dnlc_purgevp(struct vcache *avc);
 extern int osi_dnlc_purge(void);
 extern int osi_dnlc_purgevol(struct VenusFid *fidp);
-extern int osi_dnlc_init(void);
+extern int osi_dnlc_init(afs_int32 astatSize);
 extern int osi_dnlc_shutdown(void);
 
 /* afs_pag_cred.c */
@@ -1249,6 +1262,10 @@ extern int Next_AtSys(struct vcache *avc, struct vrequest *areq,
 		      struct sysname_info *state);
 extern int afs_DoBulkStat(struct vcache *adp, long dirCookie,
 			  struct vrequest *areqp);
+extern afs_int32 afs_bulkStatAhead;
+extern afs_int32 afs_bulkStatsQueued;
+extern afs_int32 afs_warmCache;
+extern void afs_WarmCache(struct vrequest *areqp);
 
 #if defined(AFS_SUN5_ENV) || defined(AFS_SGI_ENV)
 extern int afs_lookup(OSI_VC_DECL(adp), char *aname, struct vcache **avcp,
@@ -1278,6 +1295,8 @@ extern int afs_read(struct vcache *avc, struct uio *auio,
 
 extern int afs_UFSReadUIO(afs_dcache_id_t *cacheId, struct uio *tuiop);
 
+extern afs_int32 afs_readAheadMax;
+extern afs_int32 afs_fetchStripeWidth;
 extern void afs_PrefetchChunk(struct vcache *avc, struct dcache *adc,
 			      afs_ucred_t *acred, struct vrequest *areq);
 
@@ -1342,6 +1361,7 @@ extern int afs_UFSWriteUIO(struct vcache *, afs_dcache_id_t *, struct uio *);
 
 extern int afs_StoreOnLastReference(struct vcache *avc,
 				    struct vrequest *treq);
+extern afs_int32 afs_writeBehindMax;
 extern int afs_DoPartialWrite(struct vcache *avc,
 			      struct vrequest *areq);
 extern int afs_closex(struct file *afd);
@@ -1393,6 +1413,9 @@ extern void LockAndInstallUVolumeEntry(struct volume *av, struct uvldbentry *ve,
 				       int acell, struct cell *tcell,
 				       struct vrequest *areq);
 extern void afs_ResetVolumeInfo(struct volume *tv);
+extern void afs_ExpireVolumeInfo(struct volume *tv);
+extern void afs_RefreshVolume(afs_int32 volid, afs_int32 cell,
+			      struct vrequest *areq);
 extern struct volume *afs_MemGetVolSlot(afs_int32 volid, struct cell *cell);
 extern void afs_ResetVolumes(struct server *srvp, struct volume *tv);
 extern struct volume *afs_GetVolume(struct VenusFid *afid,
@@ -136,6 +136,161 @@ afs_StoreMini(struct vcache *avc, struct vrequest *areq)
     return code;
 }				/*afs_StoreMini */
 
+#if defined (AFS_HPUX_ENV)
+int NCHUNKSATONCE = 3;
+#else
+int NCHUNKSATONCE = 64;
+#endif
+int afs_dvhack = 0;
+
+/*
+ * afs_UpdateStoredVersions
+ *
+ * Description:
+ *	After a store, relabel the file's chunks that were up to date
+ *	with the data version the store produced, and turn off DWriting.
+ *
+ * Parameters:
+ *	avc     : Pointer to vcache entry.
+ *	dcList  : Scratch space for NCHUNKSATONCE dcache pointers.
+ *	oldDV   : Data version before the store.
+ *	newDV   : Data version the store should have left.
+ *	origCBs : afs_allCBs before the store.
+ *
+ * Environment:
+ *	Called with avc write-locked.
+ */
+static void
+afs_UpdateStoredVersions(struct vcache *avc, struct dcache **dcList,
+			 afs_hyper_t *oldDV, afs_hyper_t *newDV,
+			 afs_int32 origCBs)
+{
+    struct dcache *tdc;
+    afs_int32 index;
+    afs_hyper_t h_unset;
+    unsigned int i, j, minj, moredata, off;
+    int hash, safety;
+    afs_int32 foreign = (avc->f.states & CForeign);
+
+    hash = DVHash(&avc->f.fid);
+    hones(h_unset);
+
+    minj = 0;
+
+    do {
+	moredata = FALSE;
+	memset(dcList, 0,
+	       NCHUNKSATONCE * sizeof(struct dcache *));
+
+	/* overkill, but it gets the lock in case GetDSlot needs it */
+	ObtainWriteLock(&afs_xdcache, 285);
+
+	for (j = 0, safety = 0, index = afs_dvhashTbl[hash];
+	     index != NULLIDX && safety < afs_cacheFiles + 2;
+	     index = afs_dvnextTbl[index]) {
+
+	    if (afs_indexUnique[index] == avc->f.fid.Fid.Unique) {
+		tdc = afs_GetValidDSlot(index);
+		if (!tdc) {
+		    /* This is okay; since manipulating the dcaches at this
+		     * point is best-effort. We only get a dcache here to
+		     * increment the dv and turn off DWriting. If we were
+		     * supposed to do that for a dcache, but could not
+		     * due to an I/O error, it just means the dv won't
+		     * be updated so we don't be able to use that cached
+		     * chunk in the future. That's inefficient, but not
+		     * an error. */
+		    continue;
+		}
+		ReleaseReadLock(&tdc->tlock);
+
+		if (!FidCmp(&tdc->f.fid, &avc->f.fid)
+		    && tdc->f.chunk >= minj) {
+		    off = tdc->f.chunk - minj;
+		    if (off < NCHUNKSATONCE) {
+			/* this is the file, and the correct chunk range */
+			if (j >= NCHUNKSATONCE)
+			    osi_Panic
+				("Too many dcache entries in range\n");
+			dcList[j++] = tdc;
+		    } else {
+			moredata = TRUE;
+			afs_PutDCache(tdc);
+			if (j == NCHUNKSATONCE)
+			    break;
+		    }
+		} else {
+		    afs_PutDCache(tdc);
+		}
+	    }
+	}
+	ReleaseWriteLock(&afs_xdcache);
+
+	for (i = 0; i < j; i++) {
+	    /* Iterate over the dcache entries we collected above */
+	    tdc = dcList[i];
+	    ObtainSharedLock(&tdc->lock, 677);
+
+	    /* was code here to clear IFDataMod, but it should only be done
+	     * in storedcache and storealldcache.
+	     */
+	    /* Only increase DV if we had up-to-date data to start with.
+	     * Otherwise, we could be falsely upgrading an old chunk
+	     * (that we never read) into one labelled with the current
+	     * DV #.  Also note that we check that no intervening stores
+	     * occurred, otherwise we might mislabel cache information
+	     * for a chunk that we didn't store this time
+	     */
+	    /* Don't update the version number if it's not yet set. */
+	    if (!hsame(tdc->f.versionNo, h_unset)
+		&& hcmp(tdc->f.versionNo, *oldDV) >= 0) {
+
+		if ((!(afs_dvhack || foreign)
+		     && hsame(avc->f.m.DataVersion, *newDV))
+		    || ((afs_dvhack || foreign)
+			&& (origCBs == afs_allCBs))) {
+		    /* no error, this is the DV */
+
+		    UpgradeSToWLock(&tdc->lock, 678);
+		    hset(tdc->f.versionNo, avc->f.m.DataVersion);
+		    tdc->dflags |= DFEntryMod;
+		    /* DWriting may not have gotten cleared above, if all
+		     * we did was a StoreMini */
+		    tdc->f.states &= ~DWriting;
+		    ConvertWToSLock(&tdc->lock);
+		}
+	    }
+
+	    ReleaseSharedLock(&tdc->lock);
+	    afs_PutDCache(tdc);
+	}
+
+	minj += NCHUNKSATONCE;
+
+    } while (moredata);
+}
+
+/*
+ * afs_WaitWriteBehind
+ *
+ * Description:
+ *	Wait for a write-behind store of avc, which runs without
+ *	avc->lock, to finish.  Anything that changes the file's length
+ *	or data version behind its back has to call this first.
+ *
+ * Environment:
+ *	Called with avc write-locked; the lock is dropped while waiting.
+ */
+static void
+afs_WaitWriteBehind(struct vcache *avc)
+{
+    while (avc->writeBehindActive) {
+	ReleaseWriteLock(&avc->lock);
+	afs_osi_Sleep(&avc->writeBehindActive);
+	ObtainWriteLock(&avc->lock, 1224);
+    }
+}
+
 /*
  * afs_StoreAllSegments
  *
@@ -149,14 +304,6 @@ afs_StoreMini(struct vcache *avc, struct vrequest *areq)
  * Environment:
  *	Called with avc write-locked.
  */
-#if defined (AFS_HPUX_ENV)
-int NCHUNKSATONCE = 3;
-#else
-int NCHUNKSATONCE = 64;
-#endif
-int afs_dvhack = 0;
-
-
 int
 afs_StoreAllSegments(struct vcache *avc, struct vrequest *areq,
 		     int sync)
@@ -168,9 +315,9 @@ afs_StoreAllSegments(struct vcache *avc, struct vrequest *areq,
     int hash;
     afs_hyper_t newDV, oldDV;	/* DV when we start, and finish, respectively */
     struct dcache **dcList;
-    unsigned int i, j, minj, moredata, high, off;
+    unsigned int j, minj, moredata, high, off;
     afs_size_t maxStoredLength;	/* highest offset we've written to server. */
-    int safety, marineronce = 0;
+    int marineronce = 0;
 
     AFS_STATCNT(afs_StoreAllSegments);
 
@@ -212,6 +359,8 @@ afs_StoreAllSegments(struct vcache *avc, struct vrequest *areq,
 	return ENETDOWN;
     }
 
+    afs_WaitWriteBehind(avc);
+
     /*
      * Can't do this earlier because osi_VM_StoreAllSegments drops locks
      * and can indirectly do some stores that increase the DV.
@@ -219,6 +368,9 @@ afs_StoreAllSegments(struct vcache *avc, struct vrequest *areq,
     hset(oldDV, avc->f.m.DataVersion);
     hset(newDV, avc->f.m.DataVersion);
 
+    /* everything dirty now goes in this store */
+    avc->writeBehindChunks = 0;
+
     ConvertWToSLock(&avc->lock);
 
     /*
@@ -350,104 +502,8 @@ afs_StoreAllSegments(struct vcache *avc, struct vrequest *areq,
      * update f.versionNo.
      * A lot of this could be integrated into the loop above
      */
-    if (!code) {
-	afs_hyper_t h_unset;
-	hones(h_unset);
-
-	minj = 0;
-
-	do {
-	    moredata = FALSE;
-	    memset(dcList, 0,
-		   NCHUNKSATONCE * sizeof(struct dcache *));
-
-	    /* overkill, but it gets the lock in case GetDSlot needs it */
-	    ObtainWriteLock(&afs_xdcache, 285);
-
-	    for (j = 0, safety = 0, index = afs_dvhashTbl[hash];
-		 index != NULLIDX && safety < afs_cacheFiles + 2;
-	         index = afs_dvnextTbl[index]) {
-
-		if (afs_indexUnique[index] == avc->f.fid.Fid.Unique) {
-		    tdc = afs_GetValidDSlot(index);
-		    if (!tdc) {
-			/* This is okay; since manipulating the dcaches at this
-			 * point is best-effort. We only get a dcache here to
-			 * increment the dv and turn off DWriting. If we were
-			 * supposed to do that for a dcache, but could not
-			 * due to an I/O error, it just means the dv won't
-			 * be updated so we don't be able to use that cached
-			 * chunk in the future. That's inefficient, but not
-			 * an error. */
-			continue;
-		    }
-		    ReleaseReadLock(&tdc->tlock);
-
-		    if (!FidCmp(&tdc->f.fid, &avc->f.fid)
-			&& tdc->f.chunk >= minj) {
-			off = tdc->f.chunk - minj;
-			if (off < NCHUNKSATONCE) {
-			    /* this is the file, and the correct chunk range */
-			    if (j >= NCHUNKSATONCE)
-				osi_Panic
-				    ("Too many dcache entries in range\n");
-			    dcList[j++] = tdc;
-			} else {
-			    moredata = TRUE;
-			    afs_PutDCache(tdc);
-			    if (j == NCHUNKSATONCE)
-				break;
-			}
-		    } else {
-			afs_PutDCache(tdc);
-		    }
-		}
-	    }
-	    ReleaseWriteLock(&afs_xdcache);
-
-	    for (i = 0; i < j; i++) {
-		/* Iterate over the dcache entries we collected above */
-		tdc = dcList[i];
-		ObtainSharedLock(&tdc->lock, 677);
-
-		/* was code here to clear IFDataMod, but it should only be done
-		 * in storedcache and storealldcache.
-		 */
-		/* Only increase DV if we had up-to-date data to start with.
-		 * Otherwise, we could be falsely upgrading an old chunk
-		 * (that we never read) into one labelled with the current
-		 * DV #.  Also note that we check that no intervening stores
-		 * occurred, otherwise we might mislabel cache information
-		 * for a chunk that we didn't store this time
-		 */
-		/* Don't update the version number if it's not yet set. */
-		if (!hsame(tdc->f.versionNo, h_unset)
-		    && hcmp(tdc->f.versionNo, oldDV) >= 0) {
-
-		    if ((!(afs_dvhack || foreign)
-			 && hsame(avc->f.m.DataVersion, newDV))
-			|| ((afs_dvhack || foreign)
-			    && (origCBs == afs_allCBs))) {
-			/* no error, this is the DV */
-
-			UpgradeSToWLock(&tdc->lock, 678);
-			hset(tdc->f.versionNo, avc->f.m.DataVersion);
-			tdc->dflags |= DFEntryMod;
-			/* DWriting may not have gotten cleared above, if all
-			 * we did was a StoreMini */
-			tdc->f.states &= ~DWriting;
-			ConvertWToSLock(&tdc->lock);
-		    }
-		}
-
-		ReleaseSharedLock(&tdc->lock);
-		afs_PutDCache(tdc);
-	    }
-
-	    minj += NCHUNKSATONCE;
-
-	} while (moredata);
-    }
+    if (!code)
+	afs_UpdateStoredVersions(avc, dcList, &oldDV, &newDV, origCBs);
 
     if (code) {
 	/*
@@ -495,6 +551,163 @@ afs_StoreAllSegments(struct vcache *avc, struct vrequest *areq,
 
 }				/*afs_StoreAllSegments (new 03/02/94) */
 
+/*
+ * afs_StoreFilledSegments
+ *
+ * Description:
+ *	Write-behind: store the dirty chunks that lie wholly below the
+ *	file's length, which a sequential writer has finished with.
+ *	Unlike afs_StoreAllSegments, avc->lock is dropped over the
+ *	StoreData calls, so writers can go on extending the file; they
+ *	only wait if they touch a chunk that is being sent.
+ *	writeBehindActive keeps other stores and truncations out
+ *	meanwhile, as they would hold avc->lock for a normal store.
+ *
+ * Parameters:
+ *	avc  : Pointer to vcache entry.
+ *	areq : Pointer to request structure.
+ *
+ * Environment:
+ *	Called with avc write-locked; returns with it write-locked, but
+ *	drops it in between.
+ */
+int
+afs_StoreFilledSegments(struct vcache *avc, struct vrequest *areq)
+{
+    struct dcache *tdc;
+    struct dcache **dcList, **scratch;
+    struct AFSFetchStatus OutStatus;
+    afs_hyper_t newDV, oldDV;
+    afs_int32 code = 0;
+    afs_int32 index, origCBs, limit;
+    afs_size_t base, bytes, length;
+    unsigned int i, j, k, n;
+    int doProcessFS = 0;
+
+    AFS_STATCNT(afs_StoreFilledSegments);
+
+    avc->writeBehindChunks = 0;
+    /* A truncation has to go out with the rest of the file. */
+    if (AFS_IS_DISCONNECTED || avc->writeBehindActive
+	|| avc->f.truncPos != AFS_NOTRUNC)
+	return 0;
+#if !defined(AFS_AIX32_ENV) && !defined(AFS_SGI65_ENV)
+    if (cacheDiskType != AFS_FCACHE_TYPE_MEM)
+#endif
+    {
+	/* This may drop avc->lock, so look again afterwards. */
+	osi_VM_StoreAllSegments(avc);
+	if (avc->writeBehindActive || avc->f.truncPos != AFS_NOTRUNC)
+	    return 0;
+    }
+
+    hset(oldDV, avc->f.m.DataVersion);
+    hset(newDV, avc->f.m.DataVersion);
+    origCBs = afs_allCBs;
+    limit = AFS_CHUNK(avc->f.m.Length);
+    dcList = osi_AllocLargeSpace(AFS_LRALLOCSIZ);
+
+    /* Collect the dirty chunks below limit, sorted by chunk number. */
+    ObtainWriteLock(&afs_xdcache, 1219);
+    for (n = 0, index = afs_dvhashTbl[DVHash(&avc->f.fid)];
+	 index != NULLIDX && n < NCHUNKSATONCE;
+	 index = afs_dvnextTbl[index]) {
+	if ((afs_indexFlags[index] & IFDataMod)
+	    && (afs_indexUnique[index] == avc->f.fid.Fid.Unique)) {
+	    tdc = afs_GetValidDSlot(index);	/* refcount+1. */
+	    if (!tdc)
+		continue;	/* left for the final store */
+	    ReleaseReadLock(&tdc->tlock);
+	    if (!FidCmp(&tdc->f.fid, &avc->f.fid) && tdc->f.chunk < limit) {
+		for (i = n; i > 0 && dcList[i - 1]->f.chunk > tdc->f.chunk;
+		     i--)
+		    dcList[i] = dcList[i - 1];
+		dcList[i] = tdc;
+		n++;
+	    } else {
+		afs_PutDCache(tdc);
+	    }
+	}
+    }
+    ReleaseWriteLock(&afs_xdcache);
+
+    if (n == 0) {
+	osi_FreeLargeSpace(dcList);
+	return 0;
+    }
+    scratch = osi_AllocLargeSpace(AFS_LRALLOCSIZ);
+
+    /* avc->lock is dropped for the stores; keep the length it guards. */
+    length = avc->f.m.Length;
+    avc->writeBehindActive = 1;
+    ReleaseWriteLock(&avc->lock);
+
+    for (i = 0; i < n; i = j) {
+	/* Find the run of contiguous chunks starting at i and lock it;
+	 * a writer still in one of them has to finish first. */
+	for (j = i + 1;
+	     j < n && dcList[j]->f.chunk == dcList[j - 1]->f.chunk + 1; j++)
+	    ;
+	for (bytes = 0, k = i; k < j; k++) {
+	    tdc = dcList[k];
+	    ObtainSharedLock(&tdc->lock, 1220);
+	    bytes += tdc->f.chunkBytes;
+	    if ((tdc->f.chunkBytes < afs_OtherCSize) && (k < j - 1))
+		bytes += afs_OtherCSize - tdc->f.chunkBytes;
+	}
+
+	if (!code && bytes) {
+	    base = AFS_CHUNKTOBASE(dcList[i]->f.chunk);
+	    code = afs_CacheStoreRun(avc, areq, &dcList[i], j - i, base,
+				     bytes, length, AFS_ASYNC, 0,
+				     &newDV, &doProcessFS, &OutStatus);
+	    for (k = i; k < j && !code; k++) {
+		tdc = dcList[k];
+		if (afs_indexFlags[tdc->index] & IFDataMod) {
+		    afs_indexFlags[tdc->index] &= ~(IFDataMod | IFDirtyPages);
+		    afs_stats_cmperf.cacheCurrDirtyChunks--;
+		}
+	    }
+	}
+	for (k = i; k < j; k++) {
+	    tdc = dcList[k];
+	    UpgradeSToWLock(&tdc->lock, 1221);
+	    tdc->f.states &= ~DWriting;
+	    tdc->dflags |= DFEntryMod;
+	    ReleaseWriteLock(&tdc->lock);
+	    afs_PutDCache(tdc);
+	}
+
+	if (doProcessFS) {
+	    /* The chunk locks are gone, so this is in the usual order. */
+	    ObtainWriteLock(&avc->lock, 1222);
+	    afs_ProcessFS(avc, &OutStatus, areq);
+	    afs_UpdateStoredVersions(avc, scratch, &oldDV, &newDV, origCBs);
+	    if (hcmp(avc->mapDV, oldDV) >= 0
+		&& hsame(avc->f.m.DataVersion, newDV))
+		hset(avc->mapDV, newDV);
+	    hset(oldDV, newDV);
+	    length = avc->f.m.Length;
+	    ReleaseWriteLock(&avc->lock);
+	    doProcessFS = 0;
+	}
+    }
+
+    ObtainWriteLock(&avc->lock, 1223);
+    avc->writeBehindActive = 0;
+    afs_osi_Wakeup(&avc->writeBehindActive);
+    osi_FreeLargeSpace(scratch);
+    osi_FreeLargeSpace(dcList);
+
+    if (code && areq->permWriteError)
+	afs_InvalidateAllSegments(avc);
+    /* A temporary error is left for the final store to retry. */
+    if (code && !areq->permWriteError)
+	code = 0;
+
+    return code;
+}
+
 
 /*
  * afs_InvalidateAllSegments
@@ -744,6 +957,7 @@ afs_TruncateAllSegments(struct vcache *avc, afs_size_t alen,
 
     AFS_GLOCK();
     ObtainWriteLock(&avc->lock, 79);
+    afs_WaitWriteBehind(avc);
 
     avc->f.m.Length = alen;
 
@@ -274,46 +274,84 @@ afs_HaveCallBacksFrom(struct server *aserver)
 }				/*HaveCallBacksFrom */
 
 
+/* Ping the dead VL servers among sas to see if they're back.  They are all
+ * probed at once, so that this takes no longer than probing one. */
 static void
-CheckVLServer(struct srvAddr *sa, struct vrequest *areq)
+CheckVLServer(int nsas, struct srvAddr **sas, struct vrequest *areq)
 {
-    struct server *aserver = sa->server;
-    struct afs_conn *tc;
+    struct server *aserver;
+    struct srvAddr *sa;
+    struct afs_conn **conns;
+    struct rx_connection **rxconns;
+    struct srvAddr **probed;
+    afs_int32 *results;
     afs_int32 code;
-    struct rx_connection *rxconn;
+    int i, nconns;
 
     AFS_STATCNT(CheckVLServer);
-    /* Ping dead servers to see if they're back */
-    if (!((aserver->flags & SRVR_ISDOWN) || (sa->sa_flags & SRVADDR_ISDOWN))
-	|| (aserver->flags & SRVR_ISGONE))
+    if (nsas == 0)
 	return;
-    if (!aserver->cell)
-	return;			/* can't do much */
+    conns = afs_osi_Alloc(nsas * sizeof(struct afs_conn *));
+    osi_Assert(conns != NULL);
+    rxconns = afs_osi_Alloc(nsas * sizeof(struct rx_connection *));
+    osi_Assert(rxconns != NULL);
+    probed = afs_osi_Alloc(nsas * sizeof(struct srvAddr *));
+    osi_Assert(probed != NULL);
+    results = afs_osi_Alloc(nsas * sizeof(afs_int32));
+    osi_Assert(results != NULL);
 
-    tc = afs_ConnByHost(aserver, aserver->cell->vlport,
-			aserver->cell->cellNum, areq, 1, SHARED_LOCK, 0,
-			&rxconn);
-    if (!tc)
-	return;
-    rx_SetConnDeadTime(rxconn, 3);
+    nconns = 0;
+    for (i = 0; i < nsas; i++) {
+	sa = sas[i];
+	aserver = sa->server;
+	if (!((aserver->flags & SRVR_ISDOWN) || (sa->sa_flags & SRVADDR_ISDOWN))
+	    || (aserver->flags & SRVR_ISGONE))
+	    continue;
+	if (!aserver->cell)
+	    continue;		/* can't do much */
 
-    RX_AFS_GUNLOCK();
-    code = VL_ProbeServer(rxconn);
-    RX_AFS_GLOCK();
-    rx_SetConnDeadTime(rxconn, afs_rx_deadtime);
-    /*
-     * If probe worked, or probe call not yet defined (for compatibility
-     * with old vlsevers), then we treat this server as running again
-     */
-    if (code == 0 || (code <= -450 && code >= -470)) {
-	if (tc->parent->srvr == sa) {
-	    afs_MarkServerUpOrDown(sa, 0);
-	    print_internet_address("afs: volume location server ", sa,
-				   " is back up", 2, code, rxconn);
+	conns[nconns] = afs_ConnByHost(aserver, aserver->cell->vlport,
+				       aserver->cell->cellNum, areq, 1,
+				       SHARED_LOCK, 0, &rxconns[nconns]);
+	if (!conns[nconns])
+	    continue;
+	rx_SetConnDeadTime(rxconns[nconns], 3);
+	probed[nconns++] = sa;
+    }
+    if (nconns == 0)
+	goto out;
+
+    AFS_GUNLOCK();
+    multi_Rx(rxconns, nconns)
+      {
+	multi_VL_ProbeServer();
+	results[multi_i] = multi_error;
+      } multi_End;
+    AFS_GLOCK();
+
+    for (i = 0; i < nconns; i++) {
+	sa = probed[i];
+	code = results[i];
+	rx_SetConnDeadTime(rxconns[i], afs_rx_deadtime);
+	/*
+	 * If probe worked, or probe call not yet defined (for compatibility
+	 * with old vlsevers), then we treat this server as running again
+	 */
+	if (code == 0 || (code <= -450 && code >= -470)) {
+	    if (conns[i]->parent->srvr == sa) {
+		afs_MarkServerUpOrDown(sa, 0);
+		print_internet_address("afs: volume location server ", sa,
+				       " is back up", 2, code, rxconns[i]);
+	    }
 	}
+	afs_PutConn(conns[i], rxconns[i], SHARED_LOCK);
     }
-    afs_PutConn(tc, rxconn, SHARED_LOCK);
 
+  out:
+    afs_osi_Free(conns, nsas * sizeof(struct afs_conn *));
+    afs_osi_Free(rxconns, nsas * sizeof(struct rx_connection *));
+    afs_osi_Free(probed, nsas * sizeof(struct srvAddr *));
+    afs_osi_Free(results, nsas * sizeof(afs_int32));
 }				/*CheckVLServer */
 
 
@@ -634,6 +672,8 @@ afs_LoopServers(int adown, struct cell *acellp, int vlalso,
     int nconns;
     struct rx_connection **rxconns;
     afs_int32 *conntimer;
+    struct srvAddr **vlsas;
+    int nvlsas;
 
     AFS_STATCNT(afs_CheckServers);
 
@@ -676,8 +716,11 @@ afs_LoopServers(int adown, struct cell *acellp, int vlalso,
     osi_Assert(rxconns != NULL);
     conntimer = afs_osi_Alloc(j * sizeof (afs_int32));
     osi_Assert(conntimer != NULL);
+    vlsas = afs_osi_Alloc(j * sizeof(struct srvAddr *));
+    osi_Assert(vlsas != NULL);
 
     nconns = 0;
+    nvlsas = 0;
     for (i = 0; i < j; i++) {
 	struct rx_connection *rxconn;
 	sa = addrs[i];
@@ -695,10 +738,10 @@ afs_LoopServers(int adown, struct cell *acellp, int vlalso,
 	    || ((adown==AFS_LS_UP) && (sa->sa_flags & SRVADDR_ISDOWN)))
 	    continue;
 
-	/* check vlserver with special code */
+	/* check vlservers with special code, below */
 	if (sa->sa_portal == AFS_VLPORT) {
 	    if (vlalso)
-		CheckVLServer(sa, treq);
+		vlsas[nvlsas++] = sa;
 	    continue;
 	}
 
@@ -731,6 +774,9 @@ afs_LoopServers(int adown, struct cell *acellp, int vlalso,
     afs_osi_Free(addrs, srvAddrCount * sizeof(*addrs));
     addrs = NULL;
 
+    CheckVLServer(nvlsas, vlsas, treq);
+    afs_osi_Free(vlsas, j * sizeof(struct srvAddr *));
+
     (*func1)(nconns, rxconns, conns);
 
     if (func2) {
@@ -659,7 +659,12 @@ struct afs_MeanStats {
     AFS_CS(PPrefetchFromTape)   /* afs_pioctl.c */ \
     AFS_CS(PFlushAllVolumeData)	/* afs_pioctl.c */ \
     AFS_CS(afs_InitVolSlot)     /* afs_volume.c */ \
-    AFS_CS(afs_SetupVolSlot)    /* afs_volume.c */
+    AFS_CS(afs_SetupVolSlot)    /* afs_volume.c */ \
+    AFS_CS(afs_FindAxs)		/* afs_axscache.c */ \
+    AFS_CS(afs_ExpireVolumeInfo)	/* afs_volume.c */ \
+    AFS_CS(afs_RefreshVolume)	/* afs_volume.c */ \
+    AFS_CS(afs_RenewCallbacks)	/* afs_cbqueue.c */ \
+    AFS_CS(afs_StoreFilledSegments)	/* afs_segments.c */
 
 struct afs_CMCallStats {
 #define AFS_CS(call) afs_int32 C_ ## call;
@@ -668,12 +673,18 @@ struct afs_CMCallStats {
 };
 
 struct afs_CMMeanStats {
-    struct afs_MeanStats something;	/* fill this in */
+    struct afs_MeanStats cacheDrainWait;	/* ms writers waited for cache space */
+};
+
+struct afs_CMReadAheadStats {
+    afs_int32 hits;		/* sequential chunks already coming */
+    afs_int32 misses;		/* sequential chunks that had to fetch */
 };
 
 struct afs_CMStats {
     struct afs_CMCallStats callInfo;
     struct afs_CMMeanStats meanInfo;
+    struct afs_CMReadAheadStats readAheadInfo;
 };
 
 /*
@@ -831,11 +842,16 @@ struct afs_stats_CMPerf {
     afs_int32 cacheBucket0_Discarded;
     afs_int32 cacheBucket1_Discarded;
     afs_int32 cacheBucket2_Discarded;
-
-    /*
-     * Spares for future expansion.
-     */
-    afs_int32 spare[10];	/*Spares */
+    afs_int32 readAheadHits;	/*# sequential reads with data already coming */
+    afs_int32 readAheadMisses;	/*# sequential reads that had to fetch */
+    afs_int32 dnlcHits;		/*# name cache lookups that found a vnode */
+    afs_int32 dnlcMisses;	/*# name cache lookups that did not */
+    afs_int32 dnlcNegativeHits;	/*# misses answered by a negative entry */
+    afs_int32 dcacheEvictions;	/*# dcache entries reclaimed by GetDownD */
+    afs_int32 dcacheGhostHits;	/*# 2Q misses on chunks recently evicted */
+    afs_int32 warmChunksReused;	/*# cached chunks still valid at warm restart */
+    afs_int32 warmChunksStale;	/*# cached chunks found stale at warm restart */
+    afs_int32 accessCacheMisses;	/*# afs_FindAxs calls finding no entry */
 };
 
 
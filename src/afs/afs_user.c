@@ -145,8 +145,8 @@ afs_CheckTokenCache(void)
     struct unixuser *tu;
     afs_int32 now;
     struct vcache *tvc;
-    struct axscache *tofreelist;
-    int do_scan = 0;
+    struct axstable *tp;
+    int j, do_scan = 0;
 
     AFS_STATCNT(afs_CheckCacheResets);
     ObtainReadLock(&afs_xvcache);
@@ -175,32 +175,22 @@ afs_CheckTokenCache(void)
     if (!do_scan)
 	goto done;
 
-    tofreelist = NULL;
     for (i = 0; i < VCSIZE; i++) {
 	for (tvc = afs_vhashT[i]; tvc; tvc = tvc->hnext) {
 	    /* really should do this under cache write lock, but that.
 	     * is hard to under locking hierarchy */
-	    if (tvc->Access) {
-		struct axscache **ac, **nac;
-
-		for ( ac = &tvc->Access; *ac;)  {
-		    nac = &(*ac)->next;
-		    tu = afs_FindUserNoLock((*ac)->uid, tvc->f.fid.Cell);
-		    if (tu == NULL || (tu->states & UNeedsReset)) {
-			struct axscache *tmp;
-			tmp = *ac;
-			*ac = *nac;
-			tmp->next = tofreelist;
-			tofreelist = tmp;
-		    } else
-			ac = nac;
-		    if (tu != NULL)
-			tu->refCount--;
-		}
+	    /* removing the last entry frees the table */
+	    for (j = 0; (tp = tvc->Access) != NULL && j < tp->size; j++) {
+		if (axs_State(tp, j) != AXS_USED)
+		    continue;
+		tu = afs_FindUserNoLock(tp->slot[j].uid, tvc->f.fid.Cell);
+		if (tu == NULL || (tu->states & UNeedsReset))
+		    afs_RemoveAxs(&tvc->Access, &tp->slot[j]);
+		if (tu != NULL)
+		    tu->refCount--;
 	    }
 	}
     }
-    afs_FreeAllAxs(&tofreelist);
     for (i = 0; i < NUSERS; i++) {
 	for (tu = afs_users[i]; tu; tu = tu->next) {
 	    if (tu->states & UNeedsReset)
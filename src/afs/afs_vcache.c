@@ -868,6 +868,13 @@ afs_PrePopulateVCache(struct vcache *avc, struct VenusFid *afid,
     avc->f.fid = *afid;
     avc->asynchrony = -1;
     avc->vc_error = 0;
+    avc->readAhead = 0;
+    avc->readAheadChunk = -1;
+    avc->readAheadCounted = -1;
+    avc->writeBehindChunks = 0;
+    avc->writeBehindQueued = 0;
+    avc->writeBehindActive = 0;
+    avc->bulkStatCookie = -1;
 
     hzero(avc->mapDV);
     avc->f.truncPos = AFS_NOTRUNC;   /* don't truncate until we need to */
@@ -2056,13 +2063,13 @@ afs_LookupVCache(struct VenusFid *afid, struct vrequest *areq,
 	    tvc->cbExpires = CallBack.ExpirationTime + now;
 	    tvc->f.states |= CStatd | CUnique;
 	    tvc->f.states &= ~CBulkFetching;
-	    afs_QueueCallback(tvc, CBHash(CallBack.ExpirationTime), tvp);
+	    afs_QueueCallback(tvc, tvp);
 	} else if (tvc->f.states & CRO) {
 	    /* adapt gives us an hour. */
 	    tvc->cbExpires = 3600 + osi_Time();
 	     /*XXX*/ tvc->f.states |= CStatd | CUnique;
 	    tvc->f.states &= ~CBulkFetching;
-	    afs_QueueCallback(tvc, CBHash(3600), tvp);
+	    afs_QueueCallback(tvc, tvp);
 	} else {
 	    tvc->callback = NULL;
 	    afs_DequeueCallback(tvc);
@@ -2294,13 +2301,13 @@ afs_GetRootVCache(struct VenusFid *afid, struct vrequest *areq,
 	    tvc->cbExpires = CallBack.ExpirationTime + start;
 	    tvc->f.states |= CStatd;
 	    tvc->f.states &= ~CBulkFetching;
-	    afs_QueueCallback(tvc, CBHash(CallBack.ExpirationTime), tvolp);
+	    afs_QueueCallback(tvc, tvolp);
 	} else if (tvc->f.states & CRO) {
 	    /* adapt gives us an hour. */
 	    tvc->cbExpires = 3600 + osi_Time();
 	     /*XXX*/ tvc->f.states |= CStatd;
 	    tvc->f.states &= ~CBulkFetching;
-	    afs_QueueCallback(tvc, CBHash(3600), tvolp);
+	    afs_QueueCallback(tvc, tvolp);
 	}
     } else {
 	afs_DequeueCallback(tvc);
@@ -2349,13 +2356,13 @@ afs_UpdateStatus(struct vcache *avc, struct VenusFid *afid,
 	    avc->cbExpires = acb->ExpirationTime + start;
 	    avc->f.states |= CStatd;
 	    avc->f.states &= ~CBulkFetching;
-	    afs_QueueCallback(avc, CBHash(acb->ExpirationTime), volp);
+	    afs_QueueCallback(avc, volp);
     	} else if (avc->f.states & CRO) {
 	    /* ordinary callback on a read-only volume -- AFS 3.2 style */
 	    avc->cbExpires = 3600 + start;
 	    avc->f.states |= CStatd;
 	    avc->f.states &= ~CBulkFetching;
-	    afs_QueueCallback(avc, CBHash(3600), volp);
+	    afs_QueueCallback(avc, volp);
     	} else {
 	    afs_DequeueCallback(avc);
 	    avc->callback = NULL;
@@ -2588,13 +2595,13 @@ afs_StuffVcache(struct VenusFid *afid,
 	tvc->cbExpires = CallBack->ExpirationTime + osi_Time() - 1;
 	tvc->f.states |= CStatd;
 	tvc->f.states &= ~CBulkFetching;
-	afs_QueueCallback(tvc, CBHash(CallBack->ExpirationTime), tvp);
+	afs_QueueCallback(tvc, tvp);
     } else if (tvc->f.states & CRO) {
 	/* old-fashioned AFS 3.2 style */
 	tvc->cbExpires = 3600 + osi_Time();
 	 /*XXX*/ tvc->f.states |= CStatd;
 	tvc->f.states &= ~CBulkFetching;
-	afs_QueueCallback(tvc, CBHash(3600), tvp);
+	afs_QueueCallback(tvc, tvp);
     } else {
 	afs_DequeueCallback(tvc);
 	tvc->callback = NULL;
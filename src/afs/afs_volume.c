@@ -14,6 +14,8 @@
  * afs_MemGetVolSlot
  * afs_CheckVolumeNames
  * afs_FindVolume
+ * afs_ExpireVolumeInfo
+ * afs_RefreshVolume
  */
 #include <afsconfig.h>
 #include "afs/param.h"
@@ -61,6 +63,22 @@ struct volume *afs_volumes[NVOLS];
 afs_int32 afs_volCounter = 1;	/** for allocating volume indices */
 afs_int32 fvTable[NFENTRIES];
 
+/* Volume names the VLDB has recently told us do not exist, so that looking
+ * them up again (a typo, a stale automount map) need not go back to the VL
+ * servers every time.  Protected by afs_xvolume. */
+#define AFS_NEGVOLS	64	/* size of the table; a power of 2 */
+#define AFS_NEGVOLTTL	60	/* seconds we believe a VL_NOENT for */
+struct afs_negvol {
+    afs_int32 cell;
+    afs_int32 expires;		/* 0 if the slot is empty */
+    char name[VL_MAXNAMELEN + 1];
+};
+static struct afs_negvol afs_negvols[AFS_NEGVOLS];
+
+/* seconds since last use within which a read-only volume whose callback
+ * expires is refreshed in the background, rather than rechecked on use */
+#define AFS_VOLINUSE	1200
+
 /* Forward declarations */
 static struct volume *afs_NewVolumeByName(char *aname, afs_int32 acell,
 					  int agood, struct vrequest *areq,
@@ -372,7 +390,7 @@ afs_SetupVolSlot(afs_int32 volid, struct cell *tcell)
 	afs_volumes[i] = tv;
     }
     tv->refCount++;
-    tv->states &= ~VRecheck;	/* just checked it */
+    tv->states &= ~(VRecheck | VRefreshing);	/* just checked it */
     tv->accessTime = osi_Time();
     ReleaseWriteLock(&afs_xvolume);
     return tv;
@@ -444,12 +462,17 @@ afs_CheckVolumeNames(int flags)
     }
 
     now = osi_Time();
+    if (flags & AFS_VOLCHECK_FORCE)
+	memset(afs_negvols, 0, sizeof(afs_negvols));
     for (i = 0; i < NVOLS; i++) {
 	for (tv = afs_volumes[i]; tv; tv = tv->next) {
 	    if (flags & AFS_VOLCHECK_EXPIRED) {
 		if (((tv->expireTime < (now + 10)) && (tv->states & VRO))
 		    || (flags & AFS_VOLCHECK_FORCE)) {
-		    afs_ResetVolumeInfo(tv);	/* also resets status */
+		    if (flags & AFS_VOLCHECK_FORCE)
+			afs_ResetVolumeInfo(tv);	/* also resets status */
+		    else
+			afs_ExpireVolumeInfo(tv);
 		    if (volumeID) {
 			volumeID[nvols] = tv->volume;
 			cellID[nvols] = tv->cell;
@@ -603,6 +626,7 @@ afs_FindVolume(struct VenusFid *afid, afs_int32 locktype)
 	if (tv->volume == afid->Fid.Volume && tv->cell == afid->Cell
 	    && (tv->states & VRecheck) == 0) {
 	    tv->refCount++;
+	    tv->accessTime = osi_Time();
 	    break;
 	}
     }
@@ -716,6 +740,45 @@ afs_SetupVolume(afs_int32 volid, char *aname, void *ve, struct cell *tcell,
 }
 
 
+static struct afs_negvol *
+NegVolSlot(char *aname, afs_int32 acell)
+{
+    afs_uint32 h = acell;
+
+    while (*aname)
+	h = h * 31 + (unsigned char)*aname++;
+    return &afs_negvols[h & (AFS_NEGVOLS - 1)];
+}
+
+/**
+ * Is this volume name one the VLDB recently said does not exist?
+ * Environment: must be called with afs_xvolume held.
+ */
+static int
+afs_FindNegVolume(char *aname, afs_int32 acell)
+{
+    struct afs_negvol *tn = NegVolSlot(aname, acell);
+
+    return (tn->expires > osi_Time() && tn->cell == acell
+	    && !strcmp(tn->name, aname));
+}
+
+/* Remember that the VLDB says there is no volume aname in acell. */
+static void
+afs_AddNegVolume(char *aname, afs_int32 acell)
+{
+    struct afs_negvol *tn;
+
+    if (strlen(aname) > VL_MAXNAMELEN)
+	return;
+    ObtainWriteLock(&afs_xvolume, 949);
+    tn = NegVolSlot(aname, acell);
+    tn->cell = acell;
+    strcpy(tn->name, aname);
+    tn->expires = osi_Time() + AFS_NEGVOLTTL;
+    ReleaseWriteLock(&afs_xvolume);
+}
+
 /**
  * Seek volume by it's name and attributes.
  * If volume not found, try to add one.
@@ -740,11 +803,18 @@ afs_GetVolumeByName(char *aname, afs_int32 acell, int agood,
 	    if (tv->name && !strcmp(aname, tv->name) && tv->cell == acell
 		&& (tv->states & VRecheck) == 0) {
 		tv->refCount++;
+		tv->accessTime = osi_Time();
 		ReleaseWriteLock(&afs_xvolume);
 		return tv;
 	    }
 	}
     }
+    if (afs_FindNegVolume(aname, acell)) {
+	ReleaseWriteLock(&afs_xvolume);
+	if (areq)
+	    areq->volumeError = VOLMISSING;
+	return NULL;
+    }
 
     ReleaseWriteLock(&afs_xvolume);
 
@@ -790,6 +860,105 @@ afs_NewDynrootVolume(struct VenusFid *fid)
 
 int lastnvcode;
 
+/* VL servers a volume name is looked up on at once */
+#define AFS_VLRACE	2
+
+/**
+ * Look a volume name up on several of a cell's VL servers at once and take
+ * the first answer, so that a VL server which has died, but which we do not
+ * yet know to be down, does not hold the lookup up for the whole dead time.
+ *
+ * Only up servers not known to lack VL_GetEntryByNameU are asked, the best
+ * ranked first.  Servers that fail with network errors before the answer
+ * comes are marked down.
+ *
+ * @param tcell The cell.
+ * @param aname Volume name.
+ * @param utve Where to put the entry.
+ * @param areq Request to make the calls for.
+ * @param aconn Connection the answer came on, still held.
+ * @param arxconn Rx connection the answer came on.
+ * @param acode The answer; 0 or a VL error.
+ *
+ * @return 0 if a server answered, nonzero if fewer than two servers could
+ *	be asked or none of them answered.  The caller should then ask the
+ *	servers one at a time.
+ */
+static int
+afs_RaceVLGetEntryByName(struct cell *tcell, char *aname,
+			 struct uvldbentry *utve, struct vrequest *areq,
+			 struct afs_conn **aconn,
+			 struct rx_connection **arxconn, afs_int32 *acode)
+{
+    struct afs_conn *tconns[AFS_VLRACE];
+    struct rx_connection *rxconns[AFS_VLRACE];
+    afs_int32 codes[AFS_VLRACE];
+    char done[AFS_VLRACE];
+    struct uvldbentry *ves;
+    struct server *ts, *hosts[AFS_MAXCELLHOSTS];
+    int i, j, nhosts = 0, n = 0, winner = -1;
+
+    /* cellHosts was sorted when set up, but ranks may have changed since */
+    for (i = 0; i < AFS_MAXCELLHOSTS; i++) {
+	if ((ts = tcell->cellHosts[i]) == NULL)
+	    break;
+	if (!ts->addr || (ts->flags & (SRVR_ISDOWN | SNO_LHOSTS | SYES_LHOSTS)))
+	    continue;
+	for (j = nhosts;
+	     j > 0 && hosts[j - 1]->addr->sa_iprank > ts->addr->sa_iprank; j--)
+	    hosts[j] = hosts[j - 1];
+	hosts[j] = ts;
+	nhosts++;
+    }
+    for (i = 0; i < nhosts && n < AFS_VLRACE; i++) {
+	tconns[n] = afs_ConnByHost(hosts[i], tcell->vlport, tcell->cellNum,
+				   areq, 0, SHARED_LOCK, 0, &rxconns[n]);
+	if (tconns[n])
+	    n++;
+    }
+    ves = NULL;
+    if (n >= 2)
+	ves = afs_osi_Alloc(n * sizeof(*ves));
+    if (ves == NULL) {
+	for (i = 0; i < n; i++)
+	    afs_PutConn(tconns[i], rxconns[i], SHARED_LOCK);
+	return -1;
+    }
+    memset(ves, 0, n * sizeof(*ves));
+    memset(done, 0, sizeof(done));
+
+    RX_AFS_GUNLOCK();
+    multi_Rx(rxconns, n) {
+	multi_VL_GetEntryByNameU(aname, &ves[multi_i]);
+	codes[multi_i] = multi_error;
+	done[multi_i] = 1;
+	if (multi_error == 0 || (multi_error >= ERROR_TABLE_BASE_VL
+				 && multi_error <= ERROR_TABLE_BASE_VL + 255)) {
+	    winner = multi_i;
+	    multi_Abort;
+	}
+    } multi_End;
+    RX_AFS_GLOCK();
+
+    for (i = 0; i < n; i++) {
+	if (i == winner)
+	    continue;
+	if (done[i] && codes[i] < 0 && codes[i] != RXGEN_OPCODE)
+	    afs_ServerDown(tconns[i]->parent->srvr, codes[i], rxconns[i]);
+	afs_PutConn(tconns[i], rxconns[i], SHARED_LOCK);
+    }
+    if (winner >= 0) {
+	ts = tconns[winner]->parent->srvr->server;
+	ts->flags |= SVLSRV_UUID;
+	*utve = ves[winner];
+	*aconn = tconns[winner];
+	*arxconn = rxconns[winner];
+	*acode = codes[winner];
+    }
+    afs_osi_Free(ves, n * sizeof(*ves));
+    return (winner >= 0) ? 0 : -1;
+}
+
 /**
  * @param aname Volume name.
  * @param acell Cell id.
@@ -838,6 +1007,15 @@ afs_NewVolumeByName(char *aname, afs_int32 acell, int agood,
     ntve = (struct nvldbentry *)tve;
     utve = (struct uvldbentry *)tve;
 
+    if (afs_RaceVLGetEntryByName(tcell, aname, utve, treq, &tconn, &rxconn,
+				 &code) == 0) {
+	type = 2;
+	lastnvcode = code;
+	if (!afs_Analyze(tconn, rxconn, code, NULL, treq, -1, SHARED_LOCK,
+			 tcell))
+	    goto answered;
+    }
+
     do {
 	tconn =
 	    afs_ConnByMHosts(tcell->cellHosts, tcell->vlport, tcell->cellNum,
@@ -882,6 +1060,7 @@ afs_NewVolumeByName(char *aname, afs_int32 acell, int agood,
     } while (afs_Analyze(tconn, rxconn, code, NULL, treq, -1,	/* no op code for this */
 			 SHARED_LOCK, tcell));
 
+  answered:
     if (code) {
 	/* If the client has yet to contact this cell and contact failed due
 	 * to network errors, mark the VLDB servers as back up.
@@ -902,6 +1081,8 @@ afs_NewVolumeByName(char *aname, afs_int32 acell, int agood,
 	    }
 	}
 #endif
+	if (code == VL_NOENT)
+	    afs_AddNegVolume(aname, acell);
 	afs_CopyError(treq, areq);
 	osi_FreeLargeSpace(tbuffer);
 	afs_PutCell(tcell, READ_LOCK);
@@ -1259,6 +1440,62 @@ LockAndInstallUVolumeEntry(struct volume *av, struct uvldbentry *ve, int acell,
 }				/*InstallVolumeEntry */
 
 
+/**
+ *   The callbacks on a read-only volume have expired, so its location
+ * may be out of date.  If the volume is in use, look it up again in the
+ * background, so that nobody has to wait on the VLDB for it; otherwise
+ * just mark it to be rechecked next time it is used.
+ * @param tv
+ */
+void
+afs_ExpireVolumeInfo(struct volume *tv)
+{
+    AFS_STATCNT(afs_ExpireVolumeInfo);
+    if (tv->accessTime + AFS_VOLINUSE > osi_Time()) {
+	if (tv->states & VRefreshing)
+	    return;
+	if (afs_BQueue(BOP_VOLREFRESH, NULL, B_DONTWAIT, 0, afs_osi_credp,
+		       (afs_size_t)tv->volume, (afs_size_t)tv->cell,
+		       NULL, NULL, NULL)) {
+	    tv->states |= VRefreshing;
+	    return;
+	}
+    }
+    afs_ResetVolumeInfo(tv);
+}
+
+/**
+ *   Look a volume up in the VLDB again on behalf of afs_ExpireVolumeInfo,
+ * installing what we find in its existing volume structure.  If it can't
+ * be looked up, mark it to be rechecked when next used, as we would have
+ * done in the first place.
+ * @param volid Volume ID.
+ * @param cell Cell.
+ * @param areq Request to make the calls for.
+ */
+void
+afs_RefreshVolume(afs_int32 volid, afs_int32 cell, struct vrequest *areq)
+{
+    struct volume *tv;
+    struct VenusFid tfid;
+    char *bp, tbuf[CVBS];
+
+    AFS_STATCNT(afs_RefreshVolume);
+    bp = afs_cv2string(&tbuf[CVBS], volid);
+    tv = afs_NewVolumeByName(bp, cell, 0, areq, READ_LOCK);
+    if (tv) {
+	afs_PutVolume(tv, READ_LOCK);
+	return;
+    }
+    tfid.Cell = cell;
+    tfid.Fid.Volume = volid;
+    tv = afs_FindVolume(&tfid, READ_LOCK);
+    if (tv) {
+	afs_ResetVolumeInfo(tv);
+	afs_PutVolume(tv, READ_LOCK);
+    }
+}
+
 /**
  *   Reset volume info for the specified volume strecture. Mark volume
  * to be rechecked next time.
@@ -1272,6 +1509,7 @@ afs_ResetVolumeInfo(struct volume *tv)
     AFS_STATCNT(afs_ResetVolumeInfo);
     ObtainWriteLock(&tv->lock, 117);
     tv->states |= VRecheck;
+    tv->states &= ~VRefreshing;
 
     /* the hard-mount code in afs_Analyze may not be able to reset this flag
      * when VRecheck is set, so clear it here to ensure it gets cleared. */
@@ -85,6 +85,7 @@
 #include <afs/stds.h>
 #include <afs/opr.h>
 #include <afs/opr_assert.h>
+#include <opr/jhash.h>
 
 #include <afs/cmd.h>
 
@@ -94,6 +95,7 @@
 
 #include <sys/file.h>
 #include <sys/wait.h>
+#include <pthread.h>
 #include <hcrypto/rand.h>
 
 /* darwin dirent.h doesn't give us the prototypes we want if KERNEL is
@@ -186,6 +188,8 @@ static int event_pid;
 #define	DCACHEFILE	"CacheItems"
 #define	VOLINFOFILE	"VolumeItems"
 #define CELLINFOFILE	"CellItems"
+#define MANIFESTFILE	"CacheManifest"
+#define MANIFESTTEMP	"CacheManifest.new"
 
 #define MAXIPADDRS 1024
 
@@ -231,6 +235,8 @@ static char *confDir;		/*Where the workstation AFS configuration lives */
 static char fullpn_DCacheFile[1024];	/*Full pathname of DCACHEFILE */
 static char fullpn_VolInfoFile[1024];	/*Full pathname of VOLINFOFILE */
 static char fullpn_CellInfoFile[1024];	/*Full pathanem of CELLINFOFILE */
+static char fullpn_Manifest[1024];	/*Full pathname of MANIFESTFILE */
+static char fullpn_ManifestTemp[1024];	/*Full pathname of MANIFESTTEMP */
 static char fullpn_CacheInfo[1024];	/*Full pathname of CACHEINFO */
 static char fullpn_VFile[1024];	/*Full pathname of data cache files */
 static char *vFilePtr;			/*Ptr to the number part of above pathname */
@@ -252,6 +258,8 @@ static int createAndTrunc = O_CREAT | O_TRUNC;	/*Create & truncate on open */
 static int ownerRWmode = 0600;		/*Read/write OK by owner */
 static int filesSet = 0;	/*True if number of files explicitly set */
 static int nFilesPerDir = 2048;	/* # files per cache dir */
+static int nSweepThreads = 1;	/* # threads sweeping cache subdirs */
+static int nTruncThreads = 2;	/* # cache truncation daemons */
 #if defined(AFS_CACHE_BYPASS)
 #define AFSD_NDAEMONS 4
 #else
@@ -274,8 +282,11 @@ static int enable_afsdb = 0;	/* enable AFSDB support */
 static int enable_dynroot = 0;	/* enable dynroot support */
 static int enable_fakestat = 0;	/* enable fakestat support */
 static int enable_backuptree = 0;	/* enable backup tree support */
+static int enable_warmrestart = 0;	/* revalidate the cache at startup */
+static int enable_cbrenew = 0;	/* renew callbacks of open files early */
 static int enable_nomount = 0;	/* do not mount */
 static int enable_splitcache = 0;
+static int cachePolicy = AFS_DCPOLICY_LRU;
 static int afsd_dynamic_vcaches = 0;	/* Enable dynamic-vcache support */
 int afsd_verbose = 0;		/*Are we being chatty? */
 int afsd_debug = 0;		/*Are we printing debugging info? */
@@ -359,6 +370,11 @@ enum optionsList {
     OPT_rxmaxmtu,
     OPT_dynrootsparse,
     OPT_rxmaxfrags,
+    OPT_cachepolicy,
+    OPT_sweepthreads,
+    OPT_warmrestart,
+    OPT_cbrenew,
+    OPT_truncthreads,
 };
 
 #ifdef MACOS_EVENT_HANDLING
@@ -937,6 +953,103 @@ UnlinkUnwantedFile(char *rn, char *fullpn_FileToDelete, char *fileToDelete)
     }
 }
 
+/*
+ * The cache subdirectories found at the top level of the cache are swept
+ * once the top level has been read, by up to nSweepThreads threads at once.
+ * Each subdirectory only touches its own cache_dir_list and
+ * cache_dir_filelist slots and the inode_for_V and dir_for_V slots of the
+ * files in it, so the threads only need to share the list of
+ * subdirectories still to do and the totals.
+ */
+struct afsd_sweep_dir {
+    int dirNum;			/* subdirectory number */
+    int maxDir;			/* 0 if it is staying, -1 if going away */
+};
+
+struct afsd_sweep_work {
+    char *directory;		/* top level cache directory */
+    struct afsd_sweep_dir *dirs;	/* subdirectories to sweep */
+    int ndirs;
+    int next;			/* next entry in dirs to sweep */
+    int vFilesFound;		/* data cache files found so far */
+    int code;			/* first failure */
+    pthread_mutex_t lock;
+};
+
+static int doSweepAFSCache(int *vFilesFound, char *directory, int dirNum,
+			   int maxDir);
+
+static void *
+SweepSubDirs(void *rock)
+{
+    static char rn[] = "doSweepAFSCache";	/* Routine Name */
+    struct afsd_sweep_work *work = rock;
+    char dir[1024];
+    int i, found, code;
+
+    for (;;) {
+	opr_Verify(pthread_mutex_lock(&work->lock) == 0);
+	if (work->code || work->next >= work->ndirs) {
+	    opr_Verify(pthread_mutex_unlock(&work->lock) == 0);
+	    break;
+	}
+	i = work->next++;
+	opr_Verify(pthread_mutex_unlock(&work->lock) == 0);
+
+	found = 0;
+	snprintf(dir, sizeof(dir), "%s/D%d", work->directory,
+		 work->dirs[i].dirNum);
+	code = doSweepAFSCache(&found, dir, work->dirs[i].dirNum,
+			       work->dirs[i].maxDir);
+
+	opr_Verify(pthread_mutex_lock(&work->lock) == 0);
+	work->vFilesFound += found;
+	if (code && !work->code) {
+	    printf("%s: Recursive sweep failed on directory D%d\n", rn,
+		   work->dirs[i].dirNum);
+	    work->code = code;
+	}
+	opr_Verify(pthread_mutex_unlock(&work->lock) == 0);
+    }
+    return NULL;
+}
+
+/* Sweep the ndirs subdirectories in dirs of the cache directory, adding
+ * the data cache files found to vFilesFound. */
+static int
+SweepAFSCacheDirs(int *vFilesFound, char *directory,
+		  struct afsd_sweep_dir *dirs, int ndirs)
+{
+    struct afsd_sweep_work work;
+    pthread_t *tids = NULL;
+    int i, nthreads = 0;
+
+    memset(&work, 0, sizeof(work));
+    work.directory = directory;
+    work.dirs = dirs;
+    work.ndirs = ndirs;
+    opr_Verify(pthread_mutex_init(&work.lock, NULL) == 0);
+
+    /* This thread does its share as well; if no more threads can be
+     * started, it just does more of the work itself. */
+    if (nSweepThreads > 1 && ndirs > 1) {
+	tids = calloc(nSweepThreads - 1, sizeof(*tids));
+	for (i = 0; tids && i < nSweepThreads - 1 && i < ndirs - 1; i++) {
+	    if (pthread_create(&tids[i], NULL, SweepSubDirs, &work) != 0)
+		break;
+	    nthreads++;
+	}
+    }
+    SweepSubDirs(&work);
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+    free(tids);
+    opr_Verify(pthread_mutex_destroy(&work.lock) == 0);
+
+    *vFilesFound += work.vFilesFound;
+    return work.code;
+}
+
 /*-----------------------------------------------------------------------------
   * SweepAFSCache
   *
@@ -984,6 +1097,8 @@ doSweepAFSCache(int *vFilesFound,
     int vFileNum;		/*Data cache file's associated number */
     int thisDir;		/* A directory number */
     int highDir = 0;
+    struct afsd_sweep_dir *subdirs = NULL;	/* subdirectories to sweep */
+    int nsubdirs = 0, maxsubdirs = 0;
 
     if (afsd_debug)
 	printf("%s: Opening cache directory '%s'\n", rn, directory);
@@ -1001,8 +1116,8 @@ doSweepAFSCache(int *vFilesFound,
 
     /*
      * Scan the directory entries, remembering data cache file inodes
-     * and the existance of other important residents.  Recurse into
-     * the data subdirectories.
+     * and the existance of other important residents.  Remember the
+     * data subdirectories, to sweep them once this directory is done.
      *
      * Delete all files and directories that don't belong here.
      */
@@ -1095,18 +1210,29 @@ doSweepAFSCache(int *vFilesFound,
 	    if (retval == 1)
 		cache_dir_list[vFileNum] = 0;
 
-	    /* Print the dirname for recursion */
-	    sprintf(fileToDelete, "%s", currp->d_name);
+	    if (nsubdirs == maxsubdirs) {
+		struct afsd_sweep_dir *tmp;
 
-	    /* Note: vFileNum is the directory number */
-	    retval =
-		doSweepAFSCache(vFilesFound, fullpn_FileToDelete, vFileNum,
-				(retval == 1 ? 0 : -1));
-	    if (retval) {
-		printf("%s: Recursive sweep failed on directory %s\n", rn,
-		       currp->d_name);
-		return retval;
+		maxsubdirs = maxsubdirs ? maxsubdirs * 2 : 64;
+		tmp = realloc(subdirs, maxsubdirs * sizeof(*subdirs));
+		if (tmp == NULL) {
+		    printf("%s: MALLOC FAILED allocating subdir list\n", rn);
+		    free(subdirs);
+		    closedir(cdirp);
+		    return (-1);
+		}
+		subdirs = tmp;
 	    }
+	    /* Note: vFileNum is the directory number */
+	    subdirs[nsubdirs].dirNum = vFileNum;
+	    subdirs[nsubdirs].maxDir = (retval == 1 ? 0 : -1);
+	    nsubdirs++;
+	} else if (dirNum < 0
+		   && (strcmp(currp->d_name, MANIFESTFILE) == 0
+		       || strcmp(currp->d_name, MANIFESTTEMP) == 0)) {
+	    /*
+	     * The cache manifest; it is checked or replaced afterwards.
+	     */
 	} else if (dirNum < 0 && strcmp(currp->d_name, DCACHEFILE) == 0) {
 	    /*
 	     * Found the file holding the dcache entries.
@@ -1152,6 +1278,17 @@ doSweepAFSCache(int *vFilesFound,
 	}
     }
 
+    if (nsubdirs > 0) {
+	int code;
+
+	code = SweepAFSCacheDirs(vFilesFound, directory, subdirs, nsubdirs);
+	free(subdirs);
+	if (code) {
+	    closedir(cdirp);
+	    return code;
+	}
+    }
+
     if (dirNum < 0) {
 
 	/*
@@ -1427,6 +1564,273 @@ SweepAFSCache(int *vFilesFound)
     return doSweepAFSCache(vFilesFound, cacheBaseDir, -2, maxDir);
 }
 
+/*-----------------------------------------------------------------------------
+  * Cache manifest
+  *
+  * Description:
+  *	Once a sweep has found every data cache file, the layout it found is
+  *	written to MANIFESTTEMP.  A clean shutdown stamps it with the size
+  *	and modification time of CacheItems and of every cache subdirectory
+  *	and renames it to MANIFESTFILE.  If all of those still match at the
+  *	next startup, nothing has been added to or removed from the cache
+  *	since, and the layout is taken from the manifest instead of sweeping
+  *	the cache again.  MANIFESTFILE is renamed back to MANIFESTTEMP as
+  *	soon as it has been used, so that a crash always leads to a sweep.
+  *---------------------------------------------------------------------------*/
+
+#define AFSD_MANIFEST_MAGIC	0x4146534d	/* "AFSM" */
+
+#if !defined(AFS_CACHE_VNODE_PATH) && !defined(AFS_LINUX26_ENV)
+#define AFSD_MANIFEST_INOSIZE	sizeof(AFSD_INO_T)
+#else
+#define AFSD_MANIFEST_INOSIZE	0
+#endif
+
+struct afsd_manifest {
+    afs_uint32 magic;
+    afs_uint32 checksum;	/* of the whole file, with this zeroed */
+    afs_int32 cacheFiles;
+    afs_int32 filesPerDir;
+    afs_int32 maxDir;
+    afs_int32 inodeSize;	/* size of each inode_for_V entry, or 0 */
+    afs_int32 sealed;		/* stamped at a clean shutdown */
+    afs_int32 spare;
+    afs_int64 itemsSize;	/* size of CacheItems */
+    afs_int64 itemsMtime;	/* modification time of CacheItems */
+    /* followed by dir_for_V[cacheFiles], inode_for_V[cacheFiles] if
+     * inodeSize is not 0, and the afs_int64 modification time of each of
+     * the maxDir subdirectories */
+};
+
+struct afsd_manifest_data {
+    struct afsd_manifest hdr;
+    int *dirs;
+    AFSD_INO_T *inodes;
+    afs_int64 *mtimes;
+};
+
+static void
+FreeCacheManifest(struct afsd_manifest_data *m)
+{
+    free(m->dirs);
+    free(m->inodes);
+    free(m->mtimes);
+    memset(m, 0, sizeof(*m));
+}
+
+static afs_uint32
+CacheManifestChecksum(struct afsd_manifest_data *m)
+{
+    struct afsd_manifest hdr = m->hdr;
+    afs_uint32 sum;
+
+    hdr.checksum = 0;
+    sum = opr_jhash_opaque(&hdr, sizeof(hdr), 0);
+    sum = opr_jhash_opaque(m->dirs, m->hdr.cacheFiles * sizeof(int), sum);
+    if (m->hdr.inodeSize)
+	sum = opr_jhash_opaque(m->inodes,
+			       m->hdr.cacheFiles * sizeof(AFSD_INO_T), sum);
+    return opr_jhash_opaque(m->mtimes, m->hdr.maxDir * sizeof(afs_int64),
+			    sum);
+}
+
+/* Read the manifest in path into m.  Returns 0 if it is intact. */
+static int
+ReadCacheManifest(char *path, struct afsd_manifest_data *m)
+{
+    FILE *fp;
+    int code = -1;
+
+    memset(m, 0, sizeof(*m));
+    fp = fopen(path, "r");
+    if (fp == NULL)
+	return -1;
+    if (fread(&m->hdr, sizeof(m->hdr), 1, fp) != 1
+	|| m->hdr.magic != AFSD_MANIFEST_MAGIC
+	|| m->hdr.inodeSize != AFSD_MANIFEST_INOSIZE
+	|| m->hdr.cacheFiles <= 0 || m->hdr.maxDir <= 0)
+	goto out;
+    m->dirs = calloc(m->hdr.cacheFiles, sizeof(int));
+    m->inodes = calloc(m->hdr.cacheFiles, sizeof(AFSD_INO_T));
+    m->mtimes = calloc(m->hdr.maxDir, sizeof(afs_int64));
+    if (m->dirs == NULL || m->inodes == NULL || m->mtimes == NULL)
+	goto out;
+    if (fread(m->dirs, sizeof(int), m->hdr.cacheFiles, fp)
+	    != m->hdr.cacheFiles
+	|| (m->hdr.inodeSize
+	    && fread(m->inodes, sizeof(AFSD_INO_T), m->hdr.cacheFiles, fp)
+		!= m->hdr.cacheFiles)
+	|| fread(m->mtimes, sizeof(afs_int64), m->hdr.maxDir, fp)
+	    != m->hdr.maxDir)
+	goto out;
+    if (CacheManifestChecksum(m) == m->hdr.checksum)
+	code = 0;
+  out:
+    fclose(fp);
+    if (code)
+	FreeCacheManifest(m);
+    return code;
+}
+
+/* Write m to path.  Returns 0 on success. */
+static int
+WriteCacheManifest(char *path, struct afsd_manifest_data *m)
+{
+    FILE *fp;
+    int code = 0;
+
+    m->hdr.checksum = CacheManifestChecksum(m);
+    fp = fopen(path, "w");
+    if (fp == NULL)
+	return -1;
+    if (fwrite(&m->hdr, sizeof(m->hdr), 1, fp) != 1
+	|| fwrite(m->dirs, sizeof(int), m->hdr.cacheFiles, fp)
+	    != m->hdr.cacheFiles
+	|| (m->hdr.inodeSize
+	    && fwrite(m->inodes, sizeof(AFSD_INO_T), m->hdr.cacheFiles, fp)
+		!= m->hdr.cacheFiles)
+	|| fwrite(m->mtimes, sizeof(afs_int64), m->hdr.maxDir, fp)
+	    != m->hdr.maxDir
+	|| fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+	code = -1;
+    if (fclose(fp) != 0)
+	code = -1;
+    if (code)
+	unlink(path);
+    return code;
+}
+
+/* Fill in the CacheItems and subdirectory stamps of m.  Returns 0 if all
+ * of them could be found. */
+static int
+StampCacheManifest(struct afsd_manifest_data *m)
+{
+    char dir[1024];
+    struct stat st;
+    int i;
+
+    if (stat(fullpn_DCacheFile, &st) != 0)
+	return -1;
+    m->hdr.itemsSize = st.st_size;
+    m->hdr.itemsMtime = st.st_mtime;
+    for (i = 0; i < m->hdr.maxDir; i++) {
+	snprintf(dir, sizeof(dir), "%s/D%d", cacheBaseDir, i);
+	if (stat(dir, &st) != 0)
+	    return -1;
+	m->mtimes[i] = st.st_mtime;
+    }
+    return 0;
+}
+
+/*
+ * Take the cache layout from the manifest left by a clean shutdown, if
+ * the cache has not changed since.  Returns 0 if it has been used, and the
+ * cache need not be swept.
+ */
+static int
+LoadCacheManifest(void)
+{
+    static char rn[] = "LoadCacheManifest";	/*Routine name */
+    struct afsd_manifest_data m, now;
+    int i, code = -1;
+
+    if (ReadCacheManifest(fullpn_Manifest, &m) != 0) {
+	if (afsd_verbose && access(fullpn_Manifest, F_OK) == 0)
+	    printf("%s: Ignoring damaged cache manifest\n", rn);
+	unlink(fullpn_Manifest);
+	return -1;
+    }
+    memset(&now, 0, sizeof(now));
+    now.hdr = m.hdr;
+    now.mtimes = calloc(m.hdr.maxDir, sizeof(afs_int64));
+    if (!m.hdr.sealed || m.hdr.cacheFiles != cacheFiles
+	|| m.hdr.filesPerDir != nFilesPerDir || now.mtimes == NULL
+	|| StampCacheManifest(&now) != 0
+	|| now.hdr.itemsSize != m.hdr.itemsSize
+	|| now.hdr.itemsMtime != m.hdr.itemsMtime
+	|| memcmp(now.mtimes, m.mtimes, m.hdr.maxDir * sizeof(afs_int64))) {
+	if (afsd_verbose)
+	    printf("%s: Cache changed since the manifest was written\n", rn);
+	unlink(fullpn_Manifest);
+	goto out;
+    }
+    for (i = 0; i < cacheFiles; i++) {
+	if (m.dirs[i] < 0 || m.dirs[i] >= m.hdr.maxDir)
+	    goto out;
+    }
+
+    if (dir_for_V == NULL) {
+	dir_for_V = malloc(cacheFiles * sizeof(*dir_for_V));
+	if (dir_for_V == NULL)
+	    goto out;
+    }
+    memcpy(dir_for_V, m.dirs, cacheFiles * sizeof(*dir_for_V));
+#if !defined(AFS_CACHE_VNODE_PATH) && !defined(AFS_LINUX26_ENV)
+    memcpy(inode_for_V, m.inodes, cacheFiles * sizeof(*inode_for_V));
+#endif
+    CreateFileIfMissing(fullpn_VolInfoFile,
+			access(fullpn_VolInfoFile, F_OK) != 0);
+    CreateFileIfMissing(fullpn_CellInfoFile,
+			access(fullpn_CellInfoFile, F_OK) != 0);
+
+    /* from now on only a clean shutdown may vouch for the cache */
+    if (rename(fullpn_Manifest, fullpn_ManifestTemp) != 0) {
+	printf("%s: Can't rename '%s', errno is %d\n", rn, fullpn_Manifest,
+	       errno);
+	unlink(fullpn_Manifest);
+    }
+    code = 0;
+  out:
+    FreeCacheManifest(&m);
+    free(now.mtimes);
+    return code;
+}
+
+/* Record the layout the sweep found, for the next clean shutdown to
+ * vouch for. */
+static void
+SaveCacheManifest(void)
+{
+    struct afsd_manifest_data m;
+
+    memset(&m, 0, sizeof(m));
+    m.hdr.magic = AFSD_MANIFEST_MAGIC;
+    m.hdr.cacheFiles = cacheFiles;
+    m.hdr.filesPerDir = nFilesPerDir;
+    m.hdr.maxDir = (cacheFiles + nFilesPerDir - 1) / nFilesPerDir;
+    m.hdr.inodeSize = AFSD_MANIFEST_INOSIZE;
+    m.dirs = dir_for_V;
+#if !defined(AFS_CACHE_VNODE_PATH) && !defined(AFS_LINUX26_ENV)
+    m.inodes = inode_for_V;
+#endif
+    m.mtimes = calloc(m.hdr.maxDir, sizeof(afs_int64));
+    if (m.mtimes == NULL || WriteCacheManifest(fullpn_ManifestTemp, &m) != 0)
+	printf("SaveCacheManifest: Can't write '%s'\n", fullpn_ManifestTemp);
+    free(m.mtimes);
+}
+
+/* Called at a clean shutdown, once the cache manager has stopped writing
+ * to the cache: stamp the manifest saved at startup and put it in place. */
+static void
+SealCacheManifest(void)
+{
+    struct afsd_manifest_data m;
+
+    sprintf(fullpn_DCacheFile, "%s/%s", cacheBaseDir, DCACHEFILE);
+    sprintf(fullpn_Manifest, "%s/%s", cacheBaseDir, MANIFESTFILE);
+    sprintf(fullpn_ManifestTemp, "%s/%s", cacheBaseDir, MANIFESTTEMP);
+    if (ReadCacheManifest(fullpn_ManifestTemp, &m) != 0)
+	return;
+    if (StampCacheManifest(&m) == 0) {
+	m.hdr.sealed = 1;
+	if (WriteCacheManifest(fullpn_ManifestTemp, &m) == 0
+	    && rename(fullpn_ManifestTemp, fullpn_Manifest) == 0
+	    && afsd_verbose)
+	    printf("afsd: Cache manifest written to '%s'\n", fullpn_Manifest);
+    }
+    FreeCacheManifest(&m);
+}
+
 static int
 ConfigCell(struct afsconf_cell *aci, void *arock, struct afsconf_dir *adir)
 {
@@ -1791,6 +2195,9 @@ mainproc(struct cmd_syndesc *as, void *arock)
 	    printf("afsd: AFS still mounted; Not shutting down\n");
 	    exit(1);
 	}
+	if (!(cacheFlags & AFSCALL_INIT_MEMCACHE)
+	    && (sawCacheBaseDir || ParseCacheInfoFile() == 0) && cacheBaseDir)
+	    SealCacheManifest();
 	exit(0);
     }
 
@@ -1832,6 +2239,8 @@ mainproc(struct cmd_syndesc *as, void *arock)
 
     enable_nomount = cmd_OptionPresent(as, OPT_nomount);
     enable_backuptree = cmd_OptionPresent(as, OPT_backuptree);
+    enable_warmrestart = cmd_OptionPresent(as, OPT_warmrestart);
+    enable_cbrenew = cmd_OptionPresent(as, OPT_cbrenew);
     enable_rxbind = cmd_OptionPresent(as, OPT_rxbind);
 
     /* set rx_extraPackets */
@@ -1892,6 +2301,33 @@ mainproc(struct cmd_syndesc *as, void *arock)
 
     cmd_OptionAsInt(as, OPT_rxmaxfrags, &rxmaxfrags);
 
+    if (cmd_OptionPresent(as, OPT_cachepolicy)) {
+	char *var = NULL;
+
+	cmd_OptionAsString(as, OPT_cachepolicy, &var);
+	if (strcasecmp(var, "lru") == 0)
+	    cachePolicy = AFS_DCPOLICY_LRU;
+	else if (strcasecmp(var, "2q") == 0)
+	    cachePolicy = AFS_DCPOLICY_2Q;
+	else {
+	    printf("afsd: unknown cache policy %s (use lru or 2q)\n", var);
+	    exit(1);
+	}
+	free(var);
+    }
+
+    if (cmd_OptionAsInt(as, OPT_sweepthreads, &nSweepThreads) == 0
+	&& nSweepThreads < 1) {
+	printf("afsd: -sweep-threads must be at least 1\n");
+	exit(1);
+    }
+
+    if (cmd_OptionAsInt(as, OPT_truncthreads, &nTruncThreads) == 0
+	&& nTruncThreads < 1) {
+	printf("afsd: -truncate-threads must be at least 1\n");
+	exit(1);
+    }
+
     /* parse cacheinfo file if this is a diskcache */
     if (ParseCacheInfoFile()) {
 	exit(1);
@@ -2114,6 +2550,8 @@ afsd_run(void)
 	sprintf(fullpn_DCacheFile, "%s/%s", cacheBaseDir, DCACHEFILE);
 	sprintf(fullpn_VolInfoFile, "%s/%s", cacheBaseDir, VOLINFOFILE);
 	sprintf(fullpn_CellInfoFile, "%s/%s", cacheBaseDir, CELLINFOFILE);
+	sprintf(fullpn_Manifest, "%s/%s", cacheBaseDir, MANIFESTFILE);
+	sprintf(fullpn_ManifestTemp, "%s/%s", cacheBaseDir, MANIFESTTEMP);
 	sprintf(fullpn_VFile, "%s/", cacheBaseDir);
 	vFilePtr = fullpn_VFile + strlen(fullpn_VFile);
 
@@ -2232,6 +2670,14 @@ afsd_run(void)
     cparams.setTimeFlag = 0;
     cparams.memCacheFlag = cacheFlags;
     cparams.dynamic_vcaches = afsd_dynamic_vcaches;
+    if (cachePolicy != AFS_DCPOLICY_LRU) {
+	/* must come before AFSOP_CACHEINIT */
+	if (afsd_verbose)
+	    printf("%s: Setting cache policy %d\n", rn, cachePolicy);
+	code = afsd_syscall(AFSOP_SET_DCPOLICY, cachePolicy);
+	if (code)
+	    printf("%s: Error %d setting cache policy, using lru\n", rn, code);
+    }
     afsd_syscall(AFSOP_CACHEINIT, &cparams);
 
     /* do it before we init the cache inodes */
@@ -2256,7 +2702,11 @@ afsd_run(void)
 	printf("%s: Sweeping workstation's AFS cache directory.\n", rn);
     cacheIteration = 0;
     /* Memory-cache based system doesn't need any of this */
-    if (!(cacheFlags & AFSCALL_INIT_MEMCACHE)) {
+    if (!(cacheFlags & AFSCALL_INIT_MEMCACHE) && LoadCacheManifest() == 0) {
+	if (afsd_verbose)
+	    printf("%s: Cache unchanged since clean shutdown, not swept\n",
+		   rn);
+    } else if (!(cacheFlags & AFSCALL_INIT_MEMCACHE)) {
 	do {
 	    cacheIteration++;
 	    if (SweepAFSCache(&vFilesFound)) {
@@ -2270,6 +2720,8 @@ afsd_run(void)
 		     rn, vFilesFound, cacheFiles, cacheIteration);
 	} while ((vFilesFound < cacheFiles)
 		 && (cacheIteration < MAX_CACHE_LOOPS));
+	if (vFilesFound == cacheFiles)
+	    SaveCacheManifest();
     } else if (afsd_verbose)
 	printf("%s: Using memory cache, not swept\n", rn);
 
@@ -2338,6 +2790,23 @@ afsd_run(void)
 	    printf("%s: Error enabling backup tree support.\n", rn);
     }
 
+    /* A memory cache has nothing left from the last boot to revalidate */
+    if (enable_warmrestart && !(cacheFlags & AFSCALL_INIT_MEMCACHE)) {
+	if (afsd_verbose)
+	    printf("%s: Enabling warm restart in kernel.\n", rn);
+	code = afsd_syscall(AFSOP_SET_WARMCACHE, enable_warmrestart);
+	if (code)
+	    printf("%s: Error enabling warm restart.\n", rn);
+    }
+
+    if (enable_cbrenew) {
+	if (afsd_verbose)
+	    printf("%s: Enabling callback renewal in kernel.\n", rn);
+	code = afsd_syscall(AFSOP_SET_CBRENEW, enable_cbrenew);
+	if (code)
+	    printf("%s: Error enabling callback renewal.\n", rn);
+    }
+
     /*
      * Tell the kernel about each cell in the configuration.
      */
@@ -2455,8 +2924,9 @@ afsd_run(void)
     printf("%s: All AFS daemons started.\n", rn);
 
     if (afsd_verbose)
-	printf("%s: Forking trunc-cache daemon.\n", rn);
-    fork_syscall(rn, AFSOP_START_TRUNCDAEMON);
+	printf("%s: Forking %d trunc-cache daemons.\n", rn, nTruncThreads);
+    for (i = 0; i < nTruncThreads; i++)
+	fork_syscall(rn, AFSOP_START_TRUNCDAEMON);
 
     if (!enable_nomount) {
 	afsd_mount_afs(rn, afsd_cacheMountDir);
@@ -2581,6 +3051,22 @@ afsd_init(void)
 			CMD_OPTIONAL,
 			"Set the maximum number of UDP fragments Rx should "
 			"send/receive per Rx packet");
+    cmd_AddParmAtOffset(ts, OPT_cachepolicy, "-cache-policy", CMD_SINGLE,
+			CMD_OPTIONAL,
+			"Cache replacement policy (lru or 2q)");
+    cmd_AddParmAtOffset(ts, OPT_sweepthreads, "-sweep-threads", CMD_SINGLE,
+			CMD_OPTIONAL,
+			"Number of threads sweeping the cache at startup");
+    cmd_AddParmAtOffset(ts, OPT_warmrestart, "-warm-restart", CMD_FLAG,
+			CMD_OPTIONAL,
+			"Revalidate the cached files in the background at "
+			"startup");
+    cmd_AddParmAtOffset(ts, OPT_cbrenew, "-renew-callbacks", CMD_FLAG,
+			CMD_OPTIONAL,
+			"Renew the callbacks of open files before they expire");
+    cmd_AddParmAtOffset(ts, OPT_truncthreads, "-truncate-threads",
+			CMD_SINGLE, CMD_OPTIONAL,
+			"Number of threads freeing cache space");
 }
 
 int
@@ -2644,8 +3130,11 @@ afsd_syscall_populate(struct afsd_syscall_args *args, int syscall, va_list ap)
     case AFSOP_SET_FAKESTAT:
     case AFSOP_SET_BACKUPTREE:
     case AFSOP_BUCKETPCT:
+    case AFSOP_SET_DCPOLICY:
     case AFSOP_GO:
     case AFSOP_SET_RMTSYS_FLAG:
+    case AFSOP_SET_WARMCACHE:
+    case AFSOP_SET_CBRENEW:
 	params[0] = CAST_SYSCALL_PARAM((va_arg(ap, int)));
 	break;
     case AFSOP_SET_THISCELL:
@@ -53,6 +53,9 @@
 #define AFSOP_SET_RXMAXFRAGS     43     /* set rxi_nSendFrags, rxi_nRecvFrags */
 #define AFSOP_SET_RMTSYS_FLAG    44     /* set flag if rmtsys is enabled */
 #define AFSOP_SEED_ENTROPY       45     /* Give the kernel hcrypto entropy */
+#define AFSOP_SET_DCPOLICY       46     /* dcache replacement policy, below */
+#define AFSOP_SET_WARMCACHE      47     /* revalidate cache after AFSOP_GO */
+#define AFSOP_SET_CBRENEW        49     /* renew callbacks of open files */
 
 /* The range 20-30 is reserved for AFS system offsets in the afs_syscall */
 #define	AFSCALL_PIOCTL		20
@@ -155,6 +158,10 @@ struct afs_uspc_param {
     } req;
 };
 
+/* dcache replacement policies, for AFSOP_SET_DCPOLICY */
+#define AFS_DCPOLICY_LRU	0	/* least recently used first */
+#define AFS_DCPOLICY_2Q		1	/* 2Q: chunks used once go first */
+
 struct afs_cacheParams {
     afs_int32 cacheScaches;
     afs_int32 cacheFiles;
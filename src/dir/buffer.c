@@ -12,6 +12,7 @@
 
 #include <roken.h>
 #include <afs/opr.h>
+#include <opr/queue.h>
 
 #include <lock.h>
 
@@ -29,13 +30,14 @@ struct buffer {
      */
     char fid[BUFFER_FID_SIZE];
     afs_int32 page;
-    afs_int32 accesstime;
     struct buffer *hashNext;
+    struct opr_queue lruq;	/* on the shard's LRU queue */
     void *data;
     char lockers;
     char dirty;
-    char hashIndex;
+    int hashIndex;
     struct Lock lock;
+    struct DirIndex *dirIndex;	/* lookup index, if this is page 0 */
 };
 
 static_inline dir_file_t
@@ -44,40 +46,50 @@ bufferDir(struct buffer *b)
     return (dir_file_t) &b->fid;
 }
 
-struct Lock afs_bufferLock;
-
 /* page size */
 #define BUFFER_PAGE_SIZE 2048
 /* log page size */
 #define LOGPS 11
-/* page hash table size */
+/* smallest page hash table size */
 #define PHSIZE 32
-/* The hash table should be somewhat efficient even if there are only
- * a few partitions (less than 32). So the hash for the fileserver is now
- * based on the volume id. This means this macro is dependent upon the
- * layout of DirHandle in viced/viced.h, vol/salvage.h and volser/salvage.h.
+
+/*
+ * The buffers are divided among up to MAXSHARDS shards, each with its own
+ * lock, page hash table and LRU queue, so that threads reading different
+ * pages rarely wait for each other.  A page's shard is picked by hashing
+ * the directory and the page number together: the pages of one busy
+ * directory are spread over all the shards, rather than competing for the
+ * buffers of one.  Small pools keep a single shard, as a shard with only
+ * a handful of buffers could have them all held at once.
+ *
+ * A buffer stays in the shard it was created for.  The shard lock protects
+ * its hash chains and LRU queue, and must be write-held to raise a buffer's
+ * lockers from zero.
  */
-#define pHash(fid) (((afs_int32 *)fid)[0] & (PHSIZE-1))
-#define vHash(vid) (vid & (PHSIZE-1))
+#define MAXSHARDS 16
+#define MINSHARDBUFFERS 64	/* fewest buffers worth a shard of their own */
+#define GROWBUFFERS 16		/* buffers added when all of a shard's are held */
+
+struct bufshard {
+    struct Lock lock;
+    struct buffer **buffers;	/* every buffer in the shard */
+    int nbuffers;
+    struct buffer **phTable;	/* page hash table */
+    int phSize;			/* entries in phTable, a power of 2 */
+    struct opr_queue lru;	/* most recently used first */
+    afs_uint32 calls;		/* DRead calls */
+    afs_uint32 hits;		/* ... satisfied from the pool */
+    afs_uint32 ios;		/* pages read */
+    afs_uint32 writes;		/* pages written */
+    afs_uint32 grows;		/* buffers added because all were held */
+};
 
-/* admittedly system dependent, this is the maximum signed 32-bit value */
-#define BUFFER_LONG_MAX   2147483647
 #ifndef	NULL
 #define NULL 0
 #endif
 
-static struct buffer **Buffers;
-
-char *BufferData;
-
-static struct buffer *phTable[PHSIZE];	/* page hash table */
-static struct buffer *LastBuffer;
-int nbuffers;
-int timecounter;
-static int calls = 0, ios = 0;
-
-struct buffer *newslot(dir_file_t dir, afs_int32 apage,
-		       struct buffer *lp);
+static struct bufshard shards[MAXSHARDS];
+static int nshards;
 
 /* XXX - This sucks. The correct prototypes for these functions are ...
  *
@@ -88,60 +100,201 @@ struct buffer *newslot(dir_file_t dir, afs_int32 apage,
 
 extern void FidZero(dir_file_t);
 extern int FidEq(dir_file_t, dir_file_t);
+extern afs_uint32 FidHash(dir_file_t);
 extern int ReallyRead(dir_file_t, int block, char *data);
 extern int ReallyWrite(dir_file_t, int block, char *data);
 extern void FidZap(dir_file_t);
 extern int  FidVolEq(dir_file_t, afs_int32 vid);
 extern void FidCpy(dir_file_t, dir_file_t fromfile);
 
+/* Hash a page of a directory; FidHash must agree with FidEq. */
+static_inline afs_uint32
+pHash(dir_file_t fid, afs_int32 page)
+{
+    return (FidHash(fid) + page) * 0x9e3779b1;
+}
+
+#define pShard(hash) (&shards[((hash) >> 28) & (nshards - 1)])
+#define pChain(sp, hash) (((hash) ^ ((hash) >> 16)) & ((sp)->phSize - 1))
+
+static struct buffer *newslot(dir_file_t dir, afs_int32 apage,
+			      struct bufshard *sp, afs_uint32 hash);
+
 int
 DStat(int *abuffers, int *acalls, int *aios)
 {
-    *abuffers = nbuffers;
-    *acalls = calls;
-    *aios = ios;
+    struct DirBufferStats stats;
+
+    DGetStats(&stats);
+    *abuffers = stats.buffers;
+    *acalls = stats.calls;
+    *aios = stats.ios;
     return 0;
 }
 
 /**
- * initialize the directory package.
+ * get the statistics of the directory buffer pool.
  *
- * @param[in] abuffers  size of directory buffer cache
- *
- * @return operation status
- *    @retval 0 success
+ * @param[out] stats  the pool's size and counters, summed over its shards
  */
 void
-DInit(int abuffers)
+DGetStats(struct DirBufferStats *stats)
 {
-    /* Initialize the venus buffer system. */
-    int i, tsize;
-    struct buffer *tb;
-    char *tp;
+    struct bufshard *sp;
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->shards = nshards;
+    for (i = 0; i < nshards; i++) {
+	sp = &shards[i];
+	ObtainReadLock(&sp->lock);
+	stats->buffers += sp->nbuffers;
+	stats->calls += sp->calls;
+	stats->hits += sp->hits;
+	stats->ios += sp->ios;
+	stats->writes += sp->writes;
+	stats->grows += sp->grows;
+	ReleaseReadLock(&sp->lock);
+    }
+}
+
+/* Rebuild a shard's page hash table with room for size entries.  Called
+ * with the shard write-locked. */
+static int
+RehashShard(struct bufshard *sp, int size)
+{
+    struct buffer **table, *tb;
+    afs_uint32 hash;
+    int i;
+
+    table = calloc(size, sizeof(struct buffer *));
+    if (table == NULL)
+	return ENOMEM;
+    free(sp->phTable);
+    sp->phTable = table;
+    sp->phSize = size;
+    for (i = 0; i < sp->nbuffers; i++) {
+	tb = sp->buffers[i];
+	if (tb->hashIndex < 0)
+	    continue;
+	hash = pHash(bufferDir(tb), tb->page);
+	tb->hashIndex = pChain(sp, hash);
+	tb->hashNext = sp->phTable[tb->hashIndex];
+	sp->phTable[tb->hashIndex] = tb;
+    }
+    return 0;
+}
 
-    Lock_Init(&afs_bufferLock);
-    /* Align each element of Buffers on a doubleword boundary */
+/* Add abuffers empty buffers to a shard, at the cold end of its LRU queue.
+ * Called with the shard write-locked, or before anyone else can use it. */
+static int
+GrowShard(struct bufshard *sp, int abuffers)
+{
+    struct buffer **tbuffers, *tb;
+    char *tp, *tdata;
+    int i, tsize, size;
+
+    /* Align each buffer on a doubleword boundary */
     tsize = (sizeof(struct buffer) + 7) & ~7;
+    tbuffers = realloc(sp->buffers,
+		       (sp->nbuffers + abuffers) * sizeof(struct buffer *));
+    if (tbuffers == NULL)
+	return ENOMEM;
+    sp->buffers = tbuffers;
     tp = malloc(abuffers * tsize);
-    Buffers = malloc(abuffers * sizeof(struct buffer *));
-    BufferData = malloc(abuffers * BUFFER_PAGE_SIZE);
-    timecounter = 0;
-    LastBuffer = (struct buffer *)tp;
-    nbuffers = abuffers;
-    for (i = 0; i < PHSIZE; i++)
-	phTable[i] = 0;
+    tdata = malloc(abuffers * BUFFER_PAGE_SIZE);
+    if (tp == NULL || tdata == NULL) {
+	free(tp);
+	free(tdata);
+	return ENOMEM;
+    }
+
+    for (size = PHSIZE; size < sp->nbuffers + abuffers; size <<= 1)
+	;
     for (i = 0; i < abuffers; i++) {
 	/* Fill in each buffer with an empty indication. */
 	tb = (struct buffer *)tp;
-	Buffers[i] = tb;
 	tp += tsize;
 	FidZero(bufferDir(tb));
-	tb->accesstime = tb->lockers = 0;
-	tb->data = &BufferData[BUFFER_PAGE_SIZE * i];
-	tb->hashIndex = 0;
+	tb->page = 0;
+	tb->lockers = 0;
+	tb->data = &tdata[BUFFER_PAGE_SIZE * i];
 	tb->dirty = 0;
+	tb->dirIndex = NULL;
 	Lock_Init(&tb->lock);
+	tb->hashIndex = -1;	/* on no hash chain until first used */
+	tb->hashNext = NULL;
+	opr_queue_Append(&sp->lru, &tb->lruq);
+	sp->buffers[sp->nbuffers++] = tb;
     }
+    if (size != sp->phSize)
+	return RehashShard(sp, size);
+    return 0;
+}
+
+/**
+ * grow the directory buffer pool.
+ *
+ * The pool can be grown at any time; it cannot be shrunk.  The new
+ * buffers are spread evenly over the pool's shards.
+ *
+ * @param[in] abuffers  the number of buffers the pool should have
+ *
+ * @return operation status
+ *    @retval 0 success, or the pool already had that many buffers
+ *    @retval ENOMEM out of memory
+ */
+int
+DSetBuffers(int abuffers)
+{
+    struct bufshard *sp;
+    int i, total, extra, code = 0;
+
+    for (total = 0, i = 0; i < nshards; i++)
+	total += shards[i].nbuffers;
+    for (i = 0; i < nshards && code == 0; i++) {
+	/* give the remainder to the first shards */
+	extra = (abuffers - total) / nshards
+	    + (i < (abuffers - total) % nshards);
+	if (extra <= 0)
+	    continue;
+	sp = &shards[i];
+	ObtainWriteLock(&sp->lock);
+	code = GrowShard(sp, extra);
+	ReleaseWriteLock(&sp->lock);
+    }
+    return code;
+}
+
+/**
+ * initialize the directory package.
+ *
+ * @param[in] abuffers  size of directory buffer cache
+ *
+ * @return operation status
+ *    @retval 0 success
+ */
+void
+DInit(int abuffers)
+{
+    /* Initialize the venus buffer system. */
+    struct bufshard *sp;
+    int i;
+
+    for (nshards = 1;
+	 nshards < MAXSHARDS && abuffers / (2 * nshards) >= MINSHARDBUFFERS;
+	 nshards <<= 1)
+	;
+    for (i = 0; i < nshards; i++) {
+	sp = &shards[i];
+	memset(sp, 0, sizeof(*sp));
+	Lock_Init(&sp->lock);
+	opr_queue_Init(&sp->lru);
+	if (RehashShard(sp, PHSIZE) != 0)
+	    Die("no memory for directory buffers");
+    }
+    if (DSetBuffers(abuffers) != 0)
+	Die("no memory for directory buffers");
     return;
 }
 
@@ -158,76 +311,43 @@ int
 DRead(dir_file_t fid, int page, struct DirBuffer *entry)
 {
     /* Read a page from the disk. */
-    struct buffer *tb, *tb2, **bufhead;
+    struct buffer *tb, **tbp;
+    struct bufshard *sp;
+    afs_uint32 hash;
 
     memset(entry, 0, sizeof(struct DirBuffer));
 
-    ObtainWriteLock(&afs_bufferLock);
-    calls++;
-
-#define bufmatch(tb,fid) (tb->page == page && FidEq(bufferDir(tb), fid))
-#define buf_Front(head,parent,p) {(parent)->hashNext = (p)->hashNext; (p)->hashNext= *(head);*(head)=(p);}
-
-    /* this apparently-complicated-looking code is simply an example of
-     * a little bit of loop unrolling, and is a standard linked-list
-     * traversal trick. It saves a few assignments at the the expense
-     * of larger code size.  This could be simplified by better use of
-     * macros.  With the use of these LRU queues, the old one-cache is
-     * probably obsolete.
-     */
-    if ((tb = phTable[pHash(fid)])) {	/* ASSMT HERE */
-	if (bufmatch(tb, fid)) {
+    hash = pHash(fid, page);
+    sp = pShard(hash);
+    ObtainWriteLock(&sp->lock);
+    sp->calls++;
+
+    for (tbp = &sp->phTable[pChain(sp, hash)]; (tb = *tbp);
+	 tbp = &tb->hashNext) {
+	if (tb->page == page && FidEq(bufferDir(tb), fid)) {
+	    /* move it to the front of both its chain and the LRU queue */
+	    *tbp = tb->hashNext;
+	    tb->hashNext = sp->phTable[tb->hashIndex];
+	    sp->phTable[tb->hashIndex] = tb;
+	    opr_queue_Remove(&tb->lruq);
+	    opr_queue_Prepend(&sp->lru, &tb->lruq);
+	    sp->hits++;
 	    ObtainWriteLock(&tb->lock);
 	    tb->lockers++;
-	    ReleaseWriteLock(&afs_bufferLock);
-	    tb->accesstime = ++timecounter;
+	    ReleaseWriteLock(&sp->lock);
 	    ReleaseWriteLock(&tb->lock);
 	    entry->buffer = tb;
 	    entry->data = tb->data;
 	    return 0;
-	} else {
-	    bufhead = &(phTable[pHash(fid)]);
-	    while ((tb2 = tb->hashNext)) {
-		if (bufmatch(tb2, fid)) {
-		    buf_Front(bufhead, tb, tb2);
-		    ObtainWriteLock(&tb2->lock);
-		    tb2->lockers++;
-		    ReleaseWriteLock(&afs_bufferLock);
-		    tb2->accesstime = ++timecounter;
-		    ReleaseWriteLock(&tb2->lock);
-		    entry->buffer = tb2;
-		    entry->data = tb2->data;
-		    return 0;
-		}
-		if ((tb = tb2->hashNext)) {	/* ASSIGNMENT HERE! */
-		    if (bufmatch(tb, fid)) {
-			buf_Front(bufhead, tb2, tb);
-			ObtainWriteLock(&tb->lock);
-			tb->lockers++;
-			ReleaseWriteLock(&afs_bufferLock);
-			tb->accesstime = ++timecounter;
-			ReleaseWriteLock(&tb->lock);
-			entry->buffer = tb;
-			entry->data = tb->data;
-			return 0;
-		    }
-		} else
-		    break;
-	    }
 	}
-    } else
-	tb2 = NULL;
+    }
 
     /* can't find it */
-    /* The last thing we looked at was either tb or tb2 (or nothing). That
-     * is at least the oldest buffer on one particular hash chain, so it's
-     * a pretty good place to start looking for the truly oldest buffer.
-     */
-    tb = newslot(fid, page, (tb ? tb : tb2));
-    ios++;
+    tb = newslot(fid, page, sp, hash);
+    sp->ios++;
     ObtainWriteLock(&tb->lock);
     tb->lockers++;
-    ReleaseWriteLock(&afs_bufferLock);
+    ReleaseWriteLock(&sp->lock);
     if (ReallyRead(bufferDir(tb), tb->page, tb->data)) {
 	tb->lockers--;
 	FidZap(bufferDir(tb));	/* disaster */
@@ -243,17 +363,17 @@ DRead(dir_file_t fid, int page, struct DirBuffer *entry)
     return 0;
 }
 
-
+/* Move a buffer to the chain for its new page. */
 static int
-FixupBucket(struct buffer *ap)
+FixupBucket(struct bufshard *sp, struct buffer *ap, afs_uint32 hash)
 {
     struct buffer **lp, *tp;
     int i;
 
     /* first try to get it out of its current hash bucket, in which it might not be */
     i = ap->hashIndex;
-    lp = &phTable[i];
-    for (tp = *lp; tp; tp = tp->hashNext) {
+    lp = (i < 0) ? NULL : &sp->phTable[i];
+    for (tp = (lp ? *lp : NULL); tp; tp = tp->hashNext) {
 	if (tp == ap) {
 	    *lp = tp->hashNext;
 	    break;
@@ -261,62 +381,66 @@ FixupBucket(struct buffer *ap)
 	lp = &tp->hashNext;
     }
     /* now figure the new hash bucket */
-    i = pHash(ap);
+    i = pChain(sp, hash);
     ap->hashIndex = i;		/* remember where we are for deletion */
-    ap->hashNext = phTable[i];	/* add us to the list */
-    phTable[i] = ap;		/* at the front, since it's LRU */
+    ap->hashNext = sp->phTable[i];	/* add us to the list */
+    sp->phTable[i] = ap;	/* at the front, since it's LRU */
     return 0;
 }
 
-struct buffer *
-newslot(dir_file_t dir, afs_int32 apage, struct buffer *lp)
+/* Find a usable buffer slot in a shard, for page apage of dir.  Called with
+ * the shard write-locked. */
+static struct buffer *
+newslot(dir_file_t dir, afs_int32 apage, struct bufshard *sp,
+	afs_uint32 hash)
 {
-    /* Find a usable buffer slot */
-    afs_int32 i;
-    afs_int32 lt;
-    struct buffer **tbp;
-
-    if (lp && (lp->lockers == 0)) {
-	lt = lp->accesstime;
-    } else {
-	lp = 0;
-	lt = BUFFER_LONG_MAX;
-    }
-
-    tbp = Buffers;
-    for (i = 0; i < nbuffers; i++, tbp++) {
-	if ((*tbp)->lockers == 0) {
-	    if ((*tbp)->accesstime < lt) {
-		lp = (*tbp);
-		lt = (*tbp)->accesstime;
-	    }
+    struct opr_queue *cursor;
+    struct buffer *lp = NULL, *tb;
+
+    /* the least recently used buffer that nobody holds */
+    for (opr_queue_ScanBackwards(&sp->lru, cursor)) {
+	tb = opr_queue_Entry(cursor, struct buffer, lruq);
+	if (tb->lockers == 0) {
+	    lp = tb;
+	    break;
 	}
     }
 
-    /* There are no unlocked buffers */
-    if (lp == 0) {
-	if (lt < 0)
-	    Die("accesstime counter wrapped");
-	else
+    /* There are no unlocked buffers; make some more. */
+    if (lp == NULL) {
+	if (GrowShard(sp, GROWBUFFERS) != 0)
 	    Die("all buffers locked");
+	sp->grows += GROWBUFFERS;
+	lp = opr_queue_Last(&sp->lru, struct buffer, lruq);
     }
 
-    /* We do not need to lock the buffer here because it has no lockers
-     * and the afs_bufferLock prevents other threads from zapping this
-     * buffer while we are writing it out */
+    /* Nobody can take the buffer now, as the shard lock keeps its lockers
+     * at zero; but its last holder may still be in DRelease, about to mark
+     * it dirty.  Wait for that by taking the buffer's lock. */
+    ObtainWriteLock(&lp->lock);
     if (lp->dirty) {
 	if (ReallyWrite(bufferDir(lp), lp->page, lp->data))
 	    Die("writing bogus buffer");
+	sp->writes++;
 	lp->dirty = 0;
     }
 
+    /* Nobody can be using the old page's lookup index, as nobody has the
+     * page held. */
+    if (lp->dirIndex) {
+	afs_dir_FreeIndex(lp->dirIndex);
+	lp->dirIndex = NULL;
+    }
+
     /* Now fill in the header. */
     FidZap(bufferDir(lp));
     FidCpy(bufferDir(lp), dir);	/* set this */
     lp->page = apage;
-    lp->accesstime = ++timecounter;
+    ReleaseWriteLock(&lp->lock);
+    opr_queue_Remove(&lp->lruq);
+    opr_queue_Prepend(&sp->lru, &lp->lruq);
 
-    FixupBucket(lp);		/* move to the right hash bucket */
+    FixupBucket(sp, lp, hash);	/* move to the right hash bucket */
 
     return lp;
 }
@@ -332,10 +456,52 @@ DRelease(struct DirBuffer *entry, int flag)
     if (bp == NULL)
 	return;
     ObtainWriteLock(&bp->lock);
-    bp->lockers--;
     if (flag)
 	bp->dirty = 1;
+    bp->lockers--;
+    ReleaseWriteLock(&bp->lock);
+}
+
+/* Return the lookup index kept with a directory's header page, if any. */
+struct DirIndex *
+DGetIndex(struct DirBuffer *entry)
+{
+    struct buffer *bp = entry->buffer;
+    struct DirIndex *index;
+
+    ObtainReadLock(&bp->lock);
+    index = bp->dirIndex;
+    ReleaseReadLock(&bp->lock);
+    return index;
+}
+
+/* Keep a lookup index with a directory's header page, unless someone
+ * already has; returns the index now kept. */
+struct DirIndex *
+DSetIndex(struct DirBuffer *entry, struct DirIndex *index)
+{
+    struct buffer *bp = entry->buffer;
+
+    ObtainWriteLock(&bp->lock);
+    if (!bp->dirIndex)
+	bp->dirIndex = index;
+    index = bp->dirIndex;
     ReleaseWriteLock(&bp->lock);
+    return index;
+}
+
+/* Take back the lookup index kept with a directory's header page. */
+struct DirIndex *
+DDropIndex(struct DirBuffer *entry)
+{
+    struct buffer *bp = entry->buffer;
+    struct DirIndex *index;
+
+    ObtainWriteLock(&bp->lock);
+    index = bp->dirIndex;
+    bp->dirIndex = NULL;
+    ReleaseWriteLock(&bp->lock);
+    return index;
 }
 
 /* Return the byte within a file represented by a buffer pointer. */
@@ -348,42 +514,72 @@ DVOffset(struct DirBuffer *entry)
     return BUFFER_PAGE_SIZE * bp->page + (char *)entry->data - (char *)bp->data;
 }
 
+/* Free the lookup index of a buffer being zapped.  If the buffer is held,
+ * whoever holds it may still be using the index; newslot frees it then.
+ * Called with the buffer's shard locked, so the buffer cannot become held. */
+static void
+ZapIndex(struct buffer *tb)
+{
+    if (tb->dirIndex && tb->lockers == 0) {
+	afs_dir_FreeIndex(tb->dirIndex);
+	tb->dirIndex = NULL;
+    }
+}
+
 void
 DZap(dir_file_t dir)
 {
     /* Destroy all buffers pertaining to a particular fid. */
+    struct bufshard *sp;
     struct buffer *tb;
-    ObtainReadLock(&afs_bufferLock);
-    for (tb = phTable[pHash(dir)]; tb; tb = tb->hashNext)
-	if (FidEq(bufferDir(tb), dir)) {
-	    ObtainWriteLock(&tb->lock);
-	    FidZap(bufferDir(tb));
-	    tb->dirty = 0;
-	    ReleaseWriteLock(&tb->lock);
+    int i, j;
+
+    /* the file's pages may be in any shard */
+    for (i = 0; i < nshards; i++) {
+	sp = &shards[i];
+	ObtainReadLock(&sp->lock);
+	for (j = 0; j < sp->nbuffers; j++) {
+	    tb = sp->buffers[j];
+	    if (FidEq(bufferDir(tb), dir)) {
+		ObtainWriteLock(&tb->lock);
+		FidZap(bufferDir(tb));
+		tb->dirty = 0;
+		ZapIndex(tb);
+		ReleaseWriteLock(&tb->lock);
+	    }
 	}
-    ReleaseReadLock(&afs_bufferLock);
+	ReleaseReadLock(&sp->lock);
+    }
 }
 
 int
 DFlushVolume(afs_int32 vid)
 {
     /* Flush all data and release all inode handles for a particular volume */
+    struct bufshard *sp;
     struct buffer *tb;
-    int code, rcode = 0;
-    ObtainReadLock(&afs_bufferLock);
-    for (tb = phTable[vHash(vid)]; tb; tb = tb->hashNext)
-	if (FidVolEq(bufferDir(tb), vid)) {
-	    ObtainWriteLock(&tb->lock);
-	    if (tb->dirty) {
-		code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
-		if (code && !rcode)
-		    rcode = code;
-		tb->dirty = 0;
+    int i, j, code, rcode = 0;
+
+    for (i = 0; i < nshards; i++) {
+	sp = &shards[i];
+	ObtainReadLock(&sp->lock);
+	for (j = 0; j < sp->nbuffers; j++) {
+	    tb = sp->buffers[j];
+	    if (FidVolEq(bufferDir(tb), vid)) {
+		ObtainWriteLock(&tb->lock);
+		if (tb->dirty) {
+		    code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
+		    if (code && !rcode)
+			rcode = code;
+		    tb->dirty = 0;
+		}
+		FidZap(bufferDir(tb));
+		ZapIndex(tb);
+		ReleaseWriteLock(&tb->lock);
 	    }
-	    FidZap(bufferDir(tb));
-	    ReleaseWriteLock(&tb->lock);
 	}
-    ReleaseReadLock(&afs_bufferLock);
+	ReleaseReadLock(&sp->lock);
+    }
     return rcode;
 }
 
@@ -391,25 +587,31 @@ int
 DFlushEntry(dir_file_t fid)
 {
     /* Flush pages modified by one entry. */
+    struct bufshard *sp;
     struct buffer *tb;
-    int code;
-
-    ObtainReadLock(&afs_bufferLock);
-    for (tb = phTable[pHash(fid)]; tb; tb = tb->hashNext)
-	if (FidEq(bufferDir(tb), fid) && tb->dirty) {
-	    ObtainWriteLock(&tb->lock);
-	    if (tb->dirty) {
-		code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
-		if (code) {
-		    ReleaseWriteLock(&tb->lock);
-		    ReleaseReadLock(&afs_bufferLock);
-		    return code;
+    int i, j, code;
+
+    for (i = 0; i < nshards; i++) {
+	sp = &shards[i];
+	ObtainReadLock(&sp->lock);
+	for (j = 0; j < sp->nbuffers; j++) {
+	    tb = sp->buffers[j];
+	    if (tb->dirty && FidEq(bufferDir(tb), fid)) {
+		ObtainWriteLock(&tb->lock);
+		if (tb->dirty) {
+		    code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
+		    if (code) {
+			ReleaseWriteLock(&tb->lock);
+			ReleaseReadLock(&sp->lock);
+			return code;
+		    }
+		    tb->dirty = 0;
 		}
-		tb->dirty = 0;
+		ReleaseWriteLock(&tb->lock);
 	    }
-	    ReleaseWriteLock(&tb->lock);
 	}
-    ReleaseReadLock(&afs_bufferLock);
+	ReleaseReadLock(&sp->lock);
+    }
     return 0;
 }
 
@@ -417,32 +619,36 @@ int
 DFlush(void)
 {
     /* Flush all the modified buffers. */
-    int i;
-    struct buffer **tbp;
+    struct bufshard *sp;
+    struct buffer *tb;
+    int i, j;
     afs_int32 code, rcode;
 
     rcode = 0;
-    tbp = Buffers;
-    ObtainReadLock(&afs_bufferLock);
-    for (i = 0; i < nbuffers; i++, tbp++) {
-	if ((*tbp)->dirty) {
-	    ObtainWriteLock(&(*tbp)->lock);
-	    (*tbp)->lockers++;
-	    ReleaseReadLock(&afs_bufferLock);
-	    if ((*tbp)->dirty) {
-		code = ReallyWrite(bufferDir(*tbp), (*tbp)->page, (*tbp)->data);
-		if (!code)
-		    (*tbp)->dirty = 0;	/* Clear the dirty flag */
-		if (code && !rcode) {
-		    rcode = code;
+    for (i = 0; i < nshards; i++) {
+	sp = &shards[i];
+	ObtainReadLock(&sp->lock);
+	for (j = 0; j < sp->nbuffers; j++) {
+	    tb = sp->buffers[j];
+	    if (tb->dirty) {
+		ObtainWriteLock(&tb->lock);
+		tb->lockers++;
+		ReleaseReadLock(&sp->lock);
+		if (tb->dirty) {
+		    code = ReallyWrite(bufferDir(tb), tb->page, tb->data);
+		    if (!code)
+			tb->dirty = 0;	/* Clear the dirty flag */
+		    if (code && !rcode) {
+			rcode = code;
+		    }
 		}
+		tb->lockers--;
+		ReleaseWriteLock(&tb->lock);
+		ObtainReadLock(&sp->lock);
 	    }
-	    (*tbp)->lockers--;
-	    ReleaseWriteLock(&(*tbp)->lock);
-	    ObtainReadLock(&afs_bufferLock);
 	}
+	ReleaseReadLock(&sp->lock);
     }
-    ReleaseReadLock(&afs_bufferLock);
     return rcode;
 }
 
@@ -453,17 +659,21 @@ int
 DNew(dir_file_t dir, int page, struct DirBuffer *entry)
 {
     struct buffer *tb;
+    struct bufshard *sp;
+    afs_uint32 hash;
 
     memset(entry,0, sizeof(struct DirBuffer));
 
-    ObtainWriteLock(&afs_bufferLock);
-    if ((tb = newslot(dir, page, 0)) == 0) {
-	ReleaseWriteLock(&afs_bufferLock);
+    hash = pHash(dir, page);
+    sp = pShard(hash);
+    ObtainWriteLock(&sp->lock);
+    if ((tb = newslot(dir, page, sp, hash)) == 0) {
+	ReleaseWriteLock(&sp->lock);
 	return EIO;
     }
     ObtainWriteLock(&tb->lock);
     tb->lockers++;
-    ReleaseWriteLock(&afs_bufferLock);
+    ReleaseWriteLock(&sp->lock);
     ReleaseWriteLock(&tb->lock);
 
     entry->buffer = tb;
@@ -60,6 +60,10 @@ struct dcache;
 struct DirBuffer;
 extern int DRead(struct dcache *adc, int page, struct DirBuffer *);
 extern int DNew(struct dcache *adc, int page, struct DirBuffer *);
+extern void *afs_osi_Alloc(size_t x);
+#ifndef afs_osi_Free
+extern void afs_osi_Free(void *x, size_t asize);
+#endif
 
 # include "afs/afs_osi.h"
 
@@ -77,12 +81,63 @@ extern int DNew(struct dcache *adc, int page, struct DirBuffer *);
 
 afs_int32 DErrno;
 
+/*
+ * The lookup index.
+ *
+ * A directory has only NHASHENT hash chains, so a lookup in a directory
+ * of tens of thousands of entries walks a chain hundreds of entries long,
+ * each entry on whatever page it happened to be created.  For directories
+ * of at least afs_dir_indexMinPages pages we build, on the first lookup, an
+ * open addressing table from a hash of each name to its blob number.  It
+ * is kept with the buffer holding the directory's header page (see
+ * DGetIndex), which the buffer package cannot recycle while a lookup has
+ * it held, and is freed with that buffer.  afs_dir_Create and
+ * afs_dir_Delete keep it up to date; anything else that changes a
+ * directory's contents must DZap it, as it must already for the buffers.
+ *
+ * Each slot holds the low 16 bits of the name's hash above the blob
+ * number; blobs 0 and 1 are in the directory header, so never entries.
+ */
+#define DIRIDX_EMPTY	0
+#define DIRIDX_DELETED	1
+#define DIRIDX_BLOB(s)	((s) & 0xffff)
+#define DIRIDX_TAG(h)	((h) << 16)
+
+struct DirIndex {
+    int size;			/* number of slots, a power of 2 */
+    int shift;			/* 32 - log2(size) */
+    int used;			/* slots not DIRIDX_EMPTY */
+    afs_uint32 table[1];	/* the slots */
+};
+
+#ifdef KERNEL
+# define DIRIDX_ALLOC(n)	afs_osi_Alloc(n)
+# define DIRIDX_FREE(p, n)	afs_osi_Free(p, n)
+#else
+# define DIRIDX_ALLOC(n)	malloc(n)
+# define DIRIDX_FREE(p, n)	free(p)
+#endif
+#define DIRIDX_BYTES(size) \
+    (sizeof(struct DirIndex) + ((size) - 1) * sizeof(afs_uint32))
+
+/* smallest directory, in pages, worth indexing */
+int afs_dir_indexMinPages = 16;
+
 /* Local static prototypes */
+static afs_uint64 PageBitmap(struct PageHeader *);
+static int LowestBit(afs_uint64);
+static int FindFreeRun(struct PageHeader *, int);
 static int FindBlobs(dir_file_t, int);
 static void AddPage(dir_file_t, int);
 static void FreeBlobs(dir_file_t, int, int);
 static int FindItem(dir_file_t, char *, struct DirBuffer *,
 		    struct DirBuffer *);
+static int LookupItem(dir_file_t, char *, struct DirBuffer *);
+static afs_uint32 NameHash(char *);
+static afs_uint32 IndexHash(char *);
+static int IndexInsert(struct DirIndex *, afs_uint32, int);
+static void IndexAdd(struct DirBuffer *, afs_uint32, int);
+static void IndexRemove(struct DirBuffer *, afs_uint32, int);
 
 /* Find out how many entries are required to store a name. */
 int
@@ -101,7 +156,7 @@ afs_dir_Create(dir_file_t dir, char *entry, void *voidfid)
     afs_int32 *vfid = (afs_int32 *) voidfid;
     int blobs, firstelt;
     int i;
-    struct DirBuffer entrybuf, prevbuf, headerbuf;
+    struct DirBuffer entrybuf, headerbuf;
     struct DirEntry *ep;
     struct DirHeader *dhp;
 
@@ -110,9 +165,8 @@ afs_dir_Create(dir_file_t dir, char *entry, void *voidfid)
 	return EINVAL;
 
     /* First check if file already exists. */
-    if (FindItem(dir, entry, &prevbuf, &entrybuf) == 0) {
+    if (LookupItem(dir, entry, &entrybuf) == 0) {
 	DRelease(&entrybuf, 0);
-	DRelease(&prevbuf, 0);
 	return EEXIST;
     }
 
@@ -141,6 +195,7 @@ afs_dir_Create(dir_file_t dir, char *entry, void *voidfid)
     i = afs_dir_DirHash(entry);
     ep->next = dhp->hashTable[i];
     dhp->hashTable[i] = htons(firstelt);
+    IndexAdd(&headerbuf, IndexHash(entry), firstelt);
     DRelease(&headerbuf, 1);
     DRelease(&entrybuf, 1);
     return 0;
@@ -177,7 +232,7 @@ afs_dir_Delete(dir_file_t dir, char *entry)
 {
 
     int nitems, index;
-    struct DirBuffer entrybuf, prevbuf;
+    struct DirBuffer entrybuf, prevbuf, headerbuf;
     struct DirEntry *firstitem;
     unsigned short *previtem;
 
@@ -192,16 +247,111 @@ afs_dir_Delete(dir_file_t dir, char *entry)
     index = DVOffset(&entrybuf) / 32;
     nitems = afs_dir_NameBlobs(firstitem->name);
     DRelease(&entrybuf, 0);
+    if (DRead(dir, 0, &headerbuf) == 0) {
+	IndexRemove(&headerbuf, IndexHash(entry), index);
+	DRelease(&headerbuf, 0);
+    }
     FreeBlobs(dir, index, nitems);
     return 0;
 }
 
+/* Return a page's allocation bitmap as a single word, bit i standing for
+ * blob i, so that it can be searched a word at a time rather than a bit at
+ * a time. */
+static afs_uint64
+PageBitmap(struct PageHeader *pp)
+{
+    unsigned char *bp = (unsigned char *)pp->freebitmap;
+    afs_uint64 map = 0;
+    int i;
+
+    for (i = EPP / 8 - 1; i >= 0; i--)
+	map = (map << 8) | bp[i];
+    return map;
+}
+
+/* Return the number of the lowest bit set in a non-zero word. */
+static int
+LowestBit(afs_uint64 word)
+{
+    afs_uint32 low;
+    int i = 0;
+
+    if ((word & 0xffffffff) == 0) {
+	word >>= 32;
+	i += 32;
+    }
+    low = (afs_uint32)word;
+    if ((low & 0xffff) == 0) {
+	low >>= 16;
+	i += 16;
+    }
+    if ((low & 0xff) == 0) {
+	low >>= 8;
+	i += 8;
+    }
+    if ((low & 0xf) == 0) {
+	low >>= 4;
+	i += 4;
+    }
+    if ((low & 0x3) == 0) {
+	low >>= 2;
+	i += 2;
+    }
+    if ((low & 0x1) == 0)
+	i++;
+    return i;
+}
+
+/* Return the first allocated blob in a page at or after the page-relative
+ * blob start, or EPP if there are none.  Empty stretches of the bitmap are
+ * passed over a byte at a time. */
+int
+afs_dir_NextAllocBlob(struct PageHeader *pp, int start)
+{
+    unsigned char *bp = (unsigned char *)pp->freebitmap;
+    unsigned int bits;
+    int i = start;
+
+    if (i >= EPP)
+	return EPP;
+    bits = bp[i >> 3] >> (i & 7);
+    while (bits == 0) {
+	i = (i | 7) + 1;	/* the start of the next byte */
+	if (i >= EPP)
+	    return EPP;
+	bits = bp[i >> 3];
+    }
+    while ((bits & 1) == 0) {
+	bits >>= 1;
+	i++;
+    }
+    return i;
+}
+
+/* Return the first of nblobs free blobs in a row in a page, or -1 if the
+ * page has no such run.  Bit j of run is set when blobs j through
+ * j + k are all free, so after nblobs - 1 rounds it marks the start of
+ * every run that is long enough. */
+static int
+FindFreeRun(struct PageHeader *pp, int nblobs)
+{
+    afs_uint64 avail, run;
+    int k;
+
+    avail = ~PageBitmap(pp);
+    for (run = avail, k = 1; k < nblobs && run != 0; k++)
+	run &= avail >> k;
+    if (run == 0)
+	return -1;
+    return LowestBit(run);
+}
+
 /* Find a bunch of contiguous entries; at least nblobs in a row. */
 static int
 FindBlobs(dir_file_t dir, int nblobs)
 {
     int i, j, k;
-    int failed = 0;
     struct DirBuffer headerbuf, pagebuf;
     struct DirHeader *dhp;
     struct PageHeader *pp;
@@ -240,18 +390,8 @@ FindBlobs(dir_file_t dir, int nblobs)
 		break;
 	    }
 	    pp = (struct PageHeader *)pagebuf.data;
-	    for (j = 0; j <= EPP - nblobs; j++) {
-		failed = 0;
-		for (k = 0; k < nblobs; k++)
-		    if ((pp->freebitmap[(j + k) >> 3] >> ((j + k) & 7)) & 1) {
-			failed = 1;
-			break;
-		    }
-		if (!failed)
-		    break;
-		failed = 1;
-	    }
-	    if (!failed) {
+	    j = FindFreeRun(pp, nblobs);
+	    if (j >= 0) {
 		/* Here we have the first index in j.  We update the allocation maps
 		 * and free up any resources we've got allocated. */
 		if (i < MAXPAGES)
@@ -362,12 +502,11 @@ int
 afs_dir_Lookup(dir_file_t dir, char *entry, void *voidfid)
 {
     afs_int32 *fid = (afs_int32 *) voidfid;
-    struct DirBuffer firstbuf, prevbuf;
+    struct DirBuffer firstbuf;
     struct DirEntry *firstitem;
 
-    if (FindItem(dir, entry, &prevbuf, &firstbuf) != 0)
+    if (LookupItem(dir, entry, &firstbuf) != 0)
 	return ENOENT;
-    DRelease(&prevbuf, 0);
     firstitem = (struct DirEntry *)firstbuf.data;
 
     fid[1] = ntohl(firstitem->fid.vnode);
@@ -383,12 +522,11 @@ afs_dir_LookupOffset(dir_file_t dir, char *entry, void *voidfid,
 		     long *offsetp)
 {
     afs_int32 *fid = (afs_int32 *) voidfid;
-    struct DirBuffer firstbuf, prevbuf;
+    struct DirBuffer firstbuf;
     struct DirEntry *firstitem;
 
-    if (FindItem(dir, entry, &prevbuf, &firstbuf) != 0)
+    if (LookupItem(dir, entry, &firstbuf) != 0)
 	return ENOENT;
-    DRelease(&prevbuf, 0);
     firstitem = (struct DirEntry *)firstbuf.data;
 
     fid[1] = ntohl(firstitem->fid.vnode);
@@ -562,18 +700,41 @@ afs_dir_GetVerifiedBlob(dir_file_t file, afs_int32 blobno,
     return 0;
 }
 
+/* The sum over a name of each character times 173 to the power of the
+ * number of characters after it, as the directory hash has always been
+ * defined.  Taking four characters a step gives the same sum with a
+ * quarter as many multiplies depending on each other. */
+#define H1 173u
+#define H2 (H1 * H1)
+#define H3 (H2 * H1)
+#define H4 (H3 * H1)
+static afs_uint32
+NameHash(char *string)
+{
+    unsigned char *cp = (unsigned char *)string;
+    afs_uint32 hval = 0;
+
+    while (cp[0] && cp[1] && cp[2] && cp[3]) {
+	hval = hval * H4 + cp[0] * H3 + cp[1] * H2 + cp[2] * H1 + cp[3];
+	cp += 4;
+    }
+    while (*cp)
+	hval = hval * H1 + *cp++;
+    return hval;
+}
+#undef H1
+#undef H2
+#undef H3
+#undef H4
+
 int
 afs_dir_DirHash(char *string)
 {
     /* Hash a string to a number between 0 and NHASHENT. */
-    unsigned char tc;
     unsigned int hval;
     int tval;
-    hval = 0;
-    while ((tc = (*string++))) {
-	hval *= 173;
-	hval += tc;
-    }
+
+    hval = NameHash(string);
     tval = hval & (NHASHENT - 1);
     if (tval == 0)
 	return tval;
@@ -656,6 +817,183 @@ out:
     return ENOENT;
 }
 
+/* Hash a name for the lookup index; the same hash as afs_dir_DirHash, but
+ * all of it, spread into the high bits the index takes its slot from. */
+static afs_uint32
+IndexHash(char *string)
+{
+    return NameHash(string) * 0x9e3779b1;
+}
+
+void
+afs_dir_FreeIndex(struct DirIndex *index)
+{
+    if (index)
+	DIRIDX_FREE(index, DIRIDX_BYTES(index->size));
+}
+
+/* Put blob in the index with the given hash.  Returns nonzero if the
+ * index is too full to take it. */
+static int
+IndexInsert(struct DirIndex *index, afs_uint32 hash, int blob)
+{
+    afs_uint32 i, mask = index->size - 1;
+
+    if ((index->used + 1) * 4 > index->size * 3)
+	return 1;
+    for (i = hash >> index->shift; ; i = (i + 1) & mask) {
+	if (index->table[i] == DIRIDX_EMPTY) {
+	    index->used++;
+	    break;
+	}
+	if (index->table[i] == DIRIDX_DELETED)
+	    break;
+    }
+    index->table[i] = DIRIDX_TAG(hash) | blob;
+    return 0;
+}
+
+/* Record a new entry in the directory's index, if it has one.  An index
+ * that has filled up is dropped, to be built again larger on next use. */
+static void
+IndexAdd(struct DirBuffer *headerbuf, afs_uint32 hash, int blob)
+{
+    struct DirIndex *index;
+
+    index = DGetIndex(headerbuf);
+    if (index && IndexInsert(index, hash, blob))
+	afs_dir_FreeIndex(DDropIndex(headerbuf));
+}
+
+/* Remove a deleted entry from the directory's index, if it has one. */
+static void
+IndexRemove(struct DirBuffer *headerbuf, afs_uint32 hash, int blob)
+{
+    struct DirIndex *index;
+    afs_uint32 i, mask;
+
+    index = DGetIndex(headerbuf);
+    if (!index)
+	return;
+    mask = index->size - 1;
+    for (i = hash >> index->shift; index->table[i] != DIRIDX_EMPTY;
+	 i = (i + 1) & mask) {
+	if (index->table[i] == (DIRIDX_TAG(hash) | blob)) {
+	    index->table[i] = DIRIDX_DELETED;
+	    return;
+	}
+    }
+    /* Not there; the index is not to be trusted. */
+    afs_dir_FreeIndex(DDropIndex(headerbuf));
+}
+
+/* Return the lookup index of the directory whose header page is held in
+ * headerbuf, building it if the directory is big enough to have one. */
+static struct DirIndex *
+GetIndex(dir_file_t dir, struct DirBuffer *headerbuf)
+{
+    struct DirHeader *dhp = (struct DirHeader *)headerbuf->data;
+    struct DirIndex *index, *tindex;
+    struct DirBuffer entrybuf;
+    struct DirEntry *ep;
+    int i, num, elements, npages, size, shift;
+
+    index = DGetIndex(headerbuf);
+    if (index)
+	return index;
+
+    npages = ntohs(dhp->header.pgcount);
+    if (npages == 0) {
+	/* old style, count the pages */
+	for (i = 0; i < MAXPAGES; i++)
+	    if (dhp->alloMap[i] != EPP)
+		npages++;
+    }
+    if (npages < afs_dir_indexMinPages)
+	return NULL;
+
+    /* no more than half full, even if every blob held an entry */
+    for (size = 1, shift = 32; size < 2 * npages * EPP; size <<= 1)
+	shift--;
+    index = DIRIDX_ALLOC(DIRIDX_BYTES(size));
+    if (!index)
+	return NULL;
+    memset(index, 0, DIRIDX_BYTES(size));
+    index->size = size;
+    index->shift = shift;
+
+    for (i = 0; i < NHASHENT; i++) {
+	num = ntohs(dhp->hashTable[i]);
+	elements = 0;
+	while (num != 0 && elements < BIGMAXPAGES * EPP) {
+	    elements++;
+	    if (afs_dir_GetVerifiedBlob(dir, num, &entrybuf) != 0)
+		goto fail;
+	    ep = (struct DirEntry *)entrybuf.data;
+	    if (IndexInsert(index, IndexHash(ep->name), num)) {
+		DRelease(&entrybuf, 0);
+		goto fail;
+	    }
+	    num = ntohs(ep->next);
+	    DRelease(&entrybuf, 0);
+	}
+	if (num != 0)
+	    goto fail;		/* circular hash chain */
+    }
+
+    /* someone else may have beaten us to it */
+    tindex = DSetIndex(headerbuf, index);
+    if (tindex != index)
+	afs_dir_FreeIndex(index);
+    return tindex;
+
+  fail:
+    afs_dir_FreeIndex(index);
+    return NULL;
+}
+
+/* Find a directory entry, given its name, using the lookup index if the
+ * directory has one.  Like FindItem, but without the previous item. */
+static int
+LookupItem(dir_file_t dir, char *ename, struct DirBuffer *itembuf)
+{
+    struct DirBuffer headerbuf, prevbuf, curr;
+    struct DirIndex *index;
+    afs_uint32 i, mask, hash, slot;
+    int code;
+
+    code = DRead(dir, 0, &headerbuf);
+    if (code)
+	return code;
+    index = GetIndex(dir, &headerbuf);
+    if (!index) {
+	DRelease(&headerbuf, 0);
+	code = FindItem(dir, ename, &prevbuf, itembuf);
+	if (code == 0)
+	    DRelease(&prevbuf, 0);
+	return code;
+    }
+
+    memset(itembuf, 0, sizeof(struct DirBuffer));
+    hash = IndexHash(ename);
+    mask = index->size - 1;
+    for (i = hash >> index->shift; (slot = index->table[i]) != DIRIDX_EMPTY;
+	 i = (i + 1) & mask) {
+	if (slot == DIRIDX_DELETED || (slot & ~0xffff) != DIRIDX_TAG(hash))
+	    continue;
+	if (afs_dir_GetVerifiedBlob(dir, DIRIDX_BLOB(slot), &curr) != 0)
+	    continue;
+	if (!strcmp(ename, ((struct DirEntry *)curr.data)->name)) {
+	    DRelease(&headerbuf, 0);
+	    *itembuf = curr;
+	    return 0;
+	}
+	DRelease(&curr, 0);
+    }
+    DRelease(&headerbuf, 0);
+    return ENOENT;
+}
+
 static int
 FindFid (void *dir, afs_uint32 vnode, afs_uint32 unique,
 	 struct DirBuffer *itembuf)
@@ -107,6 +107,7 @@ extern int afs_dir_GetBlob(dir_file_t dir, afs_int32 blobno,
 extern int afs_dir_GetVerifiedBlob(dir_file_t dir, afs_int32 blobno,
 				   struct DirBuffer *);
 extern int afs_dir_DirHash(char *string);
+extern int afs_dir_NextAllocBlob(struct PageHeader *pp, int start);
 
 extern int afs_dir_InverseLookup (void *dir, afs_uint32 vnode,
 				  afs_uint32 unique, char *name,
@@ -115,9 +116,25 @@ extern int afs_dir_InverseLookup (void *dir, afs_uint32 vnode,
 extern int afs_dir_ChangeFid(dir_file_t dir, char *entry,
 		             afs_uint32 *old_fid, afs_uint32 *new_fid);
 
+struct DirIndex;
+extern int afs_dir_indexMinPages;
+extern void afs_dir_FreeIndex(struct DirIndex *index);
+
 /* buffer operations */
 
+struct DirBufferStats {
+    int buffers;		/* buffers in the pool */
+    int shards;			/* shards the pool is divided into */
+    afs_uint32 calls;		/* pages asked for */
+    afs_uint32 hits;		/* ... found in the pool */
+    afs_uint32 ios;		/* pages read */
+    afs_uint32 writes;		/* pages written */
+    afs_uint32 grows;		/* buffers added because all were held */
+};
+
 extern void DInit(int abuffers);
+extern int DSetBuffers(int abuffers);
+extern void DGetStats(struct DirBufferStats *stats);
 extern int DRead(dir_file_t fid, int page, struct DirBuffer *);
 extern int DFlush(void);
 extern int DFlushVolume(afs_int32);
@@ -128,6 +145,9 @@ extern int DStat(int *abuffers, int *acalls, int *aios);
 extern int DFlushVolume(afs_int32 vid);
 extern int DFlushEntry(dir_file_t fid);
 extern int DVOffset(struct DirBuffer *);
+extern struct DirIndex *DGetIndex(struct DirBuffer *);
+extern struct DirIndex *DSetIndex(struct DirBuffer *, struct DirIndex *);
+extern struct DirIndex *DDropIndex(struct DirBuffer *);
 
 /* salvage.c */
 
@@ -38,6 +38,10 @@ Usage(void)
     printf("-d file name - delete name from directory in file\n");
     printf("-r file name - lookup name in directory\n");
     printf("-a file name - add name to directory in file\n");
+    printf
+	("-b file count lookups - time creating count names and looking up names, with and without the lookup index\n");
+    printf
+	("-e file count passes - time reading a directory of count names, as the fileserver and the client read it\n");
     exit(1);
 }
 
@@ -163,6 +167,173 @@ CRTest(char *dname, char *ename, int count)
     DFlush();
 }
 
+static double
+Elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+static void
+BenchDir(char *dname, int count, int lookups)
+{
+    char tbuffer[200];
+    int i, pass, code;
+    afs_int32 fid[3];
+    dirhandle dir;
+    struct timeval start;
+    double ctime, ltime;
+
+    for (pass = 0; pass < 2; pass++) {
+	/* first without the lookup index, then with it */
+	afs_dir_indexMinPages = pass ? 16 : BIGMAXPAGES + 1;
+
+	CreateDir(dname, &dir);
+	memset(fid, 0, sizeof(fid));
+	afs_dir_MakeDir(&dir, fid, fid);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < count; i++) {
+	    sprintf(tbuffer, "entry%d", i);
+	    fid[1] = i + 2;
+	    fid[2] = 1;
+	    code = afs_dir_Create(&dir, tbuffer, fid);
+	    if (code) {
+		printf("code for '%s' is %d\n", tbuffer, code);
+		return;
+	    }
+	}
+	ctime = Elapsed(&start);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < lookups; i++) {
+	    /* spread the names over the whole directory */
+	    sprintf(tbuffer, "entry%d", (int)((i * 7919L) % count));
+	    code = afs_dir_Lookup(&dir, tbuffer, fid);
+	    if (code) {
+		printf("lookup code for '%s' is %d\n", tbuffer, code);
+		return;
+	    }
+	}
+	ltime = Elapsed(&start);
+
+	printf("%s index: %d creates in %.3f s, %d lookups in %.3f s "
+	       "(%.0f lookups/s)\n", pass ? "with" : "without", count, ctime,
+	       lookups, ltime, ltime > 0 ? lookups / ltime : 0.0);
+	DFlush();
+	DZap(&dir);
+	close(dir.fd);
+    }
+}
+
+static int
+CountEntry(void *hook, char *name, afs_int32 vnode, afs_int32 unique)
+{
+    (*(int *)hook)++;
+    return 0;
+}
+
+/* Read every entry in the directory the way the client's readdir does,
+ * page by page from the allocation bitmaps; returns the entries seen. */
+static int
+ScanDir(dirhandle *dir)
+{
+    struct DirBuffer headerbuf, entrybuf;
+    struct DirEntry *ep;
+    int blob, pageBlob, start, nblobs, i, entries = 0;
+
+    nblobs = afs_dir_Length(dir) / AFS_PAGESIZE * EPP;
+    for (blob = DHE + 1; blob < nblobs;) {
+	pageBlob = blob & ~(EPP - 1);
+	start = blob - pageBlob;
+	if (start == 0)
+	    start = 1;		/* the page header */
+	if (afs_dir_GetBlob(dir, pageBlob, &headerbuf) != 0)
+	    break;
+	i = afs_dir_NextAllocBlob((struct PageHeader *)headerbuf.data, start);
+	DRelease(&headerbuf, 0);
+	if (i == EPP) {
+	    blob = pageBlob + EPP;
+	    continue;
+	}
+	blob = pageBlob + i;
+	if (afs_dir_GetVerifiedBlob(dir, blob, &entrybuf) != 0)
+	    break;
+	ep = (struct DirEntry *)entrybuf.data;
+	entries++;
+	blob += afs_dir_NameBlobs(ep->name);
+	DRelease(&entrybuf, 0);
+    }
+    return entries;
+}
+
+static void
+ReadDirBench(char *dname, int count, int passes)
+{
+    char tbuffer[200];
+    int i, round, code, entries, expected;
+    afs_int32 fid[3];
+    dirhandle dir;
+    struct timeval start;
+    double ctime, etime, stime;
+
+    CreateDir(dname, &dir);
+    memset(fid, 0, sizeof(fid));
+    afs_dir_MakeDir(&dir, fid, fid);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++) {
+	sprintf(tbuffer, "entry%d", i);
+	fid[1] = i + 2;
+	fid[2] = 1;
+	code = afs_dir_Create(&dir, tbuffer, fid);
+	if (code) {
+	    printf("code for '%s' is %d\n", tbuffer, code);
+	    return;
+	}
+    }
+    ctime = Elapsed(&start);
+    printf("%d creates in %.3f s\n", count, ctime);
+
+    expected = count + 2;
+    for (round = 0; round < 2; round++) {
+	if (round == 1) {
+	    /* again with the pages three quarters empty */
+	    for (i = 0; i < count; i++) {
+		if (i % 4 == 0)
+		    continue;
+		sprintf(tbuffer, "entry%d", i);
+		afs_dir_Delete(&dir, tbuffer);
+		expected--;
+	    }
+	}
+
+	/* the fileserver's way, down the hash chains */
+	gettimeofday(&start, NULL);
+	for (entries = 0, i = 0; i < passes; i++)
+	    afs_dir_EnumerateDir(&dir, CountEntry, &entries);
+	etime = Elapsed(&start);
+	if (entries != passes * expected)
+	    printf("enumerate saw %d entries\n", entries);
+
+	/* the client's way, along the pages */
+	gettimeofday(&start, NULL);
+	for (entries = 0, i = 0; i < passes; i++)
+	    entries += ScanDir(&dir);
+	stime = Elapsed(&start);
+	if (entries != passes * expected)
+	    printf("scan saw %d entries\n", entries);
+
+	printf("%d entries: enumerate %.0f entries/s, readdir scan %.0f "
+	       "entries/s\n", expected,
+	       etime > 0 ? passes * expected / etime : 0.0,
+	       stime > 0 ? passes * expected / stime : 0.0);
+    }
+    DFlush();
+    DZap(&dir);
+    close(dir.fd);
+}
+
 static void
 OpenDir(char *name, dirhandle *dir)
 {
@@ -231,6 +402,12 @@ FidEq(dirhandle *dir1, dirhandle *dir2)
     return (dir1->uniq == dir2->uniq);
 }
 
+afs_uint32
+FidHash(dirhandle *dir)
+{
+    return dir->uniq;
+}
+
 int
 FidVolEq(long *afid, long *bfid)
 {
@@ -291,6 +468,12 @@ main(int argc, char **argv)
     case 'a':
 	AddEntry(*argv, argv[1]);
 	break;
+    case 'b':
+	BenchDir(*argv, atoi(argv[1]), atoi(argv[2]));
+	break;
+    case 'e':
+	ReadDirBench(*argv, atoi(argv[1]), atoi(argv[2]));
+	break;
     default:
 	Usage();
     }
@@ -111,6 +111,13 @@ FidEq(afid, bfid)
     return 1;
 }
 
+afs_uint32
+FidHash(afid)
+     long *afid;
+{				/* Hash a fid, consistently with FidEq. */
+    return *afid;
+}
+
 int
 FidVolEq(afid, bfid)
      long *afid, *bfid;
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2026 OpenAFS.ORG and others. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measure how well stat and read of cached files scale with the number of
+ * threads using the cache manager at once.  Each thread stats, and with
+ * -read also reads the first 64k of, every file named on the command line,
+ * over and over.  One pass is made first to bring the files into the cache,
+ * so that what is timed is the cache manager's own lookup and locking.
+ *
+ * usage: statbench [-threads N] [-iterations N] [-read] file... [-- afsd options]
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <afs/sysincludes.h>
+#include <rx/rx.h>
+#include <afs_usrops.h>
+
+static char **files;
+static int nfiles;
+static int iterations = 1000;
+static int doread;
+
+/* stat, and maybe read, each file once; returns the number of failures */
+static int
+bench_pass(void)
+{
+    char buf[65536];
+    struct stat st;
+    int j, fd, errors = 0;
+
+    for (j = 0; j < nfiles; j++) {
+	if (uafs_stat(files[j], &st) < 0) {
+	    errors++;
+	    continue;
+	}
+	if (!doread || !S_ISREG(st.st_mode))
+	    continue;
+	fd = uafs_open(files[j], O_RDONLY, 0);
+	if (fd < 0) {
+	    errors++;
+	    continue;
+	}
+	if (uafs_pread(fd, buf, sizeof(buf), 0) < 0)
+	    errors++;
+	uafs_close(fd);
+    }
+    return errors;
+}
+
+static void *
+bench_thread(void *arg)
+{
+    int *errors = arg;
+    int i;
+
+    for (i = 0; i < iterations; i++)
+	*errors += bench_pass();
+    return NULL;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: statbench [-threads N] [-iterations N] [-read] "
+	    "file... [-- afsd options]\n");
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t *tids;
+    int *terrors;
+    struct timeval start, end;
+    double secs;
+    int nthreads = 1;
+    int i, code, errors;
+
+    for (i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+	    nthreads = atoi(argv[++i]);
+	else if (strcmp(argv[i], "-iterations") == 0 && i + 1 < argc)
+	    iterations = atoi(argv[++i]);
+	else if (strcmp(argv[i], "-read") == 0)
+	    doread = 1;
+	else if (argv[i][0] == '-' && strcmp(argv[i], "--") != 0)
+	    usage();
+	else
+	    break;
+    }
+    files = &argv[i];
+    for (nfiles = 0; i < argc && strcmp(argv[i], "--") != 0; i++)
+	nfiles++;
+    if (nfiles == 0 || nthreads < 1 || iterations < 1)
+	usage();
+
+    code = uafs_Setup("/afs");
+    if (code) {
+	errno = code;
+	perror("libuafs");
+	return 1;
+    }
+    /* afsd options follow "--"; uafs_ParseArgs expects argv[0] first */
+    if (i < argc)
+	code = uafs_ParseArgs(argc - i, &argv[i]);
+    else
+	code = uafs_ParseArgs(0, NULL);
+    if (code) {
+	fprintf(stderr, "statbench: bad afsd options\n");
+	return 1;
+    }
+    code = uafs_Run();
+    if (code) {
+	fprintf(stderr, "statbench: cannot start the cache manager, "
+		"code %d\n", code);
+	return 1;
+    }
+
+    /* warm the cache */
+    bench_pass();
+
+    tids = calloc(nthreads, sizeof(*tids));
+    terrors = calloc(nthreads, sizeof(*terrors));
+    if (tids == NULL || terrors == NULL) {
+	perror("calloc");
+	return 1;
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+	code = pthread_create(&tids[i], NULL, bench_thread, &terrors[i]);
+	if (code) {
+	    errno = code;
+	    perror("pthread_create");
+	    return 1;
+	}
+    }
+    errors = 0;
+    for (i = 0; i < nthreads; i++) {
+	pthread_join(tids[i], NULL);
+	errors += terrors[i];
+    }
+    gettimeofday(&end, NULL);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    printf("%d threads, %d files, %d iterations%s: %.3f s, %.0f ops/s, "
+	   "%d errors\n", nthreads, nfiles, iterations,
+	   doread ? " with read" : "", secs,
+	   secs > 0 ? (double)nthreads * nfiles * iterations / secs : 0.0,
+	   errors);
+
+    free(tids);
+    free(terrors);
+    uafs_Shutdown();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2026 OpenAFS.ORG and others. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replay a trace of the cache manager's data cache against a model of
+ * caches of other sizes and policies.
+ *
+ * The trace is the output of "fstrace dump cmfx" taken while the cm set
+ * was active; the GetDCache, FindDCache and GetDownD evict records in it
+ * (CM_TRACE_DCACHEREF, CM_TRACE_DCACHEFIND and CM_TRACE_DCACHEEVICT) are
+ * used and everything else is ignored.  Make the cmfx log large enough to
+ * hold the whole run with "fstrace setlog cmfx -buffersize".
+ *
+ * For each combination of -blocks, -chunksize, -files and -policy given,
+ * the references are replayed against a model of the cache sized that way
+ * and the hit ratio, the data that would have been fetched, and the number
+ * of chunks evicted are reported.  The model follows afs_GetDownD: a cache
+ * is full when it holds -files chunks or -blocks kilobytes, lru evicts the
+ * least recently used chunk, and 2q is the policy of afsd -cache-policy 2q.
+ * It does not know about writes, or about chunks dropped because the file
+ * changed on the server, so compare policies and sizes with each other
+ * rather than with the real counts, which are printed for reference.
+ *
+ * The model is hand-written; it does not run afs_dcache.c, since libuafs
+ * could only satisfy a miss by fetching from a file server.  The build
+ * checks that the eviction code in afs_dcache.c, from afs_DCGhostTag to
+ * the end of afs_GetDownD, still has the checksum below, and fails when
+ * it does not.  After changing that code, bring Evict and its helpers
+ * here into line and record the new checksum the build prints.
+ */
+#define DCSIM_MODEL_CKSUM "3972577940 13695"
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <afs/cmd.h>
+#include <afs/afs_args.h>
+
+struct ref {
+    afs_uint32 fid[4];		/* cell, volume, vnode, unique */
+    afs_uint64 offset;		/* byte wanted */
+    afs_uint64 length;		/* file length at the time */
+    char find;			/* FindDCache: touches, never fetches */
+};
+
+struct entry {
+    struct entry *hnext;	/* hash chain */
+    struct entry *prev, *next;	/* LRU list, most recent first */
+    afs_uint32 fid[4];
+    afs_uint64 chunk;
+    afs_int32 blocks;		/* 1K blocks held */
+    int protected;		/* 2q: on the protected list */
+};
+
+struct list {
+    struct entry head;		/* head.next is most recent */
+    afs_int32 count;
+};
+
+struct sim {
+    afs_int32 blocks, files, logChunk, policy;
+    struct entry **hash;
+    afs_uint32 hashMask;
+    struct list probation;	/* the only list under lru */
+    struct list protected;
+    afs_uint32 *ghosts;
+    afs_int32 nghosts;
+    afs_int32 used;		/* 1K blocks in use */
+    /* results */
+    unsigned long long refs, hits, fetched, evictions, ghostHits;
+};
+
+static struct ref *refs;
+static afs_int32 nrefs, maxrefs;
+static unsigned long long traceHits, traceMisses, traceFinds, traceEvictions;
+
+static void
+AddRef(struct ref *aref)
+{
+    if (nrefs == maxrefs) {
+	maxrefs = maxrefs ? 2 * maxrefs : 4096;
+	refs = realloc(refs, maxrefs * sizeof(*refs));
+	if (refs == NULL) {
+	    fprintf(stderr, "dcsim: out of memory reading trace\n");
+	    exit(1);
+	}
+    }
+    refs[nrefs++] = *aref;
+}
+
+static int
+ReadTrace(FILE *afile)
+{
+    char line[1024];
+    char *p;
+    struct ref tref;
+    afs_uint32 hi, lo, lhi, llo, chunk, bytes;
+    int hit, prot;
+
+    while (fgets(line, sizeof(line), afile) != NULL) {
+	memset(&tref, 0, sizeof(tref));
+	if ((p = strstr(line, "GetDCache fid (")) != NULL) {
+	    if (sscanf(p, "GetDCache fid (%u:%u.%u.%u) offset (0x%x, 0x%x) "
+		       "length (0x%x, 0x%x) hit %d", &tref.fid[0],
+		       &tref.fid[1], &tref.fid[2], &tref.fid[3], &hi, &lo,
+		       &lhi, &llo, &hit) != 9)
+		continue;
+	    tref.offset = ((afs_uint64)hi << 32) | lo;
+	    tref.length = ((afs_uint64)lhi << 32) | llo;
+	    if (hit)
+		traceHits++;
+	    else
+		traceMisses++;
+	    AddRef(&tref);
+	} else if ((p = strstr(line, "FindDCache fid (")) != NULL) {
+	    if (sscanf(p, "FindDCache fid (%u:%u.%u.%u) offset (0x%x, 0x%x) "
+		       "hit %d", &tref.fid[0], &tref.fid[1], &tref.fid[2],
+		       &tref.fid[3], &hi, &lo, &hit) != 7)
+		continue;
+	    tref.offset = ((afs_uint64)hi << 32) | lo;
+	    tref.find = 1;
+	    traceFinds++;
+	    AddRef(&tref);
+	} else if ((p = strstr(line, "GetDownD evict fid (")) != NULL) {
+	    if (sscanf(p, "GetDownD evict fid (%u:%u.%u.%u) chunk %u bytes %u "
+		       "protected %d", &tref.fid[0], &tref.fid[1],
+		       &tref.fid[2], &tref.fid[3], &chunk, &bytes,
+		       &prot) == 7)
+		traceEvictions++;
+	}
+    }
+    return ferror(afile) ? -1 : 0;
+}
+
+/* same tag as afs_DCGhostTag in the cache manager */
+static afs_uint32
+GhostTag(afs_uint32 *afid, afs_uint64 chunk)
+{
+    afs_uint32 tag;
+
+    tag = afid[1] * 0x9e3779b1;
+    tag ^= afid[2] * 0x85ebca6b;
+    tag ^= afid[3] * 0xc2b2ae35;
+    tag ^= (afs_uint32)chunk * 0x27d4eb2f;
+    return tag | 1;
+}
+
+static afs_uint32
+HashKey(struct sim *as, afs_uint32 *afid, afs_uint64 chunk)
+{
+    afs_uint32 h;
+
+    h = afid[0] * 31 + afid[1];
+    h = h * 31 + afid[2];
+    h = h * 31 + afid[3];
+    h = h * 31 + (afs_uint32)chunk;
+    return (h ^ (h >> 16)) & as->hashMask;
+}
+
+static void
+ListRemove(struct list *al, struct entry *ae)
+{
+    ae->prev->next = ae->next;
+    ae->next->prev = ae->prev;
+    al->count--;
+}
+
+static void
+ListAdd(struct list *al, struct entry *ae)
+{
+    ae->next = al->head.next;
+    ae->prev = &al->head;
+    al->head.next->prev = ae;
+    al->head.next = ae;
+    al->count++;
+}
+
+static void
+ListInit(struct list *al)
+{
+    al->head.next = al->head.prev = &al->head;
+    al->count = 0;
+}
+
+static struct entry *
+Lookup(struct sim *as, afs_uint32 *afid, afs_uint64 chunk)
+{
+    struct entry *te;
+
+    for (te = as->hash[HashKey(as, afid, chunk)]; te; te = te->hnext) {
+	if (te->chunk == chunk && memcmp(te->fid, afid, sizeof(te->fid)) == 0)
+	    return te;
+    }
+    return NULL;
+}
+
+static void
+Evict(struct sim *as)
+{
+    struct list *tl;
+    struct entry *te, **tep;
+
+    tl = &as->probation;
+    if (as->policy == AFS_DCPOLICY_2Q
+	&& as->probation.count <= (as->probation.count
+				   + as->protected.count) / 4
+	&& as->protected.count > 0)
+	tl = &as->protected;
+    te = tl->head.prev;
+
+    ListRemove(tl, te);
+    for (tep = &as->hash[HashKey(as, te->fid, te->chunk)]; *tep != te;
+	 tep = &(*tep)->hnext)
+	;
+    *tep = te->hnext;
+    if (as->ghosts && !te->protected) {
+	afs_uint32 tag = GhostTag(te->fid, te->chunk);
+	as->ghosts[tag % as->nghosts] = tag;
+    }
+    as->used -= te->blocks;
+    as->evictions++;
+    free(te);
+}
+
+static void
+Replay(struct sim *as)
+{
+    struct ref *tr;
+    struct entry *te;
+    afs_uint64 chunk, base, bytes, chunkSize;
+    afs_uint32 h, tag;
+    afs_int32 i, tblocks;
+
+    chunkSize = (afs_uint64)1 << as->logChunk;
+    for (i = 0; i < nrefs; i++) {
+	tr = &refs[i];
+	chunk = tr->offset >> as->logChunk;
+	te = Lookup(as, tr->fid, chunk);
+	if (te) {
+	    struct list *tl = te->protected ? &as->protected : &as->probation;
+	    ListRemove(tl, te);
+	    ListAdd(tl, te);
+	    if (!tr->find) {
+		as->refs++;
+		as->hits++;
+	    }
+	    continue;
+	}
+	if (tr->find)
+	    continue;
+
+	/* a miss; fetch what there is of the chunk */
+	as->refs++;
+	base = chunk << as->logChunk;
+	bytes = tr->length > base ? tr->length - base : 0;
+	if (bytes > chunkSize)
+	    bytes = chunkSize;
+	as->fetched += bytes;
+	tblocks = (bytes + 1023) >> 10;
+	while (as->probation.count + as->protected.count > 0
+	       && (as->probation.count + as->protected.count >= as->files
+		   || as->used + tblocks > as->blocks))
+	    Evict(as);
+
+	te = calloc(1, sizeof(*te));
+	if (te == NULL) {
+	    fprintf(stderr, "dcsim: out of memory\n");
+	    exit(1);
+	}
+	memcpy(te->fid, tr->fid, sizeof(te->fid));
+	te->chunk = chunk;
+	te->blocks = tblocks;
+	if (as->ghosts) {
+	    tag = GhostTag(te->fid, chunk);
+	    if (as->ghosts[tag % as->nghosts] == tag) {
+		as->ghosts[tag % as->nghosts] = 0;
+		te->protected = 1;
+		as->ghostHits++;
+	    }
+	}
+	h = HashKey(as, te->fid, chunk);
+	te->hnext = as->hash[h];
+	as->hash[h] = te;
+	ListAdd(te->protected ? &as->protected : &as->probation, te);
+	as->used += tblocks;
+    }
+}
+
+static void
+SimFree(struct sim *as)
+{
+    struct entry *te, *ne;
+    afs_uint32 i;
+
+    for (i = 0; i <= as->hashMask; i++) {
+	for (te = as->hash[i]; te; te = ne) {
+	    ne = te->hnext;
+	    free(te);
+	}
+    }
+    free(as->hash);
+    free(as->ghosts);
+}
+
+static void
+RunOne(afs_int32 ablocks, afs_int32 alogChunk, afs_int32 afiles,
+       afs_int32 apolicy)
+{
+    struct sim tsim;
+    afs_uint32 hsize;
+
+    memset(&tsim, 0, sizeof(tsim));
+    tsim.blocks = ablocks;
+    tsim.logChunk = alogChunk;
+    tsim.policy = apolicy;
+    if (afiles > 0) {
+	tsim.files = afiles;
+    } else {
+	/* as afsd chooses -files when it is not given */
+	afs_int32 chunkKB = 1 << (alogChunk < 10 ? 0 : alogChunk - 10);
+
+	tsim.files = ablocks / 32;
+	if (tsim.files < 1000)
+	    tsim.files = 1000;
+	if (tsim.files < 1.5 * (ablocks / chunkKB))
+	    tsim.files = 1.5 * (ablocks / chunkKB);
+    }
+
+    for (hsize = 1024; hsize < 2 * (afs_uint32)tsim.files; hsize <<= 1)
+	;
+    tsim.hashMask = hsize - 1;
+    tsim.hash = calloc(hsize, sizeof(*tsim.hash));
+    if (apolicy == AFS_DCPOLICY_2Q) {
+	tsim.nghosts = 2 * tsim.files;
+	tsim.ghosts = calloc(tsim.nghosts, sizeof(*tsim.ghosts));
+    }
+    if (tsim.hash == NULL || (apolicy == AFS_DCPOLICY_2Q && !tsim.ghosts)) {
+	fprintf(stderr, "dcsim: out of memory\n");
+	exit(1);
+    }
+    ListInit(&tsim.probation);
+    ListInit(&tsim.protected);
+
+    Replay(&tsim);
+
+    printf("%-4s %10d %9d %8d %10llu %6.2f%% %12llu %10llu",
+	   apolicy == AFS_DCPOLICY_2Q ? "2q" : "lru", tsim.blocks,
+	   tsim.logChunk, tsim.files, tsim.refs,
+	   tsim.refs ? 100.0 * tsim.hits / tsim.refs : 0.0,
+	   tsim.fetched >> 10, tsim.evictions);
+    if (apolicy == AFS_DCPOLICY_2Q)
+	printf(" %10llu", tsim.ghostHits);
+    printf("\n");
+    SimFree(&tsim);
+}
+
+static int
+ParseList(struct cmd_item *ai, afs_int32 *avals, int amax, const char *aname)
+{
+    int n = 0;
+    char *end;
+
+    for (; ai; ai = ai->next) {
+	if (n == amax) {
+	    fprintf(stderr, "dcsim: too many %s values\n", aname);
+	    return -1;
+	}
+	avals[n] = strtol(ai->data, &end, 10);
+	if (*end != '\0' || avals[n] <= 0) {
+	    fprintf(stderr, "dcsim: bad %s value %s\n", aname, ai->data);
+	    return -1;
+	}
+	n++;
+    }
+    return n;
+}
+
+#define MAXVALS 16
+
+static int
+DcsimCmd(struct cmd_syndesc *as, void *arock)
+{
+    afs_int32 blocks[MAXVALS], chunks[MAXVALS], files[MAXVALS];
+    afs_int32 policies[2];
+    int nblocks, nchunks, nfiles, npolicies;
+    int ib, ic, ifl, ip;
+    struct cmd_item *ti;
+    FILE *tfile = stdin;
+
+    nblocks = ParseList(as->parms[1].items, blocks, MAXVALS, "-blocks");
+    nchunks = ParseList(as->parms[2].items, chunks, MAXVALS, "-chunksize");
+    nfiles = ParseList(as->parms[3].items, files, MAXVALS, "-files");
+    if (nblocks < 0 || nchunks < 0 || nfiles < 0)
+	return 1;
+    if (nblocks == 0)
+	blocks[nblocks++] = 100000;
+    if (nchunks == 0)
+	chunks[nchunks++] = 20;
+    if (nfiles == 0)
+	files[nfiles++] = 0;	/* afsd's default for the size */
+
+    npolicies = 0;
+    for (ti = as->parms[4].items; ti; ti = ti->next) {
+	if (npolicies == 2)
+	    break;
+	if (strcasecmp(ti->data, "lru") == 0)
+	    policies[npolicies++] = AFS_DCPOLICY_LRU;
+	else if (strcasecmp(ti->data, "2q") == 0)
+	    policies[npolicies++] = AFS_DCPOLICY_2Q;
+	else {
+	    fprintf(stderr, "dcsim: unknown policy %s (use lru or 2q)\n",
+		    ti->data);
+	    return 1;
+	}
+    }
+    if (npolicies == 0) {
+	policies[npolicies++] = AFS_DCPOLICY_LRU;
+	policies[npolicies++] = AFS_DCPOLICY_2Q;
+    }
+
+    if (as->parms[0].items) {
+	tfile = fopen(as->parms[0].items->data, "r");
+	if (tfile == NULL) {
+	    perror(as->parms[0].items->data);
+	    return 1;
+	}
+    }
+    if (ReadTrace(tfile) < 0) {
+	fprintf(stderr, "dcsim: error reading trace\n");
+	return 1;
+    }
+    if (tfile != stdin)
+	fclose(tfile);
+    if (nrefs == 0) {
+	fprintf(stderr, "dcsim: no dcache records in the trace; was the cm "
+		"set active?\n");
+	return 1;
+    }
+
+    printf("model of afs_GetDownD, not the cache manager itself\n");
+    printf("trace: %llu GetDCache (%llu hits, %.2f%%), %llu FindDCache, "
+	   "%llu evictions\n", traceHits + traceMisses, traceHits,
+	   100.0 * traceHits / (traceHits + traceMisses ? traceHits +
+				traceMisses : 1), traceFinds, traceEvictions);
+    printf("%-4s %10s %9s %8s %10s %7s %12s %10s %10s\n", "", "blocks",
+	   "chunksize", "files", "refs", "hits", "fetched(KB)", "evictions",
+	   "ghosthits");
+    for (ip = 0; ip < npolicies; ip++)
+	for (ib = 0; ib < nblocks; ib++)
+	    for (ic = 0; ic < nchunks; ic++)
+		for (ifl = 0; ifl < nfiles; ifl++)
+		    RunOne(blocks[ib], chunks[ic], files[ifl], policies[ip]);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct cmd_syndesc *ts;
+
+    ts = cmd_CreateSyntax(NULL, DcsimCmd, NULL, 0,
+			  "replay a dcache trace against a model of other caches");
+    cmd_AddParm(ts, "-trace", CMD_SINGLE, CMD_OPTIONAL,
+		"fstrace dump output (default stdin)");
+    cmd_AddParm(ts, "-blocks", CMD_LIST, CMD_OPTIONAL,
+		"cache sizes in 1K blocks (default 100000)");
+    cmd_AddParm(ts, "-chunksize", CMD_LIST, CMD_OPTIONAL,
+		"log(2) of chunk sizes (default 20)");
+    cmd_AddParm(ts, "-files", CMD_LIST, CMD_OPTIONAL,
+		"cache files (default as afsd)");
+    cmd_AddParm(ts, "-policy", CMD_LIST, CMD_OPTIONAL,
+		"lru and/or 2q (default both)");
+
+    return cmd_Dispatch(argc, argv);
+}
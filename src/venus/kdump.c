@@ -2001,24 +2001,21 @@ print_allocs(int pnt)
 	 Sum_vcachelocks);
 #endif
 
-#define	NAXSs (1000 / sizeof(struct axscache))
 #ifdef	AFS32
-    i = (NAXSs * sizeof(struct axscache));
+    i = AXS_SLABSIZE;
     T += i;
     printf("%20s:\t%8d bytes\t[%d access used by vcaches/%d bytes each]\n",
-	   "ACL List free pool", i, Sum_vcacheacc, sizeof(struct axscache));
+	   "ACL table pool", i, Sum_vcacheacc, sizeof(struct axscache));
 #else
     {
-	struct axscache *xp, xpe, *nxp = &xpe;
-
 	findsym("afs_xaxscnt", &symoff);
 	kread(kmem, symoff, (char *)&i, sizeof i);
-	j = i * (NAXSs * sizeof(struct axscache));
+	j = i * AXS_SLABSIZE;
 	T += j;
 	printf
-	    ("%20s:\t%8d bytes\t[%d access used by vcaches/%d bytes each - %d blocks of %d]\n",
-	     "ACL List free pool", j, Sum_vcacheacc, sizeof(struct axscache),
-	     i, (NAXSs * sizeof(struct axscache)));
+	    ("%20s:\t%8d bytes\t[%d access used by vcaches/%d bytes each - %d slabs of %d]\n",
+	     "ACL table pool", j, Sum_vcacheacc, sizeof(struct axscache),
+	     i, AXS_SLABSIZE);
     }
 #endif
 
@@ -2790,7 +2787,7 @@ print_vcache(int kmem, struct vcache *vep, struct vcache *ptr, int pnt)
     long *loc, j = 0;
     char *cloc;
     struct VenusFid vid;
-    struct axscache acc, *accp = &acc, *acp;
+    struct axstable axt, *axtp;
     struct SimpleLocks sl, *slcp = &sl, *slp;
     char linkchar;
 
@@ -2876,14 +2873,23 @@ print_vcache(int kmem, struct vcache *vep, struct vcache *ptr, int pnt)
 	printf("\n");
     }
     if (vep->Access) {
+	kread(kmem, (off_t) vep->Access, (char *)&axt, sizeof(axt));
 	if (pnt)
-	    printf("\tAccess Link list: %x\n", vep->Access);
-	for (j = 0, acp = vep->Access; acp; acp = accp->next, j++) {
-	    kread(kmem, (off_t) acp, (char *)accp, sizeof(*accp));
-	    Sum_vcacheacc++;
-	    if (pnt)
-		printf("\t   %lx: %d) uid=0x%x, access=0x%x, next=%lx\n", acp,
-		       j, accp->uid, accp->axess, accp->next);
+	    printf("\tAccess table: %lx, %d slots\n", vep->Access, axt.size);
+	j = sizeof(axt) - sizeof(struct axscache) +
+	    axt.size * (sizeof(struct axscache) + 1);
+	axtp = malloc(j);
+	if (axtp) {
+	    kread(kmem, (off_t) vep->Access, (char *)axtp, j);
+	    for (j = 0; j < axtp->size; j++) {
+		if (axs_State(axtp, j) != AXS_USED)
+		    continue;
+		Sum_vcacheacc++;
+		if (pnt)
+		    printf("\t   %ld) uid=0x%x, access=0x%x\n", j,
+			   axtp->slot[j].uid, axtp->slot[j].axess);
+	    }
+	    free(axtp);
 	}
     }
     if (vep->slocks) {
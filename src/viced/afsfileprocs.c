@@ -182,6 +182,7 @@ extern afs_int32 implicitAdminRights;
 extern afs_int32 readonlyServer;
 extern int CopyOnWrite_calls, CopyOnWrite_off0, CopyOnWrite_size0;
 extern afs_fsize_t CopyOnWrite_maxsize;
+extern afs_uint64 CopyOnWrite_copied, CopyOnWrite_reflinked;
 
 /*
  * Externals used by the xstat code.
@@ -1364,6 +1365,24 @@ CopyOnWrite(Vnode * targetptr, Volume * volptr, afs_foff_t off, afs_fsize_t len)
     }
 
     done = off;
+
+    /* If the partition supports reflinks, let the new inode share the old
+     * one's data blocks rather than copying them; the filesystem then
+     * copies only the blocks that are written later.  A whole file is
+     * cloned to its end; otherwise the kernel may refuse ranges that are
+     * not block aligned, and we fall back to copying. */
+    if (size > 0) {
+	afs_fsize_t rlen = size;
+
+	if (off == 0 && FDH_SIZE(targFdP) == size)
+	    rlen = 0;
+	if (FDH_REFLINK(newFdP, targFdP, off, rlen) == 0) {
+	    CopyOnWrite_reflinked += size;
+	    done += size;
+	    size = 0;
+	}
+    }
+
     while (size > 0) {
 	if (size > COPYBUFFSIZE) {	/* more than a buffer */
 	    length = COPYBUFFSIZE;
@@ -1376,6 +1395,8 @@ CopyOnWrite(Vnode * targetptr, Volume * volptr, afs_foff_t off, afs_fsize_t len)
 	if (rdlen == length) {
 	    wrlen = FDH_PWRITE(newFdP, buff, length, done);
 	    done += rdlen;
+	    if (wrlen == length)
+		CopyOnWrite_copied += length;
 	} else
 	    wrlen = 0;
 	/*  Callers of this function are not prepared to recover
@@ -162,6 +162,12 @@ FidEq(DirHandle * afile, DirHandle * bfile)
     return 1;
 }
 
+afs_uint32
+FidHash(DirHandle * afile)
+{
+    return afile->dirh_vid ^ (afile->dirh_vnode * 0x9e3779b1);
+}
+
 int
 FidVolEq(DirHandle * afile, VolumeId vid)
 {
@@ -632,11 +632,12 @@ ClearXStatValues(void)
 
 int CopyOnWrite_calls = 0, CopyOnWrite_off0 = 0, CopyOnWrite_size0 = 0;
 afs_fsize_t CopyOnWrite_maxsize = 0;
+afs_uint64 CopyOnWrite_copied = 0, CopyOnWrite_reflinked = 0;
 
 static void
 PrintCounters(void)
 {
-    int dirbuff, dircall, dirio;
+    struct DirBufferStats dirstats;
     struct timeval tpl;
     int workstations, activeworkstations, delworkstations;
     int processSize = 0;
@@ -662,10 +663,16 @@ PrintCounters(void)
 #endif
     VPrintCacheStats();
     VPrintDiskStats();
-    DStat(&dirbuff, &dircall, &dirio);
+    DGetStats(&dirstats);
     ViceLog(0,
-	    ("With %d directory buffers; %d reads resulted in %d read I/Os\n",
-	     dirbuff, dircall, dirio));
+	    ("With %d directory buffers in %d shards; %u reads (%u hits) "
+	     "resulted in %u read I/Os and %u write I/Os\n",
+	     dirstats.buffers, dirstats.shards, dirstats.calls, dirstats.hits,
+	     dirstats.ios, dirstats.writes));
+    if (dirstats.grows)
+	ViceLog(0,
+		("%u directory buffers were added because all were in use; "
+		 "consider raising -b\n", dirstats.grows));
     rx_PrintStats(stderr);
     audit_PrintStats(stderr);
     h_PrintStats();
@@ -681,6 +688,9 @@ PrintCounters(void)
 	     workstations, activeworkstations, delworkstations));
     ViceLog(0, ("CopyOnWrite: calls %d off0 %d size0 %d maxsize 0x%llx\n",
 		CopyOnWrite_calls, CopyOnWrite_off0, CopyOnWrite_size0, CopyOnWrite_maxsize));
+    ViceLog(0, ("CopyOnWrite: %llu bytes copied, %llu bytes reflinked\n",
+		CopyOnWrite_copied, CopyOnWrite_reflinked));
+    ih_PrintSyncStats();
 
     Statistics = 0;
 
@@ -1150,7 +1160,7 @@ ParseArgs(int argc, char *argv[])
     cmd_AddParmAtOffset(opts, OPT_realm, "-realm",
 			CMD_LIST, CMD_OPTIONAL, "local realm");
     cmd_AddParmAtOffset(opts, OPT_sync, "-sync",
-			CMD_SINGLE, CMD_OPTIONAL, "always | onclose | never");
+			CMD_SINGLE, CMD_OPTIONAL, "always | onclose | never | group");
 
     /* testing options */
     cmd_AddParmAtOffset(opts, OPT_logfile, "-logfile", CMD_SINGLE,
@@ -35,8 +35,8 @@ typedef struct DirHandle {
     /* device+inode+vid are low level disk addressing + validity check */
     /* vid+vnode+unique+cacheCheck are to guarantee validity of cached copy */
     /* ***NOTE*** size of this stucture must not exceed size in buffer
-     * package (dir/buffer.c. Also, dir/buffer uses the first int as a
-     * hash into the page hash table.
+     * package (dir/buffer.c. Also, dir/buffer hashes handles with FidHash,
+     * which must agree with FidEq.
      * ***NOTE*** The volume, device and inode numbers used to compare
      * fids are copied out of the handle to allow the handle to be reused
      * while pages for the old fid are still in the buffer cache.
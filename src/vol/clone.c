@@ -25,9 +25,14 @@
 #include <winbase.h>
 #endif
 
+#include <afs/opr.h>
+#ifdef AFS_PTHREAD_ENV
+# include <opr/lock.h>
+#endif
 #include <rx/xdr.h>
 #include <afs/afsint.h>
 #include <afs/afssyscalls.h>
+#include <afs/afsutil.h>
 #include <rx/rx_queue.h>
 
 #include "nfs.h"
@@ -68,6 +73,19 @@ struct clone_head {
     struct clone_items *last;
 };
 
+/* Link count increments are queued and applied to the link table in
+ * batches of this many inodes, rather than one locked update per vnode. */
+#define CLONE_INCBATCH	1024
+struct clone_incs {
+    IHandle_t *h;
+    VolId vol;
+#ifdef AFS_PTHREAD_ENV
+    pthread_mutex_t *lock;	/* held while updating a shared link table */
+#endif
+    afs_int32 nitems;
+    Inode data[CLONE_INCBATCH];
+};
+
 void CloneVolume(Error *, Volume *, Volume *, Volume *);
 
 static int
@@ -137,6 +155,43 @@ ci_Destroy(struct clone_head *ah)
     return 0;
 }
 
+/* apply all queued link count increments */
+static int
+ci_FlushIncs(struct clone_incs *ai)
+{
+    int code = 0;
+
+    if (ai->nitems > 0) {
+#ifdef AFS_PTHREAD_ENV
+	if (ai->lock)
+	    opr_mutex_enter(ai->lock);
+#endif
+	code = IH_INC_MULTI(ai->h, ai->data, ai->nitems, ai->vol);
+#ifdef AFS_PTHREAD_ENV
+	if (ai->lock)
+	    opr_mutex_exit(ai->lock);
+#endif
+	if (code == -1) {
+	    Log("IH_INC_MULTI failed: %"AFS_PTR_FMT", %d inodes, %" AFS_VOLID_FMT " errno %d\n",
+		ai->h, ai->nitems, afs_printable_VolumeId_lu(ai->vol), errno);
+	}
+	ai->nitems = 0;
+    }
+    return code;
+}
+
+/* queue an inode's link count increment, flushing the queue when full */
+static int
+ci_QueueInc(struct clone_incs *ai, Inode aino)
+{
+    if (ai->nitems >= CLONE_INCBATCH) {
+	if (ci_FlushIncs(ai) == -1)
+	    return -1;
+    }
+    ai->data[ai->nitems++] = aino;
+    return 0;
+}
+
 static int
 IDecProc(Inode adata, void *arock)
 {
@@ -146,10 +201,39 @@ IDecProc(Inode adata, void *arock)
     return 0;
 }
 
-afs_int32
-DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
+/* Number of threads used to clone one vnode index, and the fewest vnodes
+ * each of them is given; smaller indexes are cloned by the calling thread
+ * alone. */
+int vol_clone_threads = 1;
+#define CLONE_MINRANGE	65536
+#define CLONE_MAXTHREADS	16
+
+/* state of the clone of one range of a vnode index */
+struct clone_range {
+    Volume *rwvp;
+    Volume *clvp;
+    VnodeClass class;
+    int reclone;
+    afs_foff_t start;		/* offset of the first vnode in the range */
+    afs_foff_t end;		/* offset past the range; 0 means end of file */
+    afs_foff_t offset;		/* offset reached when the clone stopped */
+    afs_int32 filecount;	/* vnodes in use in the range */
+    afs_int32 diskused;		/* blocks used by those vnodes */
+    struct clone_head decHead;	/* old clone inodes to decrement */
+    afs_int32 error;
+#ifdef AFS_PTHREAD_ENV
+    pthread_mutex_t *incLock;	/* serializes link table updates */
+#endif
+};
+
+/* Clone the vnodes between cr->start and cr->end of one index. The counts,
+ * the inodes to decrement and the error are left in the clone_range. */
+static void
+DoCloneRange(struct clone_range *cr)
 {
     afs_int32 code, error = 0;
+    Volume *rwvp = cr->rwvp, *clvp = cr->clvp;
+    int reclone = cr->reclone;
     FdHandle_t *rwFd = 0, *clFdIn = 0, *clFdOut = 0;
     StreamHandle_t *rwfile = 0, *clfilein = 0, *clfileout = 0;
     IHandle_t *rwH = 0, *clHin = 0, *clHout = 0;
@@ -158,14 +242,11 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
     struct VnodeDiskObject *clvnode = (struct VnodeDiskObject *)dbuf;
     Inode rwinode = 0;
     Inode clinode;
-    struct clone_head decHead;
-    struct clone_rock decRock;
-    afs_foff_t offset = 0;
+    struct clone_incs *incs = NULL;
+    afs_foff_t offset = cr->start;
     afs_int32 dircloned, inodeinced;
-    afs_int32 filecount = 0, diskused = 0;
-    afs_ino_str_t stmp;
 
-    struct VnodeClassInfo *vcp = &VnodeClassInfo[class];
+    struct VnodeClassInfo *vcp = &VnodeClassInfo[cr->class];
     /*
      * The fileserver's -readonly switch should make this false, but we
      * have no useful way to know in the volserver.
@@ -173,39 +254,35 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
      */
     int ReadWriteOriginal = 1;
 
-    /* Correct number of files in volume: this assumes indexes are always
-       cloned starting with vLarge */
-    if (ReadWriteOriginal && class != vLarge) {
-	filecount = V_filecount(rwvp);
-	diskused = V_diskused(rwvp);
-    }
-
-    /* Initialize list of inodes to nuke - must do this before any calls
-     * to ERROR_EXIT, as the error handler requires an initialised list
-     */
-    ci_InitHead(&decHead);
-    decRock.h = V_linkHandle(rwvp);
-    decRock.vol = V_parentId(rwvp);
+    incs = malloc(sizeof(*incs));
+    if (!incs)
+	ERROR_EXIT(ENOMEM);
+    incs->h = V_linkHandle(rwvp);
+    incs->vol = V_parentId(rwvp);
+#ifdef AFS_PTHREAD_ENV
+    incs->lock = cr->incLock;
+#endif
+    incs->nitems = 0;
 
-    /* Open the RW volume's index file and seek to beginning */
-    IH_COPY(rwH, rwvp->vnodeIndex[class].handle);
+    /* Open the RW volume's index file and seek to the range */
+    IH_COPY(rwH, rwvp->vnodeIndex[cr->class].handle);
     rwFd = IH_OPEN(rwH);
     if (!rwFd)
 	ERROR_EXIT(EIO);
     rwfile = FDH_FDOPEN(rwFd, ReadWriteOriginal ? "r+" : "r");
     if (!rwfile)
 	ERROR_EXIT(EIO);
-    STREAM_ASEEK(rwfile, vcp->diskSize);	/* Will fail if no vnodes */
+    STREAM_ASEEK(rwfile, cr->start);	/* Will fail if no vnodes */
 
-    /* Open the clone volume's index file and seek to beginning */
-    IH_COPY(clHout, clvp->vnodeIndex[class].handle);
+    /* Open the clone volume's index file and seek to the range */
+    IH_COPY(clHout, clvp->vnodeIndex[cr->class].handle);
     clFdOut = IH_OPEN(clHout);
     if (!clFdOut)
 	ERROR_EXIT(EIO);
     clfileout = FDH_FDOPEN(clFdOut, "a");
     if (!clfileout)
 	ERROR_EXIT(EIO);
-    code = STREAM_ASEEK(clfileout, vcp->diskSize);
+    code = STREAM_ASEEK(clfileout, cr->start);
     if (code)
 	ERROR_EXIT(EIO);
 
@@ -214,19 +291,20 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
      * writing, so this all works.
      */
     if (reclone) {
-	IH_COPY(clHin, clvp->vnodeIndex[class].handle);
+	IH_COPY(clHin, clvp->vnodeIndex[cr->class].handle);
 	clFdIn = IH_OPEN(clHin);
 	if (!clFdIn)
 	    ERROR_EXIT(EIO);
 	clfilein = FDH_FDOPEN(clFdIn, "r");
 	if (!clfilein)
 	    ERROR_EXIT(EIO);
-	STREAM_ASEEK(clfilein, vcp->diskSize);	/* Will fail if no vnodes */
+	STREAM_ASEEK(clfilein, cr->start);	/* Will fail if no vnodes */
     }
 
-    /* Read each vnode in the old volume's index file */
-    for (offset = vcp->diskSize;
-	 STREAM_READ(rwvnode, vcp->diskSize, 1, rwfile) == 1;
+    /* Read each vnode of the range in the old volume's index file */
+    for (offset = cr->start;
+	 (cr->end == 0 || offset < cr->end)
+	 && STREAM_READ(rwvnode, vcp->diskSize, 1, rwfile) == 1;
 	 offset += vcp->diskSize) {
 	dircloned = inodeinced = 0;
 
@@ -246,19 +324,18 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
 	    if (rwvnode->vnodeMagic != vcp->magic)
 		ERROR_EXIT(-1);
 	    rwinode = VNDISK_GET_INO(rwvnode);
-	    filecount++;
+	    cr->filecount++;
 	    VNDISK_GET_LEN(ll, rwvnode);
-	    diskused += nBlocks(ll);
+	    cr->diskused += nBlocks(ll);
 
 	    /* Increment the inode if not already */
 	    if (clinode && (clinode == rwinode)) {
 		clinode = 0;	/* already cloned - don't delete later */
 	    } else if (rwinode) {
-		if (IH_INC(V_linkHandle(rwvp), rwinode, V_parentId(rwvp)) ==
-		    -1) {
-		    Log("IH_INC failed: %"AFS_PTR_FMT", %s, %" AFS_VOLID_FMT " errno %d\n",
-			V_linkHandle(rwvp), PrintInode(stmp, rwinode),
-			afs_printable_VolumeId_lu(V_parentId(rwvp)), errno);
+		/* The increment is applied once a batch has been queued; the
+		 * volume is offline, so nobody else can observe or change the
+		 * link count meanwhile. */
+		if (ci_QueueInc(incs, rwinode) == -1) {
 		    VForceOffline(rwvp);
 		    ERROR_EXIT(EIO);
 		}
@@ -305,16 +382,13 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
 	code = STREAM_WRITE(rwvnode, vcp->diskSize, 1, clfileout);
 	if (code != 1) {
 	  clonefailed:
-	    /* Couldn't clone, go back and decrement the inode's link count */
+	    /* Couldn't clone, so drop the inode's queued link count increment.
+	     * It is always the last one queued, and has not been applied yet,
+	     * since queueing only flushes increments that were already queued. */
 	    if (inodeinced) {
-		if (IH_DEC(V_linkHandle(rwvp), rwinode, V_parentId(rwvp)) ==
-		    -1) {
-		    Log("IH_DEC failed: %"AFS_PTR_FMT", %s, %" AFS_VOLID_FMT " errno %d\n",
-			V_linkHandle(rwvp), PrintInode(stmp, rwinode),
-			afs_printable_VolumeId_lu(V_parentId(rwvp)), errno);
-		    VForceOffline(rwvp);
-		    ERROR_EXIT(EIO);
-		}
+		opr_Assert(incs->nitems > 0
+			   && incs->data[incs->nitems - 1] == rwinode);
+		incs->nitems--;
 	    }
 	    /* And if the directory was marked clone, unmark it */
 	    if (dircloned) {
@@ -327,7 +401,7 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
 
 	/* Removal of the old cloned inode */
 	if (clinode) {
-	    ci_AddItem(&decHead, clinode);	/* just queue it */
+	    ci_AddItem(&cr->decHead, clinode);	/* just queue it */
 	}
 
 	DOPOLL;
@@ -335,21 +409,18 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
     if (STREAM_ERROR(clfileout))
 	ERROR_EXIT(EIO);
 
-    /* Clean out any junk at end of clone file */
-    if (reclone) {
-	STREAM_ASEEK(clfilein, offset);
-	while (STREAM_READ(clvnode, vcp->diskSize, 1, clfilein) == 1) {
-	    if (clvnode->type != vNull && VNDISK_GET_INO(clvnode) != 0) {
-		ci_AddItem(&decHead, VNDISK_GET_INO(clvnode));
-	    }
-	    DOPOLL;
+  error_exit:
+    /* Apply the increments still queued; the clone's vnode entries for
+     * these inodes have been written, even if a later one failed. */
+    if (incs) {
+	if (ci_FlushIncs(incs) == -1) {
+	    VForceOffline(rwvp);
+	    if (!error)
+		error = EIO;
 	}
+	free(incs);
     }
 
-    /* come here to finish up.  If code is non-zero, we've already run into problems,
-     * and shouldn't do the idecs.
-     */
-  error_exit:
     if (rwfile)
 	STREAM_CLOSE(rwfile);
     if (clfilein)
@@ -371,12 +442,176 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
     if (clHin)
 	IH_RELEASE(clHin);
 
+    cr->offset = offset;
+    cr->error = error;
+}
+
+#ifdef AFS_PTHREAD_ENV
+static void *
+CloneRangeThread(void *rock)
+{
+    DoCloneRange((struct clone_range *)rock);
+    return NULL;
+}
+#endif
+
+/* Decide how many ranges to split a vnode index into, and how many vnodes
+ * go in each of them but the last. */
+static int
+CloneRangeCount(Volume * rwvp, VnodeClass class, afs_int32 * aperrange)
+{
+    int nranges = 1;
+#ifdef AFS_PTHREAD_ENV
+    FdHandle_t *fdP;
+    afs_sfsize_t size;
+    afs_int32 nvnodes;
+
+    if (vol_clone_threads <= 1)
+	return 1;
+    fdP = IH_OPEN(rwvp->vnodeIndex[class].handle);
+    if (!fdP)
+	return 1;
+    size = FDH_SIZE(fdP);
+    FDH_CLOSE(fdP);
+    if (size <= VnodeClassInfo[class].diskSize)
+	return 1;
+
+    nvnodes = size / VnodeClassInfo[class].diskSize - 1;
+    nranges = nvnodes / CLONE_MINRANGE;
+    if (nranges > vol_clone_threads)
+	nranges = vol_clone_threads;
+    if (nranges > CLONE_MAXTHREADS)
+	nranges = CLONE_MAXTHREADS;
+    if (nranges < 1)
+	nranges = 1;
+    *aperrange = nvnodes / nranges;
+#endif
+    return nranges;
+}
+
+afs_int32
+DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone,
+	     int *anthreads)
+{
+    afs_int32 code, error = 0;
+    struct clone_range ranges[CLONE_MAXTHREADS];
+    struct clone_range *last;
+    struct clone_rock decRock;
+    afs_foff_t offset;
+    afs_int32 filecount = 0, diskused = 0;
+    FdHandle_t *fdP;
+    int i, nranges;
+    afs_int32 perrange = 0;
+#ifdef AFS_PTHREAD_ENV
+    pthread_t tids[CLONE_MAXTHREADS];
+    int started[CLONE_MAXTHREADS];
+    pthread_mutex_t incLock;
+#endif
+
+    struct VnodeClassInfo *vcp = &VnodeClassInfo[class];
+    /*
+     * The fileserver's -readonly switch should make this false, but we
+     * have no useful way to know in the volserver.
+     * This doesn't make client data mutable.
+     */
+    int ReadWriteOriginal = 1;
+
+    /* Correct number of files in volume: this assumes indexes are always
+       cloned starting with vLarge */
+    if (ReadWriteOriginal && class != vLarge) {
+	filecount = V_filecount(rwvp);
+	diskused = V_diskused(rwvp);
+    }
+
+    decRock.h = V_linkHandle(rwvp);
+    decRock.vol = V_parentId(rwvp);
+
+    /* Split the index into ranges of whole vnodes. Each range reads and
+     * writes its own part of the index files, so the ranges can be cloned
+     * at the same time; only the link table is shared between them. */
+    nranges = CloneRangeCount(rwvp, class, &perrange);
+    *anthreads = 1;
+    memset(ranges, 0, sizeof(ranges));
+    for (i = 0; i < nranges; i++) {
+	ranges[i].rwvp = rwvp;
+	ranges[i].clvp = clvp;
+	ranges[i].class = class;
+	ranges[i].reclone = reclone;
+	ci_InitHead(&ranges[i].decHead);
+    }
+    if (nranges == 1) {
+	ranges[0].start = vcp->diskSize;
+	DoCloneRange(&ranges[0]);
+    } else {
+#ifdef AFS_PTHREAD_ENV
+	opr_mutex_init(&incLock);
+	for (i = 0; i < nranges; i++) {
+	    ranges[i].start = vcp->diskSize
+		+ (afs_foff_t)i * perrange * vcp->diskSize;
+	    if (i < nranges - 1)
+		ranges[i].end = ranges[i].start
+		    + (afs_foff_t)perrange * vcp->diskSize;
+	    ranges[i].incLock = &incLock;
+	}
+	/* The calling thread clones the first range itself; a range whose
+	 * thread cannot be started is cloned here too. */
+	for (i = 1; i < nranges; i++) {
+	    started[i] = (pthread_create(&tids[i], NULL, CloneRangeThread,
+					 &ranges[i]) == 0);
+	    if (started[i])
+		(*anthreads)++;
+	}
+	DoCloneRange(&ranges[0]);
+	for (i = 1; i < nranges; i++) {
+	    if (started[i])
+		opr_Verify(pthread_join(tids[i], NULL) == 0);
+	    else
+		DoCloneRange(&ranges[i]);
+	}
+	opr_mutex_destroy(&incLock);
+#endif
+    }
+
+    for (i = 0; i < nranges; i++) {
+	filecount += ranges[i].filecount;
+	diskused += ranges[i].diskused;
+	if (!error)
+	    error = ranges[i].error;
+    }
+    last = &ranges[nranges - 1];
+    offset = last->offset;
+
+    /* Clean out any junk at end of clone file */
+    if (reclone && !error) {
+	StreamHandle_t *clfilein = NULL;
+	char dbuf[SIZEOF_LARGEDISKVNODE];
+	struct VnodeDiskObject *clvnode = (struct VnodeDiskObject *)dbuf;
+
+	fdP = IH_OPEN(clvp->vnodeIndex[class].handle);
+	if (fdP)
+	    clfilein = FDH_FDOPEN(fdP, "r");
+	if (!clfilein) {
+	    error = EIO;
+	} else {
+	    STREAM_ASEEK(clfilein, offset);
+	    while (STREAM_READ(clvnode, vcp->diskSize, 1, clfilein) == 1) {
+		if (clvnode->type != vNull && VNDISK_GET_INO(clvnode) != 0) {
+		    ci_AddItem(&last->decHead, VNDISK_GET_INO(clvnode));
+		}
+		DOPOLL;
+	    }
+	    STREAM_CLOSE(clfilein);
+	}
+	if (fdP)
+	    FDH_CLOSE(fdP);
+    }
+
     /* Next, we sync the disk. We have to reopen in case we're truncating,
      * since we were using stdio above, and don't know when the buffers
      * would otherwise be flushed.  There's no stdio fftruncate call.
      */
-    rwFd = IH_OPEN(clvp->vnodeIndex[class].handle);
-    if (rwFd == NULL) {
+    fdP = IH_OPEN(clvp->vnodeIndex[class].handle);
+    if (fdP == NULL) {
 	if (!error)
 	    error = EIO;
     } else {
@@ -385,11 +620,11 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
 	     * truncate the file to offset bytes.
 	     */
 	    if (reclone && !error) {
-		error = FDH_TRUNC(rwFd, offset);
+		error = FDH_TRUNC(fdP, offset);
 	    }
 	}
-	(void)FDH_SYNC(rwFd);
-	FDH_CLOSE(rwFd);
+	(void)FDH_SYNC(fdP);
+	FDH_CLOSE(fdP);
     }
 
     /* Now finally do the idec's.  At this point, all potential
@@ -397,10 +632,12 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
      * (see above fclose and fsync). No matter what happens, we
      * no longer need to keep these references around.
      */
-    code = ci_Apply(&decHead, IDecProc, (char *)&decRock);
-    if (!error)
-	error = code;
-    ci_Destroy(&decHead);
+    for (i = 0; i < nranges; i++) {
+	code = ci_Apply(&ranges[i].decHead, IDecProc, (char *)&decRock);
+	if (!error)
+	    error = code;
+	ci_Destroy(&ranges[i].decHead);
+    }
 
     if (ReadWriteOriginal && filecount > 0)
 	V_filecount(rwvp) = filecount;
@@ -415,14 +652,17 @@ CloneVolume(Error * rerror, Volume * original, Volume * new, Volume * old)
     afs_int32 code, error = 0;
     afs_int32 reclone;
     afs_int32 filecount = V_filecount(original), diskused = V_diskused(original);
+    struct timeval start, end;
+    int largeThreads = 0, smallThreads = 0;
 
     *rerror = 0;
     reclone = ((new == old) ? 1 : 0);
+    gettimeofday(&start, NULL);
 
-    code = DoCloneIndex(original, new, vLarge, reclone);
+    code = DoCloneIndex(original, new, vLarge, reclone, &largeThreads);
     if (code)
 	ERROR_EXIT(code);
-    code = DoCloneIndex(original, new, vSmall, reclone);
+    code = DoCloneIndex(original, new, vSmall, reclone, &smallThreads);
     if (code)
 	ERROR_EXIT(code);
     if (filecount != V_filecount(original) || diskused != V_diskused(original))
@@ -434,6 +674,14 @@ CloneVolume(Error * rerror, Volume * original, Volume * new, Volume * old)
     if (code)
 	ERROR_EXIT(code);
 
+    gettimeofday(&end, NULL);
+    ViceLog(1, ("Clone %" AFS_VOLID_FMT ": cloned %d vnodes in %ld ms "
+		"using %d threads for directories and %d for files\n",
+		afs_printable_VolumeId_lu(V_id(original)), V_filecount(original),
+		(long)((end.tv_sec - start.tv_sec) * 1000
+		       + (end.tv_usec - start.tv_usec) / 1000),
+		largeThreads, smallThreads));
+
   error_exit:
     *rerror = error;
 }
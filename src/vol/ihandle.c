@@ -22,6 +22,11 @@
 #include <sys/resource.h>
 #endif
 
+#ifdef AFS_LINUX26_ENV
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
 #include <afs/opr.h>
 #ifdef AFS_PTHREAD_ENV
 # include <opr/lock.h>
@@ -115,6 +120,9 @@ ih_SetSyncBehavior(const char *behavior)
     } else if (strcmp(behavior, "never") == 0) {
 	val = IH_SYNC_NEVER;
 
+    } else if (strcmp(behavior, "group") == 0) {
+	val = IH_SYNC_GROUP;
+
     } else {
 	/* invalid behavior name */
 	return -1;
@@ -1057,6 +1065,21 @@ ih_icreate(IHandle_t * ih, int dev, char *part, Inode nI, int p1, int p2,
     ino = ICREATE(dev, part, nI, p1, p2, p3, p4);
     return ino;
 }
+
+/* Increment the link counts of several inodes. Inode based file servers
+ * keep link counts in the inodes themselves, so there is nothing to batch
+ * here. */
+int
+ih_inc_multi(IHandle_t * ih, Inode * inos, int ninos, int p)
+{
+    int i, code = 0;
+
+    for (i = 0; i < ninos; i++) {
+	if (IH_INC(ih, inos[i], p) < 0)
+	    code = -1;
+    }
+    return code;
+}
 #endif /* AFS_NAMEI_ENV */
 
 #if defined(AFS_NT40_ENV) || !defined(AFS_NAMEI_ENV)
@@ -1127,14 +1150,250 @@ ih_isunlinked(int fd)
     }
     return 0;
 }
+
+/**
+ * Make a range of one file share the data blocks of the same range of
+ * another file, so that the data does not have to be copied.  This is only
+ * possible on filesystems supporting reflinks, such as XFS and btrfs.
+ *
+ * @param[in] dstfd  file to receive the data
+ * @param[in] srcfd  file holding the data
+ * @param[in] off    offset of the range in both files
+ * @param[in] len    length of the range; 0 means up to the end of srcfd
+ *
+ * @return operation status
+ *   @retval 0 success
+ *   @retval -1 the data could not be shared, and errno is set; the caller
+ *              must copy the data itself
+ */
+int
+ih_reflink(int dstfd, int srcfd, afs_foff_t off, afs_fsize_t len)
+{
+#if defined(AFS_LINUX26_ENV) && defined(FICLONERANGE)
+    struct file_clone_range range;
+
+    if (off == 0 && len == 0)
+	return ioctl(dstfd, FICLONE, srcfd);
+
+    memset(&range, 0, sizeof(range));
+    range.src_fd = srcfd;
+    range.src_offset = off;
+    range.src_length = len;
+    range.dest_offset = off;
+    return ioctl(dstfd, FICLONERANGE, &range);
+#else
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
 #endif /* !AFS_NT40_ENV */
 
+#ifdef AFS_PTHREAD_ENV
+/*
+ * Group commit for IH_SYNC_GROUP.
+ *
+ * A thread wanting a sync queues a request and waits for it.  If no batch is
+ * being synced, the thread takes every queued request as a batch and syncs
+ * it; requests queued meanwhile wait for the next batch.  Where syncfs() is
+ * available, the batch is synced with one syncfs() per partition, so under
+ * load one call covers all the files written on a partition while the
+ * previous batch was in progress.  Otherwise each file in the batch is
+ * fsync()ed once.  Nobody returns before its own data has been synced.
+ */
+struct ih_syncreq {
+    struct ih_syncreq *next;
+    FdHandle_t *fdP;
+    struct timeval queued;
+    int code;
+    int done;
+    int wholedev;		/* code is from a syncfs() of fd_ih's ih_dev */
+};
+
+#define IH_SYNC_LATBUCKETS 24	/* power of 2 microsecond buckets */
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+    struct ih_syncreq *head;	/* requests waiting for a batch */
+    int busy;			/* a batch is being synced */
+
+    afs_uint64 nbatches;	/* batches synced */
+    afs_uint64 nrequests;	/* requests completed */
+    afs_uint64 nsyncs;		/* fsync calls issued */
+    afs_uint32 maxbatch;	/* largest batch */
+    afs_uint64 latency[IH_SYNC_LATBUCKETS];	/* request latency histogram */
+} ih_group;
+
+static pthread_once_t ih_group_once = PTHREAD_ONCE_INIT;
+#ifdef HAVE_SYNCFS
+static int ih_group_nosyncfs;	/* syncfs() is not supported here */
+#endif
+
+static void
+ih_group_init(void)
+{
+    opr_mutex_init(&ih_group.lock);
+    opr_cv_init(&ih_group.cv);
+}
+
+/* Does the sync done for request prev also cover request req? */
+static int
+ih_group_covers(struct ih_syncreq *prev, struct ih_syncreq *req)
+{
+    IHandle_t *pih = prev->fdP->fd_ih, *ih = req->fdP->fd_ih;
+
+    if (prev->fdP->fd_fd == req->fdP->fd_fd)
+	return 1;
+    if (pih && ih)
+	return pih == ih || (prev->wholedev && pih->ih_dev == ih->ih_dev);
+    return 0;
+}
+
+/* Sync a batch of requests, once per partition if we can, or else once per
+ * file. Called without the lock. */
+static void
+ih_group_syncbatch(struct ih_syncreq *batch, int *nsyncs)
+{
+    struct ih_syncreq *req, *prev;
+
+    for (req = batch; req; req = req->next) {
+	for (prev = batch; prev != req; prev = prev->next) {
+	    if (ih_group_covers(prev, req))
+		break;
+	}
+	if (prev != req) {
+	    /* already synced in this batch */
+	    req->code = prev->code;
+	    continue;
+	}
+#ifdef HAVE_SYNCFS
+	if (req->fdP->fd_ih && !ih_group_nosyncfs) {
+	    req->code = syncfs(req->fdP->fd_fd);
+	    (*nsyncs)++;
+	    if (req->code == 0) {
+		req->wholedev = 1;
+		continue;
+	    }
+	    if (errno == ENOSYS)
+		ih_group_nosyncfs = 1;
+	    /* fall back to syncing just this file */
+	}
+#endif
+	req->code = OS_SYNC(req->fdP->fd_fd);
+	(*nsyncs)++;
+    }
+}
+
+static int
+ih_group_fdsync(FdHandle_t *fdP)
+{
+    struct ih_syncreq req, *batch, *r;
+    struct timeval now;
+    afs_int64 usec;
+    int nreqs, nsyncs, bucket;
+
+    opr_Verify(pthread_once(&ih_group_once, ih_group_init) == 0);
+
+    memset(&req, 0, sizeof(req));
+    req.fdP = fdP;
+    gettimeofday(&req.queued, NULL);
+
+    opr_mutex_enter(&ih_group.lock);
+    req.next = ih_group.head;
+    ih_group.head = &req;
+    while (!req.done) {
+	if (ih_group.busy) {
+	    opr_cv_wait(&ih_group.cv, &ih_group.lock);
+	    continue;
+	}
+
+	/* Nobody is syncing; sync everything queued so far, ours included. */
+	batch = ih_group.head;
+	ih_group.head = NULL;
+	ih_group.busy = 1;
+	opr_mutex_exit(&ih_group.lock);
+
+	nsyncs = 0;
+	ih_group_syncbatch(batch, &nsyncs);
+	gettimeofday(&now, NULL);
+
+	opr_mutex_enter(&ih_group.lock);
+	nreqs = 0;
+	for (r = batch; r; r = r->next) {
+	    usec = (now.tv_sec - r->queued.tv_sec) * 1000000
+		+ (now.tv_usec - r->queued.tv_usec);
+	    for (bucket = 0; bucket < IH_SYNC_LATBUCKETS - 1
+		 && usec >= ((afs_int64)1 << (bucket + 1)); bucket++)
+		;
+	    ih_group.latency[bucket]++;
+	    r->done = 1;
+	    nreqs++;
+	}
+	ih_group.nbatches++;
+	ih_group.nrequests += nreqs;
+	ih_group.nsyncs += nsyncs;
+	if (nreqs > ih_group.maxbatch)
+	    ih_group.maxbatch = nreqs;
+	ih_group.busy = 0;
+	opr_cv_broadcast(&ih_group.cv);
+    }
+    opr_mutex_exit(&ih_group.lock);
+
+    return req.code;
+}
+
+/* Latency in microseconds below which pct percent of the requests were
+ * completed, to the precision of the histogram buckets. */
+static afs_uint64
+ih_group_percentile(int pct)
+{
+    afs_uint64 seen = 0, want;
+    int bucket;
+
+    want = (ih_group.nrequests * pct + 99) / 100;
+    for (bucket = 0; bucket < IH_SYNC_LATBUCKETS; bucket++) {
+	seen += ih_group.latency[bucket];
+	if (seen >= want)
+	    break;
+    }
+    if (bucket >= IH_SYNC_LATBUCKETS - 1)
+	bucket = IH_SYNC_LATBUCKETS - 1;
+    return (afs_uint64)1 << (bucket + 1);
+}
+#endif /* AFS_PTHREAD_ENV */
+
+/* Log the group commit statistics, if group commit is in use. */
+void
+ih_PrintSyncStats(void)
+{
+#ifdef AFS_PTHREAD_ENV
+    if (vol_io_params.sync_behavior != IH_SYNC_GROUP)
+	return;
+    opr_Verify(pthread_once(&ih_group_once, ih_group_init) == 0);
+    opr_mutex_enter(&ih_group.lock);
+    ViceLog(0, ("Group sync: %llu requests in %llu batches (max %u) using "
+		"%llu syncs; latency p50 < %llu us, p99 < %llu us\n",
+		(unsigned long long)ih_group.nrequests,
+		(unsigned long long)ih_group.nbatches, ih_group.maxbatch,
+		(unsigned long long)ih_group.nsyncs,
+		(unsigned long long)(ih_group.nrequests ? ih_group_percentile(50) : 0),
+		(unsigned long long)(ih_group.nrequests ? ih_group_percentile(99) : 0)));
+    opr_mutex_exit(&ih_group.lock);
+#endif
+}
+
 int
 ih_fdsync(FdHandle_t *fdP)
 {
     switch (vol_io_params.sync_behavior) {
     case IH_SYNC_ALWAYS:
 	return OS_SYNC(fdP->fd_fd);
+    case IH_SYNC_GROUP:
+#ifdef AFS_PTHREAD_ENV
+	return ih_group_fdsync(fdP);
+#else
+	return OS_SYNC(fdP->fd_fd);
+#endif
     case IH_SYNC_ONCLOSE:
 	if (fdP->fd_ih) {
 	    fdP->fd_ih->ih_synced = 1;
@@ -56,6 +56,7 @@
  *	file descriptor.
  * IH_IREAD/IH_IWRITE - read/write an Inode.
  * IH_INC/IH_DEC - increment/decrement the link count.
+ * IH_INC_MULTI - increment the link counts of several inodes at once.
  *
  * Replacements for C runtime file operations
  * FDH_READ/FDH_WRITE - read/write using the file descriptor.
@@ -67,6 +68,7 @@
  * FDH_TRUNC - Truncate a file
  * FDH_LOCKFILE - Lock a whole file
  * FDH_UNLOCKFILE - Unlock a whole file
+ * FDH_REFLINK - Share a range of another file's data blocks (reflink)
  *
  * status information:
  * FDH_SIZE - returns the size of the file.
@@ -224,6 +226,14 @@ typedef struct StreamHandle_s {
                              * our data hits the disk eventually, depending on
                              * the platform and various OS-specific tuning
                              * parameters. */
+#define IH_SYNC_GROUP   (4) /* This makes FDH_SYNCs wait for a synchronous
+                             * sync like IH_SYNC_ALWAYS, but the syncs
+                             * requested while another batch is being synced
+                             * are done together by a single thread (group
+                             * commit), with one syncfs() per partition in the
+                             * batch, or one fsync() per file where syncfs()
+                             * is not available. Without pthreads this is
+                             * IH_SYNC_ALWAYS. */
 
 
 /* READ THIS.
@@ -328,6 +338,7 @@ extern void ih_PkgDefaults(void);
 extern void ih_Initialize(void);
 extern void ih_UseLargeCache(void);
 extern int ih_SetSyncBehavior(const char *behavior);
+extern void ih_PrintSyncStats(void);
 extern IHandle_t *ih_init(int /*@alt Device@ */ dev, int /*@alt VolId@ */ vid,
 			  Inode ino);
 extern IHandle_t *ih_copy(IHandle_t * ihP);
@@ -417,6 +428,7 @@ extern ssize_t ih_pwrite(FD_t fd, const void * buf, size_t count, afs_foff_t off
 # define OS_UNLINK(X) nt_unlink(X)
 /* we can't have a file unlinked out from under us on NT */
 # define OS_ISUNLINKED(X) (0)
+# define OS_REFLINK(D, S, O, L) (errno = EOPNOTSUPP, -1)
 # define OS_DIRSEP "\\"
 # define OS_DIRSEPC '\\'
 #else
@@ -426,6 +438,8 @@ extern ssize_t ih_pwrite(FD_t fd, const void * buf, size_t count, afs_foff_t off
 # define OS_UNLINK(X) unlink(X)
 # define OS_ISUNLINKED(X) ih_isunlinked(X)
 extern int ih_isunlinked(FD_t fd);
+# define OS_REFLINK(D, S, O, L) ih_reflink(D, S, O, L)
+extern int ih_reflink(FD_t dstfd, FD_t srcfd, afs_foff_t off, afs_fsize_t len);
 # define OS_DIRSEP "/"
 # define OS_DIRSEPC '/'
 #endif
@@ -506,6 +520,7 @@ extern int OS_TRUNC(FD_t FD, OFFT L);
 /*@=fcnmacros =macrofcndecl@*/
 # endif /* AFS_NT40_ENV */
 # define IH_INC(H, I, P) namei_inc(H, I, P)
+# define IH_INC_MULTI(H, I, N, P) namei_inc_multi(H, I, N, P)
 # define IH_DEC(H, I, P) namei_dec(H, I, P)
 # define IH_IREAD(H, O, B, S) namei_iread(H, O, B, S)
 # define IH_IWRITE(H, O, B, S) namei_iwrite(H, O, B, S)
@@ -517,6 +532,9 @@ extern int OS_TRUNC(FD_t FD, OFFT L);
 #else /* AFS_NAMEI_ENV */
 extern Inode ih_icreate(IHandle_t * ih, int dev, char *part, Inode nI, int p1,
 			int p2, int p3, int p4);
+extern int ih_inc_multi(IHandle_t * ih, Inode * inos, int ninos, int p);
+
+# define IH_INC_MULTI(H, I, N, P) ih_inc_multi(H, I, N, P)
 
 # define IH_CREATE(H, D, P, N, P1, P2, P3, P4) \
         ih_icreate(H, D, P, N, P1, P2, P3, P4)
@@ -591,6 +609,7 @@ extern afs_sfsize_t ih_size(FD_t);
 #define FDH_LOCKFILE(H, O) OS_LOCKFILE((H)->fd_fd, O)
 #define FDH_UNLOCKFILE(H, O) OS_UNLOCKFILE((H)->fd_fd, O)
 #define FDH_ISUNLINKED(H) OS_ISUNLINKED((H)->fd_fd)
+#define FDH_REFLINK(D, S, O, L) OS_REFLINK((D)->fd_fd, (S)->fd_fd, O, L)
 
 extern int ih_fdsync(FdHandle_t *fdP);
 
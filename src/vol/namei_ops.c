@@ -1340,6 +1340,9 @@ namei_copy_on_write(IHandle_t *h)
 	}
 	size = tstat.st_size;
 	offset = 0;
+	/* share the data blocks instead of copying them, where supported */
+	if (size && OS_REFLINK(fd, fdP->fd_fd, 0, 0) == 0)
+	    size = 0;
 	while (size) {
 	    tlen = size > 8192 ? 8192 : size;
 	    if (FDH_PREAD(fdP, buf, tlen, offset) != tlen)
@@ -1733,6 +1736,251 @@ namei_UnlockLinkCount(FdHandle_t * fdP, Inode ino)
     FDH_UNLOCKFILE(fdP, offset);
 }
 
+#ifndef AFS_NT40_ENV
+/* Largest span of the link table namei_inc_multi reads and rewrites at once. */
+#define NAMEI_LINKTABLE_BATCHSIZE (64 * 1024)
+
+static int
+namei_CompareInodeRows(const void *_p1, const void *_p2)
+{
+    Inode v1 = *(const Inode *)_p1 & NAMEI_VNODEMASK;
+    Inode v2 = *(const Inode *)_p2 & NAMEI_VNODEMASK;
+
+    if (v1 < v2)
+	return -1;
+    if (v1 > v2)
+	return 1;
+    return 0;
+}
+#endif
+
+/**
+ * increment the link counts of several inodes in one volume group.
+ *
+ * This has the same effect as calling namei_inc for each inode, but takes
+ * the link table lock once, and reads and rewrites neighbouring rows of the
+ * link table together, syncing the table once at the end. Cloning a volume
+ * increments the link count of every inode in it, so this turns millions of
+ * small locked I/Os into a few large ones.
+ *
+ * @param[in] h      link table handle of the volume group
+ * @param[in] inos   inodes whose link counts should be incremented
+ * @param[in] ninos  number of entries in inos
+ * @param[in] p1     parent volume id, as for namei_inc
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval -1 error; errno is set. Counts that would exceed the maximum
+ *               are left at the maximum, and rows past the end of the link
+ *               table are not created, as namei_inc does; the other counts
+ *               have been incremented.
+ */
+int
+namei_inc_multi(IHandle_t * h, Inode * inos, int ninos, int p1)
+{
+#ifdef AFS_NT40_ENV
+    int i, code = 0;
+
+    /* NT locks individual rows of the link table; keep it simple there. */
+    for (i = 0; i < ninos; i++) {
+	if (namei_inc(h, inos[i], p1) < 0)
+	    code = -1;
+    }
+    return code;
+#else
+    Inode *rows = NULL;
+    char *buf = NULL;
+    FdHandle_t *fdP = NULL;
+    afs_foff_t start, offset, end;
+    unsigned short row;
+    ssize_t nBytes;
+    int i, j, k, nrows, index, count;
+    int code = 0;
+
+    if (ninos <= 0)
+	return 0;
+    if (ninos == 1)
+	return namei_inc(h, inos[0], p1);
+
+    rows = malloc(ninos * sizeof(*rows));
+    buf = malloc(NAMEI_LINKTABLE_BATCHSIZE);
+    if (rows == NULL || buf == NULL) {
+	errno = ENOMEM;
+	code = -1;
+	goto done;
+    }
+
+    /* Of the special inodes, only the link table has a link count. */
+    for (i = 0, nrows = 0; i < ninos; i++) {
+	if ((inos[i] & NAMEI_INODESPECIAL) == NAMEI_INODESPECIAL) {
+	    int type = (int)((inos[i] >> NAMEI_TAGSHIFT) & NAMEI_TAGMASK);
+	    if (type == VI_LINKTABLE)
+		rows[nrows++] = (Inode) 0;
+	} else {
+	    rows[nrows++] = inos[i];
+	}
+    }
+    qsort(rows, nrows, sizeof(*rows), namei_CompareInodeRows);
+
+    fdP = IH_OPEN(h);
+    if (fdP == NULL) {
+	code = -1;
+	goto done;
+    }
+    if (FDH_LOCKFILE(fdP, 0) != 0) {
+	FDH_REALLYCLOSE(fdP);
+	code = -1;
+	goto done;
+    }
+
+    for (i = 0; i < nrows; i = j) {
+	/* Gather all the rows that fit into one buffer starting at row i. */
+	namei_GetLCOffsetAndIndexFromIno(rows[i], &start, &index);
+	end = start + sizeof(row);
+	for (j = i + 1; j < nrows; j++) {
+	    namei_GetLCOffsetAndIndexFromIno(rows[j], &offset, &index);
+	    if (offset + sizeof(row) - start > NAMEI_LINKTABLE_BATCHSIZE)
+		break;
+	    end = offset + sizeof(row);
+	}
+
+	nBytes = FDH_PREAD(fdP, buf, end - start, start);
+	if (nBytes < 0) {
+	    errno = OS_ERROR(EBADF);
+	    code = -1;
+	    break;
+	}
+
+	for (k = i; k < j; k++) {
+	    namei_GetLCOffsetAndIndexFromIno(rows[k], &offset, &index);
+	    if (offset - start + sizeof(row) > nBytes) {
+		/* past the end of the table; namei_inc fails these too */
+		errno = OS_ERROR(EINVAL);
+		code = -1;
+		continue;
+	    }
+	    memcpy(&row, buf + (offset - start), sizeof(row));
+	    count = (row >> index) & NAMEI_TAGMASK;
+	    count++;
+	    if (count > 7) {
+		errno = OS_ERROR(EINVAL);
+		code = -1;
+		count = 7;
+	    }
+	    row &= (unsigned short)~(NAMEI_TAGMASK << index);
+	    row |= (unsigned short)(count << index);
+	    memcpy(buf + (offset - start), &row, sizeof(row));
+	}
+
+	if (nBytes > 0 && FDH_PWRITE(fdP, buf, nBytes, start) != nBytes) {
+	    errno = OS_ERROR(EBADF);
+	    code = -1;
+	    break;
+	}
+    }
+    (void)FDH_SYNC(fdP);
+    FDH_UNLOCKFILE(fdP, 0);
+
+    if (code) {
+	FDH_REALLYCLOSE(fdP);
+    } else {
+	FDH_CLOSE(fdP);
+    }
+
+  done:
+    free(rows);
+    free(buf);
+    return code;
+#endif /* !AFS_NT40_ENV */
+}
+
+/* Largest link table we are willing to keep in memory while listing a
+ * volume group; room for about 32 million vnodes. */
+#define NAMEI_LINKTABLE_MAXCACHE (64 * 1024 * 1024)
+
+/**
+ * read a volume group's whole link table into memory.
+ *
+ * Listing a volume group needs the link count of every inode in it. Reading
+ * the table with a few large reads avoids a separate lock and pread of the
+ * link table for each inode, which dominates the scan of large volume
+ * groups.
+ *
+ * @param[in]  h      namei link count table file handle
+ * @param[out] atable malloc'd copy of the link table
+ * @param[out] asize  number of valid bytes in *atable
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval -1 the table could not be read, or is too large to cache;
+ *               callers should fall back to namei_GetLinkCount
+ *
+ * @internal
+ */
+static int
+namei_ReadLinkTable(FdHandle_t * h, char **atable, afs_sfsize_t * asize)
+{
+    afs_sfsize_t size, nBytes = 0;
+    ssize_t rc;
+    char *table;
+
+    *atable = NULL;
+    *asize = 0;
+
+    size = FDH_SIZE(h);
+    if (size <= 0 || size > NAMEI_LINKTABLE_MAXCACHE)
+	return -1;
+
+    table = malloc(size);
+    if (table == NULL)
+	return -1;
+
+    while (nBytes < size) {
+	rc = FDH_PREAD(h, table + nBytes, size - nBytes, nBytes);
+	if (rc <= 0)
+	    break;
+	nBytes += rc;
+    }
+    if (nBytes < sizeof(afs_uint32) * 2) {
+	/* not even a complete version stamp */
+	free(table);
+	return -1;
+    }
+
+    *atable = table;
+    *asize = nBytes;
+    return 0;
+}
+
+/**
+ * look up a link count in a link table read by namei_ReadLinkTable.
+ *
+ * @param[in] table  in-memory link table
+ * @param[in] size   number of valid bytes in table
+ * @param[in] ino    inode number for which we are requesting a link count
+ *
+ * @return link count
+ *    @retval 0 the row is beyond the end of the table, or the count is zero;
+ *              callers must consult namei_GetLinkCount, which knows how to
+ *              fix up such entries
+ *
+ * @internal
+ */
+static int
+namei_GetLinkCountFromTable(const char *table, afs_sfsize_t size, Inode ino)
+{
+    unsigned short row;
+    afs_foff_t offset;
+    int index;
+
+    namei_GetLCOffsetAndIndexFromIno(ino, &offset, &index);
+    if (offset + sizeof(row) > size)
+	return 0;
+
+    memcpy(&row, table + offset, sizeof(row));
+    return (int)((row >> index) & NAMEI_TAGMASK);
+}
+
 
 /* ListViceInodes - write inode data to a results file. */
 static int DecodeInode(char *dpath, char *name, struct ViceInodeInfo *info,
@@ -2051,6 +2299,8 @@ _namei_examine_special(char * path1,
  * @param[in] dname               directory entry name
  * @param[in] myIH                inode handle to volume directory
  * @param[in] linkHandle          namei link count fd handle.
+ * @param[in] lcTable             in-memory copy of the link table, or NULL
+ * @param[in] lcSize              number of valid bytes in lcTable
  * @param[in] writeFun            metadata write function pointer
  * @param[in] fp                  file pointer where inode metadata
  *                                is written by (*writeFun)()
@@ -2077,6 +2327,8 @@ _namei_examine_reg(char * path3,
 		   char * dname,
 		   IHandle_t * myIH,
 		   FdHandle_t * linkHandle,
+		   const char *lcTable,
+		   afs_sfsize_t lcSize,
 		   int (*writeFun) (FD_t, struct ViceInodeInfo *, char *,
 				    char *),
 		   FD_t fp,
@@ -2094,9 +2346,16 @@ _namei_examine_reg(char * path3,
 	goto error;
     }
 
-    info.linkCount =
-	namei_GetLinkCount(linkHandle,
-			    info.inodeNumber, 1, 1, Testing);
+    info.linkCount = 0;
+    if (lcTable) {
+	info.linkCount =
+	    namei_GetLinkCountFromTable(lcTable, lcSize, info.inodeNumber);
+    }
+    if (info.linkCount == 0) {
+	info.linkCount =
+	    namei_GetLinkCount(linkHandle,
+				info.inodeNumber, 1, 1, Testing);
+    }
     if (info.linkCount == 0) {
 #ifdef DELETE_ZLC
 	Log("Found 0 link count file %s" OS_DIRSEP "%s, deleting it.\n", path3, dname);
@@ -2145,6 +2404,9 @@ struct listsubdirs_work_node {
                                          *   inode, this will be pointed at the
                                          *   link table
                                          */
+    char *lcTable;                      /**< in-memory copy of the link table,
+                                         *   or NULL if it could not be read */
+    afs_sfsize_t lcSize;                /**< valid bytes in lcTable */
     FD_t fp;                            /**< file pointer for writeFun */
 
     /** function which will write inode metadata to fp */
@@ -2183,7 +2445,8 @@ _namei_examine_file(const struct listsubdirs_work_node *work, char *dir,
 	                              work->rock);
     } else {
 	return _namei_examine_reg(dir, filename, work->IH,
-	                          work->linkHandle, work->writeFun, work->fp,
+	                          work->linkHandle, work->lcTable,
+	                          work->lcSize, work->writeFun, work->fp,
 	                          work->judgeFun, work->singleVolumeNumber,
 	                          work->rock);
     }
@@ -2512,6 +2775,7 @@ namei_ListAFSSubDirs(IHandle_t * dirIH,
     (void)strcat(path1, NAMEI_SPECDIR);
 
     linkHandle.fd_fd = INVALID_FD;
+    memset(&work, 0, sizeof(work));
 #ifdef AFS_SALSRV_ENV
     opr_Verify(pthread_once(&wq_once, _namei_wq_keycreate) == 0);
 
@@ -2524,7 +2788,6 @@ namei_ListAFSSubDirs(IHandle_t * dirIH,
     queue_Init(&resultlist);
 #endif
 
-    memset(&work, 0, sizeof(work));
     work.linkHandle = &linkHandle;
     work.IH = &myIH;
     work.fp = fp;
@@ -2585,6 +2848,11 @@ namei_ListAFSSubDirs(IHandle_t * dirIH,
     if (linkHandle.fd_fd == INVALID_FD) {
 	Log("namei_ListAFSSubDirs: warning: VG %" AFS_VOLID_FMT " does not have a link table; "
 	    "salvager will recreate it.\n", afs_printable_VolumeId_lu(dirIH->ih_vid));
+    } else {
+	/* Looking up the link count of each inode below is then a memory
+	 * access. Entries needing fixup still go through namei_GetLinkCount,
+	 * which also takes the lock on the link table. */
+	(void)namei_ReadLinkTable(&linkHandle, &work.lcTable, &work.lcSize);
     }
 
     /* Now run through all the other subdirs */
@@ -2700,6 +2968,8 @@ namei_ListAFSSubDirs(IHandle_t * dirIH,
 #endif
     if (linkHandle.fd_fd != INVALID_FD)
 	OS_CLOSE(linkHandle.fd_fd);
+    if (work.lcTable)
+	free(work.lcTable);
 
     if (!ret) {
 	ret = ninodes;
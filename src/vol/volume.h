@@ -127,6 +127,7 @@ extern ProgramType programType;	/* The type of program using the package */
 /* Add new initialization parameters here */
 extern int (*V_BreakVolumeCallbacks) (VolumeId);
 extern int (*vol_PollProc) (void);
+extern int vol_clone_threads;	/* threads used to clone a vnode index */
 
 #define	DOPOLL	((vol_PollProc)? (*vol_PollProc)() : 0)
 
@@ -125,6 +125,14 @@ FidEq(DirHandle * afile, DirHandle * bfile)
     return 1;
 }
 
+afs_uint32
+FidHash(DirHandle * afile)
+{
+    afs_uint64 ino = (afs_uint64)afile->dirh_inode;
+
+    return afile->dirh_volume ^ ((afs_uint32)(ino ^ (ino >> 32)) * 0x9e3779b1);
+}
+
 int
 FidVolEq(DirHandle * afile, afs_int32 vid)
 {
@@ -237,7 +237,8 @@ enum optionsList {
     OPT_syslog,
     OPT_logfile,
     OPT_config,
-    OPT_restricted_query
+    OPT_restricted_query,
+    OPT_clone_threads
 };
 
 static int
@@ -286,13 +287,15 @@ ParseArgs(int argc, char **argv) {
 	    CMD_OPTIONAL, "log to syslog");
 #endif
     cmd_AddParmAtOffset(opts, OPT_sync, "-sync",
-	    CMD_SINGLE, CMD_OPTIONAL, "always | onclose | never");
+	    CMD_SINGLE, CMD_OPTIONAL, "always | onclose | never | group");
     cmd_AddParmAtOffset(opts, OPT_logfile, "-logfile", CMD_SINGLE,
 	   CMD_OPTIONAL, "location of log file");
     cmd_AddParmAtOffset(opts, OPT_config, "-config", CMD_SINGLE,
 	   CMD_OPTIONAL, "configuration location");
     cmd_AddParmAtOffset(opts, OPT_restricted_query, "-restricted_query",
 	    CMD_SINGLE, CMD_OPTIONAL, "anyuser | admin");
+    cmd_AddParmAtOffset(opts, OPT_clone_threads, "-clone-threads",
+	    CMD_SINGLE, CMD_OPTIONAL, "threads used to clone a vnode index");
 
     code = cmd_Parse(argc, argv, &opts);
     if (code == CMD_HELP) {
@@ -368,6 +371,17 @@ ParseArgs(int argc, char **argv) {
 	}
 	free(restricted_query_parameter);
     }
+    if (cmd_OptionAsInt(opts, OPT_clone_threads, &optval) == 0) {
+	if (optval < 1) {
+	    printf("Invalid -clone-threads value %d\n", optval);
+	    return -1;
+	}
+#ifndef AFS_PTHREAD_ENV
+	if (optval > 1)
+	    printf("Warning: -clone-threads ignored; requires pthreads\n");
+#endif
+	vol_clone_threads = optval;
+    }
 
     return 0;
 }
@@ -120,6 +120,18 @@ print_cmCallStats(void)
 
     AFS_CM_CALL_STATS
 #undef AFS_CS
+
+    if (nitems >= 2) {
+	printf("\t%10u cacheDrainWait elements\n",
+	       cmp->meanInfo.cacheDrainWait.elements);
+	printf("\t%10u cacheDrainWait average (ms)\n",
+	       cmp->meanInfo.cacheDrainWait.average);
+	nitems -= 2;
+    }
+    if (nitems >= 2) {
+	printf("\t%10u readAhead hits\n", cmp->readAheadInfo.hits);
+	printf("\t%10u readAhead misses\n", cmp->readAheadInfo.misses);
+    }
 }
 
 
@@ -258,6 +270,16 @@ PrintOverallPerfInfo(struct afs_stats_CMPerf *a_ovP)
     printf("\t%10u cacheBucket0_Discarded\n",  a_ovP->cacheBucket0_Discarded);
     printf("\t%10u cacheBucket1_Discarded\n",  a_ovP->cacheBucket1_Discarded);
     printf("\t%10u cacheBucket2_Discarded\n",  a_ovP->cacheBucket2_Discarded);
+    printf("\t%10u readAheadHits\n", a_ovP->readAheadHits);
+    printf("\t%10u readAheadMisses\n", a_ovP->readAheadMisses);
+    printf("\t%10u dnlcHits\n", a_ovP->dnlcHits);
+    printf("\t%10u dnlcMisses\n", a_ovP->dnlcMisses);
+    printf("\t%10u dnlcNegativeHits\n", a_ovP->dnlcNegativeHits);
+    printf("\t%10u dcacheEvictions\n", a_ovP->dcacheEvictions);
+    printf("\t%10u dcacheGhostHits\n", a_ovP->dcacheGhostHits);
+    printf("\t%10u warmChunksReused\n", a_ovP->warmChunksReused);
+    printf("\t%10u warmChunksStale\n", a_ovP->warmChunksStale);
+    printf("\t%10u accessCacheMisses\n", a_ovP->accessCacheMisses);
 
     printf("\t%10u sysName_ID\n", a_ovP->sysName_ID);
 